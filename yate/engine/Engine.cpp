@@ -89,12 +89,15 @@ class EnginePrivate : public Thread
 {
 public:
     EnginePrivate()
-	: Thread("Engine Worker")
+	: Thread("Engine Worker"), m_index(s_index++)
 	{ count++; }
     ~EnginePrivate()
 	{ count--; }
     virtual void run();
     static int count;
+private:
+    unsigned int m_index;
+    static unsigned int s_index;
 };
 
 class EngineCommand : public MessageHandler
@@ -223,6 +226,7 @@ Engine* Engine::s_self = 0;
 bool Engine::s_started = false;
 int Engine::s_haltcode = -1;
 int EnginePrivate::count = 0;
+unsigned int EnginePrivate::s_index = 0;
 static String s_cfgpath(CFG_PATH);
 static String s_usrpath;
 static bool s_createusr = true;
@@ -472,6 +476,18 @@ bool EngineStatusHandler::received(Message &msg)
 		objects(msg.retValue(),details);
 	    return true;
 	}
+	if (sel == YSTRING("mutex")) {
+	    msg.retValue() << "name=mutex,type=system";
+	    msg.retValue() << ",format=Acquired|Contended|WaitUsec|MaxWaitUsec|HoldUsec|MaxHoldUsec";
+	    msg.retValue() << ";enabled=" << Lockable::stats();
+	    String str;
+	    unsigned int n = Lockable::statistics(str);
+	    msg.retValue() << ",count=" << n;
+	    if (details && str)
+		msg.retValue() << ";" << str;
+	    msg.retValue() << "\r\n";
+	    return true;
+	}
 	return false;
     }
     msg.retValue() << "name=engine,type=system";
@@ -500,6 +516,10 @@ bool EngineStatusHandler::received(Message &msg)
 	msg.retValue() << ",waiting=" << locks;
     msg.retValue() << ",acceptcalls=" << lookup(Engine::accept(),Engine::getCallAcceptStates());
     msg.retValue() << ",congestion=" << Engine::getCongestion();
+    unsigned int logQueue = Debugger::asyncOutput();
+    if (logQueue)
+	msg.retValue() << ",logqueue=" << logQueue << ",logdropped=" << Debugger::asyncDropped();
+    Resolver::cacheStatus(msg.retValue());
     if (details) {
 	NamedIterator iter(Engine::runParams());
 	char sep = ';';
@@ -675,6 +695,7 @@ void EngineCommand::doCompletion(Message &msg, const String& partLine, const Str
     else if (partLine == YSTRING("status")) {
 	completeOne(msg.retValue(),"engine",partWord);
 	completeOne(msg.retValue(),"objects",partWord);
+	completeOne(msg.retValue(),"mutex",partWord);
     }
     else if (partLine == YSTRING("status objects")) {
 	for (ObjList* l = getObjCounters().skipNull();l;l = l->skipNext())
@@ -857,10 +878,16 @@ bool EngineHelp::received(Message &msg)
 void EnginePrivate::run()
 {
     setCurrentObjCounter(s_workCnt);
+    MessageDispatcher& disp = Engine::self()->m_dispatcher;
     for (;;) {
-	s_makeworker = false;
-	Engine::self()->m_dispatcher.dequeue();
-	Thread::idle(true);
+	// wait for messages to be enqueued, wake up periodically to check cancel
+	// when exiting wake up often so we notice a soft cancel from killall()
+	// finding all queues empty means there are enough workers
+	bool idle = false;
+	disp.dequeueWorker(m_index,Engine::exiting() ? (long)Thread::idleUsec() : 100000,&idle);
+	if (idle)
+	    s_makeworker = false;
+	Thread::check();
     }
 }
 
@@ -1439,6 +1466,15 @@ int Engine::engineInit()
 	s_modpath = modPath;
     s_minworkers = s_cfg.getIntValue("general","minworkers",s_minworkers,1,25);
     s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers);
+    m_dispatcher.setupWorkers(s_maxworkers,
+	s_cfg.getIntValue("general","workerqueue",1024,16,65536));
+    unsigned int logQueue = s_cfg.getIntValue("general","logqueue",0,0,1048576);
+    if (logQueue && !Debugger::setAsyncOutput(logQueue,s_cfg.getBoolValue("general","logblock")))
+	Debug(DebugWarn,"Could not start asynchronous output, writing synchronously");
+    Resolver::setupCache(s_cfg.getIntValue("resolver","maxttl",3600,0),
+	s_cfg.getIntValue("resolver","negttl",30,0),
+	s_cfg.getIntValue("resolver","cachesize",4096,0));
+    Resolver::setupAsync(s_cfg.getIntValue("resolver","threads",2,1,64));
     s_maxevents = s_cfg.getIntValue("general","maxevents",s_maxevents);
     s_restarts = s_cfg.getIntValue("general","restarts");
     m_dispatcher.warnTime(1000*(u_int64_t)s_cfg.getIntValue("general","warntime"));
@@ -1663,6 +1699,10 @@ int Engine::engineCleanup()
     checkPoint();
     // We are occasionally doing things that can cause crashes so don't abort
     abortOnBug(s_sigabrt && s_lateabrt);
+    // write out all queued output before the writer thread gets killed
+    Debugger::setAsyncOutput(0);
+    // let idle resolver threads exit instead of being killed while waiting
+    Resolver::setupAsync(0);
     Thread::killall();
     checkPoint();
     m_dispatcher.dequeue();
@@ -2203,6 +2243,7 @@ void Engine::initLibrary(const String& line, String* output)
 			    ENGINE_SET_VAL_BREAK('s',s_lateabrt,true);
 			    ENGINE_INSTR_BREAK('m',setLockableWait());
 			    ENGINE_INSTR_BREAK('d',Lockable::enableSafety());
+			    ENGINE_INSTR_BREAK('p',Lockable::enableStats());
 			    default:
 				unkArgs.append("-D" + String(*pc)," ");
 			}
@@ -2247,6 +2288,9 @@ int Engine::cleanupLibrary()
 {
     // We are occasionally doing things that can cause crashes so don't abort
     abortOnBug(s_sigabrt && s_lateabrt);
+    // write out all queued output before the writer thread gets killed
+    Debugger::setAsyncOutput(0);
+    Resolver::setupAsync(0);
     Thread::killall();
     int mux = Mutex::locks();
     if (mux < 0)
@@ -2292,6 +2336,7 @@ static void usage(bool client, FILE* f)
 "     a            Abort if bugs are encountered\n"
 "     m            Attempt to debug mutex deadlocks\n"
 "     d            Enable locking debugging and safety features\n"
+"     p            Collect lock contention statistics (if supported)\n"
 #ifdef RTLD_GLOBAL
 "     l            Try to keep module symbols local\n"
 #endif
@@ -2525,6 +2570,9 @@ int Engine::main(int argc, const char** argv, const char** env, RunMode mode, En
 				case 'd':
 				    Lockable::enableSafety();
 				    break;
+				case 'p':
+				    Lockable::enableStats();
+				    break;
 #ifdef RTLD_GLOBAL
 				case 'l':
 				    s_localsymbol = true;
@@ -23,8 +23,13 @@
 
 using namespace TelEngine;
 
+// Number of old table entries moved to the new table on each append
+#define HASHLIST_REHASH_STEP 2
+
 HashList::HashList(unsigned int size)
-    : m_size(size), m_lists(0)
+    : m_size(size), m_lists(0),
+      m_old(0), m_oldSize(0), m_moved(0),
+      m_maxLoad(0), m_maxSize(0), m_appends(0)
 {
     XDebug(DebugAll,"HashList::HashList(%u) [%p]",size,this);
     if (m_size < 1)
@@ -41,6 +46,7 @@ HashList::~HashList()
     XDebug(DebugAll,"HashList::~HashList() [%p]",this);
     clear();
     delete[] m_lists;
+    delete[] m_old;
 }
 
 void* HashList::getObject(const String& name) const
@@ -56,6 +62,11 @@ unsigned int HashList::count() const
     for (unsigned int i = 0; i < m_size; i++)
 	if (m_lists[i])
 	    c += m_lists[i]->count();
+    if (m_old) {
+	for (unsigned int i = m_moved; i < m_oldSize; i++)
+	    if (m_old[i])
+		c += m_old[i]->count();
+    }
     return c;
 }
 
@@ -74,6 +85,11 @@ ObjList* HashList::find(const GenObject* obj) const
     for (unsigned int i = 0; !found && i < m_size; i++)
 	if (m_lists[i])
 	    found = m_lists[i]->find(obj);
+    if (m_old) {
+	for (unsigned int i = m_moved; !found && i < m_oldSize; i++)
+	    if (m_old[i])
+		found = m_old[i]->find(obj);
+    }
     return found;
 }
 
@@ -82,6 +98,15 @@ ObjList* HashList::find(const GenObject* obj, unsigned int hash) const
     XDebug(DebugAll,"HashList::find(%p,%u) [%p]",obj,hash,this);
     if (!obj)
 	return 0;
+    if (m_old) {
+	// objects not yet moved are still in the old table
+	unsigned int o = hash % m_oldSize;
+	if (m_old[o]) {
+	    ObjList* found = m_old[o]->find(obj);
+	    if (found)
+		return found;
+	}
+    }
     unsigned int i = hash % m_size;
     return m_lists[i] ? m_lists[i]->find(obj) : 0;
 }
@@ -89,6 +114,15 @@ ObjList* HashList::find(const GenObject* obj, unsigned int hash) const
 ObjList* HashList::find(const String& str) const
 {
     XDebug(DebugAll,"HashList::find(\"%s\") [%p]",str.c_str(),this);
+    if (m_old) {
+	// older objects that were not moved yet must be found first
+	unsigned int o = str.hash() % m_oldSize;
+	if (m_old[o]) {
+	    ObjList* found = m_old[o]->find(str);
+	    if (found)
+		return found;
+	}
+    }
     unsigned int i = str.hash() % m_size;
     return m_lists[i] ? m_lists[i]->find(str) : 0;
 }
@@ -98,6 +132,17 @@ ObjList* HashList::append(const GenObject* obj)
     XDebug(DebugAll,"HashList::append(%p) [%p]",obj,this);
     if (!obj)
 	return 0;
+    if (m_maxLoad && !m_old && (++m_appends >= m_size)) {
+	// check the load once every m_size appends to keep counting cheap
+	m_appends = 0;
+	if (count() > m_size * m_maxLoad)
+	    grow();
+    }
+    if (m_old) {
+	// move older objects with the same hash first to keep their order
+	moveEntry(obj->toString().hash() % m_oldSize);
+	rehash(HASHLIST_REHASH_STEP);
+    }
     unsigned int i = obj->toString().hash() % m_size;
     if (!m_lists[i])
 	m_lists[i] = new ObjList;
@@ -119,6 +164,13 @@ void HashList::clear()
     XDebug(DebugAll,"HashList::clear() [%p]",this);
     for (unsigned int i = 0; i < m_size; i++)
 	TelEngine::destruct(m_lists[i]);
+    if (m_old) {
+	for (unsigned int i = 0; i < m_oldSize; i++)
+	    TelEngine::destruct(m_old[i]);
+	delete[] m_old;
+	m_old = 0;
+	m_oldSize = 0;
+    }
 }
 
 bool HashList::resync(GenObject* obj)
@@ -126,6 +178,8 @@ bool HashList::resync(GenObject* obj)
     XDebug(DebugAll,"HashList::resync(%p) [%p]",obj,this);
     if (!obj)
 	return false;
+    if (m_old)
+	rehash(m_oldSize);
     unsigned int i = obj->toString().hash() % m_size;
     if (m_lists[i] && m_lists[i]->find(obj))
 	return false;
@@ -148,6 +202,8 @@ bool HashList::resync(GenObject* obj)
 bool HashList::resync()
 {
     XDebug(DebugAll,"HashList::resync() [%p]",this);
+    if (m_old)
+	rehash(m_oldSize);
     bool moved = false;
     for (unsigned int n = 0; n < m_size; n++) {
 	ObjList* l = m_lists[n];
@@ -171,4 +227,60 @@ bool HashList::resync()
     return moved;
 }
 
+void HashList::autoResize(unsigned int maxLoad, unsigned int maxSize)
+{
+    m_maxLoad = maxLoad;
+    m_maxSize = maxSize;
+    m_appends = 0;
+}
+
+// Allocate a larger table, objects are moved to it by rehash()
+void HashList::grow()
+{
+    unsigned int size = 2 * m_size + 1;
+    if (size > m_maxSize)
+	size = m_maxSize;
+    if (size <= m_size)
+	return;
+    DDebug(DebugAll,"HashList growing from %u to %u entries [%p]",m_size,size,this);
+    m_old = m_lists;
+    m_oldSize = m_size;
+    m_moved = 0;
+    m_lists = new ObjList* [size];
+    for (unsigned int i = 0; i < size; i++)
+	m_lists[i] = 0;
+    m_size = size;
+}
+
+// Move all objects of an old table entry to the new table
+void HashList::moveEntry(unsigned int index)
+{
+    ObjList* list = m_old[index];
+    if (!list)
+	return;
+    m_old[index] = 0;
+    for (ObjList* l = list->skipNull(); l; l = l->skipNext()) {
+	GenObject* obj = l->get();
+	unsigned int i = obj->toString().hash() % m_size;
+	if (!m_lists[i])
+	    m_lists[i] = new ObjList;
+	m_lists[i]->append(obj)->setDelete(l->autoDelete());
+	l->set(0,false);
+    }
+    TelEngine::destruct(list);
+}
+
+// Move objects from some entries of the old table to the new one
+void HashList::rehash(unsigned int entries)
+{
+    for (; entries && (m_moved < m_oldSize); entries--)
+	moveEntry(m_moved++);
+    if (m_moved < m_oldSize)
+	return;
+    delete[] m_old;
+    m_old = 0;
+    m_oldSize = 0;
+    m_moved = 0;
+}
+
 /* vi: set ts=8 sw=4 sts=4 noet: */
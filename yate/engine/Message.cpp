@@ -20,8 +20,167 @@
 #include "yatengine.h"
 #include <string.h>
 
+namespace TelEngine {
+
+// Bounded multiple producer / multiple consumer message ring
+// Lock free if atomic operations are available
+class MessageWorkQueue
+{
+public:
+    MessageWorkQueue(unsigned int size);
+    ~MessageWorkQueue();
+    bool push(Message* msg);
+    Message* pop();
+    inline unsigned int count() const
+	{ return m_head - m_tail; }
+private:
+    struct Cell {
+	volatile unsigned int seq;
+	Message* msg;
+    };
+    Cell* m_cells;
+    unsigned int m_mask;
+    volatile unsigned int m_head;
+    volatile unsigned int m_tail;
+#ifndef ATOMIC_OPS
+    Mutex m_mutex;
+#endif
+};
+
+};
+
 using namespace TelEngine;
 
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+#define CAS_UINT(ptr,oldVal,newVal) \
+    (InterlockedCompareExchange((LONG*)(ptr),(LONG)(newVal),(LONG)(oldVal)) == (LONG)(oldVal))
+#define ADD_INT(ptr,val) (InterlockedExchangeAdd((LONG*)(ptr),(LONG)(val)) + (val))
+#define MEM_BARRIER() MemoryBarrier()
+#else
+#define CAS_UINT(ptr,oldVal,newVal) __sync_bool_compare_and_swap(ptr,oldVal,newVal)
+#define ADD_INT(ptr,val) __sync_add_and_fetch(ptr,val)
+#define MEM_BARRIER() __sync_synchronize()
+#endif
+#define ADD_UINT(ptr,val) ADD_INT(ptr,val)
+#else
+static Mutex s_workMutex(false,"MessageWorkers");
+
+static inline int addInt(volatile int* ptr, int val)
+{
+    Lock lock(s_workMutex);
+    return (*ptr += val);
+}
+
+static inline unsigned int addUInt(volatile unsigned int* ptr, unsigned int val)
+{
+    Lock lock(s_workMutex);
+    return (*ptr += val);
+}
+
+static inline bool casUInt(volatile unsigned int* ptr, unsigned int oldVal, unsigned int newVal)
+{
+    Lock lock(s_workMutex);
+    if (*ptr != oldVal)
+	return false;
+    *ptr = newVal;
+    return true;
+}
+
+#define ADD_INT(ptr,val) addInt(ptr,val)
+#define ADD_UINT(ptr,val) addUInt(ptr,val)
+#define CAS_UINT(ptr,oldVal,newVal) casUInt(ptr,oldVal,newVal)
+#define MEM_BARRIER()
+#endif
+
+MessageWorkQueue::MessageWorkQueue(unsigned int size)
+    : m_cells(0), m_mask(0), m_head(0), m_tail(0)
+#ifndef ATOMIC_OPS
+      , m_mutex(false,"MessageWorkQueue")
+#endif
+{
+    // round up size to a power of 2
+    unsigned int n = 2;
+    while (n < size && n < 0x10000)
+	n <<= 1;
+    m_mask = n - 1;
+    m_cells = new Cell[n];
+    for (unsigned int i = 0; i < n; i++) {
+	m_cells[i].seq = i;
+	m_cells[i].msg = 0;
+    }
+}
+
+MessageWorkQueue::~MessageWorkQueue()
+{
+    while (Message* msg = pop())
+	msg->destruct();
+    delete[] m_cells;
+}
+
+bool MessageWorkQueue::push(Message* msg)
+{
+#ifdef ATOMIC_OPS
+    unsigned int pos = m_head;
+    Cell* cell = 0;
+    for (;;) {
+	cell = &m_cells[pos & m_mask];
+	MEM_BARRIER();
+	int diff = (int)(cell->seq - pos);
+	if (!diff) {
+	    if (CAS_UINT(&m_head,pos,pos + 1))
+		break;
+	}
+	else if (diff < 0)
+	    return false;
+	pos = m_head;
+    }
+    cell->msg = msg;
+    MEM_BARRIER();
+    cell->seq = pos + 1;
+    return true;
+#else
+    Lock lock(m_mutex);
+    if (m_head - m_tail > m_mask)
+	return false;
+    m_cells[m_head++ & m_mask].msg = msg;
+    return true;
+#endif
+}
+
+Message* MessageWorkQueue::pop()
+{
+#ifdef ATOMIC_OPS
+    unsigned int pos = m_tail;
+    Cell* cell = 0;
+    for (;;) {
+	cell = &m_cells[pos & m_mask];
+	MEM_BARRIER();
+	int diff = (int)(cell->seq - (pos + 1));
+	if (!diff) {
+	    if (CAS_UINT(&m_tail,pos,pos + 1))
+		break;
+	}
+	else if (diff < 0)
+	    return 0;
+	pos = m_tail;
+    }
+    Message* msg = cell->msg;
+    cell->msg = 0;
+    MEM_BARRIER();
+    cell->seq = pos + m_mask + 1;
+    return msg;
+#else
+    Lock lock(m_mutex);
+    if (m_head == m_tail)
+	return 0;
+    Message* msg = m_cells[m_tail & m_mask].msg;
+    m_cells[m_tail++ & m_mask].msg = 0;
+    return msg;
+#endif
+}
+
+
 class QueueWorker : public GenObject, public Thread
 {
 public:
@@ -37,16 +196,18 @@ private:
 
 Message::Message(const char* name, const char* retval, bool broadcast)
     : NamedList(name),
-      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(\"%s\",\"%s\",%s) [%p]",
 	name,retval,String::boolText(broadcast),this);
+    // messages can carry many parameters queried by each handler
+    hashParams();
 }
 
 Message::Message(const Message& original)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(original.broadcast())
+      m_data(0), m_notify(false), m_broadcast(original.broadcast()), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p) [%p]",&original,this);
 }
@@ -54,7 +215,7 @@ Message::Message(const Message& original)
 Message::Message(const Message& original, bool broadcast)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p,%s) [%p]",
 	&original,String::boolText(broadcast),this);
@@ -295,9 +456,65 @@ bool MessageRelay::receivedInternal(Message& msg)
 }
 
 
+// Priority ordered list of the handlers installed for one message name
+class MessageHandlerList : public String
+{
+public:
+    inline MessageHandlerList(const String& name)
+	: String(name)
+	{ }
+    ObjList m_handlers;
+};
+
+// Check if a handler is sorted after a given priority and handler address
+static inline bool handlerAfter(const MessageHandler* h, unsigned int prio, const MessageHandler* ref)
+{
+    return (h->priority() > prio) || ((h->priority() == prio) && (h > ref));
+}
+
+// Insert a handler in a list sorted by priority then by address
+static void insertHandler(ObjList& list, MessageHandler* handler, bool autoDelete)
+{
+    ObjList* l = &list;
+    int pos = 0;
+    for (; l; l=l->next(),pos++) {
+	MessageHandler *h = static_cast<MessageHandler *>(l->get());
+	if (!h)
+	    continue;
+	if (h->priority() < handler->priority())
+	    continue;
+	if (h->priority() > handler->priority())
+	    break;
+	// at the same priority we sort them in pointer address order
+	if (h > handler)
+	    break;
+    }
+    if (l) {
+	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
+	l->insert(handler)->setDelete(autoDelete);
+    }
+    else {
+	XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
+	list.append(handler)->setDelete(autoDelete);
+    }
+}
+
+// Find first handler in a sorted list located after given priority and handler
+static ObjList* seekHandler(ObjList* l, unsigned int prio, const MessageHandler* ref)
+{
+    for (l = l ? l->skipNull() : 0; l; l = l->skipNext())
+	if (handlerAfter(static_cast<MessageHandler*>(l->get()),prio,ref))
+	    break;
+    return l;
+}
+
 MessageDispatcher::MessageDispatcher(const char* trackParam)
     : Mutex(false,"MessageDispatcher"),
+      m_named(101),
       m_hookMutex(false,"PostHooks"),
+      m_wakeup(1024,"MessageWorkers",0),
+      m_workQueues(0), m_workCount(0), m_workActive(0), m_workNext(0), m_workIdle(0),
+      m_msgShared(false),
       m_msgAppend(&m_messages), m_hookAppend(&m_hooks),
       m_trackParam(trackParam), m_changes(0), m_warnTime(0),
       m_hookCount(0), m_hookHole(false)
@@ -311,6 +528,11 @@ MessageDispatcher::~MessageDispatcher()
     lock();
     clear();
     unlock();
+    if (m_workQueues) {
+	for (unsigned int i = 0; i < m_workCount; i++)
+	    delete m_workQueues[i];
+	delete[] m_workQueues;
+    }
 }
 
 bool MessageDispatcher::install(MessageHandler* handler)
@@ -322,28 +544,17 @@ bool MessageDispatcher::install(MessageHandler* handler)
     ObjList *l = m_handlers.find(handler);
     if (l)
 	return false;
-    unsigned p = handler->priority();
-    int pos = 0;
-    for (l=&m_handlers; l; l=l->next(),pos++) {
-	MessageHandler *h = static_cast<MessageHandler *>(l->get());
-	if (!h)
-	    continue;
-	if (h->priority() < p)
-	    continue;
-	if (h->priority() > p)
-	    break;
-	// at the same priority we sort them in pointer address order
-	if (h > handler)
-	    break;
-    }
     m_changes++;
-    if (l) {
-	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
-	l->insert(handler);
-    }
+    insertHandler(m_handlers,handler,true);
+    if (handler->null())
+	insertHandler(m_broadcast,handler,false);
     else {
-	XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
-	m_handlers.append(handler);
+	MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_named[*handler]);
+	if (!hl) {
+	    hl = new MessageHandlerList(*handler);
+	    m_named.append(hl);
+	}
+	insertHandler(hl->m_handlers,handler,false);
     }
     handler->m_dispatcher = this;
     if (handler->null())
@@ -358,6 +569,17 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
     handler = static_cast<MessageHandler *>(m_handlers.remove(handler,false));
     if (handler) {
 	m_changes++;
+	if (handler->null())
+	    m_broadcast.remove(handler,false);
+	else {
+	    ObjList* l = m_named.find(*handler);
+	    MessageHandlerList* hl = l ? static_cast<MessageHandlerList*>(l->get()) : 0;
+	    if (hl) {
+		hl->m_handlers.remove(handler,false);
+		if (!hl->m_handlers.skipNull())
+		    l->remove();
+	    }
+	}
 	if (handler->m_unsafe > 0) {
 	    DDebug(DebugNote,"Waiting for unsafe MessageHandler %p '%s'",
 		handler,handler->c_str());
@@ -387,74 +609,71 @@ bool MessageDispatcher::dispatch(Message& msg)
     bool retv = false;
     bool counting = getObjCounting();
     NamedCounter* saved = Thread::getCurrentObjCounter(counting);
-    ObjList *l = &m_handlers;
     Lock mylock(this);
-    for (; l; l=l->next()) {
-	MessageHandler *h = static_cast<MessageHandler*>(l->get());
-	if (h && (h->null() || *h == msg)) {
-	    if (h->filter() && (*(h->filter()) != msg.getValue(h->filter()->name())))
-		continue;
-	    if (counting)
-		Thread::setCurrentObjCounter(h->objectsCounter());
-
-	    unsigned int c = m_changes;
-	    unsigned int p = h->priority();
-	    if (trackParam() && h->trackName()) {
-		NamedString* tracked = msg.getParam(trackParam());
-		if (tracked)
-		    tracked->append(h->trackName(),",");
-		else
-		    msg.addParam(trackParam(),h->trackName());
-	    }
-	    // mark handler as unsafe to destroy / uninstall
-	    h->m_unsafe++;
-	    mylock.drop();
-
-	    u_int64_t tm = m_warnTime ? Time::now() : 0;
-
-	    retv = h->receivedInternal(msg) || retv;
-
-	    if (tm) {
-		tm = Time::now() - tm;
-		if (tm > m_warnTime) {
-		    mylock.acquire(this);
-		    const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
-		    Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
-			msg.c_str(),&msg,h,
-			(name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
-		}
+    // merge handlers installed for this name with broadcast ones
+    MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_named[msg]);
+    ObjList* ln = hl ? hl->m_handlers.skipNull() : 0;
+    ObjList* lb = m_broadcast.skipNull();
+    while (ln || lb) {
+	MessageHandler* h = 0;
+	if (ln) {
+	    h = static_cast<MessageHandler*>(ln->get());
+	    if (lb) {
+		MessageHandler* bh = static_cast<MessageHandler*>(lb->get());
+		if (handlerAfter(h,bh->priority(),bh))
+		    h = 0;
 	    }
-
-	    if (retv && !msg.broadcast())
-		break;
-	    mylock.acquire(this);
-	    if (c == m_changes)
-		continue;
-	    // the handler list has changed - find again
-	    NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
-		msg.c_str(),&msg,p);
-	    ObjList* l2 = &m_handlers;
-	    for (l = l2; l; l=l->next()) {
-		MessageHandler *mh = static_cast<MessageHandler*>(l->get());
-		if (!mh)
-		    continue;
-		if (mh == h)
-		    // exact match - silently continue where we left
-		    break;
-
-		// gone past last handler priority - exit with last handler
-		if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h))) {
-		    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
-			msg.c_str(),&msg,h,p,mh,mh->priority());
-		    // l will advance in the outer for loop so use previous
-		    l = l2;
-		    break;
-		}
-		l2 = l;
+	}
+	if (h)
+	    ln = ln->skipNext();
+	else {
+	    h = static_cast<MessageHandler*>(lb->get());
+	    lb = lb->skipNext();
+	}
+	if (h->filter() && (*(h->filter()) != msg.getValue(h->filter()->name())))
+	    continue;
+	if (counting)
+	    Thread::setCurrentObjCounter(h->objectsCounter());
+
+	unsigned int c = m_changes;
+	unsigned int p = h->priority();
+	if (trackParam() && h->trackName()) {
+	    NamedString* tracked = msg.getParam(trackParam());
+	    if (tracked)
+		tracked->append(h->trackName(),",");
+	    else
+		msg.addParam(trackParam(),h->trackName());
+	}
+	// mark handler as unsafe to destroy / uninstall
+	h->m_unsafe++;
+	mylock.drop();
+
+	u_int64_t tm = m_warnTime ? Time::now() : 0;
+
+	retv = h->receivedInternal(msg) || retv;
+
+	if (tm) {
+	    tm = Time::now() - tm;
+	    if (tm > m_warnTime) {
+		mylock.acquire(this);
+		const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
+		Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
+		    msg.c_str(),&msg,h,
+		    (name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
 	    }
-	    if (!l)
-		break;
 	}
+
+	if (retv && !msg.broadcast())
+	    break;
+	mylock.acquire(this);
+	if (c == m_changes)
+	    continue;
+	// the handler lists have changed - find again
+	NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
+	    msg.c_str(),&msg,p);
+	hl = static_cast<MessageHandlerList*>(m_named[msg]);
+	ln = seekHandler(hl ? &hl->m_handlers : 0,p,h);
+	lb = seekHandler(&m_broadcast,p,h);
     }
     mylock.drop();
     if (counting)
@@ -480,6 +699,7 @@ bool MessageDispatcher::dispatch(Message& msg)
     }
 
     m_hookMutex.lock();
+    ObjList* l;
     if (m_hookHole && !m_hookCount) {
 	// compact the list, remove the holes
 	for (l = &m_hooks; l; l = l->next()) {
@@ -515,20 +735,66 @@ bool MessageDispatcher::dispatch(Message& msg)
 
 bool MessageDispatcher::enqueue(Message* msg)
 {
-    Lock lock(this);
-    if (!msg || m_messages.find(msg))
+    // a message can be in only one queue at a time
+    if (!(msg && CAS_UINT(&msg->m_queued,0,1)))
 	return false;
+    unsigned int active = m_workActive;
+    if (active) {
+	// try the worker queues in round robin order
+	unsigned int n = ADD_UINT(&m_workNext,1);
+	for (unsigned int i = 0; i < active; i++) {
+	    if (m_workQueues[(n + i) % active]->push(msg)) {
+		wakeWorker();
+		return true;
+	    }
+	}
+	DDebug(DebugMild,"All %u worker queues are full, using shared queue",active);
+    }
+    lock();
     m_msgAppend = m_msgAppend->append(msg);
+    m_msgShared = true;
+    unlock();
+    wakeWorker();
     return true;
 }
 
+void MessageDispatcher::wakeWorker()
+{
+    MEM_BARRIER();
+    if (m_workIdle > 0)
+	m_wakeup.unlock();
+}
+
+Message* MessageDispatcher::takeMessage(unsigned int index)
+{
+    // messages in the shared queue are older so take them first
+    if (m_msgShared) {
+	lock();
+	if (m_messages.next() == m_msgAppend)
+	    m_msgAppend = &m_messages;
+	Message* msg = static_cast<Message*>(m_messages.remove(false));
+	m_msgShared = (0 != m_messages.get()) || (0 != m_messages.next());
+	unlock();
+	if (msg) {
+	    msg->m_queued = 0;
+	    return msg;
+	}
+    }
+    unsigned int active = m_workActive;
+    // own queue first then try to steal from the others
+    for (unsigned int i = 0; i < active; i++) {
+	Message* msg = m_workQueues[(index + i) % active]->pop();
+	if (msg) {
+	    msg->m_queued = 0;
+	    return msg;
+	}
+    }
+    return 0;
+}
+
 bool MessageDispatcher::dequeueOne()
 {
-    lock();
-    if (m_messages.next() == m_msgAppend)
-	m_msgAppend = &m_messages;
-    Message* msg = static_cast<Message *>(m_messages.remove(false));
-    unlock();
+    Message* msg = takeMessage(0);
     if (!msg)
 	return false;
     dispatch(*msg);
@@ -542,10 +808,54 @@ void MessageDispatcher::dequeue()
 	;
 }
 
+bool MessageDispatcher::setupWorkers(unsigned int count, unsigned int size)
+{
+    Lock lock(this);
+    if (m_workQueues || !count)
+	return false;
+    MessageWorkQueue** queues = new MessageWorkQueue*[count];
+    for (unsigned int i = 0; i < count; i++)
+	queues[i] = new MessageWorkQueue(size);
+    m_workCount = count;
+    m_workQueues = queues;
+    DDebug(DebugInfo,"Created %u message worker queues of size %u",count,size);
+    return true;
+}
+
+bool MessageDispatcher::dequeueWorker(unsigned int index, long maxwait, bool* idle)
+{
+    if (index < m_workCount && index >= m_workActive) {
+	// activate the queue so it will receive messages from now on
+	Lock lock(this);
+	if (index >= m_workActive)
+	    m_workActive = index + 1;
+    }
+    Message* msg = takeMessage(index);
+    if (!msg) {
+	if (idle)
+	    *idle = true;
+	// announce we are idle before checking queues again so enqueue wakes us
+	ADD_INT(&m_workIdle,1);
+	msg = takeMessage(index);
+	if (!msg && m_wakeup.lock(maxwait))
+	    msg = takeMessage(index);
+	ADD_INT(&m_workIdle,-1);
+	if (!msg)
+	    return false;
+    }
+    dispatch(*msg);
+    msg->destruct();
+    return true;
+}
+
 unsigned int MessageDispatcher::messageCount()
 {
+    unsigned int count = 0;
+    unsigned int active = m_workActive;
+    for (unsigned int i = 0; i < active; i++)
+	count += m_workQueues[i]->count();
     Lock lock(this);
-    return m_messages.count();
+    return count + m_messages.count();
 }
 
 unsigned int MessageDispatcher::handlerCount()
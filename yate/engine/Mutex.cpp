@@ -18,6 +18,7 @@
  */
 
 #include "yateclass.h"
+#include <string.h>
 
 #ifdef _WINDOWS
 
@@ -55,6 +56,19 @@ typedef sem_t HSEMAPHORE;
 
 namespace TelEngine {
 
+#ifdef LOCK_STATS
+// Contention statistics shared by all locks with the same name
+struct LockStats {
+    const char* name;
+    volatile u_int64_t acquired;
+    volatile u_int64_t contended;
+    volatile u_int64_t waitTotal;
+    volatile u_int64_t waitMax;
+    volatile u_int64_t holdTotal;
+    volatile u_int64_t holdMax;
+};
+#endif
+
 class MutexPrivate {
 public:
     MutexPrivate(bool recursive, const char* name);
@@ -76,6 +90,7 @@ public:
     static volatile int s_count;
     static volatile int s_locks;
 private:
+    bool lockWait(long maxwait, bool warn);
     HMUTEX m_mutex;
     int m_refcount;
     volatile unsigned int m_locked;
@@ -83,6 +98,10 @@ private:
     bool m_recursive;
     const char* m_name;
     const char* m_owner;
+#ifdef LOCK_STATS
+    LockStats* m_stats;
+    u_int64_t m_lockTime;
+#endif
 };
 
 class SemaphorePrivate {
@@ -102,11 +121,15 @@ public:
     static volatile int s_count;
     static volatile int s_locks;
 private:
+    bool lockWait(long maxwait, bool warn);
     HSEMAPHORE m_semaphore;
     int m_refcount;
     volatile unsigned int m_waiting;
     unsigned int m_maxcount;
     const char* m_name;
+#ifdef LOCK_STATS
+    LockStats* m_stats;
+#endif
 };
 
 class GlobalMutex {
@@ -136,6 +159,100 @@ volatile int SemaphorePrivate::s_count = 0;
 volatile int SemaphorePrivate::s_locks = 0;
 bool GlobalMutex::s_init = true;
 
+#ifdef LOCK_STATS
+// Size of the lock statistics table, locks with new names that don't fit
+//  are accounted in the last entry
+#ifndef LOCK_STATS_SIZE
+#define LOCK_STATS_SIZE 1021
+#endif
+
+static LockStats s_lockStats[LOCK_STATS_SIZE];
+static unsigned int s_lockStatsUsed = 0;
+static volatile bool s_statsOn = false;
+
+// Find or create the statistics entry of a lock name, GlobalMutex must be locked
+static LockStats* findStats(const char* name)
+{
+    unsigned int h = String::hash(name);
+    // keep the last entry for overflow
+    unsigned int i = h % (LOCK_STATS_SIZE - 1);
+    for (unsigned int n = 0; n < (LOCK_STATS_SIZE - 1); n++) {
+	LockStats* st = &s_lockStats[i];
+	if (!st->name) {
+	    if ((s_lockStatsUsed + 1) >= ((LOCK_STATS_SIZE * 3) / 4))
+		break;
+	    st->name = ::strdup(name);
+	    s_lockStatsUsed++;
+	    return st;
+	}
+	if (!::strcmp(st->name,name))
+	    return st;
+	if (++i >= (LOCK_STATS_SIZE - 1))
+	    i = 0;
+    }
+    LockStats* st = &s_lockStats[LOCK_STATS_SIZE - 1];
+    if (!st->name)
+	st->name = "(other)";
+    return st;
+}
+
+// Counters of a name are shared by many locks so they are updated atomically
+static inline void statsAdd(volatile u_int64_t& value, u_int64_t inc)
+{
+#if defined(ATOMIC_OPS) && !defined(_WINDOWS)
+    __sync_add_and_fetch(&value,inc);
+#else
+    GlobalMutex::lock();
+    value += inc;
+    GlobalMutex::unlock();
+#endif
+}
+
+static inline void statsMax(volatile u_int64_t& value, u_int64_t val)
+{
+#if defined(ATOMIC_OPS) && !defined(_WINDOWS)
+    u_int64_t old = value;
+    while ((old < val) && !__sync_bool_compare_and_swap(&value,old,val))
+	old = value;
+#else
+    if (value >= val)
+	return;
+    GlobalMutex::lock();
+    if (value < val)
+	value = val;
+    GlobalMutex::unlock();
+#endif
+}
+
+static inline void statsWait(LockStats* st, u_int64_t waitStart, u_int64_t now)
+{
+    statsAdd(st->acquired,1);
+    if (!waitStart)
+	return;
+    statsAdd(st->contended,1);
+    statsAdd(st->waitTotal,now - waitStart);
+    statsMax(st->waitMax,now - waitStart);
+}
+#endif
+
+#ifdef ATOMIC_OPS
+// Safety counters are updated atomically so locks don't serialize on GlobalMutex
+#define SAFETY_LOCK() (void)0
+#define SAFETY_UNLOCK() (void)0
+#ifdef _WINDOWS
+#define SAFE_INC(var) InterlockedIncrement((LONG*)&(var))
+#define SAFE_DEC(var) InterlockedDecrement((LONG*)&(var))
+#else
+#define SAFE_INC(var) __sync_add_and_fetch(&(var),1)
+#define SAFE_DEC(var) __sync_sub_and_fetch(&(var),1)
+#endif
+#else
+#define SAFETY_LOCK() GlobalMutex::lock()
+#define SAFETY_UNLOCK() GlobalMutex::unlock()
+#define SAFE_INC(var) (++(var))
+#define SAFE_DEC(var) (--(var))
+#endif
+
 // WARNING!!!
 // No debug messages are allowed in mutexes since the debug output itself
 // is serialized using a mutex!
@@ -188,9 +305,15 @@ void GlobalMutex::unlock()
 MutexPrivate::MutexPrivate(bool recursive, const char* name)
     : m_refcount(1), m_locked(0), m_waiting(0), m_recursive(recursive),
       m_name(name), m_owner(0)
+#ifdef LOCK_STATS
+      , m_stats(0), m_lockTime(0)
+#endif
 {
     GlobalMutex::lock();
     s_count++;
+#ifdef LOCK_STATS
+    m_stats = findStats(name);
+#endif
 #ifdef _WINDOWS
     // All mutexes are recursive in Windows
     m_mutex = ::CreateMutex(NULL,FALSE,NULL);
@@ -249,14 +372,62 @@ bool MutexPrivate::lock(long maxwait)
     }
     bool safety = s_safety;
     if (safety)
-	GlobalMutex::lock();
+	SAFETY_LOCK();
     Thread* thr = Thread::current();
     if (thr)
 	thr->m_locking = true;
     if (safety) {
-	m_waiting++;
-	GlobalMutex::unlock();
+	SAFE_INC(m_waiting);
+	SAFETY_UNLOCK();
+    }
+#ifdef LOCK_STATS
+    u_int64_t waitStart = 0;
+    if (s_statsOn && !s_unsafe) {
+	// a failed attempt to lock without waiting means contention
+	rval = lockWait(0,false);
+	if (!rval && maxwait) {
+	    waitStart = Time::now();
+	    rval = lockWait(maxwait,warn);
+	}
+	if (rval) {
+	    u_int64_t now = Time::now();
+	    statsWait(m_stats,waitStart,now);
+	    if (!m_locked)
+		m_lockTime = now;
+	}
+    }
+    else
+#endif
+	rval = lockWait(maxwait,warn);
+    if (safety) {
+	SAFETY_LOCK();
+	SAFE_DEC(m_waiting);
+    }
+    if (thr)
+	thr->m_locking = false;
+    if (rval) {
+	if (safety)
+	    SAFE_INC(s_locks);
+	m_locked++;
+	if (thr) {
+	    thr->m_locks++;
+	    m_owner = thr->name();
+	}
+	else
+	    m_owner = 0;
     }
+    if (safety)
+	SAFETY_UNLOCK();
+    if (warn && !rval)
+	Debug(DebugFail,"Thread '%s' could not lock mutex '%s' owned by '%s' waited by %u others for %lu usec!",
+	    Thread::currentName(),m_name,m_owner,m_waiting,maxwait);
+    return rval;
+}
+
+// Wait for the mutex without any accounting
+bool MutexPrivate::lockWait(long maxwait, bool warn)
+{
+    bool rval = false;
 #ifdef _WINDOWS
     DWORD ms = 0;
     if (maxwait < 0)
@@ -297,28 +468,6 @@ bool MutexPrivate::lock(long maxwait)
 #endif // HAVE_TIMEDLOCK
     }
 #endif // _WINDOWS
-    if (safety) {
-	GlobalMutex::lock();
-	m_waiting--;
-    }
-    if (thr)
-	thr->m_locking = false;
-    if (rval) {
-	if (safety)
-	    s_locks++;
-	m_locked++;
-	if (thr) {
-	    thr->m_locks++;
-	    m_owner = thr->name();
-	}
-	else
-	    m_owner = 0;
-    }
-    if (safety)
-	GlobalMutex::unlock();
-    if (warn && !rval)
-	Debug(DebugFail,"Thread '%s' could not lock mutex '%s' owned by '%s' waited by %u others for %lu usec!",
-	    Thread::currentName(),m_name,m_owner,m_waiting,maxwait);
     return rval;
 }
 
@@ -328,7 +477,7 @@ bool MutexPrivate::unlock()
     // Hope we don't hit a bug related to the debug mutex!
     bool safety = s_safety;
     if (safety)
-	GlobalMutex::lock();
+	SAFETY_LOCK();
     if (m_locked) {
 	Thread* thr = Thread::current();
 	if (thr)
@@ -339,9 +488,17 @@ bool MutexPrivate::unlock()
 		Debug(DebugFail,"MutexPrivate '%s' unlocked by '%s' but owned by '%s' [%p]",
 		    m_name,tname,m_owner,this);
 	    m_owner = 0;
+#ifdef LOCK_STATS
+	    if (m_lockTime) {
+		u_int64_t hold = Time::now() - m_lockTime;
+		m_lockTime = 0;
+		statsAdd(m_stats->holdTotal,hold);
+		statsMax(m_stats->holdMax,hold);
+	    }
+#endif
 	}
 	if (safety) {
-	    int locks = --s_locks;
+	    int locks = SAFE_DEC(s_locks);
 	    if (locks < 0) {
 		// this is very very bad - abort right now
 		abortOnBug(true);
@@ -360,7 +517,7 @@ bool MutexPrivate::unlock()
     else
 	Debug(DebugFail,"MutexPrivate::unlock called on unlocked '%s' [%p]",m_name,this);
     if (safety)
-	GlobalMutex::unlock();
+	SAFETY_UNLOCK();
     return ok;
 }
 
@@ -369,11 +526,17 @@ SemaphorePrivate::SemaphorePrivate(unsigned int maxcount, const char* name,
     unsigned int initialCount)
     : m_refcount(1), m_waiting(0), m_maxcount(maxcount),
       m_name(name)
+#ifdef LOCK_STATS
+      , m_stats(0)
+#endif
 {
     if (initialCount > m_maxcount)
 	initialCount = m_maxcount;
     GlobalMutex::lock();
     s_count++;
+#ifdef LOCK_STATS
+    m_stats = findStats(name);
+#endif
 #ifdef _WINDOWS
     m_semaphore = ::CreateSemaphore(NULL,initialCount,maxcount,NULL);
 #else
@@ -408,15 +571,55 @@ bool SemaphorePrivate::lock(long maxwait)
     }
     bool safety = s_safety;
     if (safety)
-	GlobalMutex::lock();
+	SAFETY_LOCK();
     Thread* thr = Thread::current();
     if (thr)
 	thr->m_locking = true;
     if (safety) {
-	s_locks++;
-	m_waiting++;
-	GlobalMutex::unlock();
+	SAFE_INC(s_locks);
+	SAFE_INC(m_waiting);
+	SAFETY_UNLOCK();
+    }
+#ifdef LOCK_STATS
+    if (s_statsOn && !s_unsafe) {
+	// a semaphore that is not available at once is contended
+	u_int64_t waitStart = 0;
+	rval = lockWait(0,false);
+	if (!rval && maxwait) {
+	    waitStart = Time::now();
+	    rval = lockWait(maxwait,warn);
+	}
+	if (rval)
+	    statsWait(m_stats,waitStart,waitStart ? Time::now() : 0);
+    }
+    else
+#endif
+	rval = lockWait(maxwait,warn);
+    if (safety) {
+	SAFETY_LOCK();
+	int locks = SAFE_DEC(s_locks);
+	if (locks < 0) {
+	    // this is very very bad - abort right now
+	    abortOnBug(true);
+	    s_locks = 0;
+	    Debug(DebugFail,"SemaphorePrivate::locks() is %d [%p]",locks,this);
+	}
+	SAFE_DEC(m_waiting);
     }
+    if (thr)
+	thr->m_locking = false;
+    if (safety)
+	SAFETY_UNLOCK();
+    if (warn && !rval)
+	Debug(DebugFail,"Thread '%s' could not lock semaphore '%s' waited by %u others for %lu usec!",
+	    Thread::currentName(),m_name,m_waiting,maxwait);
+    return rval;
+}
+
+// Wait for the semaphore without any accounting
+bool SemaphorePrivate::lockWait(long maxwait, bool warn)
+{
+    bool rval = false;
 #ifdef _WINDOWS
     DWORD ms = 0;
     if (maxwait < 0)
@@ -457,24 +660,6 @@ bool SemaphorePrivate::lock(long maxwait)
 #endif // HAVE_TIMEDWAIT
     }
 #endif // _WINDOWS
-    if (safety) {
-	GlobalMutex::lock();
-	int locks = --s_locks;
-	if (locks < 0) {
-	    // this is very very bad - abort right now
-	    abortOnBug(true);
-	    s_locks = 0;
-	    Debug(DebugFail,"SemaphorePrivate::locks() is %d [%p]",locks,this);
-	}
-	m_waiting--;
-    }
-    if (thr)
-	thr->m_locking = false;
-    if (safety)
-	GlobalMutex::unlock();
-    if (warn && !rval)
-	Debug(DebugFail,"Thread '%s' could not lock semaphore '%s' waited by %u others for %lu usec!",
-	    Thread::currentName(),m_name,m_waiting,maxwait);
     return rval;
 }
 
@@ -483,7 +668,7 @@ bool SemaphorePrivate::unlock()
     if (!s_unsafe) {
 	bool safety = s_safety;
 	if (safety)
-	    GlobalMutex::lock();
+	    SAFETY_LOCK();
 #ifdef _WINDOWS
 	::ReleaseSemaphore(m_semaphore,1,NULL);
 #else
@@ -492,7 +677,7 @@ bool SemaphorePrivate::unlock()
 	    ::sem_post(&m_semaphore);
 #endif
 	if (safety)
-	    GlobalMutex::unlock();
+	    SAFETY_UNLOCK();
     }
     return true;
 }
@@ -545,6 +730,58 @@ unsigned long Lockable::wait()
     return s_maxwait;
 }
 
+bool Lockable::enableStats(bool enable)
+{
+#ifdef LOCK_STATS
+    s_statsOn = enable;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Lockable::stats()
+{
+#ifdef LOCK_STATS
+    return s_statsOn;
+#else
+    return false;
+#endif
+}
+
+void Lockable::resetStats()
+{
+#ifdef LOCK_STATS
+    GlobalMutex::lock();
+    for (unsigned int i = 0; i < LOCK_STATS_SIZE; i++) {
+	LockStats& st = s_lockStats[i];
+	st.acquired = st.contended = 0;
+	st.waitTotal = st.waitMax = 0;
+	st.holdTotal = st.holdMax = 0;
+    }
+    GlobalMutex::unlock();
+#endif
+}
+
+unsigned int Lockable::statistics(String& dest)
+{
+    unsigned int n = 0;
+#ifdef LOCK_STATS
+    // names are never removed so the table can be walked without locking
+    for (unsigned int i = 0; i < LOCK_STATS_SIZE; i++) {
+	const LockStats& st = s_lockStats[i];
+	if (!(st.name && st.acquired))
+	    continue;
+	if (n++)
+	    dest << ",";
+	dest << st.name << "=" << st.acquired << "|" << st.contended <<
+	    "|" << st.waitTotal << "|" << st.waitMax <<
+	    "|" << st.holdTotal << "|" << st.holdMax;
+    }
+#endif
+    return n;
+}
+
 
 Mutex::Mutex(bool recursive, const char* name)
     : m_private(0)
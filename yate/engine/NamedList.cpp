@@ -19,9 +19,147 @@
 
 #include "yateclass.h"
 
+namespace TelEngine {
+
+// Open addressing hash table holding the first parameter with each name
+//  and the list node holding it, also remembers the last node of the list
+class NamedListIndex
+{
+public:
+    NamedListIndex(unsigned int count);
+    inline ~NamedListIndex()
+	{ delete[] m_entries; }
+    inline ObjList* tail() const
+	{ return m_tail; }
+    inline void tail(ObjList* node)
+	{ m_tail = node; }
+    NamedString* find(const String& name) const;
+    bool add(NamedString* param, ObjList* node);
+    bool replace(NamedString* param);
+    void remove(const String& name);
+    void moved(ObjList* from, ObjList* to);
+private:
+    struct Entry {
+	unsigned int hash;
+	NamedString* param;
+	ObjList* node;
+    };
+    Entry* lookup(const String& name) const;
+    Entry* m_entries;
+    unsigned int m_mask;
+    unsigned int m_used;
+    ObjList* m_tail;
+};
+
+};
+
 using namespace TelEngine;
 
 static const NamedList s_empty("");
+#ifndef ATOMIC_OPS
+static Mutex s_indexMutex(false,"NamedListIndex");
+#endif
+
+NamedListIndex::NamedListIndex(unsigned int count)
+    : m_entries(0), m_mask(0), m_used(0), m_tail(0)
+{
+    // keep load factor under 1/2
+    unsigned int n = 32;
+    while (n < 2 * count)
+	n <<= 1;
+    m_mask = n - 1;
+    m_entries = new Entry[n];
+    for (unsigned int i = 0; i < n; i++) {
+	m_entries[i].hash = 0;
+	m_entries[i].param = 0;
+	m_entries[i].node = 0;
+    }
+}
+
+NamedListIndex::Entry* NamedListIndex::lookup(const String& name) const
+{
+    unsigned int h = name.hash();
+    for (unsigned int i = h & m_mask; m_entries[i].param; i = (i + 1) & m_mask) {
+	if (m_entries[i].hash == h && m_entries[i].param->name() == name)
+	    return m_entries + i;
+    }
+    return 0;
+}
+
+NamedString* NamedListIndex::find(const String& name) const
+{
+    Entry* e = lookup(name);
+    return e ? e->param : 0;
+}
+
+// Add a parameter if its name is not already indexed
+// Return false if the table became too full
+bool NamedListIndex::add(NamedString* param, ObjList* node)
+{
+    unsigned int h = param->name().hash();
+    unsigned int i = h & m_mask;
+    for (; m_entries[i].param; i = (i + 1) & m_mask) {
+	if (m_entries[i].hash == h && m_entries[i].param->name() == param->name())
+	    return true;
+    }
+    m_entries[i].hash = h;
+    m_entries[i].param = param;
+    m_entries[i].node = node;
+    return (++m_used * 2) <= m_mask;
+}
+
+// Put a parameter in the list node of the first one with the same name
+// Return false if there is no parameter with that name
+bool NamedListIndex::replace(NamedString* param)
+{
+    Entry* e = lookup(param->name());
+    if (!e)
+	return false;
+    e->node->set(param);
+    e->param = param;
+    return true;
+}
+
+void NamedListIndex::remove(const String& name)
+{
+    unsigned int h = name.hash();
+    unsigned int i = h & m_mask;
+    for (; m_entries[i].param; i = (i + 1) & m_mask) {
+	if (m_entries[i].hash == h && m_entries[i].param->name() == name)
+	    break;
+    }
+    if (!m_entries[i].param)
+	return;
+    // shift back following entries that probed past the freed slot
+    unsigned int j = i;
+    for (;;) {
+	j = (j + 1) & m_mask;
+	if (!m_entries[j].param)
+	    break;
+	unsigned int k = m_entries[j].hash & m_mask;
+	if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+	    continue;
+	m_entries[i] = m_entries[j];
+	i = j;
+    }
+    m_entries[i].param = 0;
+    m_entries[i].node = 0;
+    m_used--;
+}
+
+// A list node was removed, its following node was deleted and the object moved
+void NamedListIndex::moved(ObjList* from, ObjList* to)
+{
+    if (m_tail == from)
+	m_tail = to;
+    NamedString* param = static_cast<NamedString*>(to->get());
+    if (!param)
+	return;
+    Entry* e = lookup(param->name());
+    if (e && (e->node == from))
+	e->node = to;
+}
+
 
 const NamedList& NamedList::empty()
 {
@@ -29,12 +167,14 @@ const NamedList& NamedList::empty()
 }
 
 NamedList::NamedList(const char* name)
-    : String(name)
+    : String(name),
+      m_hashMin(0), m_changes(0), m_index(0)
 {
 }
 
 NamedList::NamedList(const NamedList& original)
-    : String(original)
+    : String(original),
+      m_hashMin(original.m_hashMin), m_changes(0), m_index(0)
 {
     ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
@@ -44,11 +184,17 @@ NamedList::NamedList(const NamedList& original)
 }
 
 NamedList::NamedList(const char* name, const NamedList& original, const String& prefix)
-    : String(name)
+    : String(name),
+      m_hashMin(0), m_changes(0), m_index(0)
 {
     copySubParams(original,prefix);
 }
 
+NamedList::~NamedList()
+{
+    dropIndex();
+}
+
 NamedList& NamedList::operator=(const NamedList& value)
 {
     String::operator=(value);
@@ -63,12 +209,90 @@ void* NamedList::getObject(const String& name) const
     return String::getObject(name);
 }
 
+void NamedList::hashParams(unsigned int threshold)
+{
+    m_hashMin = threshold;
+    if (!threshold)
+	dropIndex();
+}
+
+void NamedList::resetIndex()
+{
+    NamedListIndex* idx = m_index;
+    m_index = 0;
+    delete idx;
+}
+
+// Add a newly appended parameter to the index, drop the index if it grew too much
+void NamedList::indexParam(NamedString* param, ObjList* node)
+{
+    m_changes++;
+    if (!m_index)
+	return;
+    m_index->tail(node);
+    if (!m_index->add(param,node))
+	resetIndex();
+}
+
+// Append a parameter to the list, start from the last node if known
+ObjList* NamedList::appendParam(NamedString* param)
+{
+    ObjList* tail = m_index ? m_index->tail() : 0;
+    ObjList* node = tail ? tail->append(param) : m_params.append(param);
+    indexParam(param,node);
+    return node;
+}
+
+// Remove the parameter held in a list node, the next node is merged into it
+void NamedList::removeNode(ObjList* node, bool delobj)
+{
+    ObjList* next = node->next();
+    node->remove(delobj);
+    m_changes++;
+    if (m_index && next)
+	m_index->moved(next,node);
+}
+
+// Build the index and publish it, may be called concurrently from const methods
+NamedListIndex* NamedList::buildIndex() const
+{
+    NamedListIndex* idx = new NamedListIndex(m_params.count());
+    ObjList* l = const_cast<ObjList*>(&m_params);
+    for (;;) {
+	if (l->get())
+	    idx->add(static_cast<NamedString*>(l->get()),l);
+	if (!l->next())
+	    break;
+	l = l->next();
+    }
+    idx->tail(l);
+    NamedListIndex* volatile* ptr = &const_cast<NamedList*>(this)->m_index;
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+    bool set = !InterlockedCompareExchangePointer((PVOID*)ptr,idx,0);
+#else
+    bool set = __sync_bool_compare_and_swap(ptr,(NamedListIndex*)0,idx);
+#endif
+#else
+    s_indexMutex.lock();
+    bool set = !*ptr;
+    if (set)
+	*ptr = idx;
+    s_indexMutex.unlock();
+#endif
+    if (set)
+	return idx;
+    // some other thread published it first
+    delete idx;
+    return m_index;
+}
+
 NamedList& NamedList::addParam(NamedString* param)
 {
     XDebug(DebugInfo,"NamedList::addParam(%p) [\"%s\",\"%s\"]",
         param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
     if (param)
-	m_params.append(param);
+	appendParam(param);
     return *this;
 }
 
@@ -76,13 +300,35 @@ NamedList& NamedList::addParam(const char* name, const char* value, bool emptyOK
 {
     XDebug(DebugInfo,"NamedList::addParam(\"%s\",\"%s\",%s)",name,value,String::boolText(emptyOK));
     if (emptyOK || !TelEngine::null(value))
-	m_params.append(new NamedString(name, value));
+	appendParam(new NamedString(name, value));
+    return *this;
+}
+
+NamedList& NamedList::setParam(NamedString* param)
+{
+    XDebug(DebugInfo,"NamedList::setParam(%p) [\"%s\",\"%s\"]",
+        param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
+    if (!param)
+	return *this;
+    m_changes++;
+    if (!m_index)
+	m_params.setUnique(param);
+    else if (!m_index->replace(param))
+	appendParam(param);
     return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, const char* value)
 {
     XDebug(DebugInfo,"NamedList::setParam(\"%s\",\"%s\")",name.c_str(),value);
+    if (m_index) {
+	NamedString* s = m_index->find(name);
+	if (s)
+	    *s = value;
+	else
+	    appendParam(new NamedString(name,value));
+	return *this;
+    }
     ObjList *p = m_params.skipNull();
     while (p) {
         NamedString *s = static_cast<NamedString*>(p->get());
@@ -96,6 +342,7 @@ NamedList& NamedList::setParam(const String& name, const char* value)
 	else
 	    break;
     }
+    m_changes++;
     if (p)
 	p->append(new NamedString(name,value));
     else
@@ -108,13 +355,17 @@ NamedList& NamedList::clearParam(const String& name, char childSep)
     XDebug(DebugInfo,"NamedList::clearParam(\"%s\",'%.1s')",
 	name.c_str(),&childSep);
     String tmp;
-    if (childSep)
+    if (childSep) {
 	tmp << name << childSep;
+	dropIndex();
+    }
+    else if (m_index)
+	m_index->remove(name);
     ObjList *p = &m_params;
     while (p) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s && ((s->name() == name) || s->name().startsWith(tmp)))
-            p->remove();
+            removeNode(p);
 	else
 	    p = p->next();
     }
@@ -127,8 +378,12 @@ NamedList& NamedList::clearParam(NamedString* param, bool delParam)
     if (!param)
 	return *this;
     ObjList* o = m_params.find(param);
-    if (o)
-	o->remove(delParam);
+    if (o) {
+	// a parameter with the same name may follow so rebuild the index later
+	if (m_index && (m_index->find(param->name()) == param))
+	    resetIndex();
+	removeNode(o,delParam);
+    }
     XDebug(DebugInfo,"NamedList::clearParam(%p) found=%p",param,o);
     return *this;
 }
@@ -148,8 +403,10 @@ NamedList& NamedList::copyParam(const NamedList& original, const String& name, c
     ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* s = static_cast<const NamedString*>(l->get());
-        if ((s->name() == name) || s->name().startsWith(tmp))
+        if ((s->name() == name) || s->name().startsWith(tmp)) {
 	    dest = dest->append(new NamedString(s->name(),*s));
+	    indexParam(static_cast<NamedString*>(dest->get()),dest);
+	}
     }
     return *this;
 }
@@ -207,8 +464,10 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 		const char* name = s->name().c_str() + offs;
 		if (!*name)
 		    continue;
-		if (!replace)
+		if (!replace) {
 		    dest = dest->append(new NamedString(name,*s));
+		    indexParam(static_cast<NamedString*>(dest->get()),dest);
+		}
 		else if (offs)
 		    setParam(name,*s);
 		else
@@ -272,13 +531,19 @@ int NamedList::getIndex(const String& name) const
 NamedString* NamedList::getParam(const String& name) const
 {
     XDebug(DebugInfo,"NamedList::getParam(\"%s\")",name.c_str());
+    NamedListIndex* idx = m_index;
+    if (idx)
+	return idx->find(name);
+    unsigned int n = 0;
     const ObjList *p = m_params.skipNull();
-    for (; p; p=p->skipNext()) {
+    for (; p; p=p->skipNext(), n++) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s->name() == name)
-            return s;
+            break;
     }
-    return 0;
+    if (m_hashMin && (n >= m_hashMin))
+	buildIndex();
+    return p ? static_cast<NamedString *>(p->get()) : 0;
 }
 
 NamedString* NamedList::getParam(unsigned int index) const
@@ -359,6 +359,21 @@ void NaptrRecord::dump(String& buf, const char* sep)
     buf << sep << "next=" << "'" << m_next << "'";
 }
 
+// Copy a NaptrRecord list into another one
+void NaptrRecord::copy(ObjList& dest, const ObjList& src)
+{
+    dest.clear();
+    for (ObjList* o = src.skipNull(); o; o = o->skipNext()) {
+	NaptrRecord* rec = static_cast<NaptrRecord*>(o->get());
+	NaptrRecord* n = new NaptrRecord(rec->ttl(),rec->order(),rec->pref(),
+	    rec->flags(),rec->serv(),0,rec->nextName());
+	// the original expression is not kept, copy its parsed parts
+	n->m_regmatch = rec->m_regmatch.c_str();
+	n->m_template = rec->m_template;
+	dest.append(n);
+    }
+}
+
 
 // Runtime check for resolver availability
 bool Resolver::available(Type t)
@@ -848,4 +863,380 @@ int Resolver::txtQuery(const char* dname, ObjList& result, String* error)
     return printResult(Txt,code,dname,result,error);
 }
 
+
+// An answer kept in the query cache or a query still in progress
+class ResolverEntry : public RefObject
+{
+public:
+    inline ResolverEntry(const String& key, Resolver::Type type, const char* dname)
+	: m_key(key), m_type(type), m_name(dname), m_code(0),
+	  m_expires(0), m_pending(true), m_waiters(0), m_done(0)
+	{ }
+    virtual ~ResolverEntry()
+	{ delete m_done; }
+    virtual const String& toString() const
+	{ return m_key; }
+    void copyRecords(ObjList& dest) const;
+    String m_key;
+    Resolver::Type m_type;
+    String m_name;
+    ObjList m_records;
+    int m_code;
+    String m_error;
+    u_int64_t m_expires;
+    volatile bool m_pending;
+    unsigned int m_waiters;
+    Semaphore* m_done;
+    ObjList m_listeners;
+};
+
+// Thread running queued asynchronous queries
+class ResolverThread : public Thread
+{
+public:
+    inline ResolverThread()
+	: Thread("Resolver"), m_counted(true)
+	{ }
+    virtual ~ResolverThread();
+    virtual void run();
+private:
+    bool m_counted;
+};
+
+static Mutex s_cacheMutex(false,"ResolverCache");
+static HashList s_cache(61);
+static ObjList s_queue;
+static Semaphore s_queueSem(0x7fffffff,"ResolverQueue",0);
+static unsigned int s_maxTtl = 3600;
+static unsigned int s_negTtl = 30;
+static unsigned int s_maxEntries = 4096;
+static unsigned int s_maxThreads = 2;
+static unsigned int s_entries = 0;
+static unsigned int s_queued = 0;
+static unsigned int s_threads = 0;
+static unsigned int s_idleThreads = 0;
+static unsigned int s_hits = 0;
+static unsigned int s_misses = 0;
+static unsigned int s_joined = 0;
+
+// Copy the records of a completed entry, append them to a list
+void ResolverEntry::copyRecords(ObjList& dest) const
+{
+    ObjList tmp;
+    switch (m_type) {
+	case Resolver::Srv:
+	    SrvRecord::copy(tmp,m_records);
+	    break;
+	case Resolver::Naptr:
+	    NaptrRecord::copy(tmp,m_records);
+	    break;
+	default:
+	    TxtRecord::copy(tmp,m_records);
+    }
+    for (ObjList* o = tmp.skipNull(); o; o = tmp.skipNull())
+	dest.append(o->remove(false));
+}
+
+// Check if a failed or empty answer is authoritative and can be kept
+static bool negativeAnswer(int code)
+{
+    if (!code)
+	return true;
+#ifdef _WINDOWS
+    return (code == DNS_ERROR_RCODE_NAME_ERROR) || (code == DNS_INFO_NO_RECORDS);
+#elif defined(__NAMESER)
+    return (code == HOST_NOT_FOUND) || (code == NO_DATA);
+#else
+    return false;
+#endif
+}
+
+// Time in seconds to keep an answer in cache, smallest record TTL
+static unsigned int answerTtl(int code, const ObjList& records)
+{
+    if (!s_maxTtl)
+	return 0;
+    if (code || !records.skipNull())
+	return negativeAnswer(code) ? s_negTtl : 0;
+    unsigned int ttl = s_maxTtl;
+    for (ObjList* o = records.skipNull(); o; o = o->skipNext()) {
+	int t = static_cast<DnsRecord*>(o->get())->ttl();
+	if (t <= 0)
+	    return 0;
+	if ((unsigned int)t < ttl)
+	    ttl = t;
+    }
+    return ttl;
+}
+
+// Build the cache key of a query, domain names are case insensitive
+static void buildKey(String& key, Resolver::Type type, const char* dname)
+{
+    key << lookup(type,Resolver::s_types) << ":" << dname;
+    key.toLower();
+}
+
+// Remove a cache entry, cache mutex must be locked
+static void dropEntry(ResolverEntry* entry)
+{
+    if (s_cache.remove(entry,true,true))
+	s_entries--;
+}
+
+// Remove all expired answers, cache mutex must be locked
+static void purgeExpired(u_int64_t now)
+{
+    for (unsigned int i = 0; i < s_cache.length(); i++) {
+	ObjList* l = s_cache.getList(i);
+	if (!l)
+	    continue;
+	for (ObjList* o = l->skipNull(); o; ) {
+	    ResolverEntry* e = static_cast<ResolverEntry*>(o->get());
+	    if (!e->m_pending && (e->m_expires <= now)) {
+		o->remove();
+		s_entries--;
+		o = o->skipNull();
+	    }
+	    else
+		o = o->skipNext();
+	}
+    }
+}
+
+// Find a completed answer or a query in progress, cache mutex must be locked
+static ResolverEntry* findEntry(const String& key, u_int64_t now)
+{
+    ResolverEntry* e = static_cast<ResolverEntry*>(s_cache[key]);
+    if (e && !e->m_pending && (e->m_expires <= now)) {
+	dropEntry(e);
+	e = 0;
+    }
+    return e;
+}
+
+// Create and insert a query in progress, cache mutex must be locked
+static ResolverEntry* addEntry(const String& key, Resolver::Type type, const char* dname)
+{
+    ResolverEntry* e = new ResolverEntry(key,type,dname);
+    s_cache.append(e);
+    s_entries++;
+    return e;
+}
+
+// Store the answer of a query, wake up waiting threads and notify listeners
+static void completeEntry(ResolverEntry* entry, int code, ObjList& records, const String& error)
+{
+    ObjList listeners;
+    Lock lck(s_cacheMutex);
+    entry->m_code = code;
+    entry->m_error = error;
+    for (ObjList* o = records.skipNull(); o; o = records.skipNull())
+	entry->m_records.append(o->remove(false));
+    u_int64_t now = Time::now();
+    unsigned int ttl = answerTtl(code,entry->m_records);
+    if (ttl && (s_entries > s_maxEntries)) {
+	purgeExpired(now);
+	if (s_entries > s_maxEntries)
+	    ttl = 0;
+    }
+    entry->m_expires = now + 1000000 * (u_int64_t)ttl;
+    entry->m_pending = false;
+    XDebug(DebugAll,"Resolver %s answer code %d kept for %u seconds",
+	entry->m_key.c_str(),code,ttl);
+    for (ObjList* o = entry->m_listeners.skipNull(); o; o = entry->m_listeners.skipNull())
+	listeners.append(o->remove(false));
+    for (unsigned int i = 0; i < entry->m_waiters; i++)
+	entry->m_done->unlock();
+    if (!ttl)
+	dropEntry(entry);
+    lck.drop();
+    for (ObjList* o = listeners.skipNull(); o; o = listeners.skipNull()) {
+	ResolverListener* l = static_cast<ResolverListener*>(o->remove(false));
+	ObjList res;
+	entry->copyRecords(res);
+	l->resolved(entry->m_type,entry->m_name,entry->m_code,res,entry->m_error);
+	l->deref();
+    }
+}
+
+// Run the query of an entry in the current thread
+static void runEntry(ResolverEntry* entry)
+{
+    ObjList records;
+    String error;
+    int code = Resolver::query(entry->m_type,entry->m_name,records,&error);
+    completeEntry(entry,code,records,error);
+}
+
+ResolverThread::~ResolverThread()
+{
+    if (!m_counted)
+	return;
+    Lock lck(s_cacheMutex);
+    s_threads--;
+}
+
+void ResolverThread::run()
+{
+    Resolver::init();
+    while (!check(false)) {
+	Lock lck(s_cacheMutex);
+	if (s_threads > s_maxThreads) {
+	    // too many threads, possibly stopping at engine exit
+	    s_threads--;
+	    m_counted = false;
+	    break;
+	}
+	ResolverEntry* e = static_cast<ResolverEntry*>(s_queue.remove(false));
+	if (!e) {
+	    s_idleThreads++;
+	    lck.drop();
+	    s_queueSem.lock(1000000);
+	    lck.acquire(s_cacheMutex);
+	    s_idleThreads--;
+	    continue;
+	}
+	s_queued--;
+	lck.drop();
+	runEntry(e);
+	e->deref();
+    }
+}
+
+// Make a query using the shared cache
+int Resolver::cachedQuery(Type type, const char* dname, ObjList& result, String* error)
+{
+    String key;
+    buildKey(key,type,dname);
+    Lock lck(s_cacheMutex);
+    ResolverEntry* e = findEntry(key,Time::now());
+    if (!e) {
+	s_misses++;
+	e = addEntry(key,type,dname);
+	e->ref();
+	lck.drop();
+	runEntry(e);
+    }
+    else if (e->m_pending) {
+	s_joined++;
+	e->ref();
+	e->m_waiters++;
+	if (!e->m_done)
+	    e->m_done = new Semaphore(0x7fffffff,"ResolverWait",0);
+	lck.drop();
+	while (e->m_pending) {
+	    if (Thread::check(false)) {
+		e->deref();
+		return query(type,dname,result,error);
+	    }
+	    e->m_done->lock(1000000);
+	}
+    }
+    else {
+	s_hits++;
+	e->ref();
+	lck.drop();
+    }
+    // a completed entry never changes so it can be used unlocked
+    e->copyRecords(result);
+    int code = e->m_code;
+    if (code && error)
+	*error = e->m_error;
+    e->deref();
+    return code;
+}
+
+// Start an asynchronous query using the shared cache
+bool Resolver::asyncQuery(Type type, const char* dname, ResolverListener* listener)
+{
+    if (!(listener && listener->ref()))
+	return false;
+    String key;
+    buildKey(key,type,dname);
+    Lock lck(s_cacheMutex);
+    ResolverEntry* e = findEntry(key,Time::now());
+    if (e && !e->m_pending) {
+	s_hits++;
+	e->ref();
+	lck.drop();
+	ObjList res;
+	e->copyRecords(res);
+	listener->resolved(type,e->m_name,e->m_code,res,e->m_error);
+	listener->deref();
+	e->deref();
+	return true;
+    }
+    if (e) {
+	s_joined++;
+	e->m_listeners.append(listener);
+	return true;
+    }
+    s_misses++;
+    e = addEntry(key,type,dname);
+    e->m_listeners.append(listener);
+    if ((s_queued >= s_idleThreads) && (s_threads < s_maxThreads)) {
+	ResolverThread* thr = new ResolverThread;
+	if (thr->startup())
+	    s_threads++;
+	else {
+	    delete thr;
+	    if (!s_threads)
+		Debug(DebugWarn,"Resolver failed to start a thread, querying '%s' synchronously",dname);
+	}
+    }
+    if (!s_threads) {
+	// no thread to run the query, possibly the engine is exiting
+	e->ref();
+	lck.drop();
+	runEntry(e);
+	e->deref();
+	return true;
+    }
+    e->ref();
+    s_queue.append(e);
+    s_queued++;
+    lck.drop();
+    s_queueSem.unlock();
+    return true;
+}
+
+// Set up the query cache
+void Resolver::setupCache(unsigned int maxTtl, unsigned int negTtl, unsigned int maxEntries)
+{
+    Lock lck(s_cacheMutex);
+    s_maxTtl = maxTtl;
+    s_negTtl = negTtl;
+    s_maxEntries = maxEntries;
+    s_cache.autoResize();
+    if (!maxTtl)
+	purgeExpired((u_int64_t)-1);
+}
+
+// Set the maximum number of resolver threads
+void Resolver::setupAsync(unsigned int threads)
+{
+    Lock lck(s_cacheMutex);
+    s_maxThreads = threads;
+    // wake up idle threads so extra ones exit
+    for (unsigned int i = s_threads; i > threads; i--)
+	s_queueSem.unlock();
+}
+
+// Remove all answers from the query cache
+void Resolver::clearCache()
+{
+    Lock lck(s_cacheMutex);
+    purgeExpired((u_int64_t)-1);
+}
+
+// Append the query cache statistics to a status string
+void Resolver::cacheStatus(String& buf)
+{
+    Lock lck(s_cacheMutex);
+    if (!(s_hits || s_misses))
+	return;
+    buf.append("dnscache=",",") << s_entries << ",dnshits=" << s_hits <<
+	",dnsmisses=" << s_misses << ",dnsjoined=" << s_joined;
+}
+
 /* vi: set ts=8 sw=4 sts=4 noet: */
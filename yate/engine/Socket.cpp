@@ -72,10 +72,21 @@
 
 #define MAX_SOCKLEN 1024
 #define MAX_RESWAIT 5000000
+// Maximum number of datagrams in one batched system call
+#define MAX_BATCH 64
+
+#if defined(MSG_WAITFORONE) && !defined(_WINDOWS)
+// recvmmsg() and sendmmsg() are available
+#define HAVE_MMSG
+#endif
 
 using namespace TelEngine;
 
 static Mutex s_mutex(false,"SocketAddr");
+#ifdef HAVE_MMSG
+// Cleared if the running kernel doesn't implement the batched calls
+static bool s_mmsg = true;
+#endif
 
 static const TokenDict s_tosValues[] = {
     // TOS
@@ -1904,6 +1915,46 @@ int Socket::send(const void* buffer, int length, int flags)
     return res;
 }
 
+int Socket::sendBatch(const SocketDatagram* msgs, unsigned int count, int flags)
+{
+    if (!(msgs && count))
+	return 0;
+#ifdef HAVE_MMSG
+    if (s_mmsg) {
+	if (count > MAX_BATCH)
+	    count = MAX_BATCH;
+	struct mmsghdr hdr[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	::memset(hdr,0,count * sizeof(struct mmsghdr));
+	for (unsigned int i = 0; i < count; i++) {
+	    const SocketDatagram& m = msgs[i];
+	    iov[i].iov_base = m.buffer;
+	    iov[i].iov_len = m.buffer ? m.size : 0;
+	    hdr[i].msg_hdr.msg_iov = &iov[i];
+	    hdr[i].msg_hdr.msg_iovlen = 1;
+	    if (m.addr) {
+		hdr[i].msg_hdr.msg_name = m.addr->address();
+		hdr[i].msg_hdr.msg_namelen = m.addr->length();
+	    }
+	}
+	int res = ::sendmmsg(m_handle,hdr,count,flags);
+	if ((res != socketError()) || (errno != ENOSYS)) {
+	    checkError(res,true);
+	    return res;
+	}
+	s_mmsg = false;
+    }
+#endif
+    unsigned int n = 0;
+    for (; n < count; n++) {
+	const SocketDatagram& m = msgs[n];
+	int res = m.addr ? sendTo(m.buffer,m.size,*m.addr,flags) : send(m.buffer,m.size,flags);
+	if (res == socketError())
+	    return n ? (int)n : socketError();
+    }
+    return n;
+}
+
 int Socket::writeData(const void* buffer, int length)
 {
 #ifdef _WINDOWS
@@ -1941,6 +1992,71 @@ int Socket::recvFrom(void* buffer, int length, SocketAddr& addr, int flags)
     return res;
 }
 
+int Socket::recvBatch(SocketDatagram* msgs, unsigned int count, int flags)
+{
+    if (!(msgs && count))
+	return 0;
+#ifdef MSG_DONTWAIT
+    flags |= MSG_DONTWAIT;
+#endif
+#ifdef HAVE_MMSG
+    if (s_mmsg) {
+	if (count > MAX_BATCH)
+	    count = MAX_BATCH;
+	struct mmsghdr hdr[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	struct sockaddr_storage addr[MAX_BATCH];
+	::memset(hdr,0,count * sizeof(struct mmsghdr));
+	for (unsigned int i = 0; i < count; i++) {
+	    iov[i].iov_base = msgs[i].buffer;
+	    iov[i].iov_len = msgs[i].buffer ? msgs[i].size : 0;
+	    hdr[i].msg_hdr.msg_iov = &iov[i];
+	    hdr[i].msg_hdr.msg_iovlen = 1;
+	    if (msgs[i].addr) {
+		hdr[i].msg_hdr.msg_name = &addr[i];
+		hdr[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+	    }
+	}
+	int res = ::recvmmsg(m_handle,hdr,count,flags,0);
+	if ((res != socketError()) || (errno != ENOSYS)) {
+	    if (!checkError(res,true))
+		return res;
+	    for (int i = 0; i < res; i++) {
+		SocketDatagram& m = msgs[i];
+		m.length = hdr[i].msg_len;
+		const struct sockaddr* a = 0;
+		socklen_t alen = 0;
+		if (m.addr) {
+		    a = (const struct sockaddr*)&addr[i];
+		    alen = hdr[i].msg_hdr.msg_namelen;
+		    m.addr->assign(a,alen);
+		}
+		if (applyFilters(m.buffer,m.length,flags,a,alen))
+		    m.length = socketError();
+	    }
+	    return res;
+	}
+	s_mmsg = false;
+    }
+#endif
+    unsigned int n = 0;
+    for (; n < count; n++) {
+	SocketDatagram& m = msgs[n];
+	char buf[MAX_SOCKLEN];
+	socklen_t alen = sizeof(buf);
+	struct sockaddr* a = m.addr ? (struct sockaddr*)buf : 0;
+	int res = ::recvfrom(m_handle,(char*)m.buffer,(m.buffer ? m.size : 0),flags,a,(a ? &alen : 0));
+	if (!checkError(res,true))
+	    return n ? (int)n : socketError();
+	if (a)
+	    m.addr->assign(a,alen);
+	else
+	    alen = 0;
+	m.length = applyFilters(m.buffer,res,flags,a,alen) ? socketError() : res;
+    }
+    return n;
+}
+
 int Socket::recv(void* buffer, int length, int flags)
 {
     if (!buffer)
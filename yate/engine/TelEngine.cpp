@@ -188,6 +188,338 @@ static bool reentered()
     return (Thread::current() == s_thr);
 }
 
+// Maximum size of a block of lines written at once by the asynchronous writer
+#define ASYNC_BATCH_SIZE 65536
+
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+#define DBG_CAS(ptr,oldVal,newVal) \
+    (InterlockedCompareExchange((LONG*)(ptr),(LONG)(newVal),(LONG)(oldVal)) == (LONG)(oldVal))
+#define DBG_ADD(ptr,val) InterlockedExchangeAdd((LONG*)(ptr),(LONG)(val))
+#define DBG_BARRIER() MemoryBarrier()
+#else
+#define DBG_CAS(ptr,oldVal,newVal) __sync_bool_compare_and_swap(ptr,oldVal,newVal)
+#define DBG_ADD(ptr,val) __sync_fetch_and_add(ptr,val)
+#define DBG_BARRIER() __sync_synchronize()
+#endif
+#else
+static Mutex s_asyncCount(false,"DebugAsyncCount");
+
+static inline int dbgAdd(volatile int* ptr, int val)
+{
+    Lock lock(s_asyncCount);
+    int tmp = *ptr;
+    *ptr += val;
+    return tmp;
+}
+
+#define DBG_ADD(ptr,val) dbgAdd(ptr,val)
+#define DBG_BARRIER()
+#endif
+
+// Bounded multiple producer / single consumer queue of output lines
+// Lock free if atomic operations are available
+class DebugQueue
+{
+public:
+    DebugQueue(unsigned int size, bool block);
+    ~DebugQueue();
+    bool push(int level, const char* buf, unsigned int len);
+    char* pop(int& level);
+    inline unsigned int size() const
+	{ return m_mask + 1; }
+    inline bool block() const
+	{ return m_block; }
+    inline void wake()
+	{ if (m_idle) { m_idle = false; m_wakeup.unlock(); } }
+    void wait(long maxwait);
+private:
+    struct Cell {
+	volatile unsigned int seq;
+	int level;
+	char* line;
+    };
+    Cell* m_cells;
+    unsigned int m_mask;
+    volatile unsigned int m_head;
+    unsigned int m_tail;
+    bool m_block;
+    volatile bool m_idle;
+    Semaphore m_wakeup;
+#ifndef ATOMIC_OPS
+    Mutex m_mutex;
+#endif
+};
+
+// Thread writing the lines of the asynchronous output queue
+class DebugWriter : public Thread
+{
+public:
+    inline DebugWriter(DebugQueue* queue)
+	: Thread("DebugWriter"), m_queue(queue), m_stop(false)
+	{ }
+    virtual ~DebugWriter();
+    virtual void run();
+    inline void stop()
+	{ m_stop = true; m_queue->wake(); }
+private:
+    DebugQueue* m_queue;
+    volatile bool m_stop;
+};
+
+static Mutex s_asyncMux(false,"DebugAsync");
+static DebugQueue* volatile s_async = 0;
+static DebugWriter* volatile s_asyncWriter = 0;
+static volatile int s_asyncUsers = 0;
+static volatile int s_asyncDropped = 0;
+static int s_asyncReported = 0;
+
+DebugQueue::DebugQueue(unsigned int size, bool block)
+    : m_cells(0), m_mask(0), m_head(0), m_tail(0),
+      m_block(block), m_idle(false), m_wakeup(1,"DebugWriter",0)
+#ifndef ATOMIC_OPS
+      , m_mutex(false,"DebugQueue")
+#endif
+{
+    // round up size to a power of 2
+    unsigned int n = 2;
+    while (n < size && n < 0x100000)
+	n <<= 1;
+    m_mask = n - 1;
+    m_cells = new Cell[n];
+    for (unsigned int i = 0; i < n; i++) {
+	m_cells[i].seq = i;
+	m_cells[i].level = 0;
+	m_cells[i].line = 0;
+    }
+}
+
+DebugQueue::~DebugQueue()
+{
+    int level;
+    while (char* line = pop(level))
+	::free(line);
+    delete[] m_cells;
+}
+
+// The line was formatted in a stack buffer of the calling thread, copy it so
+//  the caller can return at once. Buffers owned by the producing threads would
+//  have to be handed back by the writer and outlive threads exiting with lines
+//  still queued, including threads not created through the Thread class
+bool DebugQueue::push(int level, const char* buf, unsigned int len)
+{
+    char* line = (char*)::malloc(len + 1);
+    if (!line)
+	return false;
+    ::memcpy(line,buf,len);
+    line[len] = '\0';
+#ifdef ATOMIC_OPS
+    unsigned int pos = m_head;
+    Cell* cell = 0;
+    for (;;) {
+	cell = &m_cells[pos & m_mask];
+	DBG_BARRIER();
+	int diff = (int)(cell->seq - pos);
+	if (!diff) {
+	    if (DBG_CAS(&m_head,pos,pos + 1))
+		break;
+	}
+	else if (diff < 0) {
+	    ::free(line);
+	    return false;
+	}
+	pos = m_head;
+    }
+    cell->level = level;
+    cell->line = line;
+    DBG_BARRIER();
+    cell->seq = pos + 1;
+#else
+    Lock lock(m_mutex);
+    if (m_head - m_tail > m_mask) {
+	::free(line);
+	return false;
+    }
+    Cell& cell = m_cells[m_head++ & m_mask];
+    cell.level = level;
+    cell.line = line;
+#endif
+    return true;
+}
+
+// Only the writer thread, or the caller that stopped it, retrieves lines
+char* DebugQueue::pop(int& level)
+{
+#ifdef ATOMIC_OPS
+    Cell* cell = &m_cells[m_tail & m_mask];
+    DBG_BARRIER();
+    if ((int)(cell->seq - (m_tail + 1)) < 0)
+	return 0;
+    char* line = cell->line;
+    level = cell->level;
+    cell->line = 0;
+    DBG_BARRIER();
+    cell->seq = m_tail + m_mask + 1;
+    m_tail++;
+    return line;
+#else
+    Lock lock(m_mutex);
+    if (m_head == m_tail)
+	return 0;
+    Cell& cell = m_cells[m_tail++ & m_mask];
+    level = cell.level;
+    char* line = cell.line;
+    cell.line = 0;
+    return line;
+#endif
+}
+
+void DebugQueue::wait(long maxwait)
+{
+    m_idle = true;
+    DBG_BARRIER();
+    // a line pushed before we became idle would not wake us up
+    if (m_head == m_tail)
+	m_wakeup.lock(maxwait);
+    m_idle = false;
+}
+
+// Process one output line that already ends in a newline
+// Lines going to the standard error are collected in a batch buffer if provided
+static void async_line(int level, char* line, char* batch, unsigned int& len)
+{
+    unsigned int n = ::strlen(line);
+    if (CapturedEvent::capturing()) {
+	line[n-1] = '\0';
+	bool save = s_debugging;
+	s_debugging = false;
+	CapturedEvent::append(level,line);
+	s_debugging = save;
+	line[n-1] = '\n';
+    }
+    if (batch && (s_output == dbg_stderr_func)) {
+	if (len + n > ASYNC_BATCH_SIZE) {
+	    YIGNORE(::write(2,batch,len));
+	    len = 0;
+	}
+	if (n > ASYNC_BATCH_SIZE) {
+	    YIGNORE(::write(2,line,n));
+	}
+	else {
+	    ::memcpy(batch + len,line,n);
+	    len += n;
+	}
+    }
+    else if (s_output)
+	s_output(line,level);
+    if (s_intout)
+	s_intout(line,level);
+}
+
+// Write out queued lines, return how many were processed
+static unsigned int async_flush(DebugQueue* queue, char* batch)
+{
+    unsigned int count = 0;
+    unsigned int len = 0;
+    int level = 0;
+    out_mux.lock();
+    s_thr = Thread::current();
+    // don't keep the output locked for too long, setOutput() may wait
+    while (count < 1024) {
+	char* line = queue->pop(level);
+	if (!line)
+	    break;
+	count++;
+	async_line(level,line,batch,len);
+	::free(line);
+    }
+    int dropped = s_asyncDropped - s_asyncReported;
+    if (dropped) {
+	s_asyncReported += dropped;
+	char buf[80];
+	::snprintf(buf,sizeof(buf),"<%s> Asynchronous output dropped %d lines\n",
+	    s_levels[DebugWarn],dropped);
+	async_line(DebugWarn,buf,batch,len);
+    }
+    if (len) {
+	YIGNORE(::write(2,batch,len));
+    }
+    s_thr = 0;
+    out_mux.unlock();
+    return count;
+}
+
+// Try to queue an output line, return false if synchronous output must be used
+// A line dropped from a full queue still goes synchronously to the output hook
+//  and capture, only writing it to the log is skipped
+static bool async_push(int level, const char* buf, unsigned int len, bool& dropped)
+{
+    if (!s_async)
+	return false;
+    bool queued = false;
+    DBG_ADD(&s_asyncUsers,1);
+    DebugQueue* queue = s_async;
+    if (queue) {
+	queued = true;
+	while (!queue->push(level,buf,len)) {
+	    if (!(queue->block() && s_asyncWriter)) {
+		DBG_ADD(&s_asyncDropped,1);
+		queued = false;
+		dropped = true;
+		break;
+	    }
+	    queue->wake();
+	    Thread::yield();
+	}
+	queue->wake();
+    }
+    DBG_ADD(&s_asyncUsers,-1);
+    return queued;
+}
+
+// Stop the writer and write out any lines left in queue
+// Must be called with s_asyncMux locked
+static void async_stop()
+{
+    DebugQueue* queue = s_async;
+    if (!queue)
+	return;
+    s_async = 0;
+    DBG_BARRIER();
+    // wait for callers that still push into queue
+    while (s_asyncUsers)
+	Thread::yield();
+    DebugWriter* writer = s_asyncWriter;
+    if (writer) {
+	writer->stop();
+	while (s_asyncWriter)
+	    Thread::idle();
+    }
+    while (async_flush(queue,0))
+	;
+    delete queue;
+}
+
+DebugWriter::~DebugWriter()
+{
+    s_asyncWriter = 0;
+}
+
+void DebugWriter::run()
+{
+    char* batch = (char*)::malloc(ASYNC_BATCH_SIZE);
+    for (;;) {
+	// lines pushed before the stop request must still be written
+	bool stop = m_stop;
+	if (async_flush(m_queue,batch))
+	    continue;
+	if (stop)
+	    break;
+	m_queue->wait(100000);
+    }
+    ::free(batch);
+}
+
 static void common_output(int level,char* buf)
 {
     if (level < -1)
@@ -197,6 +529,12 @@ static void common_output(int level,char* buf)
     int n = ::strlen(buf);
     if (n && (buf[n-1] == '\n'))
 	n--;
+    buf[n] = '\n';
+    bool dropped = false;
+    if (async_push(level,buf,n+1,dropped)) {
+	buf[n] = '\0';
+	return;
+    }
     // serialize the output strings
     out_mux.lock();
     // TODO: detect reentrant calls from foreign threads and main thread
@@ -210,7 +548,7 @@ static void common_output(int level,char* buf)
     }
     buf[n] = '\n';
     buf[n+1] = '\0';
-    if (s_output)
+    if (s_output && !dropped)
 	s_output(buf,level);
     if (s_intout)
 	s_intout(buf,level);
@@ -584,6 +922,36 @@ void Debugger::setIntOut(void (*outFunc)(const char*,int))
     out_mux.unlock();
 }
 
+bool Debugger::setAsyncOutput(unsigned int size, bool block)
+{
+    Lock lock(s_asyncMux);
+    async_stop();
+    if (!size)
+	return true;
+    DebugQueue* queue = new DebugQueue(size,block);
+    DebugWriter* writer = new DebugWriter(queue);
+    s_asyncWriter = writer;
+    if (!writer->startup()) {
+	s_asyncWriter = 0;
+	delete writer;
+	delete queue;
+	return false;
+    }
+    s_async = queue;
+    return true;
+}
+
+unsigned int Debugger::asyncOutput()
+{
+    Lock lock(s_asyncMux);
+    return s_async ? s_async->size() : 0;
+}
+
+unsigned int Debugger::asyncDropped()
+{
+    return s_asyncDropped;
+}
+
 void Debugger::setAlarmHook(void (*alarmFunc)(const char*,int,const char*,const char*))
 {
     s_alarms = alarmFunc;
@@ -82,7 +82,7 @@ bool ChanAssistList::received(Message& msg, int id)
 void ChanAssistList::removeAssist(ChanAssist* assist)
 {
     lock();
-    m_calls.remove(assist,false);
+    m_calls.remove(assist,false,true);
     unlock();
 }
 
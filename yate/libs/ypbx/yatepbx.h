@@ -287,7 +287,7 @@ protected:
      */
     inline ChanAssistList(const char* name, bool earlyInit = false)
 	: Module(name, "misc", earlyInit), m_first(true)
-	{ }
+	{ m_calls.autoResize(); }
 
     /**
      * Removes an assistant object from list
@@ -628,6 +628,9 @@ bool UDPSession::initGroup(int msec, Thread::Priority prio)
     // try to pick the grop from the transport if it has one
     if (m_transport)
 	group(m_transport->group());
+    // use one of the shared groups if they are enabled
+    if (!m_group)
+	group(RTPGroup::shared());
     if (!m_group)
 	group(new RTPGroup(msec,prio));
     if (!m_group)
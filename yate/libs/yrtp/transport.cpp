@@ -20,12 +20,33 @@
 
 #include <yatertp.h>
 
+#include <string.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#define RTP_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
 #define BUF_SIZE 1500
+// Maximum number of packets read or sent in one socket operation
+#define RECV_BATCH 8
+// Maximum number of socket events handled in one group loop
+#define EVENTS_BATCH 256
+// Maximum number of shared RTP groups
+#define MAX_SHARED 64
 
 using namespace TelEngine;
 
 static unsigned long s_sleep = 5;
 
+static Mutex s_sharedMutex(false,"RTPShared");
+static RTPGroup* s_shared[MAX_SHARED];
+static unsigned int s_sharedCount = 0;
+static int s_sharedSleep = 5;
+static Thread::Priority s_sharedPrio = Thread::Normal;
+
 // Set IPv6 sin6_scope_id for remote addresses from local address
 // recvFrom() will set the sin6_scope_id of the remote socket address
 // This will avoid socket address comparison mismatch (same address, different scope id)
@@ -42,21 +63,40 @@ static inline void setScopeId(const SocketAddr& local, SocketAddr& sa1,
 }
 
 
-RTPGroup::RTPGroup(int msec, Priority prio)
+RTPGroup::RTPGroup(int msec, Priority prio, bool event)
     : Mutex(true,"RTPGroup"),
-      Thread("RTP Group",prio), m_listChanged(false)
+      Thread("RTP Group",prio), m_listChanged(false), m_shared(false), m_poll(-1)
 {
-    DDebug(DebugInfo,"RTPGroup::RTPGroup() [%p]",this);
+    DDebug(DebugInfo,"RTPGroup::RTPGroup(%d,%d,%s) [%p]",
+	msec,prio,String::boolText(event),this);
     if (msec < 1)
 	msec = 1;
     if (msec > 50)
 	msec = 50;
     m_sleep = msec;
+#ifdef RTP_EPOLL
+    if (event) {
+	m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_poll < 0)
+	    Debug(DebugWarn,"RTPGroup failed to create event poller: %d %s [%p]",
+		errno,::strerror(errno),this);
+    }
+#endif
 }
 
 RTPGroup::~RTPGroup()
 {
     DDebug(DebugInfo,"RTPGroup::~RTPGroup() [%p]",this);
+    if (m_shared) {
+	Lock lck(s_sharedMutex);
+	for (unsigned int i = 0; i < MAX_SHARED; i++)
+	    if (s_shared[i] == this)
+		s_shared[i] = 0;
+    }
+#ifdef RTP_EPOLL
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
 }
 
 void RTPGroup::cleanup()
@@ -81,31 +121,125 @@ void RTPGroup::cleanup()
 void RTPGroup::run()
 {
     DDebug(DebugInfo,"RTPGroup::run() [%p]",this);
+    if (eventDriven())
+	runEvents();
+    else
+	runPolling();
+    DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+}
+
+// Call the timer tick of all processors, return true if there were any
+// Must be called with the group locked
+bool RTPGroup::tickAll(const Time& when)
+{
+    bool ok = false;
+    m_listChanged = false;
+    for (ObjList* l = &m_processors; l; l = l->next()) {
+	RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
+	if (p) {
+	    ok = true;
+	    p->timerTick(when);
+	    // the list is protected from other threads but can be changed
+	    //  from this one so if it happened we just break out and try
+	    //  again later rather than using an expensive ListIterator
+	    if (m_listChanged)
+		break;
+	}
+    }
+    return ok;
+}
+
+void RTPGroup::runPolling()
+{
+    // shared groups keep running even without processors
     bool ok = true;
-    while (ok) {
+    while (ok || m_shared) {
 	unsigned long msec = m_sleep;
 	if (msec < s_sleep)
 	    msec = s_sleep;
 	lock();
 	Time t;
-	ObjList* l = &m_processors;
-	m_listChanged = false;
-	for (ok = false;l;l = l->next()) {
-	    RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
-	    if (p) {
-		ok = true;
-		p->timerTick(t);
-		// the list is protected from other threads but can be changed
-		//  from this one so if it happened we just break out and try
-		//  again later rather than using an expensive ListIterator
-		if (m_listChanged)
-		    break;
+	ok = tickAll(t);
+	unlock();
+	Thread::msleep(msec,true);
+    }
+}
+
+void RTPGroup::runEvents()
+{
+#ifdef RTP_EPOLL
+    struct epoll_event ev[EVENTS_BATCH];
+    u_int64_t tick = 0;
+    bool ok = true;
+    while (ok || m_shared) {
+	unsigned long msec = m_sleep;
+	if (msec < s_sleep)
+	    msec = s_sleep;
+	int tout = 0;
+	u_int64_t now = Time::now();
+	if (tick > now)
+	    tout = (int)((tick - now + 999) / 1000);
+	int n = ::epoll_wait(m_poll,ev,EVENTS_BATCH,tout);
+	if (n < 0) {
+	    if (errno != EINTR) {
+		Debug(DebugWarn,"RTPGroup event wait failed: %d %s [%p]",
+		    errno,::strerror(errno),this);
+		Thread::msleep(msec);
 	    }
+	    n = 0;
+	}
+	lock();
+	Time t;
+	for (int i = 0; i < n; i++) {
+	    RTPProcessor* p = (RTPProcessor*)(uintptr_t)(ev[i].data.u64 & ~(u_int64_t)1);
+	    // processors may have left since the wait started, verify them
+	    if (m_listChanged && !m_processors.find(p))
+		continue;
+	    p->readReady(t,(ev[i].data.u64 & 1) != 0);
 	}
+	if (t >= tick) {
+	    ok = tickAll(t);
+	    tick = t + 1000 * (u_int64_t)msec;
+	}
+	else
+	    ok = (0 != m_processors.skipNull());
 	unlock();
-	Thread::msleep(msec,true);
+	Thread::check();
     }
-    DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+#endif
+}
+
+// Add or remove the sockets of a processor to the event poller
+// Must be called with the group locked
+void RTPGroup::watch(RTPProcessor* proc, bool add)
+{
+#ifdef RTP_EPOLL
+    if (m_poll < 0)
+	return;
+    SOCKET socks[2] = { Socket::invalidHandle(), Socket::invalidHandle() };
+    proc->getSockets(socks[0],socks[1]);
+    // nothing to wait on yet, keep polling until update() is called
+    bool ok = add && ((socks[0] != Socket::invalidHandle()) || (socks[1] != Socket::invalidHandle()));
+    for (unsigned int i = 0; i < 2; i++) {
+	if (socks[i] == Socket::invalidHandle())
+	    continue;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	// the low bit of the aligned pointer tells RTCP from RTP
+	ev.data.u64 = (u_int64_t)(uintptr_t)proc | i;
+	if (add) {
+	    if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,socks[i],&ev) && (errno != EEXIST)) {
+		Debug(DebugWarn,"RTPGroup failed to watch socket %d: %d %s [%p]",
+		    socks[i],errno,::strerror(errno),this);
+		ok = false;
+	    }
+	}
+	else
+	    ::epoll_ctl(m_poll,EPOLL_CTL_DEL,socks[i],&ev);
+    }
+    // fall back to polling in timerTick() if any socket is not watched
+    proc->m_watched = ok;
+#endif
 }
 
 void RTPGroup::join(RTPProcessor* proc)
@@ -114,6 +248,7 @@ void RTPGroup::join(RTPProcessor* proc)
     lock();
     m_listChanged = true;
     m_processors.append(proc)->setDelete(false);
+    watch(proc,true);
     startup();
     unlock();
 }
@@ -123,10 +258,18 @@ void RTPGroup::part(RTPProcessor* proc)
     DDebug(DebugAll,"RTPGroup::part(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
-    m_processors.remove(proc,false);
+    if (m_processors.remove(proc,false))
+	watch(proc,false);
     unlock();
 }
 
+void RTPGroup::update(RTPProcessor* proc)
+{
+    Lock lck(this);
+    if (m_processors.find(proc))
+	watch(proc,true);
+}
+
 void RTPGroup::setMinSleep(int msec)
 {
     if (msec < 1)
@@ -136,9 +279,46 @@ void RTPGroup::setMinSleep(int msec)
     s_sleep = msec;
 }
 
+void RTPGroup::setShared(unsigned int count, int msec, Priority prio)
+{
+    if (count > MAX_SHARED)
+	count = MAX_SHARED;
+    Lock lck(s_sharedMutex);
+    s_sharedCount = count;
+    s_sharedSleep = msec;
+    s_sharedPrio = prio;
+}
+
+RTPGroup* RTPGroup::shared()
+{
+    Lock lck(s_sharedMutex);
+    RTPGroup* grp = 0;
+    unsigned int load = 0;
+    for (unsigned int i = 0; i < s_sharedCount; i++) {
+	RTPGroup* g = s_shared[i];
+	if (!g) {
+	    g = new RTPGroup(s_sharedSleep,s_sharedPrio,true);
+	    g->m_shared = true;
+	    if (!g->startup()) {
+		delete g;
+		continue;
+	    }
+	    s_shared[i] = g;
+	}
+	g->lock();
+	unsigned int n = g->m_processors.count();
+	g->unlock();
+	if (grp && (n >= load))
+	    continue;
+	grp = g;
+	load = n;
+    }
+    return grp;
+}
+
 
 RTPProcessor::RTPProcessor()
-    : m_wrongSrc(0), m_group(0)
+    : m_wrongSrc(0), m_group(0), m_watched(false)
 {
     DDebug(DebugAll,"RTPProcessor::RTPProcessor() [%p]",this);
 }
@@ -173,6 +353,28 @@ void RTPProcessor::getStats(String& stats) const
 {
 }
 
+void RTPProcessor::rtpBatch(const SocketDatagram* msgs, unsigned int count)
+{
+    for (; count--; msgs++)
+	if (msgs->length >= 0)
+	    rtpData(msgs->buffer,msgs->length);
+}
+
+void RTPProcessor::rtcpBatch(const SocketDatagram* msgs, unsigned int count)
+{
+    for (; count--; msgs++)
+	if (msgs->length >= 0)
+	    rtcpData(msgs->buffer,msgs->length);
+}
+
+void RTPProcessor::getSockets(SOCKET& rtp, SOCKET& rtcp) const
+{
+}
+
+void RTPProcessor::readReady(const Time& when, bool rtcp)
+{
+}
+
 
 RTPTransport::RTPTransport(RTPTransport::Type type)
     : RTPProcessor(),
@@ -204,17 +406,69 @@ void RTPTransport::destruct()
 void RTPTransport::timerTick(const Time& when)
 {
     XDebug(DebugAll,"RTPTransport::timerTick() group=%p [%p]",group(),this);
+    // event driven groups call readReady() only when there is data to read
+    bool poll = !watched();
     if (m_rtpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while ((len = m_rtpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTP)) > 0) {
+	if (poll)
+	    rtpReceive();
+	m_rtpSock.timerTick(when);
+    }
+    if (m_rtcpSock.valid()) {
+	if (poll)
+	    rtcpReceive();
+	m_rtcpSock.timerTick(when);
+    }
+}
+
+void RTPTransport::getSockets(SOCKET& rtp, SOCKET& rtcp) const
+{
+    rtp = m_rtpSock.handle();
+    rtcp = m_rtcpSock.handle();
+}
+
+void RTPTransport::readReady(const Time& when, bool rtcp)
+{
+    XDebug(DebugAll,"RTPTransport::readReady(%s) [%p]",String::boolText(rtcp),this);
+    if (rtcp) {
+	if (m_rtcpSock.valid())
+	    rtcpReceive();
+    }
+    else if (m_rtpSock.valid())
+	rtpReceive();
+}
+
+// Prepare an array of datagrams for receiving into buffers of BUF_SIZE
+static inline void setBuffers(SocketDatagram* msgs, char (*buf)[BUF_SIZE], SocketAddr* addr)
+{
+    for (unsigned int i = 0; i < RECV_BATCH; i++) {
+	msgs[i].buffer = buf[i];
+	msgs[i].size = BUF_SIZE;
+	msgs[i].length = 0;
+	msgs[i].addr = &addr[i];
+    }
+}
+
+// Read and dispatch all RTP or UDPTL packets waiting in the socket
+void RTPTransport::rtpReceive()
+{
+    char buf[RECV_BATCH][BUF_SIZE];
+    SocketAddr addr[RECV_BATCH];
+    SocketDatagram msgs[RECV_BATCH];
+    SocketDatagram fwd[RECV_BATCH];
+    setBuffers(msgs,buf,addr);
+    int n;
+    do {
+	n = m_rtpSock.recvBatch(msgs,RECV_BATCH);
+	unsigned int f = 0;
+	for (int i = 0; i < n; i++) {
+	    int len = msgs[i].length;
 	    XDebug(DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
-		m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port(),len,this);
+		addr[i].host().c_str(),addr[i].port(),len,this);
 	    switch (m_type) {
 		case RTP:
 		    if (len < 12)
 			continue;
-		    if (((unsigned char)buf[0] & 0xc0) != 0x80)
+		    if (((unsigned char)buf[i][0] & 0xc0) != 0x80)
 			continue;
 		    break;
 		case UDPTL:
@@ -222,47 +476,65 @@ void RTPTransport::timerTick(const Time& when)
 			continue;
 		    break;
 		default:
+		    if (len < 0)
+			continue;
 		    break;
 	    }
 	    if (!m_remoteAddr.valid())
 		continue;
 	    // looks like it's RTP or UDPTL, at least by length and version
 	    bool preferred = false;
-	    if ((m_autoRemote || (preferred = (m_rxAddrRTP == m_remotePref))) && (m_rxAddrRTP != m_remoteAddr)) {
+	    if ((m_autoRemote || (preferred = (addr[i] == m_remotePref))) && (addr[i] != m_remoteAddr)) {
 		Debug(DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
 		    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
 		    (preferred ? " preferred" : ""),
-		    m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port());
+		    addr[i].host().c_str(),addr[i].port());
 		// if we received from the preferred address don't auto change any more
 		if (preferred)
 		    m_remotePref.clear();
-		remoteAddr(m_rxAddrRTP);
+		remoteAddr(addr[i]);
 	    }
 	    m_autoRemote = false;
-	    if (m_rxAddrRTP == m_remoteAddr) {
-		if (m_processor)
-		    m_processor->rtpData(buf,len);
-		if (m_monitor)
-		    m_monitor->rtpData(buf,len);
-	    }
+	    if (addr[i] == m_remoteAddr)
+		fwd[f++] = msgs[i];
 	    else if (m_processor)
 		m_processor->incWrongSrc();
 	}
-	m_rtpSock.timerTick(when);
-    }
-    if (m_rtcpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
+	if (!f)
+	    continue;
+	if (m_processor)
+	    m_processor->rtpBatch(fwd,f);
+	if (m_monitor)
+	    m_monitor->rtpBatch(fwd,f);
+    } while (n == RECV_BATCH);
+}
+
+// Read and dispatch all RTCP packets waiting in the socket
+void RTPTransport::rtcpReceive()
+{
+    char buf[RECV_BATCH][BUF_SIZE];
+    SocketAddr addr[RECV_BATCH];
+    SocketDatagram msgs[RECV_BATCH];
+    SocketDatagram fwd[RECV_BATCH];
+    setBuffers(msgs,buf,addr);
+    int n;
+    do {
+	n = m_rtcpSock.recvBatch(msgs,RECV_BATCH);
+	unsigned int f = 0;
+	for (int i = 0; i < n; i++) {
+	    if ((msgs[i].length < 8) || (addr[i] != m_remoteRTCP))
+		continue;
 	    XDebug(DebugAll,"RTCP from '%s:%d' length %d [%p]",
-		m_rxAddrRTCP.host().c_str(),m_rxAddrRTCP.port(),len,this);
-	    if (m_processor)
-		m_processor->rtcpData(buf,len);
-	    if (m_monitor)
-		m_monitor->rtcpData(buf,len);
+		addr[i].host().c_str(),addr[i].port(),msgs[i].length,this);
+	    fwd[f++] = msgs[i];
 	}
-	m_rtcpSock.timerTick(when);
-    }
+	if (!f)
+	    continue;
+	if (m_processor)
+	    m_processor->rtcpBatch(fwd,f);
+	if (m_monitor)
+	    m_monitor->rtcpBatch(fwd,f);
+    } while (n == RECV_BATCH);
 }
 
 // Send data to remote party
@@ -298,6 +570,51 @@ static bool sendData(Socket& sock, const SocketAddr& to, const void* data, int l
     return wr == len;
 }
 
+// Send a batch of packets to remote party, skip those shorter than minLen
+// Put a debug message on failure
+static void sendBatch(Socket& sock, SocketAddr& to, const SocketDatagram* msgs,
+    unsigned int count, int minLen, const char* what, bool& flag)
+{
+    if (!sock.valid())
+	return;
+    if (!to.valid()) {
+	if (flag) {
+	    flag = false;
+	    SocketAddr local;
+	    sock.getSockName(local);
+	    Debug(DebugNote,"%s send failed (local=%s): invalid remote address",
+		what,local.addr().c_str());
+	}
+	return;
+    }
+    SocketDatagram out[RECV_BATCH];
+    while (count) {
+	unsigned int n = 0;
+	for (; count && (n < RECV_BATCH); msgs++, count--) {
+	    if ((msgs->length < minLen) || !msgs->buffer)
+		continue;
+	    out[n].buffer = msgs->buffer;
+	    out[n].size = msgs->length;
+	    out[n].length = 0;
+	    out[n].addr = &to;
+	    n++;
+	}
+	if (!n)
+	    break;
+	if (sock.sendBatch(out,n) == Socket::socketError() && flag && !sock.canRetry()) {
+	    flag = false;
+	    // Retrieve the error before calling getSockName() to avoid reset
+	    String s;
+	    int e = sock.error();
+	    Thread::errorString(s,e);
+	    SocketAddr local;
+	    sock.getSockName(local);
+	    Debug(DebugNote,"%s send failed (local=%s remote=%s): %d %s",
+		what,local.addr().c_str(),to.addr().c_str(),e,s.c_str());
+	}
+    }
+}
+
 void RTPTransport::rtpData(const void* data, int len)
 {
     if (!data)
@@ -324,6 +641,30 @@ void RTPTransport::rtcpData(const void* data, int len)
     sendData(m_rtcpSock,m_remoteRTCP,data,len,"RTCP",m_warnSendErrorRtcp);
 }
 
+void RTPTransport::rtpBatch(const SocketDatagram* msgs, unsigned int count)
+{
+    if (!(msgs && count))
+	return;
+    int minLen = 0;
+    switch (m_type) {
+	case RTP:
+	    minLen = 12;
+	    break;
+	case UDPTL:
+	    minLen = 6;
+	    break;
+	default:
+	    break;
+    }
+    sendBatch(m_rtpSock,m_remoteAddr,msgs,count,minLen,"RTP",m_warnSendErrorRtp);
+}
+
+void RTPTransport::rtcpBatch(const SocketDatagram* msgs, unsigned int count)
+{
+    if (msgs && count)
+	sendBatch(m_rtcpSock,m_remoteRTCP,msgs,count,8,"RTCP",m_warnSendErrorRtcp);
+}
+
 void RTPTransport::setProcessor(RTPProcessor* processor)
 {
     if (processor) {
@@ -359,6 +700,8 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    m_rtpSock.getSockName(addr);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remotePref);
+	    if (group())
+		group()->update(this);
 	    return true;
 	}
 	if (!p) {
@@ -372,6 +715,8 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 		    m_rtpSock.setBlocking(false);
 		    m_localAddr = addr;
 		    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+		    if (group())
+			group()->update(this);
 		    return true;
 		}
 		DDebug(DebugMild,"RTP Socket failed with code %d",m_rtpSock.error());
@@ -386,6 +731,8 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    addr.port(p);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+	    if (group())
+		group()->update(this);
 	    return true;
 	}
 #ifdef DEBUG
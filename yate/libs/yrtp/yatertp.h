@@ -96,6 +96,22 @@ public:
      */
     virtual void rtcpData(const void* data, int len);
 
+    /**
+     * This method is called to send or process several RTP packets at once.
+     * The default implementation calls rtpData() for each of them
+     * @param msgs Array of datagrams holding raw RTP data in buffer and length
+     * @param count Number of datagrams in the array
+     */
+    virtual void rtpBatch(const SocketDatagram* msgs, unsigned int count);
+
+    /**
+     * This method is called to send or process several RTCP packets at once.
+     * The default implementation calls rtcpData() for each of them
+     * @param msgs Array of datagrams holding raw RTCP data in buffer and length
+     * @param count Number of datagrams in the array
+     */
+    virtual void rtcpBatch(const SocketDatagram* msgs, unsigned int count);
+
     /**
      * Retrieve MGCP P: style comma separated session parameters
      * @param stats String to append parameters to
@@ -128,10 +144,32 @@ protected:
      */
     virtual void timerTick(const Time& when) = 0;
 
+    /**
+     * Retrieve the sockets an event driven group should wait on for data
+     * @param rtp Set to the handle of the RTP socket, if any
+     * @param rtcp Set to the handle of the RTCP socket, if any
+     */
+    virtual void getSockets(SOCKET& rtp, SOCKET& rtcp) const;
+
+    /**
+     * Method called by event driven groups when a socket has data to read
+     * @param when Time to use as base in all computing
+     * @param rtcp True if the RTCP socket is readable, false for the RTP one
+     */
+    virtual void readReady(const Time& when, bool rtcp);
+
+    /**
+     * Check if an event driven group waits for data on the sockets
+     * @return True if the sockets need not be polled in timerTick()
+     */
+    inline bool watched() const
+	{ return m_watched; }
+
     unsigned int m_wrongSrc;
 
 private:
     RTPGroup* m_group;
+    bool m_watched;
 };
 
 /**
@@ -148,8 +186,10 @@ public:
      * Constructor
      * @param msec Minimum time to sleep in loop in milliseconds
      * @param prio Thread priority to run this group
+     * @param event Wait for socket events instead of polling, timer ticks are
+     *  still delivered every msec. Polling is used if events are not supported
      */
-    RTPGroup(int msec = 0, Priority prio = Normal);
+    RTPGroup(int msec = 0, Priority prio = Normal, bool event = false);
 
     /**
      * Group destructor, removes itself from all remaining processors
@@ -184,10 +224,44 @@ public:
      */
     void part(RTPProcessor* proc);
 
+    /**
+     * Update the sockets watched for a processor after they were created
+     * @param proc Pointer to a RTP processor member of this group
+     */
+    void update(RTPProcessor* proc);
+
+    /**
+     * Check if this group waits for socket events instead of polling
+     * @return True if the group is event driven
+     */
+    inline bool eventDriven() const
+	{ return m_poll >= 0; }
+
+    /**
+     * Set up the pool of shared groups returned by shared()
+     * Lowering the count leaves the extra groups running with their processors
+     * @param count Number of shared groups, 0 to disable sharing
+     * @param msec Timer tick interval of new shared groups in milliseconds
+     * @param prio Thread priority of new shared groups
+     */
+    static void setShared(unsigned int count, int msec = 5, Priority prio = Normal);
+
+    /**
+     * Get the least loaded of the shared event driven groups
+     * @return Pointer to a shared group, NULL if sharing is disabled
+     */
+    static RTPGroup* shared();
+
 private:
+    void runPolling();
+    void runEvents();
+    bool tickAll(const Time& when);
+    void watch(RTPProcessor* proc, bool add);
     ObjList m_processors;
     bool m_listChanged;
+    bool m_shared;
     unsigned long m_sleep;
+    int m_poll;
 };
 
 /**
@@ -329,7 +403,37 @@ protected:
      */
     virtual void rtcpData(const void* data, int len);
 
+    /**
+     * This method is called to send several RTP packets with one system call
+     * @param msgs Array of datagrams holding raw RTP data in buffer and length
+     * @param count Number of datagrams in the array
+     */
+    virtual void rtpBatch(const SocketDatagram* msgs, unsigned int count);
+
+    /**
+     * This method is called to send several RTCP packets with one system call
+     * @param msgs Array of datagrams holding raw RTCP data in buffer and length
+     * @param count Number of datagrams in the array
+     */
+    virtual void rtcpBatch(const SocketDatagram* msgs, unsigned int count);
+
+    /**
+     * Retrieve the sockets an event driven group should wait on for data
+     * @param rtp Set to the handle of the RTP socket, if any
+     * @param rtcp Set to the handle of the RTCP socket, if any
+     */
+    virtual void getSockets(SOCKET& rtp, SOCKET& rtcp) const;
+
+    /**
+     * Read the data available on a socket signaled by an event driven group
+     * @param when Time to use as base in all computing
+     * @param rtcp True if the RTCP socket is readable, false for the RTP one
+     */
+    virtual void readReady(const Time& when, bool rtcp);
+
 private:
+    void rtpReceive();
+    void rtcpReceive();
     Type m_type;
     RTPProcessor* m_processor;
     RTPProcessor* m_monitor;
@@ -339,8 +443,6 @@ private:
     SocketAddr m_remoteAddr;
     SocketAddr m_remoteRTCP;
     SocketAddr m_remotePref;
-    SocketAddr m_rxAddrRTP;
-    SocketAddr m_rxAddrRTCP;
     bool m_autoRemote;
     bool m_warnSendErrorRtp;
     bool m_warnSendErrorRtcp;
@@ -895,7 +997,8 @@ public:
     bool initTransport();
 
     /**
-     * Initialize the RTP session, attach a group if none is present
+     * Initialize the RTP session, attach a group if none is present.
+     * A shared group is used if enabled, msec and prio are ignored then
      * @param msec Minimum time to sleep in group loop in milliseconds
      * @param prio Thread priority to run the new group
      * @return True if initialized, false on some failure
@@ -21,6 +21,9 @@
 #include "yatescript.h"
 #include <yatengine.h>
 
+#include <stdio.h>
+#include <string.h>
+
 //#define STATS_TRACE "jstrace"
 
 using namespace TelEngine;
@@ -30,6 +33,7 @@ namespace { // anonymous
 class ParseNested;
 class JsRunner;
 class JsCodeStats;
+class JsCompiled;
 
 class JsContext : public JsObject, public Mutex
 {
@@ -48,7 +52,6 @@ public:
     GenObject* resolve(ObjList& stack, String& name, GenObject* context);
     bool runStringFunction(GenObject* obj, const String& name, ObjList& stack, const ExpOperation& oper, GenObject* context);
     bool runStringField(GenObject* obj, const String& name, ObjList& stack, const ExpOperation& oper, GenObject* context);
-private:
     GenObject* resolveTop(ObjList& stack, const String& name, GenObject* context);
 };
 
@@ -101,6 +104,174 @@ struct JsEntry
     unsigned int index;
 };
 
+// Field name of a compiled field operation, split at dots
+class JsPath : public GenObject
+{
+public:
+    inline JsPath(const ExpOperation& oper)
+	: m_oper(oper), m_names(oper.name().split('.',true))
+	{ }
+    virtual ~JsPath()
+	{ TelEngine::destruct(m_names); }
+    inline const ExpOperation& oper() const
+	{ return m_oper; }
+    inline const ObjList* names() const
+	{ return m_names->skipNull(); }
+    inline const String& first() const
+	{ return *static_cast<const String*>(m_names->get()); }
+    bool valid() const;
+private:
+    const ExpOperation& m_oper;
+    ObjList* m_names;
+};
+
+// Value held in a register of a compiled block
+class JsValue : public GenObject
+{
+public:
+    enum Type {
+	Mark,		// block begin marker
+	Ref,		// field reference, static or dynamic
+	Num,		// integer number
+	NaN,		// number that is not an integer
+	Bool,		// boolean
+	Str,		// string
+    };
+    inline JsValue()
+	: type(Mark), number(0), name(&String::empty()), oper(0), path(0), slot(0)
+	{ }
+    inline int64_t valInteger() const
+	{ return (type == Num || type == Bool) ? number : 0; }
+    inline int64_t identity() const
+	{ return (type == Num || type == Bool) ? number : ExpOperation::nonInteger(); }
+    inline int64_t toNumber() const
+	{ return (type == Str) ? str.toInt64(ExpOperation::nonInteger()) : identity(); }
+    inline bool valBoolean() const
+	{ return (type == Str) ? !str.null() : ((type == NaN) || number); }
+    inline bool isNumber() const
+	{ return type != Str; }
+    inline bool isValue() const
+	{ return type > Ref; }
+    inline void setNum(int64_t val)
+	{ type = (val == ExpOperation::nonInteger()) ? NaN : Num; number = val; unnamed(); }
+    inline void setBool(bool val)
+	{ type = Bool; number = val ? 1 : 0; unnamed(); }
+    inline void setStr()
+	{ type = Str; number = 0; unnamed(); }
+    inline void unnamed()
+	{ name = &String::empty(); oper = 0; }
+    const char* text(char* buf, unsigned int len) const;
+    bool sameText(const JsValue& other) const;
+    void copy(const JsValue& other);
+    bool canonical(const String& value, int64_t num, bool isBool, bool isNum);
+    bool assign(const ExpOperation& oper);
+    bool assign(const NamedString& param, const String& newName, bool ownName);
+    ExpOperation* create(const char* newName, bool field = false) const;
+    ExpOperation* materialize() const;
+
+    unsigned char type;
+    int64_t number;
+    const String* name;
+    const ExpOperation* oper;
+    const JsPath* path;
+    unsigned int slot;
+    String str;
+    String own;
+};
+
+// Operation of a compiled block working on registers
+struct JsInstr
+{
+    unsigned char code;
+    int opcode;
+    unsigned int depth;
+    unsigned int index;
+    unsigned int arg;
+    const JsValue* value;
+    const JsPath* path;
+};
+
+// Run of linked operations compiled as a whole
+struct JsBlock
+{
+    unsigned int start;
+    unsigned int end;
+    unsigned int first;
+    unsigned int count;
+    unsigned int depth;
+    unsigned int regs;
+};
+
+// Object holding a field name, valid for one run of compiled code
+struct JsHolder
+{
+    JsObject* object;
+    unsigned int run;
+};
+
+// Straight runs of simple operations compiled to run on registers
+class JsCompiled
+{
+public:
+    enum Instr {
+	IBegin,
+	IConst,
+	IField,
+	IDrop,
+	IDup,
+	IEnd,
+	IFlush,
+	IFlushStack,
+	IBinary,
+	IIdentity,
+	IUnary,
+	IIncDec,
+	IAssign,
+	IAssignOp,
+	IIndex,
+	IFieldOf,
+	IJump,
+	IJumpTrue,
+	IJumpFalse,
+    };
+    JsCompiled(const ObjVector& linked);
+    ~JsCompiled();
+    inline const JsBlock* block(unsigned int index) const
+	{ return (index < m_length) ? m_blockAt[index] : 0; }
+    inline unsigned int blocks() const
+	{ return m_blocks; }
+    inline unsigned int registers() const
+	{ return 2 * m_registers; }
+    inline unsigned int slots() const
+	{ return m_slots; }
+    bool run(const JsBlock& blk, ObjList& stack, JsRunner* runner) const;
+private:
+    bool compile(const ObjVector& linked, unsigned int& index);
+    bool compileOp(const ExpOperation& oper, unsigned int index, bool* marks,
+	unsigned int& depth, bool& last);
+    JsObject* holder(JsRunner* runner, ObjList& stack, const JsValue& ref,
+	ObjList*& list, const String*& last) const;
+    bool fetch(JsRunner* runner, ObjList& stack, JsObject* obj, const String& name,
+	bool ownName, JsValue& val) const;
+    bool load(JsRunner* runner, ObjList& stack, JsValue& val) const;
+    bool store(JsObject* obj, const String& name, const JsValue& val, bool field) const;
+    bool binary(int opcode, JsValue& op1, const JsValue& op2) const;
+    bool flushStack(ObjList& stack) const;
+    void spill(const JsValue* regs, unsigned int count, ObjList& stack) const;
+    unsigned int m_length;
+    const JsBlock** m_blockAt;
+    JsBlock* m_block;
+    unsigned int m_blocks;
+    JsInstr* m_instr;
+    unsigned int m_count;
+    unsigned int m_registers;
+    unsigned int m_slots;
+    ObjList m_values;
+    ObjList m_paths;
+    ObjList m_names;
+};
+
+
 class JsCode : public ScriptCode, public ExpEvaluator
 {
     friend class TelEngine::JsFunction;
@@ -155,7 +326,7 @@ public:
     };
     inline JsCode()
 	: ExpEvaluator(C),
-	  m_pragmas(""), m_label(0), m_depth(0), m_entries(0), m_traceable(false)
+	  m_pragmas(""), m_label(0), m_depth(0), m_entries(0), m_compiled(0), m_traceable(false)
 	{ debugName("JsCode"); }
     ~JsCode();
     virtual void* getObject(const String& name) const
@@ -172,6 +343,7 @@ public:
     virtual bool null() const;
     virtual void dump(String& res, bool loneNo = false) const;
     bool link();
+    unsigned int compileBlocks();
     inline bool traceable() const
 	{ return m_traceable; }
     JsObject* parseArray(ParsePoint& expr, bool constOnly, Mutex* mtx);
@@ -246,6 +418,7 @@ private:
     long int m_label;
     int m_depth;
     JsEntry* m_entries;
+    JsCompiled* m_compiled;
     bool m_traceable;
 };
 
@@ -355,14 +528,15 @@ class JsRunner : public ScriptRun
 {
     YCLASS(JsRunner,ScriptRun)
     friend class JsCode;
+    friend class JsCompiled;
 public:
     inline JsRunner(ScriptCode* code, ScriptContext* context, const char* title)
 	: ScriptRun(code,context),
 	  m_paused(false), m_tracing(false), m_opcode(0), m_index(0),
-	  m_instr(0), m_lastLine(0), m_lastTime(0), m_totalTime(0), m_callInfo(0)
+	  m_instr(0), m_lastLine(0), m_lastTime(0), m_totalTime(0), m_callInfo(0),
+	  m_jsContext(0), m_regs(0), m_regCount(0), m_holders(0), m_holderCount(0), m_run(0)
 	{ traceCheck(title); }
-    virtual ~JsRunner()
-	{ if (m_tracing) traceDump(); }
+    virtual ~JsRunner();
     inline bool tracing() const
 	{ return m_tracing; }
     virtual Status reset(bool init);
@@ -379,6 +553,8 @@ protected:
     void traceDump();
     void traceCheck(const char* title);
     void traceStart(const char* title, JsCodeStats* stats);
+    JsValue* registers(const JsCompiled& code);
+    void nextRun();
 private:
     bool m_paused;
     bool m_tracing;
@@ -391,6 +567,12 @@ private:
     JsCallInfo* m_callInfo;
     ObjList m_traceStack;
     RefPointer<JsCodeStats> m_stats;
+    JsContext* m_jsContext;
+    JsValue* m_regs;
+    unsigned int m_regCount;
+    JsHolder* m_holders;
+    unsigned int m_holderCount;
+    unsigned int m_run;
 };
 
 class ParseNested : public GenObject
@@ -926,8 +1108,866 @@ bool JsContext::runAssign(ObjList& stack, const ExpOperation& oper, GenObject* c
 }
 
 
+// Maximum registers used by a compiled block
+static const unsigned int s_maxRegisters = 32;
+
+bool JsPath::valid() const
+{
+    if (!m_names->skipNull())
+	return false;
+    for (const ObjList* l = m_names->skipNull(); l; l = l->skipNext())
+	if (static_cast<const String*>(l->get())->null())
+	    return false;
+    return true;
+}
+
+static inline const char* numText(char* buf, unsigned int len, int64_t num)
+{
+    ::snprintf(buf,len,FMT64,num);
+    return buf;
+}
+
+// Build the value text as it would be stored in an ExpOperation
+const char* JsValue::text(char* buf, unsigned int len) const
+{
+    switch (type) {
+	case Num:
+	    return numText(buf,len,number);
+	case NaN:
+	    return "NaN";
+	case Bool:
+	    return String::boolText(number != 0);
+	default:
+	    return str.safe();
+    }
+}
+
+bool JsValue::sameText(const JsValue& other) const
+{
+    if (type != Str && other.type != Str)
+	return (type == other.type) && ((type == NaN) || (number == other.number));
+    char b1[24];
+    char b2[24];
+    return !::strcmp(text(b1,sizeof(b1)),other.text(b2,sizeof(b2)));
+}
+
+void JsValue::copy(const JsValue& other)
+{
+    type = other.type;
+    number = other.number;
+    oper = other.oper;
+    path = other.path;
+    slot = other.slot;
+    if (type == Str || (type == Ref && !path))
+	str = other.str;
+    if (other.name == &other.own) {
+	own = other.own;
+	name = &own;
+    }
+    else
+	name = other.name;
+}
+
+// Take a value only if an ExpOperation built from it would hold the same data
+bool JsValue::canonical(const String& value, int64_t num, bool isBool, bool isNum)
+{
+    if (isBool) {
+	if (!isNum || (num != 0 && num != 1) || value != String::boolText(num != 0))
+	    return false;
+	type = Bool;
+    }
+    else if (num != ExpOperation::nonInteger()) {
+	char buf[24];
+	if (!isNum || value != numText(buf,sizeof(buf),num))
+	    return false;
+	type = Num;
+    }
+    else if (isNum) {
+	if (value != YSTRING("NaN"))
+	    return false;
+	type = NaN;
+    }
+    else {
+	type = Str;
+	str = value;
+    }
+    number = num;
+    path = 0;
+    return true;
+}
+
+bool JsValue::assign(const ExpOperation& op)
+{
+    if (op.barrier() || !canonical(op,op.number(),op.isBoolean(),op.isNumber()))
+	return false;
+    name = &op.name();
+    oper = &op;
+    return true;
+}
+
+// Load a field value like JsObject::runField() would push it
+bool JsValue::assign(const NamedString& param, const String& newName, bool ownName)
+{
+    if (YOBJECT(ExpFunction,&param) || YOBJECT(ExpWrapper,&param) || YOBJECT(JsObject,&param))
+	return false;
+    const ExpOperation* op = YOBJECT(ExpOperation,&param);
+    if (op) {
+	if (op->barrier() || !canonical(*op,op->number(),op->isBoolean(),op->isNumber()))
+	    return false;
+    }
+    else {
+	int64_t num = param.toInt64(ExpOperation::nonInteger());
+	bool isBool = param.isBoolean();
+	bool isNum = true;
+	if (isBool)
+	    num = param.toBoolean() ? 1 : 0;
+	else
+	    isNum = (param == YSTRING("NaN")) || (num != ExpOperation::nonInteger());
+	if (!canonical(param,num,isBool,isNum))
+	    return false;
+    }
+    oper = 0;
+    if (ownName) {
+	own = newName;
+	name = &own;
+    }
+    else
+	name = &newName;
+    return true;
+}
+
+ExpOperation* JsValue::create(const char* newName, bool field) const
+{
+    if (field)
+	return new ExpOperation(ExpEvaluator::OpcField,newName,String(number),number,false);
+    switch (type) {
+	case Bool:
+	    return new ExpOperation(number != 0,newName);
+	case Str:
+	    return new ExpOperation(str,newName);
+	default:
+	    return new ExpOperation(number,newName);
+    }
+}
+
+// Build the operation the interpreter would have on its stack
+ExpOperation* JsValue::materialize() const
+{
+    switch (type) {
+	case Mark:
+	    return new ExpOperation((ExpEvaluator::Opcode)JsCode::OpcBegin);
+	case Ref:
+	    return path ? path->oper().clone() : new ExpOperation(ExpEvaluator::OpcField,str);
+	default:
+	    return oper ? oper->clone() : create(*name);
+    }
+}
+
+
+JsCompiled::JsCompiled(const ObjVector& linked)
+    : m_length(linked.length()), m_blockAt(0), m_block(0), m_blocks(0),
+      m_instr(0), m_count(0), m_registers(0), m_slots(0)
+{
+    if (!m_length)
+	return;
+    m_blockAt = new const JsBlock*[m_length];
+    m_block = new JsBlock[m_length];
+    m_instr = new JsInstr[m_length];
+    for (unsigned int i = 0; i < m_length; i++)
+	m_blockAt[i] = 0;
+    unsigned int index = 0;
+    while (index < m_length) {
+	unsigned int start = index;
+	compile(linked,index);
+	if (index == start)
+	    index++;
+    }
+    for (unsigned int b = 0; b < m_blocks; b++)
+	m_blockAt[m_block[b].start] = &m_block[b];
+}
+
+JsCompiled::~JsCompiled()
+{
+    delete[] m_blockAt;
+    delete[] m_block;
+    delete[] m_instr;
+}
+
+// Compile the longest run of supported operations starting at index
+bool JsCompiled::compile(const ObjVector& linked, unsigned int& index)
+{
+    JsBlock& blk = m_block[m_blocks];
+    blk.start = index;
+    blk.first = m_count;
+    bool marks[s_maxRegisters];
+    unsigned int depth = 0;
+    unsigned int regs = 0;
+    bool last = false;
+    while (!last && index < m_length) {
+	const ExpOperation* oper = static_cast<const ExpOperation*>(linked[index]);
+	if (!(oper && compileOp(*oper,index,marks,depth,last)))
+	    break;
+	index++;
+	if (regs < depth)
+	    regs = depth;
+    }
+    blk.count = m_count - blk.first;
+    if (blk.count < 2) {
+	m_count = blk.first;
+	return false;
+    }
+    blk.end = index;
+    blk.depth = depth;
+    blk.regs = regs;
+    if (m_registers < regs)
+	m_registers = regs;
+    m_slots = m_names.count();
+    m_blocks++;
+    return true;
+}
+
+// Find the innermost block marker below a stack depth
+static int findMark(const bool* marks, unsigned int depth)
+{
+    while (depth--)
+	if (marks[depth])
+	    return depth;
+    return -1;
+}
+
+bool JsCompiled::compileOp(const ExpOperation& oper, unsigned int index, bool* marks,
+    unsigned int& depth, bool& last)
+{
+    JsInstr& in = m_instr[m_count];
+    in.opcode = oper.opcode();
+    in.depth = depth;
+    in.index = index;
+    in.arg = 0;
+    in.value = 0;
+    in.path = 0;
+    // operands taken from registers, result pushed
+    unsigned int pop = 0;
+    bool push = true;
+    int mark = -1;
+    switch (in.opcode) {
+	case ExpEvaluator::OpcNone:
+	    return true;
+	case ExpEvaluator::OpcPush:
+	    {
+		if (YOBJECT(ExpFunction,&oper) || YOBJECT(ExpWrapper,&oper))
+		    return false;
+		JsValue* val = new JsValue;
+		if (!val->assign(oper)) {
+		    TelEngine::destruct(val);
+		    return false;
+		}
+		m_values.append(val);
+		in.code = IConst;
+		in.value = val;
+	    }
+	    break;
+	case ExpEvaluator::OpcField:
+	    {
+		if (oper.barrier())
+		    return false;
+		JsPath* path = new JsPath(oper);
+		if (!path->valid()) {
+		    TelEngine::destruct(path);
+		    return false;
+		}
+		int slot = m_names.index(path->first());
+		if (slot >= 0)
+		    in.arg = slot;
+		else {
+		    in.arg = m_names.count();
+		    m_names.append(new String(path->first()));
+		}
+		m_paths.append(path);
+		in.code = IField;
+		in.path = path;
+	    }
+	    break;
+	case JsCode::OpcBegin:
+	    if (depth >= s_maxRegisters)
+		return false;
+	    in.code = IBegin;
+	    marks[depth++] = true;
+	    m_count++;
+	    return true;
+	case JsCode::OpcEnd:
+	    if (!depth)
+		return false;
+	    if (marks[depth - 1]) {
+		in.code = IDrop;
+		depth--;
+		m_count++;
+		return true;
+	    }
+	    mark = findMark(marks,depth - 1);
+	    if (mark < 0)
+		return false;
+	    in.code = IEnd;
+	    in.arg = mark;
+	    depth = mark + 1;
+	    marks[mark] = false;
+	    m_count++;
+	    return true;
+	case JsCode::OpcFlush:
+	    mark = findMark(marks,depth);
+	    if (mark < 0) {
+		// the marker was pushed before the block
+		in.code = IFlushStack;
+		depth = 0;
+	    }
+	    else {
+		in.code = IFlush;
+		in.arg = mark;
+		depth = mark;
+	    }
+	    m_count++;
+	    return true;
+	case ExpEvaluator::OpcDrop:
+	    if (!depth)
+		return false;
+	    in.code = IDrop;
+	    depth--;
+	    m_count++;
+	    return true;
+	case ExpEvaluator::OpcDup:
+	    if (!depth || marks[depth - 1] || depth >= s_maxRegisters)
+		return false;
+	    in.code = IDup;
+	    marks[depth++] = false;
+	    m_count++;
+	    return true;
+	case ExpEvaluator::OpcAdd:
+	case ExpEvaluator::OpcSub:
+	case ExpEvaluator::OpcMul:
+	case ExpEvaluator::OpcDiv:
+	case ExpEvaluator::OpcMod:
+	case ExpEvaluator::OpcAnd:
+	case ExpEvaluator::OpcOr:
+	case ExpEvaluator::OpcXor:
+	case ExpEvaluator::OpcShl:
+	case ExpEvaluator::OpcShr:
+	case ExpEvaluator::OpcEq:
+	case ExpEvaluator::OpcNe:
+	case ExpEvaluator::OpcLt:
+	case ExpEvaluator::OpcGt:
+	case ExpEvaluator::OpcLe:
+	case ExpEvaluator::OpcGe:
+	case ExpEvaluator::OpcLAnd:
+	case ExpEvaluator::OpcLOr:
+	case ExpEvaluator::OpcCat:
+	    in.code = IBinary;
+	    pop = 2;
+	    break;
+	case JsCode::OpcEqIdentity:
+	case JsCode::OpcNeIdentity:
+	    in.code = IIdentity;
+	    pop = 2;
+	    break;
+	case ExpEvaluator::OpcNeg:
+	case ExpEvaluator::OpcNot:
+	case ExpEvaluator::OpcLNot:
+	    in.code = IUnary;
+	    pop = 1;
+	    break;
+	case ExpEvaluator::OpcIncPre:
+	case ExpEvaluator::OpcDecPre:
+	case ExpEvaluator::OpcIncPost:
+	case ExpEvaluator::OpcDecPost:
+	    in.code = IIncDec;
+	    pop = 1;
+	    break;
+	case ExpEvaluator::OpcAssign:
+	    in.code = IAssign;
+	    pop = 2;
+	    break;
+	case JsCode::OpcIndex:
+	    in.code = IIndex;
+	    pop = 2;
+	    break;
+	case JsCode::OpcFieldOf:
+	    in.code = IFieldOf;
+	    pop = 2;
+	    break;
+	case JsCode::OpcJRel:
+	case JsCode::OpcJRelTrue:
+	case JsCode::OpcJRelFalse:
+	    {
+		int64_t target = (int64_t)index + 1 + oper.number();
+		if (target < 0 || target > (int64_t)m_length)
+		    return false;
+		in.arg = (unsigned int)target;
+		if (in.opcode == JsCode::OpcJRel) {
+		    in.code = IJump;
+		    last = true;
+		}
+		else {
+		    in.code = (in.opcode == JsCode::OpcJRelTrue) ? IJumpTrue : IJumpFalse;
+		    pop = 1;
+		}
+		push = false;
+	    }
+	    break;
+	default:
+	    switch (in.opcode & ~ExpEvaluator::OpcAssign) {
+		case ExpEvaluator::OpcAdd:
+		case ExpEvaluator::OpcSub:
+		case ExpEvaluator::OpcMul:
+		case ExpEvaluator::OpcDiv:
+		case ExpEvaluator::OpcMod:
+		case ExpEvaluator::OpcAnd:
+		case ExpEvaluator::OpcOr:
+		case ExpEvaluator::OpcXor:
+		case ExpEvaluator::OpcShl:
+		case ExpEvaluator::OpcShr:
+		    if (!(in.opcode & ExpEvaluator::OpcAssign))
+			return false;
+		    in.code = IAssignOp;
+		    in.opcode &= ~ExpEvaluator::OpcAssign;
+		    pop = 2;
+		    break;
+		default:
+		    return false;
+	    }
+    }
+    if (depth < pop)
+	return false;
+    for (unsigned int i = 1; i <= pop; i++)
+	if (marks[depth - i])
+	    return false;
+    depth -= pop;
+    if (push) {
+	if (depth >= s_maxRegisters)
+	    return false;
+	marks[depth++] = false;
+    }
+    m_count++;
+    return true;
+}
+
+// Find the object holding the last name of a reference like JsContext::resolve()
+JsObject* JsCompiled::holder(JsRunner* runner, ObjList& stack, const JsValue& ref,
+    ObjList*& list, const String*& last) const
+{
+    const ObjList* l = 0;
+    if (ref.path)
+	l = ref.path->names();
+    else {
+	list = ref.str.split('.',true);
+	l = list->skipNull();
+    }
+    if (!l)
+	return 0;
+    const String* s = static_cast<const String*>(l->get());
+    if (s->null())
+	return 0;
+    JsHolder& top = runner->m_holders[ref.slot];
+    if (top.run != runner->m_run) {
+	top.object = YOBJECT(JsObject,runner->m_jsContext->resolveTop(stack,*s,runner));
+	top.run = runner->m_run;
+    }
+    JsObject* obj = top.object;
+    bool nested = false;
+    while (obj && (l = l->skipNext())) {
+	JsObject* adv = YOBJECT(JsObject,obj->getField(stack,*s,runner));
+	if (adv == runner->m_jsContext)
+	    return 0;
+	obj = adv;
+	s = static_cast<const String*>(l->get());
+	if (s->null())
+	    return 0;
+	nested = true;
+    }
+    // properties of special objects are handled by their own runField()
+    if (nested && obj && obj->toString() != YSTRING("[object Object]"))
+	return 0;
+    last = s;
+    return obj;
+}
+
+// Load a field into a register, only plain values are accepted
+bool JsCompiled::fetch(JsRunner* runner, ObjList& stack, JsObject* obj, const String& name,
+    bool ownName, JsValue& val) const
+{
+    const NamedString* param = obj->getField(stack,name,runner);
+    return param && val.assign(*param,name,ownName);
+}
+
+// Replace a reference with its value, does nothing for values
+bool JsCompiled::load(JsRunner* runner, ObjList& stack, JsValue& val) const
+{
+    if (val.isValue())
+	return true;
+    if (val.type != JsValue::Ref)
+	return false;
+    ObjList* list = 0;
+    const String* last = 0;
+    JsObject* obj = holder(runner,stack,val,list,last);
+    bool ok = obj && fetch(runner,stack,obj,*last,(list != 0),val);
+    TelEngine::destruct(list);
+    return ok;
+}
+
+// Store a value like JsObject::runAssign(), numbers are updated in place
+bool JsCompiled::store(JsObject* obj, const String& name, const JsValue& val, bool field) const
+{
+    if (obj->frozen())
+	return false;
+    if (val.type == JsValue::Num) {
+	ExpOperation* op = YOBJECT(ExpOperation,obj->ownField(name));
+	if (op && op->opcode() == (field ? ExpEvaluator::OpcField : ExpEvaluator::OpcPush)
+		&& !(op->isBoolean() || op->barrier()) && !(YOBJECT(ExpWrapper,op) || YOBJECT(ExpFunction,op))) {
+	    *op = val.number;
+	    return true;
+	}
+    }
+    obj->setField(val.create(name,field));
+    return true;
+}
+
+// Binary operation of ExpEvaluator::runOperation(), result is left in first operand
+bool JsCompiled::binary(int opcode, JsValue& op1, const JsValue& op2) const
+{
+    switch (opcode) {
+	case ExpEvaluator::OpcDiv:
+	case ExpEvaluator::OpcMod:
+	    // let the interpreter report the error
+	    if (!op2.toNumber())
+		return false;
+	    break;
+	case ExpEvaluator::OpcAdd:
+	    if (op1.isNumber() && op2.isNumber())
+		break;
+	    // fall through
+	case ExpEvaluator::OpcCat:
+	    {
+		char buf[24];
+		if (op1.type != JsValue::Str)
+		    op1.str = op1.text(buf,sizeof(buf));
+		op1.str += op2.text(buf,sizeof(buf));
+		op1.setStr();
+	    }
+	    return true;
+	case ExpEvaluator::OpcAnd:
+	    op1.setNum(op1.valInteger() & op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcOr:
+	    op1.setNum(op1.valInteger() | op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcXor:
+	    op1.setNum(op1.valInteger() ^ op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcShl:
+	    op1.setNum(op1.valInteger() << op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcShr:
+	    op1.setNum(op1.valInteger() >> op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcLt:
+	    op1.setBool(op1.valInteger() < op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcGt:
+	    op1.setBool(op1.valInteger() > op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcLe:
+	    op1.setBool(op1.valInteger() <= op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcGe:
+	    op1.setBool(op1.valInteger() >= op2.valInteger());
+	    return true;
+	case ExpEvaluator::OpcEq:
+	    op1.setBool(op1.sameText(op2));
+	    return true;
+	case ExpEvaluator::OpcNe:
+	    op1.setBool(!op1.sameText(op2));
+	    return true;
+	case ExpEvaluator::OpcLAnd:
+	    op1.setBool(op1.valBoolean() && op2.valBoolean());
+	    return true;
+	case ExpEvaluator::OpcLOr:
+	    op1.setBool(op1.valBoolean() || op2.valBoolean());
+	    return true;
+	default:
+	    break;
+    }
+    int64_t val = ExpOperation::nonInteger();
+    int64_t val1 = op1.toNumber();
+    int64_t val2 = op2.toNumber();
+    if (val1 != ExpOperation::nonInteger() && val2 != ExpOperation::nonInteger()) {
+	switch (opcode) {
+	    case ExpEvaluator::OpcAdd:
+		val = val1 + val2;
+		break;
+	    case ExpEvaluator::OpcSub:
+		val = val1 - val2;
+		break;
+	    case ExpEvaluator::OpcMul:
+		val = val1 * val2;
+		break;
+	    case ExpEvaluator::OpcDiv:
+		val = val1 / val2;
+		break;
+	    case ExpEvaluator::OpcMod:
+		val = val1 % val2;
+		break;
+	    default:
+		return false;
+	}
+    }
+    op1.setNum(val);
+    return true;
+}
+
+// Run compiled blocks while jumps lead to other blocks
+// At any point it can leave the rest to the interpreter
+bool JsCompiled::run(const JsBlock& start, ObjList& stack, JsRunner* runner) const
+{
+    JsValue* base = runner->registers(*this);
+    if (!base)
+	return false;
+    JsValue& tmp = base[registers()];
+    // registers of the current block start at regs, below are left by previous blocks
+    JsValue* regs = base;
+    const JsBlock* blk = &start;
+    const JsInstr* in = 0;
+    bool progress = false;
+    unsigned int next = 0;
+    while (blk) {
+	if ((unsigned int)(regs - base) + blk->regs > registers()) {
+	    spill(base,regs - base,stack);
+	    regs = base;
+	}
+	in = m_instr + blk->first;
+	const JsInstr* end = in + blk->count;
+	next = blk->end;
+	unsigned int depth = blk->depth;
+	for (; in < end; in++) {
+	    JsValue* r = regs + in->depth;
+	    switch (in->code) {
+		case IBegin:
+		    r->type = JsValue::Mark;
+		    break;
+		case IConst:
+		    r->copy(*in->value);
+		    break;
+		case IField:
+		    r->type = JsValue::Ref;
+		    r->path = in->path;
+		    r->slot = in->arg;
+		    break;
+		case IDrop:
+		case IFlush:
+		    break;
+		case IDup:
+		    if (!load(runner,stack,r[-1]))
+			goto deopt;
+		    r->copy(r[-1]);
+		    break;
+		case IEnd:
+		    regs[in->arg].copy(r[-1]);
+		    break;
+		case IBinary:
+		    if (!(load(runner,stack,r[-1]) && load(runner,stack,r[-2])
+			    && binary(in->opcode,r[-2],r[-1])))
+			goto deopt;
+		    break;
+		case IIdentity:
+		    if (!(load(runner,stack,r[-1]) && load(runner,stack,r[-2])))
+			goto deopt;
+		    {
+			bool eq = (r[-2].identity() == r[-1].identity()) && r[-2].sameText(r[-1]);
+			r[-2].setBool((in->opcode == JsCode::OpcEqIdentity) ? eq : !eq);
+		    }
+		    break;
+		case IUnary:
+		    if (!load(runner,stack,r[-1]))
+			goto deopt;
+		    switch (in->opcode) {
+			case ExpEvaluator::OpcNeg:
+			    r[-1].setNum(-r[-1].toNumber());
+			    break;
+			case ExpEvaluator::OpcNot:
+			    r[-1].setNum(~r[-1].valInteger());
+			    break;
+			default:
+			    r[-1].setBool(!r[-1].valBoolean());
+			    break;
+		    }
+		    break;
+		case IIncDec:
+		    {
+			JsValue& fld = r[-1];
+			if (fld.type != JsValue::Ref)
+			    goto deopt;
+			ObjList* list = 0;
+			const String* last = 0;
+			JsObject* obj = holder(runner,stack,fld,list,last);
+			// the interpreter would keep a boolean type on the changed value
+			bool ok = obj && fetch(runner,stack,obj,*last,(list != 0),tmp)
+			    && (tmp.type != JsValue::Bool);
+			if (ok) {
+			    int64_t num = tmp.valInteger();
+			    int64_t res = num;
+			    switch (in->opcode) {
+				case ExpEvaluator::OpcIncPre:
+				    res = ++num;
+				    break;
+				case ExpEvaluator::OpcDecPre:
+				    res = --num;
+				    break;
+				case ExpEvaluator::OpcIncPost:
+				    num++;
+				    break;
+				default:
+				    num--;
+				    break;
+			    }
+			    tmp.number = num;
+			    tmp.type = JsValue::Num;
+			    ok = store(obj,*last,tmp,true);
+			    if (ok) {
+				tmp.number = res;
+				fld.copy(tmp);
+			    }
+			}
+			TelEngine::destruct(list);
+			if (!ok)
+			    goto deopt;
+		    }
+		    break;
+		case IAssign:
+		case IAssignOp:
+		    {
+			JsValue& fld = r[-2];
+			if (!load(runner,stack,r[-1]) || fld.type != JsValue::Ref)
+			    goto deopt;
+			ObjList* list = 0;
+			const String* last = 0;
+			JsObject* obj = holder(runner,stack,fld,list,last);
+			const JsValue* val = &r[-1];
+			bool ok = (obj != 0);
+			if (ok && in->code == IAssignOp) {
+			    ok = fetch(runner,stack,obj,*last,false,tmp) && binary(in->opcode,tmp,r[-1]);
+			    val = &tmp;
+			}
+			ok = ok && store(obj,*last,*val,false);
+			TelEngine::destruct(list);
+			if (!ok)
+			    goto deopt;
+			fld.copy(*val);
+		    }
+		    break;
+		case IIndex:
+		    if (!load(runner,stack,r[-1]) || r[-2].type != JsValue::Ref)
+			goto deopt;
+		    {
+			JsValue& fld = r[-2];
+			char buf[24];
+			if (fld.path) {
+			    fld.str = fld.path->oper().name();
+			    fld.path = 0;
+			}
+			fld.str << "." << r[-1].text(buf,sizeof(buf));
+		    }
+		    break;
+		case IFieldOf:
+		    if (r[-1].type != JsValue::Ref || r[-2].type != JsValue::Ref)
+			goto deopt;
+		    {
+			JsValue& fld = r[-2];
+			if (fld.path) {
+			    fld.str = fld.path->oper().name();
+			    fld.path = 0;
+			}
+			fld.str << "." << (r[-1].path ? r[-1].path->oper().name() : r[-1].str);
+		    }
+		    break;
+		case IJumpTrue:
+		case IJumpFalse:
+		    if (!load(runner,stack,r[-1]))
+			goto deopt;
+		    if (r[-1].valBoolean() == (in->code == IJumpTrue)) {
+			// leave the block after this instruction
+			next = in->arg;
+			depth = in->depth - 1;
+			end = in + 1;
+		    }
+		    break;
+		case IJump:
+		    next = in->arg;
+		    break;
+		case IFlushStack:
+		    {
+			JsValue* mark = 0;
+			for (JsValue* v = regs; v > base; )
+			    if ((--v)->type == JsValue::Mark) {
+				mark = v;
+				break;
+			    }
+			if (mark) {
+			    regs = mark;
+			    break;
+			}
+			// marker is on the stack, everything left by previous blocks is dropped
+			if (!flushStack(stack))
+			    goto deopt;
+			regs = base;
+			runner->nextRun();
+		    }
+		    break;
+	    }
+	    progress = true;
+	}
+	regs += depth;
+	blk = block(next);
+    }
+    spill(base,regs - base,stack);
+    runner->m_index = next;
+    return true;
+deopt:
+    if (!progress)
+	return false;
+    spill(base,(regs - base) + in->depth,stack);
+    runner->m_index = in->index;
+    return true;
+}
+
+// Pop the stack up to and including the last block marker, like OpcFlush
+bool JsCompiled::flushStack(ObjList& stack) const
+{
+    bool found = false;
+    for (ObjList* l = stack.skipNull(); l; l = l->skipNext()) {
+	if (static_cast<const ExpOperation*>(l->get())->opcode() == (ExpEvaluator::Opcode)JsCode::OpcBegin) {
+	    found = true;
+	    break;
+	}
+    }
+    if (!found)
+	return false;
+    ExpOperation* o;
+    while ((o = static_cast<ExpOperation*>(stack.remove(false)))) {
+	bool done = (o->opcode() == (ExpEvaluator::Opcode)JsCode::OpcBegin);
+	TelEngine::destruct(o);
+	if (done)
+	    break;
+    }
+    return true;
+}
+
+// Push registers on the stack the way the interpreter would have left it
+void JsCompiled::spill(const JsValue* regs, unsigned int count, ObjList& stack) const
+{
+    for (unsigned int i = 0; i < count; i++)
+	ExpEvaluator::pushOne(stack,regs[i].materialize());
+}
+
+
 JsCode::~JsCode()
 {
+    delete m_compiled;
     delete[] m_entries;
 }
 
@@ -967,6 +2007,8 @@ bool JsCode::link()
     m_linked.assign(m_opcodes);
     delete[] m_entries;
     m_entries = 0;
+    delete m_compiled;
+    m_compiled = 0;
     unsigned int n = m_linked.count();
     if (!n)
 	return false;
@@ -1018,6 +2060,23 @@ bool JsCode::link()
     return true;
 }
 
+// Compile runs of simple linked operations to run on registers
+unsigned int JsCode::compileBlocks()
+{
+    delete m_compiled;
+    m_compiled = 0;
+    if (!m_linked.length())
+	return 0;
+    m_compiled = new JsCompiled(m_linked);
+    unsigned int blocks = m_compiled->blocks();
+    DDebug(this,DebugAll,"Compiled %u blocks of linked code",blocks);
+    if (!blocks) {
+	delete m_compiled;
+	m_compiled = 0;
+    }
+    return blocks;
+}
+
 const String& JsCode::getFileAt(unsigned int index) const
 {
     if (!index)
@@ -1661,6 +2720,7 @@ bool JsCode::parseFor(ParsePoint& expr, GenObject* nested)
     int64_t cont = 0;
     int64_t jump = ++m_label;
     int64_t body = ++m_label;
+    bool iterate = false;
     // parse initializer
     if (skipComments(expr) == ';') {
 	int64_t check = body;
@@ -1695,11 +2755,17 @@ bool JsCode::parseFor(ParsePoint& expr, GenObject* nested)
 	addOpcode(OpcLabel,cont);
 	addOpcode((Opcode)OpcNext);
 	addOpcode((Opcode)OpcJumpFalse,jump);
+	iterate = true;
     }
     if (skipComments(expr) != ')')
 	return gotError("Expecting ')'",expr);
     ParseLoop parseStack(this,nested,OpcFor,cont,jump);
     addOpcode(OpcLabel,body);
+    if (!iterate) {
+	// drop values left by the previous iteration, the iterator must stay
+	addOpcode((Opcode)OpcFlush);
+	addOpcode((Opcode)OpcBegin);
+    }
     if (!getOneInstruction(++expr,parseStack))
 	return false;
     addOpcode((Opcode)OpcJump,cont);
@@ -1715,6 +2781,9 @@ bool JsCode::parseWhile(ParsePoint& expr, GenObject* nested)
     addOpcode((Opcode)OpcBegin);
     int64_t cont = ++m_label;
     addOpcode(OpcLabel,cont);
+    // drop values left by the previous iteration
+    addOpcode((Opcode)OpcFlush);
+    addOpcode((Opcode)OpcBegin);
     if (!runCompile(++expr,')'))
 	return false;
     if (skipComments(expr) != ')')
@@ -2235,7 +3304,7 @@ bool JsCode::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* c
 			if (!jso->hasField(stack,oper.name(),context)) {
 			    XDebug(this,DebugInfo,"Creating variable '%s' in scope",
 				oper.name().c_str());
-			    jso->params().setParam(new ExpWrapper(0,oper.name()));
+			    jso->setField(new ExpWrapper(0,oper.name()));
 			}
 			break;
 		    }
@@ -2660,6 +3729,11 @@ bool JsCode::evalVector(ObjList& stack, GenObject* context) const
     JsRunner* runner = static_cast<JsRunner*>(context);
     unsigned int& index = runner->m_index;
     while (index < m_linked.length()) {
+	if (m_compiled && !runner->m_tracing) {
+	    const JsBlock* blk = m_compiled->block(index);
+	    if (blk && m_compiled->run(*blk,stack,runner))
+		continue;
+	}
 	const ExpOperation* o = static_cast<const ExpOperation*>(m_linked[index++]);
 	if (o && !runOperation(stack,*o,context))
 	    return false;
@@ -2813,9 +3887,9 @@ bool JsCode::callFunction(ObjList& stack, const ExpOperation& oper, GenObject* c
 	    break;
 	ExpOperation* param = static_cast<ExpOperation*>(args.remove(false));
 	if (param)
-	    ctxt->params().setParam(param->clone(*name));
+	    ctxt->setField(param->clone(*name));
 	else
-	    ctxt->params().setParam(new ExpWrapper(0,*name));
+	    ctxt->setField(new ExpWrapper(0,*name));
 	TelEngine::destruct(param);
     }
     pushOne(stack,new ExpWrapper(ctxt,ctxt->toString(),true));
@@ -2854,6 +3928,48 @@ void JsCode::dump(String& res, bool lineNo) const
 }
 
 
+JsRunner::~JsRunner()
+{
+    if (m_tracing)
+	traceDump();
+    delete[] m_regs;
+    delete[] m_holders;
+}
+
+// Get registers for running compiled code, forget previously found field holders
+JsValue* JsRunner::registers(const JsCompiled& code)
+{
+    if (!m_jsContext) {
+	m_jsContext = YOBJECT(JsContext,context());
+	if (!m_jsContext)
+	    return 0;
+    }
+    if (m_regCount <= code.registers()) {
+	delete[] m_regs;
+	m_regCount = code.registers() + 1;
+	m_regs = new JsValue[m_regCount];
+    }
+    if (m_holderCount < code.slots()) {
+	delete[] m_holders;
+	m_holderCount = code.slots();
+	m_holders = new JsHolder[m_holderCount];
+	for (unsigned int i = 0; i < m_holderCount; i++)
+	    m_holders[i].run = 0;
+    }
+    nextRun();
+    return m_regs;
+}
+
+// Invalidate all field holders found so far
+void JsRunner::nextRun()
+{
+    if (++m_run)
+	return;
+    for (unsigned int i = 0; i < m_holderCount; i++)
+	m_holders[i].run = 0;
+    m_run = 1;
+}
+
 ScriptRun::Status JsRunner::reset(bool init)
 {
     Status s = ScriptRun::reset(init);
@@ -3508,6 +4624,13 @@ bool JsParser::callable(const String& name)
     return (c && c->getGlobalFunction(name));
 }
 
+// Retrieve the pragmas of the parsed code
+const NamedList* JsParser::pragmas() const
+{
+    const JsCode* c = static_cast<const JsCode*>(code());
+    return c ? &c->pragmas() : 0;
+}
+
 // Parse a piece of Javascript text
 bool JsParser::parse(const char* text, bool fragment, const char* file, int len)
 {
@@ -3538,6 +4661,8 @@ bool JsParser::parse(const char* text, bool fragment, const char* file, int len)
     DDebug(DebugAll,"Simplified: %s",jsc->ExpEvaluator::dump().c_str());
     if (m_allowLink) {
 	jsc->link();
+	if (m_allowCompile)
+	    jsc->compileBlocks();
 #ifdef DEBUG
 #ifdef XDEBUG
 	Debug(DebugAll,"Linked: %s",jsc->ExpEvaluator::dump(true).c_str());
@@ -21,6 +21,48 @@
 #include "yatescript.h"
 #include <string.h>
 
+// Objects with more properties find them through the hash index of params()
+#define JS_SHAPE_SLOTS 32
+// Objects looked up fewer times are faster to search directly in params()
+#define JS_SHAPE_READS 16
+// Objects changed this many times through params() stop using shapes
+#define JS_SHAPE_REBUILDS 8
+// Limits of the shape tree, objects that would need more use the hash index
+#define JS_SHAPE_CHILDREN 64
+#define JS_SHAPE_MAX 16384
+
+namespace TelEngine {
+
+// Layout shared by the objects that got the same properties in the same order
+// A shape never changes, adding a property moves the object to a child shape
+// Shapes are kept until exit so objects don't need to reference them
+class JsShape : public GenObject
+{
+public:
+    JsShape(JsShape* parent = 0, const String& name = String::empty());
+    virtual ~JsShape();
+    static JsShape* root();
+    JsShape* child(const String& name);
+    int find(const String& name) const;
+    inline unsigned int count() const
+	{ return m_count; }
+private:
+    struct Entry {
+	const String* name;
+	unsigned int slot;
+    };
+    Entry* buildTable() const;
+    JsShape* m_parent;
+    String m_name;
+    unsigned int m_count;
+    unsigned int m_mask;
+    Entry* volatile m_table;
+    ObjList m_children;
+    unsigned int m_fanout;
+};
+
+};
+
 using namespace TelEngine;
 
 namespace { // anonymous
@@ -190,14 +232,103 @@ static void dumpRecursiveObj(const GenObject* obj, String& buf, unsigned int dep
 }
 
 
+static Mutex s_shapeMutex(false,"JsShape");
+static JsShape s_rootShape;
+static unsigned int s_shapes = 0;
+
+JsShape::JsShape(JsShape* parent, const String& name)
+    : m_parent(parent), m_name(name),
+      m_count(parent ? parent->count() + 1 : 0), m_mask(7), m_table(0), m_fanout(0)
+{
+    // keep load factor under 1/2
+    while (m_mask < 2 * m_count)
+	m_mask = (m_mask << 1) | 1;
+    // compute the hash now, shapes are read by many threads
+    m_name.hash();
+}
+
+JsShape::~JsShape()
+{
+    delete[] m_table;
+}
+
+// Get the shape of objects without properties
+JsShape* JsShape::root()
+{
+    return &s_rootShape;
+}
+
+// Get the shape with one more property, NULL if the tree grew too large
+JsShape* JsShape::child(const String& name)
+{
+    Lock mylock(s_shapeMutex);
+    for (ObjList* l = m_children.skipNull(); l; l = l->skipNext()) {
+	JsShape* s = static_cast<JsShape*>(l->get());
+	if (s->m_name == name)
+	    return s;
+    }
+    // many different names following the same ones look like a map
+    if ((m_fanout >= JS_SHAPE_CHILDREN) || (s_shapes >= JS_SHAPE_MAX))
+	return 0;
+    m_fanout++;
+    s_shapes++;
+    JsShape* s = new JsShape(this,name);
+    m_children.append(s);
+    return s;
+}
+
+// Find the slot of a property, -1 if the shape does not have it
+int JsShape::find(const String& name) const
+{
+    if (!m_count)
+	return -1;
+    Entry* table = m_table;
+    if (!table)
+	table = buildTable();
+    unsigned int h = name.hash();
+    for (unsigned int i = h & m_mask; table[i].name; i = (i + 1) & m_mask) {
+	if (*table[i].name == name)
+	    return table[i].slot;
+    }
+    return -1;
+}
+
+// Build the name table on first lookup, shapes only passed through don't need one
+JsShape::Entry* JsShape::buildTable() const
+{
+    Entry* table = new Entry[m_mask + 1];
+    for (unsigned int i = 0; i <= m_mask; i++) {
+	table[i].name = 0;
+	table[i].slot = 0;
+    }
+    for (const JsShape* s = this; s->m_parent; s = s->m_parent) {
+	unsigned int i = s->m_name.hash() & m_mask;
+	while (table[i].name)
+	    i = (i + 1) & m_mask;
+	table[i].name = &s->m_name;
+	table[i].slot = s->m_count - 1;
+    }
+    Lock mylock(s_shapeMutex);
+    if (m_table) {
+	// some other thread built it first
+	delete[] table;
+	return m_table;
+    }
+    const_cast<JsShape*>(this)->m_table = table;
+    return table;
+}
+
+
 const String JsObject::s_protoName("__proto__");
 
 JsObject::JsObject(const char* name, Mutex* mtx, bool frozen)
     : ScriptContext(String("[object ") + name + "]"),
-      m_frozen(frozen), m_mutex(mtx)
+      m_frozen(frozen), m_mutex(mtx),
+      m_shape(0), m_slots(0), m_alloc(0), m_changes(0), m_reads(0), m_rebuilds(0)
 {
     XDebug(DebugAll,"JsObject::JsObject('%s',%p,%s) [%p]",
 	name,mtx,String::boolText(frozen),this);
+    params().hashParams();
     params().addParam(new ExpFunction("freeze"));
     params().addParam(new ExpFunction("isFrozen"));
     params().addParam(new ExpFunction("toString"));
@@ -206,22 +337,28 @@ JsObject::JsObject(const char* name, Mutex* mtx, bool frozen)
 
 JsObject::JsObject(Mutex* mtx, const char* name, bool frozen)
     : ScriptContext(name),
-      m_frozen(frozen), m_mutex(mtx)
+      m_frozen(frozen), m_mutex(mtx),
+      m_shape(0), m_slots(0), m_alloc(0), m_changes(0), m_reads(0), m_rebuilds(0)
 {
     XDebug(DebugAll,"JsObject::JsObject(%p,'%s',%s) [%p]",
 	mtx,name,String::boolText(frozen),this);
+    params().hashParams();
 }
 
 JsObject::JsObject(GenObject* context, Mutex* mtx, bool frozen)
     : ScriptContext("[object Object]"),
-      m_frozen(frozen), m_mutex(mtx)
+      m_frozen(frozen), m_mutex(mtx),
+      m_shape(0), m_slots(0), m_alloc(0), m_changes(0), m_reads(0), m_rebuilds(0)
 {
+    // objects used as maps get their properties indexed once they grow large
+    params().hashParams();
     setPrototype(context,YSTRING("Object"));
 }
 
 JsObject::~JsObject()
 {
     XDebug(DebugAll,"JsObject::~JsObject '%s' [%p]",toString().c_str(),this);
+    dropShape();
 }
 
 JsObject* JsObject::copy(Mutex* mtx) const
@@ -264,7 +401,7 @@ JsObject* JsObject::buildCallContext(Mutex* mtx, JsObject* thisObj)
 {
     JsObject* ctxt = new JsObject(mtx,"()");
     if (thisObj && thisObj->alive())
-	ctxt->params().addParam(new ExpWrapper(thisObj,"this"));
+	ctxt->setField(new ExpWrapper(thisObj,"this"));
     return ctxt;
 }
 
@@ -283,9 +420,9 @@ void JsObject::fillFieldNames(ObjList& names)
 
 bool JsObject::hasField(ObjList& stack, const String& name, GenObject* context) const
 {
-    if (ScriptContext::hasField(stack,name,context))
+    if (ownField(name))
 	return true;
-    const ScriptContext* proto = YOBJECT(ScriptContext,params().getParam(protoName()));
+    const ScriptContext* proto = YOBJECT(ScriptContext,ownField(protoName()));
     if (proto && proto->hasField(stack,name,context))
 	return true;
     NamedList* np = nativeParams();
@@ -294,10 +431,10 @@ bool JsObject::hasField(ObjList& stack, const String& name, GenObject* context)
 
 NamedString* JsObject::getField(ObjList& stack, const String& name, GenObject* context) const
 {
-    NamedString* fld = ScriptContext::getField(stack,name,context);
+    NamedString* fld = ownField(name);
     if (fld)
 	return fld;
-    const ScriptContext* proto = YOBJECT(ScriptContext,params().getParam(protoName()));
+    const ScriptContext* proto = YOBJECT(ScriptContext,ownField(protoName()));
     if (proto) {
 	fld = proto->getField(stack,name,context);
 	if (fld)
@@ -309,6 +446,102 @@ NamedString* JsObject::getField(ObjList& stack, const String& name, GenObject* c
     return 0;
 }
 
+NamedString* JsObject::ownField(const String& name) const
+{
+    if (!syncShape())
+	return params().getParam(name);
+    int slot = m_shape->find(name);
+    return (slot >= 0) ? m_slots[slot] : 0;
+}
+
+void JsObject::setField(NamedString* param)
+{
+    if (!param)
+	return;
+    if (!syncShape()) {
+	params().setParam(param);
+	return;
+    }
+    int slot = m_shape->find(param->name());
+    params().setParam(param);
+    if (slot >= 0)
+	m_slots[slot] = param;
+    else if ((m_shape->count() >= JS_SHAPE_SLOTS) || !addSlot(param)) {
+	// grown into a map, the hash index of params() is faster
+	dropShape();
+	m_rebuilds = JS_SHAPE_REBUILDS;
+	return;
+    }
+    m_changes = params().changes();
+}
+
+// Make the shape match params() again after changes made directly to them
+// Return false if the object does not use a shape
+bool JsObject::syncShape() const
+{
+    if (m_shape) {
+	if (m_changes == params().changes())
+	    return true;
+	dropShape();
+	m_reads = 0;
+    }
+    if (m_reads < JS_SHAPE_READS) {
+	m_reads++;
+	return false;
+    }
+    if (m_rebuilds >= JS_SHAPE_REBUILDS)
+	return false;
+    m_rebuilds++;
+    m_shape = JsShape::root();
+    for (const ObjList* l = params().paramList()->skipNull(); l; l = l->skipNext()) {
+	NamedString* param = static_cast<NamedString*>(l->get());
+	// a property is the first parameter with its name
+	unsigned int i = 0;
+	for (; i < m_shape->count(); i++) {
+	    if (m_slots[i]->name() == param->name())
+		break;
+	}
+	if (i < m_shape->count())
+	    continue;
+	if ((i >= JS_SHAPE_SLOTS) || !addSlot(param)) {
+	    dropShape();
+	    m_rebuilds = JS_SHAPE_REBUILDS;
+	    return false;
+	}
+    }
+    m_changes = params().changes();
+    return true;
+}
+
+void JsObject::dropShape() const
+{
+    m_shape = 0;
+    delete[] m_slots;
+    m_slots = 0;
+    m_alloc = 0;
+}
+
+// Move to the shape with one more property held in the last slot
+bool JsObject::addSlot(NamedString* param) const
+{
+    JsShape* shape = m_shape->child(param->name());
+    if (!shape)
+	return false;
+    m_shape = shape;
+    unsigned int n = shape->count();
+    if (n > m_alloc) {
+	unsigned int alloc = m_alloc ? 2 * m_alloc : 4;
+	NamedString** slots = new NamedString*[alloc];
+	for (unsigned int i = 0; i + 1 < n; i++)
+	    slots[i] = m_slots[i];
+	delete[] m_slots;
+	m_slots = slots;
+	m_alloc = alloc;
+    }
+    m_slots[n - 1] = param;
+    return true;
+}
+
 JsObject* JsObject::runConstructor(ObjList& stack, const ExpOperation& oper, GenObject* context)
 {
     if (!ref())
@@ -377,17 +610,17 @@ bool JsObject::runAssign(ObjList& stack, const ExpOperation& oper, GenObject* co
     }
     ExpFunction* ef = YOBJECT(ExpFunction,&oper);
     if (ef)
-	params().setParam(ef->ExpOperation::clone());
+	setField(ef->ExpOperation::clone());
     else {
 	ExpWrapper* w = YOBJECT(ExpWrapper,&oper);
 	if (w) {
 	    JsFunction* jsf = YOBJECT(JsFunction,w->object());
 	    if (jsf)
 		jsf->firstName(oper.name());
-	    params().setParam(w->clone(oper.name()));
+	    setField(w->clone(oper.name()));
 	}
 	else
-	    params().setParam(oper.clone());
+	    setField(oper.clone());
     }
     return true;
 }
@@ -408,7 +641,7 @@ bool JsObject::runNative(ObjList& stack, const ExpOperation& oper, GenObject* co
 	    ExpOperation* op = popValue(stack,context);
 	    if (!op)
 		continue;
-	    ok = ok && params().getParam(*op);
+	    ok = ok && ownField(*op);
 	    TelEngine::destruct(op);
 	}
 	ExpEvaluator::pushOne(stack,new ExpOperation(ok));
@@ -763,6 +996,8 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	    if (n2)
 		const_cast<String&>(n2->name()) = s1;
 	}
+	// parameters were renamed, drop the name index
+	params().paramList();
 	ref();
 	ExpEvaluator::pushOne(stack,new ExpWrapper(this));
     }
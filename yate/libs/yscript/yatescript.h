@@ -1892,6 +1892,7 @@ private:
 };
 
 class JsFunction;
+class JsShape;
 
 /**
  * Javascript Object class, base for all JS objects
@@ -1991,6 +1992,22 @@ public:
      */
     virtual NamedString* getField(ObjList& stack, const String& name, GenObject* context) const;
 
+    /**
+     * Find a property of the object itself, the prototype is not searched.
+     * Small objects find it through a layout shared with similar objects,
+     *  large ones and those often changed through params() use its hash index
+     * @param name Name of the property
+     * @return Pointer to the property, NULL if not present
+     */
+    NamedString* ownField(const String& name) const;
+
+    /**
+     * Set a property of the object, replaces the first one with the same name.
+     * Unlike params().setParam() it keeps the shared layout in sync
+     * @param param Property to set, ownership is taken
+     */
+    void setField(NamedString* param);
+
     /**
      * Native constructor initialization, called by addConstructor on the prototype
      * @param construct Function that has this object as prototype
@@ -2156,9 +2173,18 @@ protected:
 	{ return m_mutex; }
 
 private:
+    bool syncShape() const;
+    void dropShape() const;
+    bool addSlot(NamedString* param) const;
     static const String s_protoName;
     bool m_frozen;
     Mutex* m_mutex;
+    mutable JsShape* m_shape;
+    mutable NamedString** m_slots;
+    mutable unsigned int m_alloc;
+    mutable unsigned int m_changes;
+    mutable unsigned int m_reads;
+    mutable unsigned int m_rebuilds;
 };
 
 /**
@@ -2478,7 +2504,7 @@ public:
      * @param allowTrace True to allow the script to enable performance tracing
      */
     inline JsParser(bool allowLink = true, bool allowTrace = false)
-	: m_allowLink(allowLink), m_allowTrace(allowTrace)
+	: m_allowLink(allowLink), m_allowTrace(allowTrace), m_allowCompile(true)
 	{ }
 
     /**
@@ -2522,6 +2548,12 @@ public:
      */
     virtual bool callable(const String& name);
 
+    /**
+     * Retrieve the pragmas set by the parsed code with the #pragma directive
+     * @return Pointer to the list of pragmas, NULL if there is no parsed code
+     */
+    const NamedList* pragmas() const;
+
     /**
      * Adjust a file script path to include default if needed
      * @param script File path to adjust
@@ -2589,6 +2621,13 @@ public:
     inline void trace(bool allowed = true)
 	{ m_allowTrace = allowed; }
 
+    /**
+     * Set whether simple runs of linked code should be compiled to run on registers
+     * @param allowed True to allow compiling linked code, false to only interpret it
+     */
+    inline void compile(bool allowed = true)
+	{ m_allowCompile = allowed; }
+
     /**
      * Parse and run a piece of Javascript code
      * @param text Source code fragment to execute
@@ -2639,6 +2678,7 @@ private:
     String m_parsedFile;
     bool m_allowLink;
     bool m_allowTrace;
+    bool m_allowCompile;
 };
 
 }; // namespace TelEngine
@@ -29,6 +29,17 @@
 
 using namespace TelEngine;
 
+// Number of buckets in the transaction matching indexes
+#define TRANS_INDEX_SIZE 1021
+
+// Timer wheel resolution in microseconds
+#define WHEEL_TICK 4000
+// Each wheel level has 64 slots, 4 levels cover over 18 hours
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
 static TokenDict sip_responses[] = {
     { "Trying", 100 },
     { "Ringing", 180 },
@@ -171,13 +182,23 @@ SIPEngine::SIPEngine(const char* userAgent)
     : Mutex(true,"SIPEngine"),
       m_t1(500000), m_t4(5000000), m_reqTransCount(5), m_rspTransCount(6),
       m_maxForwards(70),
-      m_flags(0), m_lazyTrying(false),
+      m_flags(0), m_lazyTrying(false), m_lazyParse(false),
       m_userAgent(userAgent), m_nc(0), m_nonce_time(0),
       m_nonce_mutex(false,"SIPEngine::nonce"),
-      m_autoChangeParty(false)
+      m_autoChangeParty(false),
+      m_wheel(0), m_wheelTick(0), m_timers(0),
+      m_transListed(0), m_transDead(0)
 {
+    m_queueHead[PendingQueue] = m_queueTail[PendingQueue] = 0;
+    m_queueHead[ReadyQueue] = m_queueTail[ReadyQueue] = 0;
     debugName("sipengine");
     DDebug(this,DebugInfo,"SIPEngine::SIPEngine() [%p]",this);
+    m_branchIndex = new ObjList[TRANS_INDEX_SIZE];
+    m_callIndex = new ObjList[TRANS_INDEX_SIZE];
+    m_wheel = new SIPTransaction*[WHEEL_LEVELS * WHEEL_SLOTS];
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+	m_wheel[i] = 0;
+    m_wheelTick = Time::now() / WHEEL_TICK;
     m_seq = new SIPSequence;
     m_seq->deref();
     if (m_userAgent.null())
@@ -191,12 +212,247 @@ SIPEngine::SIPEngine(const char* userAgent)
 SIPEngine::~SIPEngine()
 {
     DDebug(this,DebugInfo,"SIPEngine::~SIPEngine() [%p]",this);
+    // transactions remove themselves from the indexes and queues
+    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext())
+	static_cast<SIPTransaction*>(l->get())->m_listed = false;
+    m_transList.clear();
+    delete[] m_branchIndex;
+    delete[] m_callIndex;
+    delete[] m_wheel;
+}
+
+void SIPEngine::remove(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock mylock(this);
+    dequeue(transaction,PendingQueue);
+    dequeue(transaction,ReadyQueue);
+    unschedule(transaction);
+    removeIndex(transaction,transaction->getBranch());
+    if (!transaction->m_listed)
+	return;
+    transaction->m_listed = false;
+    m_transList.remove(transaction,false);
+    m_transListed--;
+    if (m_transDead > m_transListed)
+	m_transDead = m_transListed;
+}
+
+// The order of the main list doesn't matter, events are reported in the
+//  order transactions were queued so add new transactions at its start
+void SIPEngine::append(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock mylock(this);
+    m_transList.insert(transaction);
+    transaction->m_listed = true;
+    m_transListed++;
+    addIndex(transaction,false);
+    enqueue(transaction,ReadyQueue);
+}
+
+void SIPEngine::insert(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock mylock(this);
+    m_transList.insert(transaction);
+    transaction->m_listed = true;
+    m_transListed++;
+    addIndex(transaction,true);
+    enqueue(transaction,ReadyQueue,true);
+}
+
+// Add a transaction to the matching indexes, keep the order of the main list
+void SIPEngine::addIndex(SIPTransaction* transaction, bool first)
+{
+    const String& branch = transaction->getBranch();
+    ObjList* l = branch ? &m_branchIndex[branch.hash() % TRANS_INDEX_SIZE] : 0;
+    if (l)
+	(first ? l->insert(transaction) : l->append(transaction))->setDelete(false);
+    l = &m_callIndex[transaction->getCallID().hash() % TRANS_INDEX_SIZE];
+    (first ? l->insert(transaction) : l->append(transaction))->setDelete(false);
+}
+
+// Remove a transaction from the matching indexes
+void SIPEngine::removeIndex(SIPTransaction* transaction, const String& branch)
+{
+    if (branch)
+	m_branchIndex[branch.hash() % TRANS_INDEX_SIZE].remove(transaction,false);
+    m_callIndex[transaction->getCallID().hash() % TRANS_INDEX_SIZE].remove(transaction,false);
+}
+
+// Move a transaction in the index after its branch was changed
+void SIPEngine::reindex(SIPTransaction* transaction, const String& oldBranch)
+{
+    Lock mylock(this);
+    if ((oldBranch == transaction->getBranch()) || !transaction->m_listed)
+	return;
+    removeIndex(transaction,oldBranch);
+    addIndex(transaction,false);
+}
+
+// Queue a transaction that has something to report without waiting
+void SIPEngine::enqueue(SIPTransaction* transaction, int queue, bool first)
+{
+    Lock mylock(this);
+    if (transaction->m_queued[queue] || (transaction->m_state == SIPTransaction::Invalid))
+	return;
+    transaction->m_queued[queue] = true;
+    if (first) {
+	transaction->m_queuePrev[queue] = 0;
+	transaction->m_queueNext[queue] = m_queueHead[queue];
+	if (m_queueHead[queue])
+	    m_queueHead[queue]->m_queuePrev[queue] = transaction;
+	else
+	    m_queueTail[queue] = transaction;
+	m_queueHead[queue] = transaction;
+    }
+    else {
+	transaction->m_queueNext[queue] = 0;
+	transaction->m_queuePrev[queue] = m_queueTail[queue];
+	if (m_queueTail[queue])
+	    m_queueTail[queue]->m_queueNext[queue] = transaction;
+	else
+	    m_queueHead[queue] = transaction;
+	m_queueTail[queue] = transaction;
+    }
+}
+
+// Remove a transaction from an event queue
+void SIPEngine::dequeue(SIPTransaction* transaction, int queue)
+{
+    if (!transaction->m_queued[queue])
+	return;
+    transaction->m_queued[queue] = false;
+    SIPTransaction* prev = transaction->m_queuePrev[queue];
+    SIPTransaction* next = transaction->m_queueNext[queue];
+    if (prev)
+	prev->m_queueNext[queue] = next;
+    else
+	m_queueHead[queue] = next;
+    if (next)
+	next->m_queuePrev[queue] = prev;
+    else
+	m_queueTail[queue] = prev;
+    transaction->m_queuePrev[queue] = transaction->m_queueNext[queue] = 0;
+}
+
+// Put a transaction in the timer wheel slot matching its timeout
+void SIPEngine::schedule(SIPTransaction* transaction)
+{
+    Lock mylock(this);
+    unschedule(transaction);
+    if (!transaction->m_timeout || (transaction->m_state == SIPTransaction::Invalid))
+	return;
+    u_int64_t expire = (transaction->m_timeout + WHEEL_TICK - 1) / WHEEL_TICK;
+    if (expire < m_wheelTick)
+	expire = m_wheelTick;
+    u_int64_t delta = expire - m_wheelTick;
+    int level = 0;
+    while ((level < WHEEL_LEVELS - 1) && (delta >> (WHEEL_BITS * (level + 1))))
+	level++;
+    // too far in the future, it will be rescheduled when reached
+    if (delta >> (WHEEL_BITS * WHEEL_LEVELS))
+	expire = m_wheelTick + (1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    SIPTransaction** slot = m_wheel + level * WHEEL_SLOTS +
+	(int)((expire >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    transaction->m_timerSlot = slot;
+    transaction->m_timerPrev = 0;
+    transaction->m_timerNext = *slot;
+    if (*slot)
+	(*slot)->m_timerPrev = transaction;
+    *slot = transaction;
+    m_timers++;
+}
+
+// Remove a transaction from the timer wheel
+void SIPEngine::unschedule(SIPTransaction* transaction)
+{
+    if (!transaction->m_timerSlot)
+	return;
+    if (transaction->m_timerPrev)
+	transaction->m_timerPrev->m_timerNext = transaction->m_timerNext;
+    else
+	*transaction->m_timerSlot = transaction->m_timerNext;
+    if (transaction->m_timerNext)
+	transaction->m_timerNext->m_timerPrev = transaction->m_timerPrev;
+    transaction->m_timerPrev = transaction->m_timerNext = 0;
+    transaction->m_timerSlot = 0;
+    m_timers--;
+}
+
+// Advance the timer wheel up to the given time, queue expired transactions
+void SIPEngine::runTimers(u_int64_t time)
+{
+    u_int64_t tick = time / WHEEL_TICK;
+    if (!m_timers) {
+	if (m_wheelTick <= tick)
+	    m_wheelTick = tick + 1;
+	return;
+    }
+    while (m_wheelTick <= tick) {
+	int idx = (int)(m_wheelTick & WHEEL_MASK);
+	// when a level wraps around move down the next slot of the level above
+	int cascade = idx;
+	for (int level = 1; !cascade && (level < WHEEL_LEVELS); level++) {
+	    cascade = (int)((m_wheelTick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	    SIPTransaction* t = m_wheel[level * WHEEL_SLOTS + cascade];
+	    while (t) {
+		SIPTransaction* next = t->m_timerNext;
+		schedule(t);
+		t = next;
+	    }
+	}
+	m_wheelTick++;
+	while (SIPTransaction* t = m_wheel[idx]) {
+	    unschedule(t);
+	    enqueue(t,ReadyQueue);
+	}
+    }
+}
+
+// Finish reporting an event, forget the transaction if it became invalid
+SIPEvent* SIPEngine::gotEvent(SIPTransaction* transaction, SIPEvent* event)
+{
+    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
+	event,SIPTransaction::stateName(event->getState()),transaction,this);
+    if (transaction->getState() == SIPTransaction::Invalid) {
+	dequeue(transaction,PendingQueue);
+	dequeue(transaction,ReadyQueue);
+	unschedule(transaction);
+	removeIndex(transaction,transaction->getBranch());
+	// finding it in the main list is expensive, drop finished ones in batches
+	if (transaction->m_listed && ((++m_transDead * 8) > m_transListed))
+	    sweep();
+    }
+    return event;
+}
+
+// Remove all finished transactions from the main list
+void SIPEngine::sweep()
+{
+    ObjList* l = &m_transList;
+    while (l) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	if (t && (t->getState() == SIPTransaction::Invalid)) {
+	    t->m_listed = false;
+	    m_transListed--;
+	    // this moves the next transaction in current list item
+	    l->remove();
+	    continue;
+	}
+	l = l->next();
+    }
+    m_transDead = 0;
 }
 
 SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
 {
     DDebug(this,DebugInfo,"addMessage(%p,%d) [%p]",buf,len,this);
-    SIPMessage* msg = SIPMessage::fromParsing(ep,buf,len);
+    SIPMessage* msg = SIPMessage::fromParsing(ep,buf,len,0,m_lazyParse);
     if (ep)
 	ep->deref();
     if (msg) {
@@ -207,6 +463,30 @@ SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
     return 0;
 }
 
+// Match a message against the transactions in an index bucket
+// Remember the last transaction that reported a forked answer
+static SIPTransaction* matchList(ObjList& list, SIPMessage* message, const String& branch,
+    SIPTransaction*& forked, bool skipBranch = false)
+{
+    for (ObjList* l = list.skipNull(); l; l = l->skipNext()) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	// transactions with the same branch were already checked
+	if (skipBranch && branch && (branch == t->getBranch()))
+	    continue;
+	switch (t->processMessage(message,branch)) {
+	    case SIPTransaction::Matched:
+		return t;
+	    case SIPTransaction::NoDialog:
+		forked = t;
+		break;
+	    case SIPTransaction::NoMatch:
+	    default:
+		break;
+	}
+    }
+    return 0;
+}
+
 SIPTransaction* SIPEngine::addMessage(SIPMessage* message)
 {
     DDebug(this,DebugInfo,"addMessage(%p) [%p]",message,this);
@@ -229,22 +509,17 @@ SIPTransaction* SIPEngine::addMessage(SIPMessage* message)
 	branch = *br;
     Lock lock(this);
     SIPTransaction* forked = 0;
-    ObjList* l = &m_transList;
-    for (; l; l = l->next()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	if (!t)
-	    continue;
-	switch (t->processMessage(message,branch)) {
-	    case SIPTransaction::Matched:
-		return t;
-	    case SIPTransaction::NoDialog:
-		forked = t;
-		break;
-	    case SIPTransaction::NoMatch:
-	    default:
-		break;
-	}
+    SIPTransaction* t = 0;
+    // RFC 3261 transactions can match only their own branch...
+    if (branch)
+	t = matchList(m_branchIndex[branch.hash() % TRANS_INDEX_SIZE],message,branch,forked);
+    // ...while RFC 2543 matching and ACK to 2xx always need the same Call-ID
+    if (!t && (branch.null() || message->isACK())) {
+	const String& callid = message->getHeaderValue("Call-ID");
+	t = matchList(m_callIndex[callid.hash() % TRANS_INDEX_SIZE],message,branch,forked,true);
     }
+    if (t)
+	return t;
     if (forked)
 	return forkInvite(message,forked);
 
@@ -280,32 +555,30 @@ bool SIPEngine::process()
 SIPEvent* SIPEngine::getEvent()
 {
     Lock lock(this);
-    ObjList* l = m_transList.skipNull();
-    if (!l)
-	return 0;
     u_int64_t time = Time::now();
-    for (; l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    runTimers(time);
+    SIPTransaction* t = m_queueHead[PendingQueue];
+    while (t) {
 	SIPEvent* e = t->getEvent(true,time);
-	if (e) {
-	    DDebug(this,DebugInfo,"Got pending event %p (state %s) from transaction %p [%p]",
-		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
-	    return e;
-	}
+	if (e)
+	    return gotEvent(t,e);
+	SIPTransaction* next = t->m_queueNext[PendingQueue];
+	dequeue(t,PendingQueue);
+	t = next;
     }
     time = Time::now();
-    for (l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    for (t = m_queueHead[ReadyQueue]; t; ) {
+	int state = t->getState();
 	SIPEvent* e = t->getEvent(false,time);
-	if (e) {
-	    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
-		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
-	    return e;
-	}
+	// firing a timer may have changed the timeout
+	schedule(t);
+	if (e)
+	    return gotEvent(t,e);
+	SIPTransaction* next = t->m_queueNext[ReadyQueue];
+	// keep it if it moved to a state that may report something
+	if (t->getState() == state)
+	    dequeue(t,ReadyQueue);
+	t = next;
     }
     return 0;
 }
@@ -517,6 +790,7 @@ int SIPEngine::authUser(const SIPMessage* message, String& user, bool proxy, Gen
     long bestAge = -1;
     String bestNonce;
     const char* hdr = proxy ? "Proxy-Authorization" : "Authorization";
+    message->decodeHeaders();
     const ObjList* l = &message->header;
     for (; l; l = l->next()) {
 	const GenObject* o = l->get();
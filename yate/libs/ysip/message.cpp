@@ -29,6 +29,148 @@ using namespace TelEngine;
 
 static Regexp s_angled("<\\([^>]\\+\\)>");
 
+// Header lines built while parsing lazily, the rest are built on first access
+static const struct {
+    const char* name;
+    char compact;
+} s_lazyNames[] = {
+    { "Via", 'v' },
+    { "Call-ID", 'i' },
+    { "From", 'f' },
+    { "To", 't' },
+    { "CSeq", 0 },
+    { "Content-Length", 'l' },
+    { 0, 0 }
+};
+
+// Find the canonical name of a header line built while parsing lazily
+static const char* lazyName(const char* name, int len)
+{
+    for (int i = 0; s_lazyNames[i].name; i++) {
+	if (len == 1) {
+	    if (*name == s_lazyNames[i].compact)
+		return s_lazyNames[i].name;
+	}
+	else if (((int)::strlen(s_lazyNames[i].name) == len) &&
+	    !::strncasecmp(name,s_lazyNames[i].name,len))
+	    return s_lazyNames[i].name;
+    }
+    return 0;
+}
+
+// Protects the lazy headers of messages shared by several threads
+static Mutex s_lazyMutex(false,"SIPLazyHeaders");
+
+// Remove the line breaks of folded header values, with the blanks following them
+static void unfoldValue(String& value)
+{
+    String tmp;
+    const char* s = value.c_str();
+    int start = 0;
+    int i = 0;
+    while (s[i]) {
+	if ((s[i] != '\r') && (s[i] != '\n')) {
+	    i++;
+	    continue;
+	}
+	tmp.append(s + start,i - start);
+	if ((s[i] == '\r') && (s[i + 1] == '\n'))
+	    i++;
+	i++;
+	while ((s[i] == ' ') || (s[i] == '\t'))
+	    i++;
+	start = i;
+    }
+    tmp.append(s + start,i - start);
+    value = tmp;
+}
+
+namespace TelEngine {
+
+// Text of the header lines of a lazily parsed message
+class SIPLazyHeaders
+{
+public:
+    struct Line {
+	const char* known;
+	int name;
+	int nameLen;
+	int value;
+	int valueLen;
+	bool folded;
+	MimeHeaderLine* line;
+    };
+    inline SIPLazyHeaders()
+	: m_lines(0), m_count(0), m_alloc(0), m_contentType(false)
+	{ }
+    ~SIPLazyHeaders();
+    Line* add();
+    MimeHeaderLine* build(Line& l) const;
+    const MimeHeaderLine* find(const char* name, bool last) const;
+    String m_text;
+    Line* m_lines;
+    unsigned int m_count;
+    unsigned int m_alloc;
+    bool m_contentType;
+};
+
+}; // namespace TelEngine
+
+SIPLazyHeaders::~SIPLazyHeaders()
+{
+    for (unsigned int i = 0; i < m_count; i++)
+	TelEngine::destruct(m_lines[i].line);
+    delete[] m_lines;
+}
+
+SIPLazyHeaders::Line* SIPLazyHeaders::add()
+{
+    if (m_count >= m_alloc) {
+	m_alloc = m_alloc ? (2 * m_alloc) : 16;
+	Line* lines = new Line[m_alloc];
+	for (unsigned int i = 0; i < m_count; i++)
+	    lines[i] = m_lines[i];
+	delete[] m_lines;
+	m_lines = lines;
+    }
+    Line* l = m_lines + m_count++;
+    l->known = 0;
+    l->line = 0;
+    return l;
+}
+
+// Build a header line from its text, same as the eager parser does
+MimeHeaderLine* SIPLazyHeaders::build(Line& l) const
+{
+    String name(m_text.c_str() + l.name,l.nameLen);
+    name = uncompactForm(name);
+    String value(m_text.c_str() + l.value,l.valueLen);
+    if (l.folded)
+	unfoldValue(value);
+    value.trimBlanks();
+    if ((name &= "WWW-Authenticate") ||
+	(name &= "Proxy-Authenticate") ||
+	(name &= "Authorization") ||
+	(name &= "Proxy-Authorization"))
+	return new MimeAuthLine(name,value);
+    return new MimeHeaderLine(name,value);
+}
+
+// Find a header line built while parsing, returns null if not one of them
+const MimeHeaderLine* SIPLazyHeaders::find(const char* name, bool last) const
+{
+    const MimeHeaderLine* res = 0;
+    for (unsigned int i = 0; i < m_count; i++) {
+	const Line& l = m_lines[i];
+	if (!(l.line && (l.line->name() &= name)))
+	    continue;
+	if (!last)
+	    return l.line;
+	res = l.line;
+    }
+    return res;
+}
+
 SIPMessage::SIPMessage(const SIPMessage& original)
     : RefObject(),
       version(original.version), method(original.method), uri(original.uri),
@@ -36,7 +178,7 @@ SIPMessage::SIPMessage(const SIPMessage& original)
       body(0), m_ep(0),
       m_valid(original.isValid()), m_answer(original.isAnswer()),
       m_outgoing(original.isOutgoing()), m_ack(original.isACK()),
-      m_cseq(-1), m_flags(original.getFlags())
+      m_cseq(-1), m_flags(original.getFlags()), m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(&%p) [%p]",
 	&original,this);
@@ -45,6 +187,7 @@ SIPMessage::SIPMessage(const SIPMessage& original)
     setParty(original.getParty());
     setSequence(original.getSequence());
     bool via1 = true;
+    original.decodeHeaders();
     const ObjList* l = &original.header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* hl = static_cast<MimeHeaderLine*>(l->get());
@@ -66,15 +209,17 @@ SIPMessage::SIPMessage(const SIPMessage& original)
 SIPMessage::SIPMessage(const char* _method, const char* _uri, const char* _version)
     : version(_version), method(_method), uri(_uri), code(0),
       body(0), m_ep(0), m_valid(true),
-      m_answer(false), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1)
+      m_answer(false), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
+      m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage('%s','%s','%s') [%p]",
 	_method,_uri,_version,this);
 }
 
-SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen)
+SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen, bool lazy)
     : code(0), body(0), m_ep(ep), m_valid(false),
-      m_answer(false), m_outgoing(false), m_ack(false), m_cseq(-1), m_flags(-1)
+      m_answer(false), m_outgoing(false), m_ack(false), m_cseq(-1), m_flags(-1),
+      m_lazy(0)
 {
     DDebug(DebugInfo,"SIPMessage::SIPMessage(%p,%d) [%p]\r\n------\r\n%s------",
 	buf,len,this,buf);
@@ -86,13 +231,14 @@ SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bod
     }
     if (len < 0)
 	len = ::strlen(buf);
-    m_valid = parse(buf,len,bodyLen);
+    m_valid = parse(buf,len,bodyLen,lazy);
 }
 
 SIPMessage::SIPMessage(const SIPMessage* message, int _code, const char* _reason)
     : code(_code), body(0),
       m_ep(0), m_valid(false),
-      m_answer(true), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1)
+      m_answer(true), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
+      m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%d,'%s') [%p]",
 	message,_code,_reason,this);
@@ -121,7 +267,8 @@ SIPMessage::SIPMessage(const SIPMessage* message, int _code, const char* _reason
 SIPMessage::SIPMessage(const SIPMessage* original, const SIPMessage* answer)
     : method("ACK"), code(0),
       body(0), m_ep(0), m_valid(false),
-      m_answer(false), m_outgoing(true), m_ack(true), m_cseq(-1), m_flags(-1)
+      m_answer(false), m_outgoing(true), m_ack(true), m_cseq(-1), m_flags(-1),
+      m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%p) [%p]",original,answer,this);
     if (!(original && original->isValid()))
@@ -184,6 +331,7 @@ SIPMessage::~SIPMessage()
     m_valid = false;
     setParty();
     setBody();
+    delete m_lazy;
 }
 
 void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domain, const char* dlgTag, int flags)
@@ -196,6 +344,7 @@ void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domai
 	this);
     if (!engine)
 	return;
+    decodeHeaders();
     if (-1 == flags)
 	flags = m_flags;
     if (-1 == flags)
@@ -358,6 +507,7 @@ bool SIPMessage::copyHeader(const SIPMessage* message, const char* name, const c
 {
     const MimeHeaderLine* hl = message ? message->getHeader(name) : 0;
     if (hl) {
+	decodeHeaders();
 	header.append(hl->clone(newName));
 	return true;
     }
@@ -369,6 +519,8 @@ int SIPMessage::copyAllHeaders(const SIPMessage* message, const char* name, cons
     if (!(message && name && *name))
 	return 0;
     int c = 0;
+    decodeHeaders();
+    message->decodeHeaders();
     const ObjList* l = &message->header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* hl = static_cast<const MimeHeaderLine*>(l->get());
@@ -416,9 +568,9 @@ bool SIPMessage::parseFirst(String& line)
     return true;
 }
 
-bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
+bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen, bool lazy)
 {
-    DDebug(DebugAll,"SIPMessage::parse(%p,%d) [%p]",buf,len,this);
+    DDebug(DebugAll,"SIPMessage::parse(%p,%d,%s) [%p]",buf,len,String::boolText(lazy),this);
     String* line = 0;
     while (len > 0) {
 	line = MimeBody::getUnfoldedLine(buf,len);
@@ -435,7 +587,8 @@ bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
     }
     line->destruct();
     int clen = -1;
-    while (len > 0) {
+    bool eager = !(lazy && parseLazy(buf,len,clen));
+    while (eager && (len > 0)) {
 	line = MimeBody::getUnfoldedLine(buf,len);
 	if (line->null()) {
 	    // Found end of headers
@@ -489,18 +642,157 @@ bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
 		len = clen;
 	    }
 	}
-	buildBody(buf,len);
+	// without a Content-Type the body would be dropped anyway
+	if (!m_lazy || m_lazy->m_contentType)
+	    buildBody(buf,len);
     }
     else
 	*bodyLen = (clen >= 0) ? clen : 0;
-    DDebug(DebugAll,"SIPMessage::parse %d header lines, body %p",
-	header.count(),body);
+    DDebug(DebugAll,"SIPMessage::parse %d header lines%s, body %p",
+	(m_lazy ? (int)m_lazy->m_count : header.count()),(m_lazy ? " (lazy)" : ""),body);
     return true;
 }
 
-SIPMessage* SIPMessage::fromParsing(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen)
+// Index the header lines found in the received buffer, build only the lines
+//  needed to match transactions. Returns false to let the full parser handle
+//  unusual or invalid headers
+bool SIPMessage::parseLazy(const char*& buf, int& len, int& clen)
 {
-    SIPMessage* msg = new SIPMessage(ep,buf,len,bodyLen);
+    SIPLazyHeaders* lazy = new SIPLazyHeaders;
+    int cl = -1;
+    int cseq = -1;
+    String cseqMethod;
+    int i = 0;
+    while (i < len) {
+	// find the end of the (possibly folded) line, same as getUnfoldedLine()
+	int start = i;
+	int end = i;
+	bool folded = false;
+	for (;;) {
+	    while ((i < len) && buf[i] && (buf[i] != '\r') && (buf[i] != '\n'))
+		i++;
+	    if ((i < len) && !buf[i]) {
+		delete lazy;
+		return false;
+	    }
+	    end = i;
+	    if (i < len) {
+		if ((buf[i] == '\r') && (i + 1 < len) && (buf[i + 1] == '\n'))
+		    i++;
+		i++;
+	    }
+	    if ((end == start) || (i >= len) || ((buf[i] != ' ') && (buf[i] != '\t')))
+		break;
+	    folded = true;
+	    while ((i < len) && ((buf[i] == ' ') || (buf[i] == '\t')))
+		i++;
+	}
+	// empty line - found end of headers
+	if (end == start)
+	    break;
+	int col = start;
+	while ((col < end) && (buf[col] != ':'))
+	    col++;
+	int ns = start;
+	int ne = col;
+	while ((ns < ne) && ((buf[ns] == ' ') || (buf[ns] == '\t')))
+	    ns++;
+	while ((ne > ns) && ((buf[ne - 1] == ' ') || (buf[ne - 1] == '\t')))
+	    ne--;
+	bool ok = (col < end) && (ns < ne);
+	for (int j = ns; ok && (j < ne); j++)
+	    ok = (buf[j] != '\r') && (buf[j] != '\n');
+	if (!ok) {
+	    delete lazy;
+	    return false;
+	}
+	SIPLazyHeaders::Line* l = lazy->add();
+	l->name = ns;
+	l->nameLen = ne - ns;
+	l->value = col + 1;
+	l->valueLen = end - col - 1;
+	l->folded = folded;
+	l->known = lazyName(buf + ns,ne - ns);
+	if (!l->known) {
+	    if ((ne - ns == 1) ? (buf[ns] == 'c') :
+		    ((ne - ns == 12) && !::strncasecmp(buf + ns,"Content-Type",12)))
+		lazy->m_contentType = true;
+	    continue;
+	}
+	String value(buf + col + 1,end - col - 1);
+	if (folded)
+	    unfoldValue(value);
+	value.trimBlanks();
+	String name(buf + ns,ne - ns);
+	l->line = new MimeHeaderLine(uncompactForm(name),value);
+	XDebug(DebugAll,"SIPMessage::parseLazy header='%s' value='%s'",
+	    l->line->name().c_str(),l->line->c_str());
+	if ((cl < 0) && (l->line->name() &= "Content-Length"))
+	    cl = value.toInteger(-1,10);
+	else if ((cseq < 0) && (l->line->name() &= "CSeq")) {
+	    int sep = value.find(' ');
+	    if (sep > 0) {
+		cseq = value.substr(0,sep).toInteger(-1,10);
+		if (m_answer) {
+		    cseqMethod = value.substr(sep + 1);
+		    cseqMethod.trimBlanks().toUpper();
+		}
+	    }
+	}
+    }
+    lazy->m_text.assign(buf,i);
+    buf += i;
+    len -= i;
+    clen = cl;
+    if (cseq >= 0) {
+	m_cseq = cseq;
+	if (m_answer)
+	    method = cseqMethod;
+    }
+    m_lazy = lazy;
+    return true;
+}
+
+// Build all header lines in received order, move in the ones already built
+// The lazy headers are dropped only after the list is complete so concurrent
+//  readers either wait here or see the full list
+void SIPMessage::buildHeaders() const
+{
+    Lock mylock(s_lazyMutex);
+    SIPLazyHeaders* lazy = m_lazy;
+    if (!lazy)
+	return;
+    ObjList* hdr = const_cast<ObjList*>(&header);
+    ObjList* last = hdr->last();
+    for (unsigned int i = 0; i < lazy->m_count; i++) {
+	SIPLazyHeaders::Line& l = lazy->m_lines[i];
+	MimeHeaderLine* line = l.line ? l.line : lazy->build(l);
+	l.line = 0;
+	last = last->append(line);
+    }
+    m_lazy = 0;
+    mylock.drop();
+    delete lazy;
+}
+
+// Find an already built header line while the message is still lazy
+// Returns false if the whole header list must be searched instead
+bool SIPMessage::findLazy(const char* name, bool last, const MimeHeaderLine*& line) const
+{
+    if (!(name[1] && lazyName(name,::strlen(name))))
+	return false;
+    Lock mylock(s_lazyMutex);
+    if (!m_lazy)
+	return false;
+    // lines are moved to the header list when built, they stay valid
+    line = m_lazy->find(name,last);
+    return true;
+}
+
+SIPMessage* SIPMessage::fromParsing(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen,
+    bool lazy)
+{
+    SIPMessage* msg = new SIPMessage(ep,buf,len,bodyLen,lazy);
     if (msg->isValid())
 	return msg;
     DDebug("SIPMessage",DebugInfo,"Invalid message");
@@ -541,6 +833,12 @@ const MimeHeaderLine* SIPMessage::getHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    if (m_lazy) {
+	const MimeHeaderLine* line = 0;
+	if (findLazy(name,false,line))
+	    return line;
+	buildHeaders();
+    }
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -554,6 +852,12 @@ const MimeHeaderLine* SIPMessage::getLastHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    if (m_lazy) {
+	const MimeHeaderLine* line = 0;
+	if (findLazy(name,true,line))
+	    return line;
+	buildHeaders();
+    }
     const MimeHeaderLine* res = 0;
     const ObjList* l = &header;
     for (; l; l = l->next()) {
@@ -568,6 +872,7 @@ void SIPMessage::clearHeaders(const char* name)
 {
     if (!(name && *name))
 	return;
+    decodeHeaders();
     ObjList* l = &header;
     while (l) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -583,6 +888,7 @@ int SIPMessage::countHeaders(const char* name) const
     if (!(name && *name))
 	return 0;
     int res = 0;
+    decodeHeaders();
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -618,6 +924,7 @@ const String& SIPMessage::getHeaders() const
 	else
 	    m_string << method << " " << uri << " " << version << "\r\n";
 
+	decodeHeaders();
 	const ObjList* l = &header;
 	for (; l; l = l->next()) {
 	    MimeHeaderLine* t = static_cast<MimeHeaderLine*>(l->get());
@@ -679,6 +986,7 @@ MimeAuthLine* SIPMessage::buildAuth(const String& username, const String& passwo
     const String& meth, const String& uri, bool proxy, SIPEngine* engine) const
 {
     const char* hdr = proxy ? "Proxy-Authenticate" : "WWW-Authenticate";
+    decodeHeaders();
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeAuthLine* t = YOBJECT(MimeAuthLine,l->get());
@@ -746,6 +1054,7 @@ MimeAuthLine* SIPMessage::buildAuth(const SIPMessage& original, SIPEngine* engin
 ObjList* SIPMessage::getRoutes() const
 {
     ObjList* list = 0;
+    decodeHeaders();
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* h = YOBJECT(MimeHeaderLine,l->get());
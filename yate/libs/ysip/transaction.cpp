@@ -30,8 +30,13 @@ using namespace TelEngine;
 SIPTransaction::SIPTransaction(SIPMessage* message, SIPEngine* engine, bool outgoing)
     : m_outgoing(outgoing), m_invite(false), m_transmit(false), m_state(Invalid),
       m_response(0), m_timeouts(0), m_timeout(0),
-      m_firstMessage(message), m_lastMessage(0), m_pending(0), m_engine(engine), m_private(0)
+      m_firstMessage(message), m_lastMessage(0), m_pending(0), m_engine(engine), m_private(0),
+      m_timerPrev(0), m_timerNext(0), m_timerSlot(0), m_listed(false)
 {
+    for (int i = 0; i < 2; i++) {
+	m_queuePrev[i] = m_queueNext[i] = 0;
+	m_queued[i] = false;
+    }
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(%p,%p,%d) [%p]",
 	message,engine,outgoing,this);
     if (m_firstMessage) {
@@ -77,8 +82,13 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
       m_firstMessage(original.m_firstMessage), m_lastMessage(original.m_lastMessage),
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(original.m_tag),
-      m_private(0)
+      m_private(0),
+      m_timerPrev(0), m_timerNext(0), m_timerSlot(0), m_listed(false)
 {
+    for (int i = 0; i < 2; i++) {
+	m_queuePrev[i] = m_queueNext[i] = 0;
+	m_queued[i] = false;
+    }
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(&%p,%p) [%p]",
 	&original,answer,this);
 
@@ -87,11 +97,13 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
     m_firstMessage->setAutoAuth();
     msg->complete(m_engine);
     msg->addHeader(auth);
+    String oldBranch = original.m_branch;
     const NamedString* ns = msg->getParam("Via","branch",true);
     if (ns)
 	original.m_branch = *ns;
     else
 	original.m_branch.clear();
+    m_engine->reindex(&original,oldBranch);
     ns = msg->getParam("To","tag");
     if (ns)
 	original.m_tag = *ns;
@@ -122,8 +134,13 @@ SIPTransaction::SIPTransaction(const SIPTransaction& original, const String& tag
       m_firstMessage(original.m_firstMessage), m_lastMessage(0),
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(tag),
-      m_private(0)
+      m_private(0),
+      m_timerPrev(0), m_timerNext(0), m_timerSlot(0), m_listed(false)
 {
+    for (int i = 0; i < 2; i++) {
+	m_queuePrev[i] = m_queueNext[i] = 0;
+	m_queued[i] = false;
+    }
     if (m_firstMessage)
 	m_firstMessage->ref();
 
@@ -187,6 +204,8 @@ bool SIPTransaction::changeState(int newstate)
     DDebug(getEngine(),DebugAll,"SIPTransaction state changed from %s to %s [%p]",
 	stateName(m_state),stateName(newstate),this);
     m_state = newstate;
+    // a new state may have something to report right away
+    m_engine->enqueue(this,SIPEngine::ReadyQueue);
     return true;
 }
 
@@ -232,6 +251,14 @@ void SIPTransaction::setPendingEvent(SIPEvent* event, bool replace)
 	    delete event;
     else
 	m_pending = event;
+    if (m_pending)
+	m_engine->enqueue(this,SIPEngine::PendingQueue);
+}
+
+void SIPTransaction::setTransmit()
+{
+    m_transmit = true;
+    m_engine->enqueue(this,SIPEngine::PendingQueue);
 }
 
 void SIPTransaction::setTransCount(int count)
@@ -256,6 +283,7 @@ void SIPTransaction::setTimeout(u_int64_t delay, unsigned int count)
 	Debug(getEngine(),DebugAll,"SIPTransaction new %d timeouts initially " FMT64U " usec apart [%p]",
 	    m_timeouts,m_delay,this);
 #endif
+    m_engine->schedule(this);
 }
 
 SIPEvent* SIPTransaction::getEvent(bool pendingOnly, u_int64_t time)
@@ -52,6 +52,7 @@ extern YSIP_API TokenDict* SIPResponses;
 
 class SIPEngine;
 class SIPEvent;
+class SIPLazyHeaders;
 
 class YSIP_API SIPParty : public RefObject
 {
@@ -179,8 +180,11 @@ public:
      * @param bodyLen Pointer to body length to be set if the message was received
      *  on a stream transport. If not 0 the buffer must contain the message
      *  without its body
+     * @param lazy True to build only the header lines needed to match transactions,
+     *  the others are built from the kept text when first accessed
      */
-    SIPMessage(SIPParty* ep, const char* buf, int len = -1, unsigned int* bodyLen = 0);
+    SIPMessage(SIPParty* ep, const char* buf, int len = -1, unsigned int* bodyLen = 0,
+	bool lazy = false);
 
     /**
      * Creates a new SIPMessage as answer to another message.
@@ -205,10 +209,11 @@ public:
      * @param bodyLen Pointer to body length to be set if the message was received
      *  on a stream transport. If not 0 the buffer must contain the message
      *  without its body
+     * @param lazy True to delay building most header lines until accessed
      * @return A pointer to a valid new message or NULL
      */
     static SIPMessage* fromParsing(SIPParty* ep, const char* buf, int len = -1,
-	unsigned int* bodyLen = 0);
+	unsigned int* bodyLen = 0, bool lazy = false);
 
     /**
      * Build message's body. Reset it before.
@@ -366,14 +371,14 @@ public:
      * @param value Content of the new header line
      */
     inline void addHeader(const char* name, const char* value = 0)
-	{ header.append(new MimeHeaderLine(name,value)); }
+	{ decodeHeaders(); header.append(new MimeHeaderLine(name,value)); }
 
     /**
      * Append an already constructed header line
      * @param line Header line to add
      */
     inline void addHeader(MimeHeaderLine* line)
-	{ header.append(line); }
+	{ decodeHeaders(); header.append(line); }
 
     /**
      * Clear all header lines that match a name
@@ -381,6 +386,13 @@ public:
      */
     void clearHeaders(const char* name);
 
+    /**
+     * Build all header lines left undecoded by a lazy parse.
+     * This must be called before accessing the header list directly
+     */
+    inline void decodeHeaders() const
+	{ if (m_lazy) buildHeaders(); }
+
     /**
      * Set a header line constructed from name and content
      */
@@ -498,6 +510,8 @@ public:
 
     /**
      * All the headers should be in this list.
+     * Call decodeHeaders() before accessing it directly as a message parsed
+     *  lazily holds most of its received header lines as text
      */
     ObjList header;
 
@@ -508,7 +522,7 @@ public:
     MimeBody* body;
 
 protected:
-    bool parse(const char* buf, int len, unsigned int* bodyLen);
+    bool parse(const char* buf, int len, unsigned int* bodyLen, bool lazy = false);
     bool parseFirst(String& line);
     SIPParty* m_ep;
     RefPointer<SIPSequence> m_seq;
@@ -524,6 +538,10 @@ protected:
     String m_authPass;
 private:
     SIPMessage(); // no, thanks
+    bool parseLazy(const char*& buf, int& len, int& clen);
+    void buildHeaders() const;
+    bool findLazy(const char* name, bool last, const MimeHeaderLine*& line) const;
+    mutable SIPLazyHeaders* m_lazy;
 };
 
 /**
@@ -738,6 +756,7 @@ protected:
  */
 class YSIP_API SIPTransaction : public RefObject
 {
+    friend class SIPEngine;
 public:
     /**
      * Current state of the transaction
@@ -914,8 +933,7 @@ public:
      * Set the (re)transmission flag that allows the latest outgoing message
      *  to be send over the wire
      */
-    inline void setTransmit()
-	{ m_transmit = true; }
+    void setTransmit();
 
     /**
      * Change transaction status to Cleared
@@ -1133,6 +1151,16 @@ protected:
     String m_callid;
     String m_tag;
     void *m_private;
+
+private:
+    // event scheduling links owned by the engine, protected by its lock
+    SIPTransaction* m_queuePrev[2];
+    SIPTransaction* m_queueNext[2];
+    bool m_queued[2];
+    SIPTransaction* m_timerPrev;
+    SIPTransaction* m_timerNext;
+    SIPTransaction** m_timerSlot;
+    bool m_listed;
 };
 
 /**
@@ -1224,6 +1252,7 @@ protected:
  */
 class YSIP_API SIPEngine : public DebugEnabler, public Mutex
 {
+    friend class SIPTransaction;
 public:
     /**
      * Create the SIP Engine
@@ -1302,9 +1331,9 @@ public:
 
     /**
      * Get a SIPEvent from the queue.
-     * This method mainly looks into the transaction list and get all kind of
-     * events, like an incoming request (INVITE, REGISTRATION), a timer, an
-     * outgoing message.
+     * This method looks only at transactions that have something to report,
+     * like an incoming request (INVITE, REGISTRATION), an expired timer or an
+     * outgoing message. Pending events are reported before timer events.
      * This method is thread safe
      */
     SIPEvent *getEvent();
@@ -1405,6 +1434,20 @@ public:
     inline void lazyTrying(bool lazy100)
 	{ m_lazyTrying = lazy100; }
 
+    /**
+     * Check if received messages are parsed lazily
+     * @return True if only header lines needed to match transactions are built
+     */
+    inline bool lazyParse() const
+	{ return m_lazyParse; }
+
+    /**
+     * Set lazy parsing of received messages
+     * @param lazy True to build most header lines only when accessed
+     */
+    inline void lazyParse(bool lazy)
+	{ m_lazyParse = lazy; }
+
     /**
      * Retrieve various flags for this engine
      * @return Value of flags ORed together
@@ -1487,36 +1530,48 @@ public:
      * Remove a transaction from the list without dereferencing it
      * @param transaction Pointer to transaction to remove
      */
-    inline void remove(SIPTransaction* transaction)
-	{ lock(); m_transList.remove(transaction,false); unlock(); }
+    void remove(SIPTransaction* transaction);
 
     /**
-     * Append a transaction to the end of the list
+     * Add a transaction to the list, its events will be reported after
+     *  the ones of the transactions that are already waiting
      * @param transaction Pointer to transaction to append
      */
-    inline void append(SIPTransaction* transaction)
-	{ lock(); m_transList.append(transaction); unlock(); }
+    void append(SIPTransaction* transaction);
 
     /**
-     * Insert a transaction at the start of the list
+     * Add a transaction to the list, its events will be reported before
+     *  the ones of the transactions that are already waiting
      * @param transaction Pointer to transaction to insert
      */
-    inline void insert(SIPTransaction* transaction)
-	{ lock(); m_transList.insert(transaction); unlock(); }
+    void insert(SIPTransaction* transaction);
 
     /**
      * Get the number of active SIP transactions
      * @return Count of transactions in the list
      */
     inline unsigned int transactionCount()
-	{ Lock mylock(this); return m_transList.count(); }
+	{ Lock mylock(this); return m_transListed - m_transDead; }
 
 protected:
     /**
-     * The list that holds all the SIP transactions.
+     * The list that holds all the SIP transactions, newest first.
+     * Transactions must be added and removed only by append(), insert()
+     *  and remove() so the matching indexes and event queues are kept in sync.
+     * Finished transactions are in Invalid state and are dropped in batches
      */
     ObjList m_transList;
 
+    /**
+     * Transactions hashed by their branch, only for RFC 3261 branches
+     */
+    ObjList* m_branchIndex;
+
+    /**
+     * Transactions hashed by their Call-ID, used by RFC 2543 matching
+     */
+    ObjList* m_callIndex;
+
     u_int64_t m_t1;
     u_int64_t m_t4;
     int m_reqTransCount;
@@ -1524,6 +1579,7 @@ protected:
     unsigned int m_maxForwards;
     int m_flags;
     bool m_lazyTrying;
+    bool m_lazyParse;
     String m_userAgent;
     String m_allowed;
     RefPointer<SIPSequence> m_seq;
@@ -1533,6 +1589,34 @@ protected:
     u_int32_t m_nonce_time;
     Mutex m_nonce_mutex;
     bool m_autoChangeParty;
+
+private:
+    enum EventQueue {
+	PendingQueue = 0,
+	ReadyQueue = 1
+    };
+    void addIndex(SIPTransaction* transaction, bool first);
+    void removeIndex(SIPTransaction* transaction, const String& branch);
+    void reindex(SIPTransaction* transaction, const String& oldBranch);
+    void enqueue(SIPTransaction* transaction, int queue, bool first = false);
+    void dequeue(SIPTransaction* transaction, int queue);
+    void schedule(SIPTransaction* transaction);
+    void unschedule(SIPTransaction* transaction);
+    void runTimers(u_int64_t time);
+    SIPEvent* gotEvent(SIPTransaction* transaction, SIPEvent* event);
+    void sweep();
+
+    // transactions with a pending event or message to send, then those
+    //  that may report an event from their state or an expired timer
+    SIPTransaction* m_queueHead[2];
+    SIPTransaction* m_queueTail[2];
+    // hierarchical timer wheel of transactions waiting for their timeout
+    SIPTransaction** m_wheel;
+    u_int64_t m_wheelTick;
+    unsigned int m_timers;
+    // transactions in the main list and how many of them are finished
+    unsigned int m_transListed;
+    unsigned int m_transDead;
 };
 
 }
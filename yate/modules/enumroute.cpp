@@ -48,6 +48,7 @@ static String s_domains;
 static unsigned int s_minlen;
 static int s_timeout;
 static int s_retries;
+static bool s_cache = true;
 static int s_maxcall;
 
 static bool s_redirect;
@@ -68,6 +69,23 @@ static int s_reroute = 0;
 
 static EnumModule emodule;
 
+// Answer of one NAPTR query started in parallel with the other domains
+class EnumQuery : public ResolverListener
+{
+public:
+    inline EnumQuery()
+	: m_code(-1), m_done(false), m_semaphore(1,"EnumQuery",0)
+	{ }
+    virtual void resolved(Resolver::Type type, const String& dname, int code,
+	ObjList& result, const String& error);
+    bool wait(ObjList& res);
+private:
+    int m_code;
+    bool m_done;
+    ObjList m_records;
+    Semaphore m_semaphore;
+};
+
 class EnumHandler : public MessageHandler
 {
 public:
@@ -77,10 +95,38 @@ public:
     virtual bool received(Message& msg);
 private:
     static bool resolve(Message& msg,bool canRedirect);
+    static void query(const ObjList* domains,const String& prefix,ObjList& res);
     static void addRoute(String& dest,const String& src);
 };
 
 
+// Keep the records of a completed query and wake up the routing thread
+void EnumQuery::resolved(Resolver::Type type, const String& dname, int code,
+    ObjList& result, const String& error)
+{
+    for (ObjList* o = result.skipNull(); o; o = result.skipNull())
+	m_records.append(o->remove(false));
+    m_code = code;
+    m_done = true;
+    m_semaphore.unlock();
+}
+
+// Wait for the query to complete, return true if it found records
+bool EnumQuery::wait(ObjList& res)
+{
+    while (!m_done) {
+	if (Thread::check(false))
+	    return false;
+	m_semaphore.lock(Thread::idleUsec());
+    }
+    if (m_code || !m_records.skipNull())
+	return false;
+    for (ObjList* o = m_records.skipNull(); o; o = m_records.skipNull())
+	res.append(o->remove(false));
+    return true;
+}
+
+
 // Routing message handler, performs checks and calls resolve method
 bool EnumHandler::received(Message& msg)
 {
@@ -120,14 +166,7 @@ bool EnumHandler::resolve(Message& msg,bool canRedirect)
 	tmp << called.at(i) << ".";
     u_int64_t dt = Time::now();
     ObjList res;
-    for (ObjList* l = domains; l; l = l->next()) {
-	const String* s = static_cast<const String*>(l->get());
-	if (!s || s->null())
-	    continue;
-	int result = Resolver::naptrQuery(tmp + *s,res);
-	if ((result == 0) && res.skipNull())
-	    break;
-    }
+    query(domains,tmp,res);
     dt = Time::now() - dt;
     Debug(&emodule,DebugInfo,"Returned %d NAPTR records in %u.%06u s",
 	res.count(),(unsigned int)(dt / 1000000),(unsigned int)(dt % 1000000));
@@ -237,6 +276,33 @@ bool EnumHandler::resolve(Message& msg,bool canRedirect)
     return rval;
 }
 
+// Query the domains in order until one of them returns records
+// With the cache in use the queries of all domains are started at once by
+//  the resolver threads so a slow domain does not delay the next ones
+void EnumHandler::query(const ObjList* domains,const String& prefix,ObjList& res)
+{
+    ObjList queries;
+    ObjList* last = &queries;
+    for (const ObjList* l = domains->skipNull(); l; l = l->skipNext()) {
+	const String* s = static_cast<const String*>(l->get());
+	if (s->null())
+	    continue;
+	if (!s_cache) {
+	    if ((Resolver::naptrQuery(prefix + *s,res) == 0) && res.skipNull())
+		return;
+	    continue;
+	}
+	EnumQuery* q = new EnumQuery;
+	last = last->append(q);
+	Resolver::asyncQuery(Resolver::Naptr,prefix + *s,q);
+    }
+    // unanswered queries are kept by the resolver until they complete
+    for (ObjList* l = queries.skipNull(); l; l = l->skipNext()) {
+	if (static_cast<EnumQuery*>(l->get())->wait(res))
+	    return;
+    }
+}
+
 // Add one route to the result, take care of forking
 void EnumHandler::addRoute(String& dest,const String& src)
 {
@@ -307,6 +373,7 @@ void EnumModule::initialize()
 	tmp = 120000;
     s_maxcall = tmp;
 
+    s_cache = cfg.getBoolValue("general","cache",true);
     s_redirect = cfg.getBoolValue("general","redirect");
     s_autoFork = cfg.getBoolValue("general","autofork");
     s_sipUsed  = cfg.getBoolValue("protocols","sip",true);
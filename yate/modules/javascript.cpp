@@ -23,10 +23,24 @@
 #include <yatescript.h>
 #include <yatexml.h>
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
 #define NATIVE_TITLE "[native code]"
 
 #define MIN_CALLBACK_INTERVAL Thread::idleMsec()
 
+// Maximum number of cloned contexts of a global script
+#define MAX_POOL_SIZE 64
+// How long a handler waits for a free pooled context before using the main one
+#define POOL_WAIT_USEC 1000000
+
+// Trailing MSISDN digits used as key of the subscriber store suffix index
+#define STORE_SUFFIX_LEN 6
+// Journal entries written before a subscriber store is compacted
+#define STORE_COMPACT_MIN 10000
+
 using namespace TelEngine;
 namespace { // anonymous
 
@@ -118,6 +132,97 @@ private:
     RefPointer<JsMessage> m_message;
 };
 
+class JsPoolSlot;
+
+// Reference from a pooled context to an object of the main context
+// Field and method operations lock the main context only while they run,
+//  objects they return are referenced the same way and values stored in the
+//  object are rebound to the main context. Native code asking for the object
+//  itself locks the main context until an async operation or the slot release
+// A read-modify-write like counter++ takes two operations and is not atomic
+class JsSharedRef : public JsObject
+{
+public:
+    JsSharedRef(JsPoolSlot* slot, JsObject* obj);
+    virtual ~JsSharedRef();
+    virtual void* getObject(const String& name) const;
+    virtual JsObject* copy(Mutex* mtx) const;
+    virtual void fillFieldNames(ObjList& names);
+    virtual bool hasField(ObjList& stack, const String& name, GenObject* context) const;
+    virtual NamedString* getField(ObjList& stack, const String& name, GenObject* context) const;
+    virtual bool runFunction(ObjList& stack, const ExpOperation& oper, GenObject* context);
+    virtual bool runField(ObjList& stack, const ExpOperation& oper, GenObject* context);
+    virtual bool runAssign(ObjList& stack, const ExpOperation& oper, GenObject* context);
+    inline JsObject* object() const
+	{ return m_object; }
+    JsObject* lockObject() const;
+private:
+    ExpWrapper* shared(JsObject* obj, const char* name) const;
+    ExpOperation* rebind(const ExpOperation& oper) const;
+    void wrapTop(ObjList& stack) const;
+    RefPointer<JsPoolSlot> m_slot;
+    JsObject* m_object;
+};
+
+// A clone of the main context of a global script used by one handler at a time
+class JsPoolSlot : public RefObject
+{
+public:
+    JsPoolSlot(ScriptContext* main);
+    virtual ~JsPoolSlot();
+    bool init(const JsParser& parser, const char* name, const ObjList& shared);
+    void clear();
+    Mutex* lockMain();
+    void lockShared();
+    void unlockShared();
+    static void unlockThread();
+    void keepField(NamedString* field);
+    void clearFields();
+    inline ScriptContext* context()
+	{ return m_context; }
+    inline Mutex* mainMutex()
+	{ return m_main ? m_main->mutex() : 0; }
+    inline Thread* owner() const
+	{ return m_owner; }
+    inline bool busy() const
+	{ return m_busy > 0; }
+    inline void acquire(Thread* owner)
+	{ if (!m_busy) m_sharedWait = 0; m_owner = owner; m_busy++; }
+    inline bool release()
+	{ return (--m_busy <= 0); }
+    inline u_int64_t sharedWait() const
+	{ return m_sharedWait; }
+private:
+    RefPointer<ScriptContext> m_main;
+    RefPointer<ScriptContext> m_context;
+    Thread* m_owner;
+    int m_busy;
+    bool m_locked;
+    u_int64_t m_sharedWait;
+    ObjList m_fields;
+};
+
+// Pool of contexts cloned from a global script to run message handlers in parallel
+class JsPool : public RefObject
+{
+public:
+    JsPool(unsigned int size, const String& shared);
+    virtual ~JsPool();
+    bool fill(const JsParser& parser, ScriptContext* main, const char* name);
+    void shutdown();
+    JsPoolSlot* acquire(u_int64_t& wait);
+    void release(JsPoolSlot* slot);
+    inline unsigned int size() const
+	{ return m_size; }
+private:
+    Mutex m_mutex;
+    Semaphore m_free;
+    ObjList m_slots;
+    ObjList* m_shared;
+    unsigned int m_size;
+    bool m_ready;
+};
+
 class JsGlobal : public NamedString
 {
 public:
@@ -130,6 +235,8 @@ public:
 	{ return m_context; }
     inline const String& fileName()
 	{ return m_file; }
+    inline JsPool* pool()
+	{ return m_pool; }
     bool runMain();
     static void markUnused();
     static void freeUnused();
@@ -137,6 +244,7 @@ public:
     static bool initScript(const String& scriptName, const String& fileName, bool relPath = true, bool fromCfg = true);
     static bool reloadScript(const String& scriptName);
     static void loadScripts(const NamedList* sect);
+    static bool findPool(const ScriptContext* context, RefPointer<JsPool>& pool);
     inline static ObjList& globals()
 	{ return s_globals; }
     inline static void unloadAll()
@@ -144,6 +252,7 @@ public:
 private:
     JsParser m_jsCode;
     RefPointer<ScriptContext> m_context;
+    RefPointer<JsPool> m_pool;
     bool m_inUse;
     bool m_confLoaded;
     String m_file;
@@ -342,6 +451,7 @@ public:
 	{ m_message = message; m_owned = owned; }
     static void initialize(ScriptContext* context);
     void runAsync(ObjList& stack, Message* msg);
+    void dumpHandlers(String& buf, const String& script);
 protected:
     bool runNative(ObjList& stack, const ExpOperation& oper, GenObject* context);
     void getColumn(ObjList& stack, const ExpOperation* col, GenObject* context);
@@ -362,7 +472,8 @@ class JsHandler : public MessageHandler
 public:
     inline JsHandler(const char* name, unsigned priority, const ExpFunction& func, GenObject* context)
 	: MessageHandler(name,priority,__plugin.name()),
-	  m_function(func.name(),1)
+	  m_function(func.name(),1), m_stats(false,"JsHandlerStats"),
+	  m_calls(0), m_pooled(0), m_waitUsec(0), m_maxWait(0), m_runUsec(0), m_maxRun(0)
 	{
 	    XDebug(&__plugin,DebugAll,"JsHandler::JsHandler('%s',%u,'%s') [%p]",
 		name,priority,func.name().c_str(),this);
@@ -370,6 +481,7 @@ public:
 	    if (runner) {
 		m_context = runner->context();
 		m_code = runner->code();
+		JsGlobal::findPool(m_context,m_pool);
 	    }
 	}
     virtual ~JsHandler()
@@ -379,10 +491,20 @@ public:
     virtual bool received(Message& msg);
     inline const ExpFunction& function() const
 	{ return m_function; }
+    void fillStats(NamedList& params);
 private:
+    void addStats(bool pooled, u_int64_t wait, u_int64_t run);
     ExpFunction m_function;
     RefPointer<ScriptContext> m_context;
     RefPointer<ScriptCode> m_code;
+    RefPointer<JsPool> m_pool;
+    Mutex m_stats;
+    unsigned int m_calls;
+    unsigned int m_pooled;
+    u_int64_t m_waitUsec;
+    u_int64_t m_maxWait;
+    u_int64_t m_runUsec;
+    u_int64_t m_maxRun;
 };
 
 class JsMessageQueue : public MessageQueue
@@ -662,6 +784,108 @@ protected:
     bool runNative(ObjList& stack, const ExpOperation& oper, GenObject* context);
 };
 
+class JsStoreRecord;
+
+// Exact match index entry of a subscriber store, the string holds the key
+class JsStoreKey : public String
+{
+public:
+    inline JsStoreKey(const String& key, JsStoreRecord* rec)
+	: String(key), m_record(rec)
+	{ }
+    JsStoreRecord* m_record;
+};
+
+// MSISDN suffix index entry, shared by all subscribers ending in the same digits
+class JsStoreSuffix : public String
+{
+public:
+    inline JsStoreSuffix(const String& suffix)
+	: String(suffix)
+	{ }
+    ObjList m_records;
+};
+
+// Subscriber held in a subscriber store, the string holds the IMSI
+class JsStoreRecord : public String
+{
+public:
+    inline JsStoreRecord(const String& imsi)
+	: String(imsi),
+	  m_expires(0), m_tmsiKey(0), m_imeiKey(0), m_msisdnKey(0), m_suffix(0)
+	{ }
+    String m_tmsi;
+    String m_imei;
+    String m_msisdn;
+    String m_location;
+    int64_t m_expires;
+    JsStoreKey* m_tmsiKey;
+    JsStoreKey* m_imeiKey;
+    JsStoreKey* m_msisdnKey;
+    JsStoreSuffix* m_suffix;
+};
+
+// Subscriber registrations indexed by IMSI, TMSI, IMEI and MSISDN
+// Changes are appended to a journal that is periodically compacted into
+//  a configuration style file compatible with what ConfigFile saves
+class JsSubscriberStore : public JsObject
+{
+    YCLASS(JsSubscriberStore,JsObject)
+public:
+    inline JsSubscriberStore(Mutex* mtx)
+	: JsObject("SubscriberStore",mtx,true),
+	  m_imsi(1), m_tmsi(1), m_imei(1), m_msisdn(1), m_suffix(1),
+	  m_journal(0), m_journaled(0), m_count(0), m_storeMutex(false,"JsSubscriberStore")
+	{
+	    XDebug(DebugAll,"JsSubscriberStore::JsSubscriberStore() [%p]",this);
+	    params().addParam(new ExpFunction("load"));
+	    params().addParam(new ExpFunction("compact"));
+	    params().addParam(new ExpFunction("count"));
+	    params().addParam(new ExpFunction("keys"));
+	    params().addParam(new ExpFunction("get"));
+	    params().addParam(new ExpFunction("set"));
+	    params().addParam(new ExpFunction("remove"));
+	    params().addParam(new ExpFunction("findTmsi"));
+	    params().addParam(new ExpFunction("findImei"));
+	    params().addParam(new ExpFunction("findMsisdn"));
+	    params().addParam(new ExpFunction("matchMsisdn"));
+	    params().addParam(new ExpFunction("lastTmsi"));
+	}
+    JsSubscriberStore(GenObject* context, Mutex* mtx, const String& file, const String& journalFile);
+    virtual ~JsSubscriberStore();
+    virtual JsObject* runConstructor(ObjList& stack, const ExpOperation& oper, GenObject* context);
+    static void initialize(ScriptContext* context);
+protected:
+    bool runNative(ObjList& stack, const ExpOperation& oper, GenObject* context);
+private:
+    bool load();
+    bool compact();
+    void clear();
+    bool update(const String& imsi, const String& tmsi, const String& imei,
+	const String& msisdn, int64_t expires, const String& location, bool journal);
+    bool update(const String& imsi, const String& fields, bool journal);
+    bool remove(const String& imsi, bool journal);
+    bool lastTmsi(const String& tmsi, bool journal);
+    void unindex(JsStoreRecord* rec);
+    void index(JsStoreRecord* rec);
+    JsStoreRecord* matchMsisdn(const String& number, bool both) const;
+    bool writeJournal(const String& line);
+    HashList m_imsi;
+    HashList m_tmsi;
+    HashList m_imei;
+    HashList m_msisdn;
+    HashList m_suffix;
+    String m_file;
+    String m_journalFile;
+    String m_lastTmsi;
+    String m_head;
+    String m_extra;
+    FILE* m_journal;
+    unsigned int m_journaled;
+    unsigned int m_count;
+    Mutex m_storeMutex;
+};
+
 class JsChannel : public JsObject
 {
     YCLASS(JsChannel,JsObject)
@@ -718,7 +942,7 @@ public:
 	  m_stack(stack), m_msg(jsMsg), m_message(msg)
 	{ XDebug(DebugAll,"JsMsgAsync"); }
     virtual bool run()
-	{ m_msg->runAsync(*m_stack,m_message); return true; }
+	{ JsPoolSlot::unlockThread(); m_msg->runAsync(*m_stack,m_message); return true; }
 private:
     ObjList* m_stack;
     RefPointer<JsMessage> m_msg;
@@ -735,7 +959,7 @@ public:
 	  m_stack(stack), m_name(name), m_type(type), m_context(context), m_dns(jsDns)
 	{ XDebug(DebugAll,"JsDnsAsync"); }
     virtual bool run()
-	{ m_dns->runQuery(*m_stack,m_name,m_type,m_context); return true; }
+	{ JsPoolSlot::unlockThread(); m_dns->runQuery(*m_stack,m_name,m_type,m_context); return true; }
 private:
     ObjList* m_stack;
     String m_name;
@@ -757,6 +981,7 @@ static bool s_engineStop = false;
 static bool s_allowAbort = false;
 static bool s_allowTrace = false;
 static bool s_allowLink = true;
+static bool s_allowCompile = true;
 static bool s_autoExt = true;
 
 UNLOAD_PLUGIN(unloadNow)
@@ -814,6 +1039,7 @@ static void contextInit(ScriptRun* runner, const char* name = 0, JsAssist* assis
     JsHasher::initialize(ctx);
     JsJSON::initialize(ctx);
     JsDNS::initialize(ctx);
+    JsSubscriberStore::initialize(ctx);
     if (s_autoExt)
 	contextLoad(ctx,name);
 }
@@ -982,6 +1208,7 @@ static void copyObjParams(NamedList& dest, const NamedList* src)
 
 bool JsEngAsync::run()
 {
+    JsPoolSlot::unlockThread();
     switch (m_oper) {
 	case AsyncSleep:
 	    Thread::sleep((unsigned int)m_val);
@@ -1836,7 +2063,7 @@ bool JsMessage::runNative(ObjList& stack, const ExpOperation& oper, GenObject* c
 	JsRegExp* rexp = YOBJECT(JsRegExp,name);
 	JsArray* jsa = 0;
 	for (ObjList* l = m_handlers.skipNull(); l; l = l->skipNext()) {
-	    const JsHandler* h = static_cast<JsHandler*>(l->get());
+	    JsHandler* h = static_cast<JsHandler*>(l->get());
 	    if (rexp) {
 		if (!rexp->regexp().matches(*h))
 		    continue;
@@ -1856,6 +2083,7 @@ bool JsMessage::runNative(ObjList& stack, const ExpOperation& oper, GenObject* c
 	    }
 	    if (h->trackName())
 		jso->params().setParam(new ExpOperation(h->trackName(),"trackName"));
+	    h->fillStats(jso->params());
 	    jsa->push(new ExpWrapper(jso));
 	}
 	if (jsa)
@@ -2180,6 +2408,21 @@ JsObject* JsMessage::runConstructor(ObjList& stack, const ExpOperation& oper, Ge
     return obj;
 }
 
+// Add one line for each installed handler and its statistics
+void JsMessage::dumpHandlers(String& buf, const String& script)
+{
+    for (ObjList* l = m_handlers.skipNull(); l; l = l->skipNext()) {
+	JsHandler* h = static_cast<JsHandler*>(l->get());
+	NamedList stats("");
+	h->fillStats(stats);
+	buf << script << ": " << *h << "=" << h->function().name() << " priority=" << h->priority();
+	NamedIterator iter(stats);
+	while (const NamedString* ns = iter.get())
+	    buf << " " << ns->name() << "=" << *ns;
+	buf << "\r\n";
+    }
+}
+
 void JsMessage::initialize(ScriptContext* context)
 {
     if (!context)
@@ -2198,12 +2441,24 @@ bool JsHandler::received(Message& msg)
 	return false;
     DDebug(&__plugin,DebugInfo,"Running %s(message) handler for '%s'",
 	m_function.name().c_str(),c_str());
-#ifdef DEBUG
+    u_int64_t wait = 0;
+    JsPoolSlot* slot = m_pool ? m_pool->acquire(wait) : 0;
+    ScriptContext* ctx = slot ? slot->context() : (ScriptContext*)m_context;
     u_int64_t tm = Time::now();
-#endif
-    ScriptRun* runner = m_code->createRunner(m_context,NATIVE_TITLE);
-    if (!runner)
+    if (!slot && ctx) {
+	// the runner locks the main context only while evaluating code,
+	//  account the time spent until it can be locked the first time
+	Lock mylock(ctx->mutex());
+	u_int64_t t = Time::now();
+	wait += t - tm;
+	tm = t;
+    }
+    ScriptRun* runner = ctx ? m_code->createRunner(ctx,NATIVE_TITLE) : 0;
+    if (!runner) {
+	if (slot)
+	    m_pool->release(slot);
 	return false;
+    }
     JsMessage* jm = new JsMessage(&msg,runner->context()->mutex(),false);
     jm->ref();
     ObjList args;
@@ -2220,14 +2475,46 @@ bool JsHandler::received(Message& msg)
     }
     TelEngine::destruct(jm);
     TelEngine::destruct(runner);
-
-#ifdef DEBUG
     tm = Time::now() - tm;
-    Debug(&__plugin,DebugInfo,"Handler for '%s' ran for " FMT64U " usec",c_str(),tm);
-#endif
+    if (slot) {
+	// waiting for the main context when touching shared objects is not running
+	u_int64_t shared = slot->sharedWait();
+	wait += shared;
+	tm = (tm > shared) ? (tm - shared) : 0;
+	m_pool->release(slot);
+    }
+    addStats(0 != slot,wait,tm);
+    XDebug(&__plugin,DebugInfo,"Handler for '%s' waited " FMT64U " and ran for " FMT64U " usec",
+	c_str(),wait,tm);
     return ok;
 }
 
+void JsHandler::addStats(bool pooled, u_int64_t wait, u_int64_t run)
+{
+    Lock mylock(m_stats);
+    m_calls++;
+    if (pooled)
+	m_pooled++;
+    m_waitUsec += wait;
+    if (m_maxWait < wait)
+	m_maxWait = wait;
+    m_runUsec += run;
+    if (m_maxRun < run)
+	m_maxRun = run;
+}
+
+// Put the handler statistics in a list, average and maximum times are in usec
+void JsHandler::fillStats(NamedList& params)
+{
+    Lock mylock(m_stats);
+    params.setParam(new ExpOperation((int64_t)m_calls,"calls"));
+    params.setParam(new ExpOperation((int64_t)m_pooled,"pooled"));
+    params.setParam(new ExpOperation((int64_t)(m_calls ? (m_waitUsec / m_calls) : 0),"wait"));
+    params.setParam(new ExpOperation((int64_t)m_maxWait,"maxWait"));
+    params.setParam(new ExpOperation((int64_t)(m_calls ? (m_runUsec / m_calls) : 0),"run"));
+    params.setParam(new ExpOperation((int64_t)m_maxRun,"maxRun"));
+}
+
 
 void JsMessageQueue::received(Message& msg)
 {
@@ -3365,6 +3652,9 @@ void JsJSON::stringify(const NamedString* ns, String& buf, int spaces, int inden
     }
     const char* nl = spaces ? "\r\n" : "";
     JsObject* jso = YOBJECT(JsObject,oper);
+    JsSharedRef* ref = YOBJECT(JsSharedRef,jso);
+    if (ref)
+	jso = ref->lockObject();
     JsArray* jsa = YOBJECT(JsArray,jso);
     if (jsa) {
 	if (jsa->length() <= 0) {
@@ -3601,7 +3891,7 @@ void JsDNS::runQuery(ObjList& stack, const String& name, Resolver::Type type, Ge
 {
     JsArray* jsa = 0;
     ObjList res;
-    if (Resolver::query(type,name,res) == 0) {
+    if (Resolver::cachedQuery(type,name,res) == 0) {
 	jsa = new JsArray(context,mutex());
 	switch (type) {
 	    case Resolver::A4:
@@ -3658,6 +3948,569 @@ void JsDNS::initialize(ScriptContext* context)
 	addObject(params,"DNS",new JsDNS(mtx));
 }
 
+// Read a line of any length from a file, strip the line terminators
+static bool storeReadLine(FILE* f, String& line)
+{
+    line.clear();
+    char buf[1024];
+    while (::fgets(buf,sizeof(buf),f)) {
+	line << buf;
+	if (line.endsWith("\n"))
+	    break;
+    }
+    if (line.null())
+	return false;
+    unsigned int len = line.length();
+    while (len && ((line.at(len - 1) == '\n') || (line.at(len - 1) == '\r')))
+	len--;
+    line.assign(line.c_str(),len);
+    return true;
+}
+
+// MSISDN as used in indexes and matching, without international prefix
+static inline String storeNumber(const String& msisdn)
+{
+    return msisdn.startsWith("+") ? msisdn.substr(1) : msisdn;
+}
+
+// Retrieve a subscriber field from a script object, undefined and null are empty
+static String storeField(const JsObject* jso, const String& name)
+{
+    const NamedString* ns = jso->params().getParam(name);
+    if (!ns)
+	return String::empty();
+    const ExpOperation* op = YOBJECT(ExpOperation,ns);
+    if (op && (JsParser::isUndefined(*op) || JsParser::isNull(*op)))
+	return String::empty();
+    return *ns;
+}
+
+JsSubscriberStore::JsSubscriberStore(GenObject* context, Mutex* mtx,
+    const String& file, const String& journalFile)
+    : JsObject(mtx,"SubscriberStore",false),
+      m_imsi(1021), m_tmsi(1021), m_imei(1021), m_msisdn(1021), m_suffix(1021),
+      m_file(file), m_journalFile(journalFile),
+      m_journal(0), m_journaled(0), m_count(0), m_storeMutex(false,"JsSubscriberStore")
+{
+    XDebug(&__plugin,DebugAll,"JsSubscriberStore::JsSubscriberStore('%s','%s') [%p]",
+	file.c_str(),journalFile.c_str(),this);
+    // a NIB may hold a few hundred thousand subscribers
+    m_imsi.autoResize(4,262144);
+    m_tmsi.autoResize(4,262144);
+    m_imei.autoResize(4,262144);
+    m_msisdn.autoResize(4,262144);
+    m_suffix.autoResize(4,262144);
+    setPrototype(context,YSTRING("SubscriberStore"));
+}
+
+JsSubscriberStore::~JsSubscriberStore()
+{
+    XDebug(&__plugin,DebugAll,"JsSubscriberStore::~JsSubscriberStore() [%p]",this);
+    if (m_journal) {
+	::fclose(m_journal);
+	m_journal = 0;
+    }
+}
+
+void JsSubscriberStore::clear()
+{
+    if (m_journal) {
+	::fclose(m_journal);
+	m_journal = 0;
+    }
+    m_suffix.clear();
+    m_msisdn.clear();
+    m_imei.clear();
+    m_tmsi.clear();
+    m_imsi.clear();
+    m_count = 0;
+    m_journaled = 0;
+    m_lastTmsi.clear();
+    m_head.clear();
+    m_extra.clear();
+}
+
+// Read the subscribers file, replay the journal over it and fold it in
+bool JsSubscriberStore::load()
+{
+    clear();
+    String line;
+    FILE* f = ::fopen(m_file,"r");
+    if (f) {
+	String sect;
+	while (storeReadLine(f,line)) {
+	    line.trimBlanks();
+	    if (line.null() || (line.at(0) == ';'))
+		continue;
+	    if (line.at(0) == '[') {
+		int r = line.find(']');
+		if (r > 0) {
+		    sect = line.substr(1,r - 1);
+		    // sections not owned by the store are kept as they are
+		    if ((sect != YSTRING("tmsi")) && (sect != YSTRING("ues")))
+			m_extra << "\n[" << sect << "]\n";
+		}
+		continue;
+	    }
+	    int q = line.find('=');
+	    if (q <= 0)
+		continue;
+	    String key = line.substr(0,q);
+	    key.trimBlanks();
+	    if (sect == YSTRING("ues"))
+		update(key,line.substr(q + 1).trimBlanks(),false);
+	    else if (sect == YSTRING("tmsi")) {
+		if (key == YSTRING("last"))
+		    m_lastTmsi = line.substr(q + 1).trimBlanks();
+	    }
+	    else if (sect.null())
+		m_head << line << "\n";
+	    else
+		m_extra << line << "\n";
+	}
+	::fclose(f);
+    }
+    unsigned int replayed = 0;
+    f = ::fopen(m_journalFile,"r");
+    if (f) {
+	while (storeReadLine(f,line)) {
+	    switch (line.at(0)) {
+		case '+':
+		    {
+			int q = line.find('=');
+			if (q <= 1)
+			    continue;
+			update(line.substr(1,q - 1),line.substr(q + 1),false);
+		    }
+		    break;
+		case '-':
+		    remove(line.substr(1),false);
+		    break;
+		case '=':
+		    lastTmsi(line.substr(1),false);
+		    break;
+		default:
+		    continue;
+	    }
+	    replayed++;
+	}
+	::fclose(f);
+    }
+    Debug(&__plugin,DebugInfo,"Loaded %u subscribers from '%s' and %u journal entries [%p]",
+	m_count,m_file.c_str(),replayed,this);
+    if (replayed) {
+	if (compact())
+	    return true;
+	// the file is not updated, keep adding to the journal replayed over it
+	m_journaled = replayed;
+    }
+    if (!m_journal)
+	m_journal = ::fopen(m_journalFile,"a");
+    if (!m_journal) {
+	int err = errno;
+	Debug(&__plugin,DebugWarn,"Failed to open subscriber journal '%s' (%d: %s) [%p]",
+	    m_journalFile.c_str(),err,strerror(err),this);
+    }
+    return m_journal != 0;
+}
+
+// Rewrite the subscribers file from memory and start an empty journal
+bool JsSubscriberStore::compact()
+{
+    String tmp = m_file + ".tmp";
+    FILE* f = ::fopen(tmp,"w");
+    if (!f) {
+	int err = errno;
+	Debug(&__plugin,DebugWarn,"Failed to create subscriber file '%s' (%d: %s) [%p]",
+	    tmp.c_str(),err,strerror(err),this);
+	return false;
+    }
+    // keys found before any section must stay there
+    if (m_head)
+	::fprintf(f,"%s\n",m_head.c_str());
+    ::fprintf(f,"[tmsi]\nlast=%s\n\n[ues]\n",m_lastTmsi.safe());
+    for (unsigned int i = 0; i < m_imsi.length(); i++) {
+	ObjList* l = m_imsi.getList(i);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    const JsStoreRecord* rec = static_cast<const JsStoreRecord*>(l->get());
+	    ::fprintf(f,"%s=%s,%s,%s," FMT64 ",%s\n",rec->c_str(),rec->m_tmsi.safe(),
+		rec->m_imei.safe(),rec->m_msisdn.safe(),rec->m_expires,rec->m_location.safe());
+	}
+    }
+    if (m_extra)
+	::fputs(m_extra,f);
+    bool ok = !::ferror(f);
+    ok = (::fclose(f) == 0) && ok;
+    int err = 0;
+    if (!(ok && File::rename(tmp,m_file,&err))) {
+	Debug(&__plugin,DebugWarn,"Failed to save subscriber file '%s' (%d: %s) [%p]",
+	    m_file.c_str(),err,strerror(err),this);
+	File::remove(tmp);
+	return false;
+    }
+    // the journal is folded in the file, replaying it again would do no harm
+    if (m_journal)
+	::fclose(m_journal);
+    m_journal = ::fopen(m_journalFile,"w");
+    m_journaled = 0;
+    if (!m_journal) {
+	err = errno;
+	Debug(&__plugin,DebugWarn,"Failed to open subscriber journal '%s' (%d: %s) [%p]",
+	    m_journalFile.c_str(),err,strerror(err),this);
+	return false;
+    }
+    DDebug(&__plugin,DebugAll,"Compacted %u subscribers in '%s' [%p]",
+	m_count,m_file.c_str(),this);
+    return true;
+}
+
+// Append a change to the journal, compact once it grows past the subscribers count
+bool JsSubscriberStore::writeJournal(const String& line)
+{
+    if (!m_journal)
+	return false;
+    if ((::fprintf(m_journal,"%s\n",line.c_str()) < 0) || ::fflush(m_journal)) {
+	int err = errno;
+	Debug(&__plugin,DebugWarn,"Failed to write subscriber journal '%s' (%d: %s) [%p]",
+	    m_journalFile.c_str(),err,strerror(err),this);
+	return false;
+    }
+    if ((++m_journaled >= STORE_COMPACT_MIN) && (m_journaled > m_count))
+	return compact();
+    return true;
+}
+
+void JsSubscriberStore::index(JsStoreRecord* rec)
+{
+    if (rec->m_tmsi) {
+	rec->m_tmsiKey = new JsStoreKey(rec->m_tmsi,rec);
+	m_tmsi.append(rec->m_tmsiKey);
+    }
+    if (rec->m_imei) {
+	rec->m_imeiKey = new JsStoreKey(rec->m_imei,rec);
+	m_imei.append(rec->m_imeiKey);
+    }
+    String num = storeNumber(rec->m_msisdn);
+    if (num.null())
+	return;
+    rec->m_msisdnKey = new JsStoreKey(num,rec);
+    m_msisdn.append(rec->m_msisdnKey);
+    if (num.length() > STORE_SUFFIX_LEN)
+	num = num.substr(num.length() - STORE_SUFFIX_LEN);
+    JsStoreSuffix* sfx = static_cast<JsStoreSuffix*>(m_suffix[num]);
+    if (!sfx) {
+	sfx = new JsStoreSuffix(num);
+	m_suffix.append(sfx);
+    }
+    sfx->m_records.append(rec)->setDelete(false);
+    rec->m_suffix = sfx;
+}
+
+void JsSubscriberStore::unindex(JsStoreRecord* rec)
+{
+    if (rec->m_tmsiKey) {
+	m_tmsi.remove(rec->m_tmsiKey,true,true);
+	rec->m_tmsiKey = 0;
+    }
+    if (rec->m_imeiKey) {
+	m_imei.remove(rec->m_imeiKey,true,true);
+	rec->m_imeiKey = 0;
+    }
+    if (rec->m_msisdnKey) {
+	m_msisdn.remove(rec->m_msisdnKey,true,true);
+	rec->m_msisdnKey = 0;
+    }
+    if (rec->m_suffix) {
+	rec->m_suffix->m_records.remove(rec,false);
+	if (!rec->m_suffix->m_records.skipNull())
+	    m_suffix.remove(rec->m_suffix,true,true);
+	rec->m_suffix = 0;
+    }
+}
+
+bool JsSubscriberStore::update(const String& imsi, const String& tmsi, const String& imei,
+    const String& msisdn, int64_t expires, const String& location, bool journal)
+{
+    if (imsi.null())
+	return false;
+    JsStoreRecord* rec = static_cast<JsStoreRecord*>(m_imsi[imsi]);
+    if (rec) {
+	if ((rec->m_tmsi == tmsi) && (rec->m_imei == imei) && (rec->m_msisdn == msisdn)
+	    && (rec->m_expires == expires) && (rec->m_location == location))
+	    return true;
+	unindex(rec);
+    }
+    else {
+	rec = new JsStoreRecord(imsi);
+	m_imsi.append(rec);
+	m_count++;
+    }
+    rec->m_tmsi = tmsi;
+    rec->m_imei = imei;
+    rec->m_msisdn = msisdn;
+    rec->m_expires = expires;
+    rec->m_location = location;
+    index(rec);
+    if (!journal)
+	return true;
+    String line;
+    line << "+" << imsi << "=" << tmsi << "," << imei << "," << msisdn << ","
+	<< expires << "," << location;
+    return writeJournal(line);
+}
+
+// Update from the text form used in the file: tmsi,imei,msisdn,expires,location
+bool JsSubscriberStore::update(const String& imsi, const String& fields, bool journal)
+{
+    String val[5];
+    ObjList* list = fields.split(',');
+    unsigned int i = 0;
+    for (ObjList* l = list->skipNull(); l && (i < 4); l = l->skipNext())
+	val[i++] = l->get()->toString();
+    TelEngine::destruct(list);
+    // the location is last and kept whole
+    int pos = -1;
+    for (i = 0; i < 4; i++) {
+	pos = fields.find(',',pos + 1);
+	if (pos < 0)
+	    break;
+    }
+    if (pos >= 0)
+	val[4] = fields.substr(pos + 1);
+    return update(imsi,val[0],val[1],val[2],val[3].toInt64(),val[4],journal);
+}
+
+bool JsSubscriberStore::remove(const String& imsi, bool journal)
+{
+    JsStoreRecord* rec = static_cast<JsStoreRecord*>(m_imsi[imsi]);
+    if (!rec)
+	return true;
+    unindex(rec);
+    m_imsi.remove(rec,true,true);
+    m_count--;
+    if (!journal)
+	return true;
+    return writeJournal("-" + imsi);
+}
+
+bool JsSubscriberStore::lastTmsi(const String& tmsi, bool journal)
+{
+    if (m_lastTmsi == tmsi)
+	return true;
+    m_lastTmsi = tmsi;
+    return !journal || writeJournal("=" + tmsi);
+}
+
+// Find the subscriber whose MSISDN is a suffix of a number
+// If both is set also find a subscriber whose MSISDN ends with the number
+JsStoreRecord* JsSubscriberStore::matchMsisdn(const String& number, bool both) const
+{
+    String num = storeNumber(number);
+    if (num.null())
+	return 0;
+    for (unsigned int i = 0; i < num.length(); i++) {
+	const JsStoreKey* key = static_cast<const JsStoreKey*>(m_msisdn[num.substr(i)]);
+	if (key)
+	    return key->m_record;
+    }
+    if (!both)
+	return 0;
+    if (num.length() >= STORE_SUFFIX_LEN) {
+	const JsStoreSuffix* sfx = static_cast<const JsStoreSuffix*>(
+	    m_suffix[num.substr(num.length() - STORE_SUFFIX_LEN)]);
+	for (ObjList* l = sfx ? sfx->m_records.skipNull() : 0; l; l = l->skipNext()) {
+	    JsStoreRecord* rec = static_cast<JsStoreRecord*>(l->get());
+	    if (rec->m_msisdnKey && rec->m_msisdnKey->endsWith(num))
+		return rec;
+	}
+	return 0;
+    }
+    // too short for the suffix index
+    for (unsigned int i = 0; i < m_imsi.length(); i++) {
+	ObjList* l = m_imsi.getList(i);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    JsStoreRecord* rec = static_cast<JsStoreRecord*>(l->get());
+	    if (rec->m_msisdnKey && rec->m_msisdnKey->endsWith(num))
+		return rec;
+	}
+    }
+    return 0;
+}
+
+bool JsSubscriberStore::runNative(ObjList& stack, const ExpOperation& oper, GenObject* context)
+{
+    XDebug(&__plugin,DebugAll,"JsSubscriberStore::runNative '%s'(" FMT64 ") [%p]",
+	oper.name().c_str(),oper.number(),this);
+    ObjList args;
+    if (oper.name() == YSTRING("load")) {
+	if (extractArgs(stack,oper,context,args) != 0)
+	    return false;
+	Lock mylock(m_storeMutex);
+	ExpEvaluator::pushOne(stack,new ExpOperation(load()));
+    }
+    else if (oper.name() == YSTRING("compact")) {
+	if (extractArgs(stack,oper,context,args) != 0)
+	    return false;
+	Lock mylock(m_storeMutex);
+	ExpEvaluator::pushOne(stack,new ExpOperation(compact()));
+    }
+    else if (oper.name() == YSTRING("count")) {
+	if (extractArgs(stack,oper,context,args) != 0)
+	    return false;
+	ExpEvaluator::pushOne(stack,new ExpOperation((int64_t)m_count));
+    }
+    else if (oper.name() == YSTRING("keys")) {
+	if (extractArgs(stack,oper,context,args) != 0)
+	    return false;
+	JsArray* jsa = new JsArray(context,mutex());
+	Lock mylock(m_storeMutex);
+	int32_t len = 0;
+	for (unsigned int i = 0; i < m_imsi.length(); i++) {
+	    ObjList* l = m_imsi.getList(i);
+	    for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+		jsa->push(new ExpOperation(l->get()->toString()));
+		len++;
+	    }
+	}
+	mylock.drop();
+	jsa->setLength(len);
+	ExpEvaluator::pushOne(stack,new ExpWrapper(jsa,oper.name()));
+    }
+    else if (oper.name() == YSTRING("get")) {
+	if (extractArgs(stack,oper,context,args) != 1)
+	    return false;
+	Lock mylock(m_storeMutex);
+	const JsStoreRecord* rec = static_cast<const JsStoreRecord*>(
+	    m_imsi[*static_cast<ExpOperation*>(args[0])]);
+	if (rec) {
+	    JsObject* jso = new JsObject(context,mutex());
+	    jso->params().setParam(new ExpOperation(rec->m_tmsi,"tmsi"));
+	    jso->params().setParam(new ExpOperation(rec->m_imei,"imei"));
+	    jso->params().setParam(new ExpOperation(rec->m_msisdn,"msisdn"));
+	    jso->params().setParam(new ExpOperation(rec->m_expires,"expires"));
+	    jso->params().setParam(new ExpOperation(rec->m_location,"location"));
+	    mylock.drop();
+	    ExpEvaluator::pushOne(stack,new ExpWrapper(jso,oper.name()));
+	}
+	else
+	    ExpEvaluator::pushOne(stack,JsParser::nullClone());
+    }
+    else if (oper.name() == YSTRING("set")) {
+	if (extractArgs(stack,oper,context,args) != 2)
+	    return false;
+	const String& imsi = *static_cast<ExpOperation*>(args[0]);
+	ExpOperation* sub = static_cast<ExpOperation*>(args[1]);
+	const JsObject* jso = YOBJECT(JsObject,sub);
+	Lock mylock(m_storeMutex);
+	bool ok = false;
+	if (jso)
+	    ok = update(imsi,storeField(jso,YSTRING("tmsi")),storeField(jso,YSTRING("imei")),
+		storeField(jso,YSTRING("msisdn")),storeField(jso,YSTRING("expires")).toInt64(),
+		storeField(jso,YSTRING("location")),true);
+	else if (!(JsParser::isUndefined(*sub) || JsParser::isNull(*sub)))
+	    ok = update(imsi,*sub,true);
+	else
+	    ok = remove(imsi,true);
+	ExpEvaluator::pushOne(stack,new ExpOperation(ok));
+    }
+    else if (oper.name() == YSTRING("remove")) {
+	if (extractArgs(stack,oper,context,args) != 1)
+	    return false;
+	Lock mylock(m_storeMutex);
+	ExpEvaluator::pushOne(stack,new ExpOperation(remove(*static_cast<ExpOperation*>(args[0]),true)));
+    }
+    else if (oper.name() == YSTRING("findTmsi") || oper.name() == YSTRING("findImei")
+	|| oper.name() == YSTRING("findMsisdn") || oper.name() == YSTRING("matchMsisdn")) {
+	bool both = false;
+	switch (extractArgs(stack,oper,context,args)) {
+	    case 2:
+		if (oper.name() != YSTRING("matchMsisdn"))
+		    return false;
+		both = static_cast<ExpOperation*>(args[1])->valBoolean();
+		// fall through
+	    case 1:
+		break;
+	    default:
+		return false;
+	}
+	const String& key = *static_cast<ExpOperation*>(args[0]);
+	Lock mylock(m_storeMutex);
+	const JsStoreKey* found = 0;
+	const JsStoreRecord* rec = 0;
+	if (oper.name() == YSTRING("findTmsi"))
+	    found = static_cast<const JsStoreKey*>(m_tmsi[key]);
+	else if (oper.name() == YSTRING("findImei"))
+	    found = static_cast<const JsStoreKey*>(m_imei[key]);
+	else if (oper.name() == YSTRING("findMsisdn"))
+	    found = static_cast<const JsStoreKey*>(m_msisdn[storeNumber(key)]);
+	else
+	    rec = matchMsisdn(key,both);
+	if (found)
+	    rec = found->m_record;
+	if (rec)
+	    ExpEvaluator::pushOne(stack,new ExpOperation(*rec,oper.name()));
+	else
+	    ExpEvaluator::pushOne(stack,JsParser::nullClone());
+    }
+    else if (oper.name() == YSTRING("lastTmsi")) {
+	switch (extractArgs(stack,oper,context,args)) {
+	    case 0:
+		{
+		    Lock mylock(m_storeMutex);
+		    ExpEvaluator::pushOne(stack,new ExpOperation(m_lastTmsi,oper.name()));
+		}
+		break;
+	    case 1:
+		{
+		    Lock mylock(m_storeMutex);
+		    ExpEvaluator::pushOne(stack,new ExpOperation(
+			lastTmsi(*static_cast<ExpOperation*>(args[0]),true)));
+		}
+		break;
+	    default:
+		return false;
+	}
+    }
+    else
+	return JsObject::runNative(stack,oper,context);
+    return true;
+}
+
+JsObject* JsSubscriberStore::runConstructor(ObjList& stack, const ExpOperation& oper, GenObject* context)
+{
+    XDebug(&__plugin,DebugAll,"JsSubscriberStore::runConstructor '%s'(" FMT64 ") [%p]",
+	oper.name().c_str(),oper.number(),this);
+    String journalFile;
+    ObjList args;
+    switch (extractArgs(stack,oper,context,args)) {
+	case 2:
+	    journalFile = *static_cast<ExpOperation*>(args[1]);
+	    // fall through
+	case 1:
+	    break;
+	default:
+	    return 0;
+    }
+    const String& file = *static_cast<ExpOperation*>(args[0]);
+    if (file.null())
+	return 0;
+    if (journalFile.null())
+	journalFile = file + ".journal";
+    return new JsSubscriberStore(context,mutex(),file,journalFile);
+}
+
+void JsSubscriberStore::initialize(ScriptContext* context)
+{
+    if (!context)
+	return;
+    Mutex* mtx = context->mutex();
+    Lock mylock(mtx);
+    NamedList& params = context->params();
+    if (!params.getParam(YSTRING("SubscriberStore")))
+	addConstructor(params,"SubscriberStore",new JsSubscriberStore(mtx));
+}
+
+
 
 /**
  * class JsTimeEvent
@@ -4306,6 +5159,413 @@ void JsAssist::msgPostExecute(const Message& msg, bool handled)
 }
 
 
+// Holds the main context of a pooled slot locked while in scope
+class JsSharedLock
+{
+public:
+    inline JsSharedLock(JsPoolSlot* slot)
+	: m_mutex(slot->lockMain())
+	{ }
+    inline ~JsSharedLock()
+	{ if (m_mutex) m_mutex->unlock(); }
+private:
+    Mutex* m_mutex;
+};
+
+// Slots holding the main context locked for native code, by owner thread
+static ObjList s_sharedLocked;
+static Mutex s_sharedMutex(false,"JsShared");
+
+JsSharedRef::JsSharedRef(JsPoolSlot* slot, JsObject* obj)
+    : JsObject(slot->context() ? slot->context()->mutex() : 0,"[object Shared]"),
+      m_slot(slot), m_object(obj)
+{
+}
+
+JsSharedRef::~JsSharedRef()
+{
+    TelEngine::destruct(m_object);
+}
+
+void* JsSharedRef::getObject(const String& name) const
+{
+    if (name == YATOM("JsSharedRef"))
+	return const_cast<JsSharedRef*>(this);
+    if (name == YATOM("JsObject") || name == YATOM("ScriptContext") ||
+	    name == YATOM("ExpExtender") || name == YATOM("RefObject") || name == YATOM("GenObject"))
+	return JsObject::getObject(name);
+    // native code asking for the object itself will access it directly
+    void* obj = m_object->getObject(name);
+    if (obj)
+	m_slot->lockShared();
+    return obj;
+}
+
+// Get the object for native code, the main context stays locked
+JsObject* JsSharedRef::lockObject() const
+{
+    m_slot->lockShared();
+    return m_object;
+}
+
+JsObject* JsSharedRef::copy(Mutex* mtx) const
+{
+    JsSharedLock lck(m_slot);
+    return m_object->copy(mtx);
+}
+
+void JsSharedRef::fillFieldNames(ObjList& names)
+{
+    JsSharedLock lck(m_slot);
+    m_object->fillFieldNames(names);
+}
+
+bool JsSharedRef::hasField(ObjList& stack, const String& name, GenObject* context) const
+{
+    JsSharedLock lck(m_slot);
+    return m_object->hasField(stack,name,context);
+}
+
+// Fields are returned as copies kept by the slot until the end of the run,
+//  objects of the main context as references to them
+NamedString* JsSharedRef::getField(ObjList& stack, const String& name, GenObject* context) const
+{
+    JsSharedLock lck(m_slot);
+    NamedString* field = m_object->getField(stack,name,context);
+    if (!field)
+	return 0;
+    JsObject* jso = YOBJECT(JsObject,field);
+    if (jso && !YOBJECT(JsFunction,jso) && (jso->mutex() == m_slot->mainMutex()) && jso->ref())
+	field = shared(jso,name);
+    else {
+	ExpOperation* op = YOBJECT(ExpOperation,field);
+	field = op ? op->clone() : new NamedString(field->name(),*field);
+    }
+    m_slot->keepField(field);
+    return field;
+}
+
+bool JsSharedRef::runFunction(ObjList& stack, const ExpOperation& oper, GenObject* context)
+{
+    // evaluate the arguments in the pooled context before locking the main one
+    ObjList args;
+    int argc = extractArgs(stack,oper,context,args);
+    for (ObjList* l = args.skipNull(); l; l = l->skipNext()) {
+	ExpOperation* op = rebind(*static_cast<ExpOperation*>(l->get()));
+	if (op)
+	    l->set(op);
+    }
+    while (GenObject* o = args.remove(false))
+	ExpEvaluator::pushOne(stack,static_cast<ExpOperation*>(o));
+    ExpOperation op((ExpEvaluator::Opcode)oper.opcode(),oper.name(),argc);
+    op.lineNumber(oper.lineNumber());
+    JsSharedLock lck(m_slot);
+    if (!m_object->runFunction(stack,op,context))
+	return false;
+    wrapTop(stack);
+    return true;
+}
+
+bool JsSharedRef::runField(ObjList& stack, const ExpOperation& oper, GenObject* context)
+{
+    JsSharedLock lck(m_slot);
+    if (!m_object->runField(stack,oper,context))
+	return false;
+    wrapTop(stack);
+    return true;
+}
+
+bool JsSharedRef::runAssign(ObjList& stack, const ExpOperation& oper, GenObject* context)
+{
+    ExpOperation* op = rebind(oper);
+    JsSharedLock lck(m_slot);
+    bool ok = m_object->runAssign(stack,op ? *op : oper,context);
+    TelEngine::destruct(op);
+    return ok;
+}
+
+// Build a reference to another object of the main context, takes its reference
+ExpWrapper* JsSharedRef::shared(JsObject* obj, const char* name) const
+{
+    return new ExpWrapper(new JsSharedRef(m_slot,obj),name);
+}
+
+// Make a value fit for storing in the main context, NULL if no change is needed
+// References are replaced by the object they point to, objects created in the
+//  pooled context are copied to use the mutex of the main context
+ExpOperation* JsSharedRef::rebind(const ExpOperation& oper) const
+{
+    ExpWrapper* w = YOBJECT(ExpWrapper,&oper);
+    if (!(w && w->object()))
+	return 0;
+    JsSharedRef* ref = YOBJECT(JsSharedRef,w->object());
+    if (ref) {
+	if (!ref->object()->ref())
+	    return 0;
+	return new ExpWrapper(ref->object(),oper.name());
+    }
+    JsObject* jso = YOBJECT(JsObject,w->object());
+    Mutex* mtx = m_slot->mainMutex();
+    if (!jso || (jso->mutex() == mtx))
+	return 0;
+    return w->copy(mtx);
+}
+
+// Replace an object of the main context on top of stack with a reference
+void JsSharedRef::wrapTop(ObjList& stack) const
+{
+    ExpWrapper* w = YOBJECT(ExpWrapper,stack.get());
+    if (!w)
+	return;
+    JsObject* jso = YOBJECT(JsObject,w->object());
+    if (!jso || YOBJECT(JsFunction,jso) || (jso->mutex() != m_slot->mainMutex()) || !jso->ref())
+	return;
+    stack.set(shared(jso,w->name()));
+}
+
+
+JsPoolSlot::JsPoolSlot(ScriptContext* main)
+    : m_main(main), m_owner(0), m_busy(0), m_locked(false), m_sharedWait(0)
+{
+}
+
+JsPoolSlot::~JsPoolSlot()
+{
+    clear();
+}
+
+// Create the context and copy the globals of the main context which must be
+//  locked by the caller. Plain objects, arrays and functions are copied,
+//  declared shared and native objects are only referenced
+bool JsPoolSlot::init(const JsParser& parser, const char* name, const ObjList& shared)
+{
+    ScriptRun* runner = parser.createRunner(0,NATIVE_TITLE);
+    if (!runner)
+	return false;
+    m_context = runner->context();
+    contextInit(runner,name);
+    TelEngine::destruct(runner);
+    if (!(m_context && m_main))
+	return false;
+    Mutex* mtx = m_context->mutex();
+    NamedList& dst = m_context->params();
+    for (const ObjList* l = m_main->params().paramList()->skipNull(); l; l = l->skipNext()) {
+	const NamedString* p = static_cast<const NamedString*>(l->get());
+	if (dst.getParam(p->name()))
+	    continue;
+	ExpOperation* op = YOBJECT(ExpOperation,p);
+	JsObject* jso = YOBJECT(JsObject,op);
+	if (!op)
+	    dst.addParam(p->name(),*p);
+	else if (!jso || YOBJECT(JsFunction,jso))
+	    dst.addParam(op->copy(mtx));
+	else if (shared.find(p->name()) ||
+		!(YOBJECT(JsArray,jso) || (jso->toString() == YSTRING("[object Object]")))) {
+	    if (jso->ref())
+		dst.addParam(new ExpWrapper(new JsSharedRef(this,jso),p->name()));
+	}
+	else
+	    dst.addParam(op->copy(mtx));
+    }
+    return true;
+}
+
+// Break the reference cycles of the shared objects
+void JsPoolSlot::clear()
+{
+    if (!m_context)
+	return;
+    Lock mylock(m_context->mutex());
+    m_context->params().clearParams();
+}
+
+// Lock the main context for one operation, account the time spent waiting
+Mutex* JsPoolSlot::lockMain()
+{
+    Mutex* mtx = mainMutex();
+    if (!mtx)
+	return 0;
+    u_int64_t t = Time::now();
+    mtx->lock();
+    if (m_owner == Thread::current())
+	m_sharedWait += Time::now() - t;
+    return mtx;
+}
+
+// Lock the main context until an async operation or the end of the run,
+//  only from the handler thread
+void JsPoolSlot::lockShared()
+{
+    if (m_locked || !m_busy || (m_owner != Thread::current()) || !m_main)
+	return;
+    u_int64_t t = Time::now();
+    m_main->mutex()->lock();
+    m_sharedWait += Time::now() - t;
+    m_locked = true;
+    Lock mylock(s_sharedMutex);
+    s_sharedLocked.append(this)->setDelete(false);
+}
+
+void JsPoolSlot::unlockShared()
+{
+    if (!m_locked)
+	return;
+    Lock mylock(s_sharedMutex);
+    s_sharedLocked.remove(this,false);
+    mylock.drop();
+    m_locked = false;
+    m_main->mutex()->unlock();
+}
+
+// Release the main context before the current thread suspends its script
+void JsPoolSlot::unlockThread()
+{
+    Thread* thr = Thread::current();
+    Lock mylock(s_sharedMutex);
+    for (ObjList* l = s_sharedLocked.skipNull(); l; l = l->skipNext()) {
+	JsPoolSlot* slot = static_cast<JsPoolSlot*>(l->get());
+	if (slot->owner() == thr) {
+	    mylock.drop();
+	    slot->unlockShared();
+	    return;
+	}
+    }
+}
+
+// Keep a field returned by reference until the end of the run
+void JsPoolSlot::keepField(NamedString* field)
+{
+    m_fields.append(field);
+}
+
+void JsPoolSlot::clearFields()
+{
+    m_fields.clear();
+}
+
+
+JsPool::JsPool(unsigned int size, const String& shared)
+    : m_mutex(false,"JsPool"), m_free(size,"JsPool",size),
+      m_shared(shared.split(',',false)), m_size(size), m_ready(false)
+{
+    for (ObjList* l = m_shared->skipNull(); l; l = l->skipNext())
+	static_cast<String*>(l->get())->trimBlanks();
+}
+
+JsPool::~JsPool()
+{
+    shutdown();
+    TelEngine::destruct(m_shared);
+}
+
+// Clone the main context once its code finished running
+bool JsPool::fill(const JsParser& parser, ScriptContext* main, const char* name)
+{
+    if (!main)
+	return false;
+    u_int64_t t = Time::now();
+    Lock ctxLock(main->mutex());
+    for (ObjList* l = m_shared->skipNull(); l; l = l->skipNext()) {
+	const String& s = *static_cast<String*>(l->get());
+	NamedString* p = main->params().getParam(s);
+	if (!p)
+	    Debug(&__plugin,DebugMild,"Shared object '%s' not found in script '%s'",s.c_str(),name);
+	else if (!YOBJECT(JsObject,p))
+	    Debug(&__plugin,DebugMild,"Shared '%s' in script '%s' is not an object, it will be copied",
+		s.c_str(),name);
+    }
+    ObjList slots;
+    for (unsigned int i = 0; i < m_size; i++) {
+	JsPoolSlot* slot = new JsPoolSlot(main);
+	slots.append(slot);
+	if (!slot->init(parser,name,*m_shared)) {
+	    Debug(&__plugin,DebugWarn,"Failed to clone context of script '%s'",name);
+	    for (ObjList* s = slots.skipNull(); s; s = s->skipNext())
+		static_cast<JsPoolSlot*>(s->get())->clear();
+	    return false;
+	}
+    }
+    ctxLock.drop();
+    Lock mylock(m_mutex);
+    while (GenObject* o = slots.remove(false))
+	m_slots.append(o);
+    m_ready = true;
+    mylock.drop();
+    Debug(&__plugin,DebugInfo,"Script '%s' runs handlers in %u contexts, cloned in " FMT64U " usec",
+	name,m_size,Time::now() - t);
+    return true;
+}
+
+void JsPool::shutdown()
+{
+    ObjList slots;
+    Lock mylock(m_mutex);
+    m_ready = false;
+    while (GenObject* o = m_slots.remove(false))
+	slots.append(o);
+    mylock.drop();
+    for (ObjList* l = slots.skipNull(); l; l = l->skipNext())
+	static_cast<JsPoolSlot*>(l->get())->clear();
+    // wake up handlers waiting for a context, they will find none
+    for (unsigned int i = 0; i < m_size; i++)
+	m_free.unlock();
+}
+
+// Get a free context, the caller gets a reference to it
+JsPoolSlot* JsPool::acquire(u_int64_t& wait)
+{
+    Thread* thr = Thread::current();
+    if (!thr)
+	return 0;
+    Lock mylock(m_mutex);
+    if (!m_ready)
+	return 0;
+    // a handler dispatching a message to the same script keeps its context
+    for (ObjList* l = m_slots.skipNull(); l; l = l->skipNext()) {
+	JsPoolSlot* slot = static_cast<JsPoolSlot*>(l->get());
+	if (slot->busy() && (slot->owner() == thr) && slot->ref()) {
+	    slot->acquire(thr);
+	    return slot;
+	}
+    }
+    mylock.drop();
+    u_int64_t t = Time::now();
+    bool ok = m_free.lock(POOL_WAIT_USEC);
+    wait += Time::now() - t;
+    if (!ok) {
+	Debug(&__plugin,DebugMild,"No free pooled context after " FMT64U " usec, using the main one",
+	    Time::now() - t);
+	return 0;
+    }
+    mylock.acquire(m_mutex);
+    for (ObjList* l = m_slots.skipNull(); l; l = l->skipNext()) {
+	JsPoolSlot* slot = static_cast<JsPoolSlot*>(l->get());
+	if (!slot->busy() && slot->ref()) {
+	    slot->acquire(thr);
+	    return slot;
+	}
+    }
+    // pool was shut down meanwhile
+    m_free.unlock();
+    return 0;
+}
+
+void JsPool::release(JsPoolSlot* slot)
+{
+    if (!slot)
+	return;
+    Lock mylock(m_mutex);
+    if (slot->release()) {
+	slot->unlockShared();
+	slot->clearFields();
+	if (m_slots.find(slot))
+	    m_free.unlock();
+    }
+    mylock.drop();
+    TelEngine::destruct(slot);
+}
+
+
 ObjList JsGlobal::s_globals;
 
 JsGlobal::JsGlobal(const char* scriptName, const char* fileName, bool relPath, bool fromCfg)
@@ -4316,12 +5576,22 @@ JsGlobal::JsGlobal(const char* scriptName, const char* fileName, bool relPath, b
     if (relPath)
 	m_jsCode.adjustPath(*this);
     m_jsCode.link(s_allowLink);
+    m_jsCode.compile(s_allowCompile);
     m_jsCode.trace(s_allowTrace);
     DDebug(&__plugin,DebugAll,"Loading global Javascript '%s' from '%s'",name().c_str(),c_str());
     if (m_jsCode.parseFile(*this))
 	Debug(&__plugin,DebugInfo,"Parsed '%s' script: %s",name().c_str(),c_str());
     else if (*this)
 	Debug(&__plugin,DebugWarn,"Failed to parse '%s' script: %s",name().c_str(),c_str());
+    // #pragma pool "N" runs handlers in N cloned contexts
+    //  #pragma shared "obj1,obj2" lists the objects all clones access synchronized
+    const NamedList* pragmas = m_jsCode.pragmas();
+    int size = pragmas ? pragmas->getIntValue(YSTRING("pool"),0,0,MAX_POOL_SIZE) : 0;
+    if (size > 0) {
+	JsPool* pool = new JsPool(size,pragmas->getValue(YSTRING("shared")));
+	m_pool = pool;
+	TelEngine::destruct(pool);
+    }
 }
 
 JsGlobal::~JsGlobal()
@@ -4335,6 +5605,8 @@ JsGlobal::~JsGlobal()
 	    TelEngine::destruct(runner);
 	}
     }
+    if (m_pool)
+	m_pool->shutdown();
     if (m_context)
 	m_context->params().clearParams();
 }
@@ -4433,6 +5705,22 @@ bool JsGlobal::reloadScript(const String& scriptName)
     return script->runMain();
 }
 
+// Find the context pool of the global script owning a context
+bool JsGlobal::findPool(const ScriptContext* context, RefPointer<JsPool>& pool)
+{
+    if (!context)
+	return false;
+    Lock mylock(__plugin);
+    for (ObjList* l = s_globals.skipNull(); l; l = l->skipNext()) {
+	JsGlobal* script = static_cast<JsGlobal*>(l->get());
+	if (script->context() == context) {
+	    pool = script->pool();
+	    return (0 != pool);
+	}
+    }
+    return false;
+}
+
 void JsGlobal::loadScripts(const NamedList* sect)
 {
     if (!sect)
@@ -4458,19 +5746,22 @@ bool JsGlobal::runMain()
     contextInit(runner,name());
     ScriptRun::Status st = runner->run();
     TelEngine::destruct(runner);
+    if (m_pool && (ScriptRun::Succeeded == st))
+	m_pool->fill(m_jsCode,m_context,name());
     return (ScriptRun::Succeeded == st);
 }
 
 
 static const char* s_cmds[] = {
     "info",
+    "handlers",
     "eval",
     "reload",
     "load",
     0
 };
 
-static const char* s_cmdsLine = "  javascript {info|eval[=context] instructions...|reload script|load [script=]file}";
+static const char* s_cmdsLine = "  javascript {info|handlers|eval[=context] instructions...|reload script|load [script=]file}";
 
 
 JsModule::JsModule()
@@ -4533,6 +5824,32 @@ bool JsModule::commandExecute(String& retVal, const String& line)
 	return true;
     }
 
+    if (cmd == YSTRING("handlers")) {
+	// contexts are locked one by one after releasing the module
+	retVal.clear();
+	ObjList contexts;
+	lock();
+	ListIterator iter(JsGlobal::globals());
+	while (JsGlobal* script = static_cast<JsGlobal*>(iter.get())) {
+	    ScriptContext* ctx = script->context();
+	    if (ctx && ctx->ref())
+		contexts.append(new NamedPointer(script->name(),ctx,
+		    String(script->pool() ? script->pool()->size() : 0)));
+	}
+	unlock();
+	for (ObjList* l = contexts.skipNull(); l; l = l->skipNext()) {
+	    NamedPointer* p = static_cast<NamedPointer*>(l->get());
+	    ScriptContext* ctx = static_cast<ScriptContext*>(p->userData());
+	    retVal << p->name() << ": pool=" << *p << "\r\n";
+	    Lock mylock(ctx->mutex());
+	    JsFunction* ctr = YOBJECT(JsFunction,ctx->params().getParam(YSTRING("Message")));
+	    JsMessage* jsm = ctr ? YOBJECT(JsMessage,ctr->params().getParam(YSTRING("prototype"))) : 0;
+	    if (jsm)
+		jsm->dumpHandlers(retVal,p->name());
+	}
+	return true;
+    }
+
     if (cmd.startSkip("reload") && cmd.trimSpaces())
 	return JsGlobal::reloadScript(cmd);
 
@@ -4610,6 +5927,7 @@ bool JsModule::evalContext(String& retVal, const String& cmd, ScriptContext* con
     JsParser parser;
     parser.basePath(s_basePath,s_libsPath);
     parser.link(s_allowLink);
+    parser.compile(s_allowCompile);
     parser.trace(s_allowTrace);
     if (!parser.parse(cmd)) {
 	retVal << "parsing failed\r\n";
@@ -4817,12 +6135,17 @@ void JsModule::initialize()
 	s_allowLink = !s_allowLink;
 	changed = true;
     }
+    if (cfg.getBoolValue("general","allow_compile",true) != s_allowCompile) {
+	s_allowCompile = !s_allowCompile;
+	changed = true;
+    }
     tmp = cfg.getValue("general","routing");
     Engine::runParams().replaceParams(tmp);
     lock();
     if (changed || m_assistCode.scriptChanged(tmp,s_basePath,s_libsPath)) {
 	m_assistCode.clear();
 	m_assistCode.link(s_allowLink);
+	m_assistCode.compile(s_allowCompile);
 	m_assistCode.trace(s_allowTrace);
 	m_assistCode.basePath(s_basePath,s_libsPath);
 	m_assistCode.adjustPath(tmp);
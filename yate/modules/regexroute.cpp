@@ -30,15 +30,17 @@ namespace { // anonymous
 #define DEFAULT_RULE "^\\(false\\|no\\|off\\|disable\\|f\\|0*\\)$^"
 #define BLOCK_STACK 10
 #define MAX_VAR_LEN 8100
+#define PREFIX_DEPTH 32
+
+class RouteContext;
+class RouteProgram;
 
-static Configuration s_cfg;
 static const char* s_trackName = 0;
-static bool s_extended;
-static bool s_insensitive;
 static bool s_prerouteall;
-static int s_maxDepth = 5;
-static String s_defRule;
+// protects the program pointer, variables and dispatch counter, never held while routing
 static Mutex s_mutex(true,"RegexRoute");
+// current rules, replaced as a whole on reload
+static RouteProgram* s_program = 0;
 static ObjList s_extra;
 static NamedList s_vars("");
 static int s_dispatching = 0;
@@ -96,11 +98,242 @@ public:
     ~GenericHandler()
 	{ s_extra.remove(this,false); }
     virtual bool received(Message &msg);
+    inline bool same(const String& name, int prio, const char* context, const char* match) const
+	{ return (name == *this) && ((unsigned)prio == priority()) &&
+	    (m_context == context) && (m_match == match); }
 private:
     String m_context;
     String m_match;
 };
 
+// A replacement template, text without any replacements is used as is
+class RouteTemplate : public String
+{
+public:
+    inline RouteTemplate(const String& text)
+	: String(text), m_static(text.find('\\') < 0 && text.find('$') < 0)
+	{ }
+    inline bool isStatic() const
+	{ return m_static; }
+    void apply(const String& match, Message& msg, String& dest) const;
+private:
+    bool m_static;
+};
+
+// One precompiled match of a rule, taken from the rule name or a secondary match
+class RouteMatch : public GenObject
+{
+public:
+    enum Link {
+	First,
+	If,
+	Or,
+    };
+    enum Source {
+	Called,
+	Param,
+	Func,
+    };
+    RouteMatch(int link, bool clause, bool hasValue = true);
+    void compile(String reg, const RouteProgram& prog, const String& context, unsigned int rule);
+    bool matches(Message& msg, String& match) const;
+    inline int link() const
+	{ return m_link; }
+    inline bool clause() const
+	{ return m_clause; }
+    inline bool hasValue() const
+	{ return m_hasValue; }
+    inline const Regexp& regexp() const
+	{ return m_regexp; }
+    inline const String& prefix() const
+	{ return m_prefix; }
+private:
+    int m_link;
+    bool m_clause;
+    bool m_hasValue;
+    bool m_valid;
+    int m_source;
+    String m_param;
+    String m_default;
+    String m_func;
+    Regexp m_regexp;
+    bool m_negate;
+    String m_prefix;
+};
+
+// One line of a context with its matches and parsed value
+class RouteRule : public GenObject
+{
+public:
+    enum Type {
+	Set,
+	Echo,
+	Block,
+	Dispatch,
+	Enqueue,
+    };
+    enum Action {
+	ActNone,
+	ActReturn,
+	ActGoto,
+	ActInclude,
+	ActMatch,
+	ActRename,
+	ActRoute,
+    };
+    RouteRule(const NamedString& line, unsigned int index, const RouteProgram& prog,
+	const String& context);
+    void resolve(const RouteProgram& prog);
+    bool matches(Message& msg, const String& str, String& match) const;
+    inline const String& name() const
+	{ return m_name; }
+    inline unsigned int line() const
+	{ return m_line; }
+    inline bool blockStart() const
+	{ return m_blockStart; }
+    inline bool blockEnd() const
+	{ return m_blockEnd; }
+    inline int type() const
+	{ return m_type; }
+    inline bool send() const
+	{ return m_send; }
+    inline const ObjList& parts() const
+	{ return m_parts; }
+    inline bool isStatic() const
+	{ return m_static; }
+    inline int action() const
+	{ return m_action; }
+    inline bool quiet() const
+	{ return m_quiet; }
+    inline const String& target() const
+	{ return m_target; }
+    inline const RouteContext* context() const
+	{ return m_context; }
+    inline const String& prefix() const
+	{ return m_prefix; }
+private:
+    String m_name;
+    unsigned int m_line;
+    bool m_blockStart;
+    bool m_blockEnd;
+    ObjList m_matches;
+    int m_type;
+    bool m_send;
+    ObjList m_parts;
+    bool m_static;
+    int m_action;
+    bool m_quiet;
+    String m_target;
+    const RouteContext* m_context;
+    String m_prefix;
+};
+
+// Node of the tree of literal prefixes required by the rules of a context
+class RoutePrefix : public GenObject
+{
+public:
+    inline explicit RoutePrefix(char chr = 0)
+	: m_chr(chr), m_count(0), m_rules(0)
+	{ }
+    virtual ~RoutePrefix()
+	{ delete[] m_rules; }
+    RoutePrefix* child(char chr);
+    const RoutePrefix* find(char chr) const;
+    inline unsigned int count() const
+	{ return m_count; }
+    inline const unsigned int* rules() const
+	{ return m_rules; }
+    inline void reserve()
+	{ m_count++; }
+    inline void allocate()
+	{ if (m_count) m_rules = new unsigned int[m_count]; m_count = 0; }
+    inline void add(unsigned int rule)
+	{ m_rules[m_count++] = rule; }
+private:
+    char m_chr;
+    unsigned int m_count;
+    unsigned int* m_rules;
+    ObjList m_children;
+};
+
+// The rules of one configuration section
+class RouteContext : public String
+{
+public:
+    inline explicit RouteContext(const String& name)
+	: String(name), m_index(0), m_count(0), m_fold(false)
+	{ }
+    virtual ~RouteContext()
+	{ delete[] m_index; }
+    unsigned int compile(bool insensitive);
+    inline ObjList& rules()
+	{ return m_rules; }
+    inline const ObjList& rules() const
+	{ return m_rules; }
+    inline const RouteRule* rule(unsigned int index) const
+	{ return (index < m_count) ? m_index[index] : 0; }
+    inline const RoutePrefix& prefixes() const
+	{ return m_prefixes; }
+    inline bool fold() const
+	{ return m_fold; }
+private:
+    ObjList m_rules;
+    const RouteRule** m_index;
+    unsigned int m_count;
+    RoutePrefix m_prefixes;
+    bool m_fold;
+};
+
+// Walk in order the rules of a context that may match a string,
+//  skipping those whose required literal prefix is not found in it
+class RouteCursor
+{
+public:
+    RouteCursor(const RouteContext& ctx, const String& str);
+    void reset(const String& str);
+    const RouteRule* next();
+private:
+    const RouteContext& m_ctx;
+    unsigned int m_lists;
+    const unsigned int* m_list[PREFIX_DEPTH + 1];
+    unsigned int m_len[PREFIX_DEPTH + 1];
+    unsigned int m_pos[PREFIX_DEPTH + 1];
+    unsigned int m_next;
+};
+
+// All contexts compiled from one configuration load, never changed after built
+class RouteProgram : public RefObject
+{
+public:
+    RouteProgram(const Configuration& cfg, const String& defRule,
+	bool extended, bool insensitive, int maxDepth);
+    inline const RouteContext* find(const String& name) const
+	{ return static_cast<const RouteContext*>(m_contexts[name]); }
+    inline const String& defRule() const
+	{ return m_defRule; }
+    inline bool extended() const
+	{ return m_extended; }
+    inline bool insensitive() const
+	{ return m_insensitive; }
+    inline int maxDepth() const
+	{ return m_maxDepth; }
+    inline unsigned int sections() const
+	{ return m_sections; }
+    inline unsigned int rules() const
+	{ return m_rules; }
+    inline unsigned int indexed() const
+	{ return m_indexed; }
+private:
+    HashList m_contexts;
+    String m_defRule;
+    bool m_extended;
+    bool m_insensitive;
+    int m_maxDepth;
+    unsigned int m_sections;
+    unsigned int m_rules;
+    unsigned int m_indexed;
+};
+
 class RegexRoutePlugin : public Plugin
 {
 public:
@@ -124,11 +357,18 @@ static String& vars(String& s, String* vName = 0)
 	s.trimBlanks();
 	if (vName)
 	    *vName = s;
+	Lock lock(s_mutex);
 	s = s_vars.getValue(s);
     }
     return s;
 }
 
+static void dispatching(int delta)
+{
+    Lock lock(s_mutex);
+    s_dispatching += delta;
+}
+
 enum {
     OPER_ADD,
     OPER_SUB,
@@ -216,12 +456,14 @@ static void evalFunc(String& str, Message& msg)
 	;
     else if (str.startSkip("++",false)) {
 	String tmp;
+	Lock lock(s_mutex);
 	str = vars(str,&tmp).toInteger(0,10) + 1;
 	if (tmp)
 	    s_vars.setParam(tmp,str);
     }
     else if (str.startSkip("--",false)) {
 	String tmp;
+	Lock lock(s_mutex);
 	str = vars(str,&tmp).toInteger(0,10) - 1;
 	if (tmp)
 	    s_vars.setParam(tmp,str);
@@ -356,6 +598,7 @@ static void evalFunc(String& str, Message& msg)
 		// auto increment the index variable if any
 		if (vname) {
 		    par = (idx + 1) % n;
+		    Lock lock(s_mutex);
 		    s_vars.setParam(vname,par);
 		}
 	    }
@@ -401,6 +644,7 @@ static void evalFunc(String& str, Message& msg)
 	    }
 	    else
 		str.clear();
+	    Lock lock(s_mutex);
 	    if (par.null() || par == YSTRING("count"))
 		str = s_vars.count();
 	    else if (par == YSTRING("list")) {
@@ -439,10 +683,14 @@ static void evalFunc(String& str, Message& msg)
 	    str.append(fmts,",");
 	    TelEngine::destruct(fmts);
 	}
-	else if (str == YSTRING("dispatching"))
+	else if (str == YSTRING("dispatching")) {
+	    Lock lock(s_mutex);
 	    str = s_dispatching;
-	else if (bare && str.trimBlanks())
+	}
+	else if (bare && str.trimBlanks()) {
+	    Lock lock(s_mutex);
 	    str = s_vars.getValue(str);
+	}
 	else {
 	    Debug("RegexRoute",DebugWarn,"Invalid function '%s'",str.c_str());
 	    str.clear();
@@ -471,19 +719,31 @@ static void replaceFuncs(String &str, Message& msg)
     }
 }
 
-// handle ;paramname[=value] assignments
-static void setMessage(const String& match, Message& msg, String& line, Message* target = 0)
+void RouteTemplate::apply(const String& match, Message& msg, String& dest) const
+{
+    if (m_static) {
+	dest = *this;
+	return;
+    }
+    dest = match.replaceMatches(*this);
+    msg.replaceParams(dest);
+    replaceFuncs(dest,msg);
+}
+
+// handle ;paramname[=value] assignments, the parts were split at rule load
+static void setMessage(const String& match, Message& msg, const ObjList& parts, String& line,
+    Message* target = 0)
 {
     if (!target)
 	target = &msg;
-    ObjList *strs = line.split(';');
     bool first = true;
-    for (ObjList *p = strs; p; p=p->next()) {
-	String *s = static_cast<String*>(p->get());
-	if (s) {
-	    *s = match.replaceMatches(*s);
-	    msg.replaceParams(*s);
-	    replaceFuncs(*s,msg);
+    for (const ObjList *p = &parts; p; p=p->next()) {
+	const RouteTemplate* t = static_cast<const RouteTemplate*>(p->get());
+	String tmp;
+	String* s = 0;
+	if (t) {
+	    t->apply(match,msg,tmp);
+	    s = &tmp;
 	}
 	if (first) {
 	    first = false;
@@ -498,41 +758,114 @@ static void setMessage(const String& match, Message& msg, String& line, Message*
 		n.trimBlanks();
 		v.trimBlanks();
 		DDebug("RegexRoute",DebugAll,"Setting '%s' to '%s'",n.c_str(),v.c_str());
-		if (n.startSkip("$",false))
+		if (n.startSkip("$",false)) {
+		    Lock lock(s_mutex);
 		    s_vars.setParam(n,v);
+		}
 		else
 		    target->setParam(n,v);
 	    }
 	    else {
 		DDebug("RegexRoute",DebugAll,"Clearing parameter '%s'",s->c_str());
-		if (s->startSkip("$",false))
+		if (s->startSkip("$",false)) {
+		    Lock lock(s_mutex);
 		    s_vars.clearParam(*s);
+		}
 		else
 		    target->clearParam(*s);
 	    }
 	}
     }
-    strs->destruct();
+}
+
+// classify the target of a rule, strip the keyword
+static int routeAction(String& val, bool& quiet)
+{
+    quiet = false;
+    if (val.null())
+	return RouteRule::ActNone;
+    if (val.startSkip("return"))
+	return RouteRule::ActReturn;
+    if (val.startSkip("goto") || val.startSkip("jump"))
+	return RouteRule::ActGoto;
+    if (val.startSkip("@goto") || val.startSkip("@jump")) {
+	quiet = true;
+	return RouteRule::ActGoto;
+    }
+    if (val.startSkip("include") || val.startSkip("call"))
+	return RouteRule::ActInclude;
+    if (val.startSkip("@include") || val.startSkip("@call")) {
+	quiet = true;
+	return RouteRule::ActInclude;
+    }
+    if (val.startSkip("match") || val.startSkip("newmatch"))
+	return RouteRule::ActMatch;
+    if (val.startSkip("rename"))
+	return RouteRule::ActRename;
+    return RouteRule::ActRoute;
 }
 
 // helper function to set the default regexp
-static void setDefault(Regexp& reg)
+static void setDefault(String& reg, const String& defRule)
 {
-    if (s_defRule.null())
+    if (defRule.null())
 	return;
     if (reg.null())
-	reg = s_defRule;
+	reg = defRule;
     else if (reg == "^") {
 	// deal with double '^' at end
-	if (s_defRule.endsWith("^"))
-	    reg.assign(s_defRule,s_defRule.length()-1);
+	if (defRule.endsWith("^"))
+	    reg.assign(defRule,defRule.length()-1);
 	else
-	    reg = s_defRule + reg;
+	    reg = defRule + reg;
+    }
+}
+
+// Find the literal text a regexp requires at the start of the matched string
+static void literalPrefix(const String& reg, bool extended, bool insensitive, String& prefix)
+{
+    prefix.clear();
+    // alternatives may have different or no prefixes
+    if (!reg.startsWith("^") || (reg.find(extended ? "|" : "\\|") >= 0))
+	return;
+    const char* special = extended ? ".[\\*^$+?{}()|" : ".[\\*^$";
+    const char* s = reg.c_str() + 1;
+    while (*s && (prefix.length() < PREFIX_DEPTH)) {
+	char c = *s;
+	const char* n = s + 1;
+	if ('\\' == c) {
+	    // only escaped special characters are literals
+	    c = s[1];
+	    if (!c || !strchr(special,c))
+		break;
+	    n = s + 2;
+	}
+	else if (strchr(special,c))
+	    break;
+	// a repeat makes the last character optional
+	if (('*' == n[0]) || (extended && ('+' == n[0] || '?' == n[0] || '{' == n[0])) ||
+	    (!extended && ('\\' == n[0]) && ('+' == n[1] || '?' == n[1] || '{' == n[1])))
+	    break;
+	if (insensitive) {
+	    if (c & 0x80)
+		break;
+	    if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	}
+	prefix << c;
+	s = n;
     }
 }
 
-// helper function to process one match attempt
-static bool oneMatch(Message& msg, Regexp& reg, String& match, const String& context, unsigned int rule)
+RouteMatch::RouteMatch(int link, bool clause, bool hasValue)
+    : m_link(link), m_clause(clause), m_hasValue(hasValue),
+      m_valid(false), m_source(Called), m_negate(false)
+{
+}
+
+// Compile one match attempt, see oneMatch() in older versions for the syntax
+void RouteMatch::compile(String reg, const RouteProgram& prog, const String& context,
+    unsigned int rule)
 {
     if (reg.startsWith("${")) {
 	// handle special matching by param ${paramname}regexp
@@ -540,29 +873,26 @@ static bool oneMatch(Message& msg, Regexp& reg, String& match, const String& con
 	if (p < 3) {
 	    Debug("RegexRoute",DebugWarn,"Invalid parameter match '%s' in rule #%u in context '%s'",
 		reg.c_str(),rule,context.c_str());
-	    return false;
+	    return;
 	}
-	match = reg.substr(2,p-2);
+	m_param = reg.substr(2,p-2);
 	reg = reg.substr(p+1);
-	match.trimBlanks();
+	m_param.trimBlanks();
 	reg.trimBlanks();
-	String def;
-	p = match.find('$');
+	p = m_param.find('$');
 	if (p >= 0) {
 	    // param is in ${<name>$<default>} format
-	    def = match.substr(p+1);
-	    match = match.substr(0,p);
-	    match.trimBlanks();
+	    m_default = m_param.substr(p+1);
+	    m_param = m_param.substr(0,p);
+	    m_param.trimBlanks();
 	}
-	setDefault(reg);
-	if (match.null() || reg.null()) {
+	setDefault(reg,prog.defRule());
+	if (m_param.null() || reg.null()) {
 	    Debug("RegexRoute",DebugWarn,"Missing parameter or rule in rule #%u in context '%s'",
 		rule,context.c_str());
-	    return false;
+	    return;
 	}
-	DDebug("RegexRoute",DebugAll,"Using message parameter '%s' default '%s'",
-	    match.c_str(),def.c_str());
-	match = msg.getValue(match,def);
+	m_source = Param;
     }
     else if (reg.startsWith("$(")) {
 	// handle special matching by param $(function)regexp
@@ -570,30 +900,324 @@ static bool oneMatch(Message& msg, Regexp& reg, String& match, const String& con
 	if (p < 3) {
 	    Debug("RegexRoute",DebugWarn,"Invalid function match '%s' in rule #%u in context '%s'",
 		reg.c_str(),rule,context.c_str());
-	    return false;
+	    return;
 	}
-	match = reg.substr(0,p+1);
+	m_func = reg.substr(0,p+1);
 	reg = reg.substr(p+1);
 	reg.trimBlanks();
-	setDefault(reg);
+	setDefault(reg,prog.defRule());
 	if (reg.null()) {
 	    Debug("RegexRoute",DebugWarn,"Missing rule in rule #%u in context '%s'",
 		rule,context.c_str());
-	    return false;
+	    return;
 	}
-	DDebug("RegexRoute",DebugAll,"Using function '%s'",match.c_str());
+	m_source = Func;
+    }
+    if (reg.endsWith("^")) {
+	// reverse match on final ^ (makes no sense in a regexp)
+	m_negate = true;
+	reg = reg.substr(0,reg.length()-1);
+    }
+    m_regexp.setFlags(prog.extended(),prog.insensitive());
+    m_regexp = reg;
+    m_regexp.compile();
+    m_valid = true;
+    if ((Called == m_source) && !m_negate)
+	literalPrefix(reg,prog.extended(),prog.insensitive(),m_prefix);
+}
+
+// Process one match attempt, match holds the string to match unless taken
+//  from a parameter or function
+bool RouteMatch::matches(Message& msg, String& match) const
+{
+    if (!m_valid)
+	return false;
+    if (Param == m_source) {
+	DDebug("RegexRoute",DebugAll,"Using message parameter '%s' default '%s'",
+	    m_param.c_str(),m_default.c_str());
+	match = msg.getValue(m_param,m_default);
+    }
+    else if (Func == m_source) {
+	DDebug("RegexRoute",DebugAll,"Using function '%s'",m_func.c_str());
+	match = m_func;
 	msg.replaceParams(match);
 	replaceFuncs(match,msg);
     }
     match.trimBlanks();
+    return (match.matches(m_regexp) != m_negate);
+}
 
-    bool doMatch = true;
-    if (reg.endsWith("^")) {
-	// reverse match on final ^ (makes no sense in a regexp)
-	doMatch = false;
-	reg = reg.substr(0,reg.length()-1);
+
+RouteRule::RouteRule(const NamedString& line, unsigned int index, const RouteProgram& prog,
+    const String& context)
+    : m_name(line.name()), m_line(index), m_blockStart(false), m_blockEnd(false),
+      m_type(Set), m_send(false), m_static(false), m_action(ActNone), m_quiet(false),
+      m_context(0)
+{
+    String reg(line.name());
+    if (reg.startSkip("}")) {
+	m_blockEnd = true;
+	if (reg.trimBlanks().null())
+	    reg = ".*";
+    }
+    static const Regexp s_blockStart("\\(=[[:space:]]*\\)\\?{$");
+    m_blockStart = s_blockStart.matches(line);
+    RouteMatch* m = new RouteMatch(RouteMatch::First,true);
+    m_matches.append(m);
+    m->compile(reg,prog,context,index);
+
+    // secondary match rules: regexp=if regexp=and regexp=or regexp=value
+    String val(line);
+    for (;;) {
+	int link = RouteMatch::If;
+	if (val.startSkip("or"))
+	    link = RouteMatch::Or;
+	else if (!(val.startSkip("if") || val.startSkip("and")))
+	    break;
+	int p = val.find('=');
+	if (p < 0) {
+	    Debug("RegexRoute",DebugWarn,"Malformed '%s' rule #%u in context '%s'",
+		(RouteMatch::Or == link) ? "or" : "if",index,context.c_str());
+	    m_matches.append(new RouteMatch(link,false,false));
+	    val.clear();
+	    break;
+	}
+	reg = val.substr(0,p);
+	val = val.substr(p+1);
+	reg.trimBlanks();
+	val.trimBlanks();
+	m = new RouteMatch(link,(p >= 1) && !reg.null());
+	m_matches.append(m);
+	if (m->clause())
+	    m->compile(reg,prog,context,index);
+	else
+	    Debug("RegexRoute",DebugWarn,"Missing 'if' in rule #%u in context '%s'",
+		index,context.c_str());
+    }
+
+    if (val.startSkip("echo") || val.startSkip("output")) {
+	// special case: display the line but don't set params
+	m_type = Echo;
+	m_parts.append(new RouteTemplate(val));
+	return;
+    }
+    else if (val == "{") {
+	m_type = Block;
+	return;
+    }
+    bool disp = val.startSkip("dispatch");
+    if (disp || val.startSkip("enqueue")) {
+	m_type = disp ? Dispatch : Enqueue;
+	m_send = val && (val[0] != ';');
+    }
+    ObjList* parts = val.split(';');
+    for (ObjList* p = parts; p; p = p->next()) {
+	String* s = static_cast<String*>(p->get());
+	m_parts.append(new RouteTemplate(s ? *s : String::empty()));
+    }
+    TelEngine::destruct(parts);
+    // the rule fails without checking the message if the called prefix is not
+    //  found, unless it is part of a block structure or followed by an 'or'
+    m = static_cast<RouteMatch*>(m_matches.get());
+    const RouteMatch* second = static_cast<const RouteMatch*>(m_matches.at(1));
+    if (!(m_blockStart || m_blockEnd || (second && RouteMatch::Or == second->link())))
+	m_prefix = m->prefix();
+    // a target that needs no replacements can be classified right now
+    const RouteTemplate* target = static_cast<const RouteTemplate*>(m_parts.get());
+    if (Set == m_type && target && target->isStatic()) {
+	m_static = true;
+	m_target = *target;
+	m_target.trimBlanks();
+	m_action = routeAction(m_target,m_quiet);
+    }
+}
+
+// Resolve a constant goto or include target once all contexts are known
+void RouteRule::resolve(const RouteProgram& prog)
+{
+    if (m_static && (ActGoto == m_action || ActInclude == m_action))
+	m_context = prog.find(m_target);
+}
+
+// Check the rule and all its secondary matches,
+//  leave in match the string that matched last
+bool RouteRule::matches(Message& msg, const String& str, String& match) const
+{
+    const ObjList* o = m_matches.skipNull();
+    while (o) {
+	const RouteMatch* m = static_cast<const RouteMatch*>(o->get());
+	match = str;
+	bool ok = m->matches(msg,match);
+	o = o->skipNext();
+	if (!o)
+	    return ok;
+	m = static_cast<const RouteMatch*>(o->get());
+	if (ok && (RouteMatch::Or == m->link())) {
+	    // already matched, skip all remaining secondary rules
+	    for (; o; o = o->skipNext()) {
+		if (!static_cast<const RouteMatch*>(o->get())->hasValue())
+		    return false;
+	    }
+	    return true;
+	}
+	if (!(ok || (RouteMatch::Or == m->link())))
+	    return false;
+	if (!m->clause())
+	    return false;
+	NDebug("RegexRoute",DebugAll,"Secondary match rule '%s' by rule #%u",
+	    m->regexp().c_str(),m_line);
+    }
+    return false;
+}
+
+
+const RoutePrefix* RoutePrefix::find(char chr) const
+{
+    for (const ObjList* l = m_children.skipNull(); l; l = l->skipNext()) {
+	const RoutePrefix* p = static_cast<const RoutePrefix*>(l->get());
+	if (p->m_chr == chr)
+	    return p;
+    }
+    return 0;
+}
+
+RoutePrefix* RoutePrefix::child(char chr)
+{
+    RoutePrefix* p = const_cast<RoutePrefix*>(find(chr));
+    if (!p) {
+	p = new RoutePrefix(chr);
+	m_children.append(p);
     }
-    return (match.matches(reg) == doMatch);
+    return p;
+}
+
+// Index the rules and file them in the prefix tree, rules without a
+//  literal prefix stay in the root, return how many have a prefix
+unsigned int RouteContext::compile(bool insensitive)
+{
+    m_fold = insensitive;
+    m_count = m_rules.count();
+    if (!m_count)
+	return 0;
+    m_index = new const RouteRule*[m_count];
+    RoutePrefix** nodes = new RoutePrefix*[m_count];
+    unsigned int indexed = 0;
+    unsigned int i = 0;
+    for (ObjList* o = m_rules.skipNull(); o; o = o->skipNext(), i++) {
+	const RouteRule* r = static_cast<const RouteRule*>(o->get());
+	m_index[i] = r;
+	RoutePrefix* p = &m_prefixes;
+	for (unsigned int c = 0; c < r->prefix().length(); c++)
+	    p = p->child(r->prefix().at(c));
+	if (p != &m_prefixes)
+	    indexed++;
+	p->reserve();
+	nodes[i] = p;
+    }
+    for (i = 0; i < m_count; i++)
+	nodes[i]->allocate();
+    // allocate() cleared the counts of all used nodes, they now fill in order
+    for (i = 0; i < m_count; i++)
+	nodes[i]->add(i);
+    delete[] nodes;
+    return indexed;
+}
+
+RouteCursor::RouteCursor(const RouteContext& ctx, const String& str)
+    : m_ctx(ctx), m_lists(0), m_next(0)
+{
+    reset(str);
+}
+
+// Collect the rule lists along the path of the string in the prefix tree,
+//  rules before the next one are already done
+void RouteCursor::reset(const String& str)
+{
+    m_lists = 0;
+    const char* s = str.c_str();
+    // matches are done on strings with blanks trimmed
+    while (' ' == *s || '\t' == *s)
+	s++;
+    for (const RoutePrefix* p = &m_ctx.prefixes(); p; ) {
+	if (p->count()) {
+	    unsigned int pos = 0;
+	    while (pos < p->count() && p->rules()[pos] < m_next)
+		pos++;
+	    m_list[m_lists] = p->rules();
+	    m_len[m_lists] = p->count();
+	    m_pos[m_lists] = pos;
+	    m_lists++;
+	}
+	char c = *s++;
+	if (!c)
+	    break;
+	if (m_ctx.fold() && c >= 'A' && c <= 'Z')
+	    c += 'a' - 'A';
+	p = p->find(c);
+    }
+}
+
+// Get the first rule in context order from all the collected lists
+const RouteRule* RouteCursor::next()
+{
+    unsigned int best = 0;
+    unsigned int idx = m_lists;
+    for (unsigned int i = 0; i < m_lists; i++) {
+	if (m_pos[i] >= m_len[i])
+	    continue;
+	unsigned int rule = m_list[i][m_pos[i]];
+	if (idx >= m_lists || rule < best) {
+	    best = rule;
+	    idx = i;
+	}
+    }
+    if (idx >= m_lists)
+	return 0;
+    m_pos[idx]++;
+    m_next = best + 1;
+    return m_ctx.rule(best);
+}
+
+
+RouteProgram::RouteProgram(const Configuration& cfg, const String& defRule,
+    bool extended, bool insensitive, int maxDepth)
+    : m_contexts(64), m_defRule(defRule),
+      m_extended(extended), m_insensitive(insensitive), m_maxDepth(maxDepth),
+      m_sections(cfg.sections()), m_rules(0), m_indexed(0)
+{
+    for (unsigned int s = 0; s < m_sections; s++) {
+	const NamedList* sect = cfg.getSection(s);
+	if (!sect || find(*sect))
+	    continue;
+	RouteContext* ctx = new RouteContext(*sect);
+	m_contexts.append(ctx);
+	// rules keep their line numbers, append to the list end directly
+	ObjList* last = &ctx->rules();
+	unsigned int i = 0;
+	for (const ObjList* l = sect->paramList()->skipNull(); l; l = l->skipNext()) {
+	    const NamedString* n = static_cast<const NamedString*>(l->get());
+	    last = last->append(new RouteRule(*n,++i,*this,*ctx));
+	    m_rules++;
+	}
+    }
+    for (unsigned int i = 0; i < m_contexts.length(); i++) {
+	for (ObjList* l = m_contexts.getList(i); l; l = l->next()) {
+	    RouteContext* ctx = static_cast<RouteContext*>(l->get());
+	    if (!ctx)
+		continue;
+	    for (ObjList* r = ctx->rules().skipNull(); r; r = r->skipNext())
+		static_cast<RouteRule*>(r->get())->resolve(*this);
+	    m_indexed += ctx->compile(m_insensitive);
+	}
+    }
+}
+
+// Get a reference to the current rule program
+static bool getProgram(RefPointer<RouteProgram>& prog)
+{
+    Lock lock(s_mutex);
+    prog = s_program;
+    return (0 != prog);
 }
 
 enum BlockState {
@@ -603,45 +1227,39 @@ enum BlockState {
 };
 
 // process one context, can call itself recursively
-static bool oneContext(Message &msg, String &str, const String &context, String &ret,
-    bool warn = false, int depth = 0)
+static bool oneContext(const RouteProgram& prog, Message &msg, String &str, const String &context,
+    String &ret, bool warn = false, int depth = 0, const RouteContext* ctx = 0)
 {
     if (context.null())
 	return false;
-    if (depth > s_maxDepth) {
+    if (depth > prog.maxDepth()) {
 	Debug("RegexRoute",DebugWarn,"Possible loop detected, current context '%s'",context.c_str());
 	return false;
     }
-    NamedList *l = s_cfg.getSection(context);
-    if (l) {
+    if (!ctx)
+	ctx = prog.find(context);
+    if (ctx) {
 	unsigned int blockDepth = 0;
 	BlockState blockStack[BLOCK_STACK];
-	unsigned int len = l->length();
-	for (unsigned int i = 0; i < len; i++) {
-	    const NamedString* n = l->getParam(i);
-	    if (!n)
-		continue;
+	RouteCursor cursor(*ctx,str);
+	while (const RouteRule* r = cursor.next()) {
 	    BlockState blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    BlockState blockLast = BlockSkip;
-	    Regexp reg(n->name(),s_extended,s_insensitive);
-	    if (reg.startSkip("}")) {
+	    if (r->blockEnd()) {
 		if (!blockDepth) {
 		    Debug("RegexRoute",DebugWarn,"Got '}' outside block in line #%u in context '%s'",
-			i+1,context.c_str());
+			r->line(),context.c_str());
 		    continue;
 		}
-		if (reg.trimBlanks().null())
-		    reg = ".*";
 		blockDepth--;
 		blockLast = blockThis;
 		blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    }
-	    static Regexp s_blockStart("\\(=[[:space:]]*\\)\\?{$");
-	    if (s_blockStart.matches(*n)) {
+	    if (r->blockStart()) {
 		// start of a new block
 		if (blockDepth >= BLOCK_STACK) {
 		    Debug("RegexRoute",DebugWarn,"Block stack overflow in line #%u in context '%s'",
-			i+1,context.c_str());
+			r->line(),context.c_str());
 		    return false;
 		}
 		// assume block is done
@@ -655,152 +1273,116 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 		}
 		blockStack[blockDepth++] = blockEnter;
 	    }
-	    XDebug("RegexRoute",DebugAll,"%s:%d(%u:%s) %s=%s",context.c_str(),i+1,
-		blockDepth,String::boolText(BlockRun == blockThis),
-		n->name().c_str(),n->c_str());
+	    XDebug("RegexRoute",DebugAll,"%s:%d(%u:%s) %s",context.c_str(),r->line(),
+		blockDepth,String::boolText(BlockRun == blockThis),r->name().c_str());
 	    if (BlockRun != blockThis)
 		continue;
 
-	    String val(*n);
 	    String match;
-	    bool ok;
-	    do {
-		match = str;
-		ok = oneMatch(msg,reg,match,context,i+1);
-		if (ok) {
-		    if (val.startSkip("or")) {
-			do {
-			    int p = val.find('=');
-			    if (p < 0) {
-				Debug("RegexRoute",DebugWarn,"Malformed 'or' rule #%u in context '%s'",
-				    i+1,context.c_str());
-				ok = false;
-				break;
-			    }
-			    val = val.substr(p+1);
-			    val.trimBlanks();
-			} while (ok && (val.startSkip("or") || val.startSkip("if") || val.startSkip("and")));
-			break;
-		    }
-		    if (!(val.startSkip("if") || val.startSkip("and")))
-			break;
-		}
-		else if (val.startSkip("or"))
-		    ok = true;
-		if (ok) {
-		    int p = val.find('=');
-		    if (p >= 1) {
-			reg = val.substr(0,p);
-			val = val.substr(p+1);
-			reg.trimBlanks();
-			val.trimBlanks();
-			if (!reg.null()) {
-			    NDebug("RegexRoute",DebugAll,"Secondary match rule '%s' by rule #%u in context '%s'",
-				reg.c_str(),i+1,context.c_str());
-			    continue;
-			}
-		    }
-		    Debug("RegexRoute",DebugWarn,"Missing 'if' in rule #%u in context '%s'",
-			i+1,context.c_str());
-		    ok = false;
-		}
-	    } while (ok);
-	    if (!ok)
+	    if (!r->matches(msg,str,match))
 		continue;
 
-	    if (val.startSkip("echo") || val.startSkip("output")) {
-		// special case: display the line but don't set params
-		val = match.replaceMatches(val);
-		msg.replaceParams(val);
-		replaceFuncs(val,msg);
-		Output("%s",val.safe());
-		continue;
-	    }
-	    else if (val == "{") {
-		// mark block as being processed now
-		if (blockDepth)
-		    blockStack[blockDepth-1] = BlockRun;
-		else
-		    Debug("RegexRoute",DebugWarn,"Got '{' outside block in line #%u in context '%s'",
-			i+1,context.c_str());
-		continue;
-	    }
-	    bool disp = val.startSkip("dispatch");
-	    if (disp || val.startSkip("enqueue")) {
-		// special case: enqueue or dispatch a new message
-		if (val && (val[0] != ';')) {
-		    Message* m = new Message("");
-		    // parameters are set in the new message
-		    setMessage(match,msg,val,m);
-		    val.trimBlanks();
-		    if (val) {
-			*m = val;
-			m->userData(msg.userData());
-			NDebug("RegexRoute",DebugAll,"%s new message '%s' by rule #%u '%s' in context '%s'",
-			    (disp ? "Dispatching" : "Enqueueing"),
-			    val.c_str(),i+1,n->name().c_str(),context.c_str());
-			if (disp) {
-			    s_dispatching++;
-			    Engine::dispatch(m);
-			    s_dispatching--;
-			}
-			else {
-			    Engine::enqueue(m);
-			    m = 0;
+	    String val;
+	    switch (r->type()) {
+		case RouteRule::Echo:
+		    static_cast<const RouteTemplate*>(r->parts().get())->apply(match,msg,val);
+		    Output("%s",val.safe());
+		    continue;
+		case RouteRule::Block:
+		    // mark block as being processed now
+		    if (blockDepth)
+			blockStack[blockDepth-1] = BlockRun;
+		    else
+			Debug("RegexRoute",DebugWarn,"Got '{' outside block in line #%u in context '%s'",
+			    r->line(),context.c_str());
+		    continue;
+		case RouteRule::Dispatch:
+		case RouteRule::Enqueue:
+		    // special case: enqueue or dispatch a new message
+		    if (r->send()) {
+			bool disp = (RouteRule::Dispatch == r->type());
+			Message* m = new Message("");
+			// parameters are set in the new message
+			setMessage(match,msg,r->parts(),val,m);
+			val.trimBlanks();
+			if (val) {
+			    *m = val;
+			    m->userData(msg.userData());
+			    NDebug("RegexRoute",DebugAll,"%s new message '%s' by rule #%u '%s' in context '%s'",
+				(disp ? "Dispatching" : "Enqueueing"),
+				val.c_str(),r->line(),r->name().c_str(),context.c_str());
+			    if (disp) {
+				dispatching(1);
+				Engine::dispatch(m);
+				dispatching(-1);
+			    }
+			    else {
+				Engine::enqueue(m);
+				m = 0;
+			    }
 			}
+			TelEngine::destruct(m);
 		    }
-		    TelEngine::destruct(m);
-		}
-		continue;
+		    continue;
+		default:
+		    break;
 	    }
-	    setMessage(match,msg,val);
+	    setMessage(match,msg,r->parts(),val);
 	    warn = true;
-	    val.trimBlanks();
-	    if (val.null()) {
-		// special case: do nothing on empty target
-		continue;
-	    }
-	    else if (val.startSkip("return")) {
-		bool ok = val.toBoolean();
-		NDebug("RegexRoute",DebugAll,"Returning %s from context '%s'",
-		    String::boolText(ok),context.c_str());
-		return ok;
-	    }
-	    else if (val.startSkip("goto") || val.startSkip("jump") ||
-		((val.startSkip("@goto") || val.startSkip("@jump")) && !(warn = false))) {
-		NDebug("RegexRoute",DebugAll,"Jumping to context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
-		return oneContext(msg,str,val,ret,warn,depth+1);
-	    }
-	    else if (val.startSkip("include") || val.startSkip("call") ||
-		((val.startSkip("@include") || val.startSkip("@call")) && !(warn = false))) {
-		NDebug("RegexRoute",DebugAll,"Including context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
-		if (oneContext(msg,str,val,ret,warn,depth+1)) {
-		    DDebug("RegexRoute",DebugAll,"Returning true from context '%s'", context.c_str());
-		    return true;
-		}
-	    }
-	    else if (val.startSkip("match") || val.startSkip("newmatch")) {
-		if (!val.null()) {
-		    NDebug("RegexRoute",DebugAll,"Setting match string '%s' by rule #%u '%s' in context '%s'",
-			val.c_str(),i+1,n->name().c_str(),context.c_str());
-		    str = val;
-		}
-	    }
-	    else if (val.startSkip("rename")) {
-		if (!val.null()) {
-		    NDebug("RegexRoute",DebugAll,"Renaming message '%s' to '%s' by rule #%u '%s' in context '%s'",
-			msg.c_str(),val.c_str(),i+1,n->name().c_str(),context.c_str());
-		    msg = val;
-		}
-	    }
+	    bool quiet = r->quiet();
+	    int action = r->action();
+	    const RouteContext* target = r->context();
+	    if (r->isStatic())
+		val = r->target();
 	    else {
-		DDebug("RegexRoute",DebugAll,"Returning '%s' for '%s' in context '%s' by rule #%u '%s'",
-		    val.c_str(),str.c_str(),context.c_str(),i+1,n->name().c_str());
-		ret = val;
-		return true;
+		val.trimBlanks();
+		action = routeAction(val,quiet);
 	    }
+	    if (quiet)
+		warn = false;
+	    switch (action) {
+		case RouteRule::ActNone:
+		    // special case: do nothing on empty target
+		    continue;
+		case RouteRule::ActReturn:
+		    {
+			bool ok = val.toBoolean();
+			NDebug("RegexRoute",DebugAll,"Returning %s from context '%s'",
+			    String::boolText(ok),context.c_str());
+			return ok;
+		    }
+		case RouteRule::ActGoto:
+		    NDebug("RegexRoute",DebugAll,"Jumping to context '%s' by rule #%u '%s'",
+			val.c_str(),r->line(),r->name().c_str());
+		    return oneContext(prog,msg,str,val,ret,warn,depth+1,target);
+		case RouteRule::ActInclude:
+		    NDebug("RegexRoute",DebugAll,"Including context '%s' by rule #%u '%s'",
+			val.c_str(),r->line(),r->name().c_str());
+		    if (oneContext(prog,msg,str,val,ret,warn,depth+1,target)) {
+			DDebug("RegexRoute",DebugAll,"Returning true from context '%s'", context.c_str());
+			return true;
+		    }
+		    continue;
+		case RouteRule::ActMatch:
+		    if (!val.null()) {
+			NDebug("RegexRoute",DebugAll,"Setting match string '%s' by rule #%u '%s' in context '%s'",
+			    val.c_str(),r->line(),r->name().c_str(),context.c_str());
+			str = val;
+			cursor.reset(str);
+		    }
+		    continue;
+		case RouteRule::ActRename:
+		    if (!val.null()) {
+			NDebug("RegexRoute",DebugAll,"Renaming message '%s' to '%s' by rule #%u '%s' in context '%s'",
+			    msg.c_str(),val.c_str(),r->line(),r->name().c_str(),context.c_str());
+			msg = val;
+		    }
+		    continue;
+	    }
+	    DDebug("RegexRoute",DebugAll,"Returning '%s' for '%s' in context '%s' by rule #%u '%s'",
+		val.c_str(),str.c_str(),context.c_str(),r->line(),r->name().c_str());
+	    ret = val;
+	    return true;
 	}
 	if (blockDepth)
 	    Debug("RegexRoute",DebugWarn,"There are %u blocks still open at end of context '%s'",
@@ -820,8 +1402,10 @@ bool RouteHandler::received(Message &msg)
     if (called.null())
 	return false;
     const char *context = msg.getValue(YSTRING("context"),"default");
-    Lock lock(s_mutex);
-    if (oneContext(msg,called,context,msg.retValue())) {
+    RefPointer<RouteProgram> prog;
+    if (!getProgram(prog))
+	return false;
+    if (oneContext(*prog,msg,called,context,msg.retValue())) {
 	Debug(DebugInfo,"Routing %s to '%s' in context '%s' via '%s' in " FMT64U " usec",
 	    msg.getValue(YSTRING("route_type"),"call"),called.c_str(),context,
 	    msg.retValue().c_str(),Time::now()-tmr);
@@ -845,8 +1429,10 @@ bool PrerouteHandler::received(Message &msg)
 	return false;
 
     String ret;
-    Lock lock(s_mutex);
-    if (oneContext(msg,caller,"contexts",ret)) {
+    RefPointer<RouteProgram> prog;
+    if (!getProgram(prog))
+	return false;
+    if (oneContext(*prog,msg,caller,"contexts",ret)) {
 	Debug(DebugInfo,"Classifying caller '%s' in context '%s' in " FMT64 " usec",
 	    caller.c_str(),ret.c_str(),Time::now()-tmr);
 	if (ret == YSTRING("-") || ret == YSTRING("error"))
@@ -869,8 +1455,10 @@ bool GenericHandler::received(Message &msg)
 	what = msg.getValue(what);
     else
 	what = *this;
-    Lock lock(s_mutex);
-    return oneContext(msg,what,m_context,msg.retValue());
+    RefPointer<RouteProgram> prog;
+    if (!getProgram(prog))
+	return false;
+    return oneContext(*prog,msg,what,m_context,msg.retValue());
 }
 
 
@@ -881,7 +1469,8 @@ bool StatusHandler::received(Message &msg)
 	return false;
     Lock lock(s_mutex);
     msg.retValue() << "name=" << __plugin.name()
-	<< ",type=route;sections=" << s_cfg.count()
+	<< ",type=route;sections=" << (s_program ? s_program->sections() : 0)
+	<< ",rules=" << (s_program ? s_program->rules() : 0)
 	<< ",extra=" << s_extra.count()
 	<< ",variables=" << s_vars.count() << "\r\n";
     return !dest.null();
@@ -904,7 +1493,7 @@ bool CommandHandler::received(Message &msg)
 
 RegexRoutePlugin::RegexRoutePlugin()
     : Plugin("regexroute"),
-      m_preroute(0), m_route(0), m_status(0), m_first(true)
+      m_preroute(0), m_route(0), m_status(0), m_command(0), m_first(true)
 {
     Output("Loaded module RegexRoute");
 }
@@ -924,43 +1513,62 @@ void RegexRoutePlugin::initVars(NamedList* sect)
 void RegexRoutePlugin::initialize()
 {
     Output("Initializing module RegexRoute");
-    TelEngine::destruct(m_preroute);
-    TelEngine::destruct(m_route);
-    TelEngine::destruct(m_status);
-    TelEngine::destruct(m_command);
-    s_extra.clear();
-    Lock lock(s_mutex);
-    s_cfg = Engine::configFile(name());
-    s_cfg.load();
-    if (m_first) {
-	m_first = false;
-	initVars(s_cfg.getSection("$once"));
-    }
-    initVars(s_cfg.getSection("$init"));
-    s_trackName = s_cfg.getBoolValue("priorities","trackparam",true) ?
-	name().c_str() : (const char*)0;
-    s_extended = s_cfg.getBoolValue("priorities","extended",false);
-    s_insensitive = s_cfg.getBoolValue("priorities","insensitive",false);
-    s_prerouteall = s_cfg.getBoolValue("priorities","prerouteall",false);
-    unsigned priority = s_cfg.getIntValue("priorities","preroute",100);
-    if (priority)
-	Engine::install(m_preroute = new PrerouteHandler(priority));
-    priority = s_cfg.getIntValue("priorities","route",100);
-    if (priority)
-	Engine::install(m_route = new RouteHandler(priority));
-    priority = s_cfg.getIntValue("priorities","status",110);
-    if (priority) {
-	Engine::install(m_status = new StatusHandler(priority));
-	Engine::install(m_command = new CommandHandler(priority));
-    }
-    int depth = s_cfg.getIntValue("priorities","maxdepth",5);
+    Configuration cfg(Engine::configFile(name()));
+    cfg.load();
+    int depth = cfg.getIntValue("priorities","maxdepth",5);
     if (depth < 5)
 	depth = 5;
     else if (depth > 100)
 	depth = 100;
-    s_maxDepth = depth;
-    s_defRule = s_cfg.getValue("priorities","defaultrule",DEFAULT_RULE);
-    NamedList* l = s_cfg.getSection("extra");
+    // compile all rules before touching the running ones, routing goes on meanwhile
+    u_int64_t t = Time::now();
+    RouteProgram* prog = new RouteProgram(cfg,
+	cfg.getValue("priorities","defaultrule",DEFAULT_RULE),
+	cfg.getBoolValue("priorities","extended",false),
+	cfg.getBoolValue("priorities","insensitive",false),depth);
+    Debug(DebugInfo,"Compiled %u rules (%u indexed by prefix) in %u sections in " FMT64U " usec",
+	prog->rules(),prog->indexed(),prog->sections(),Time::now() - t);
+    s_mutex.lock();
+    RouteProgram* old = s_program;
+    s_program = prog;
+    if (m_first) {
+	m_first = false;
+	initVars(cfg.getSection("$once"));
+    }
+    initVars(cfg.getSection("$init"));
+    s_mutex.unlock();
+    // routing threads may still hold the old program, last one deletes it
+    TelEngine::destruct(old);
+
+    s_trackName = cfg.getBoolValue("priorities","trackparam",true) ?
+	name().c_str() : (const char*)0;
+    s_prerouteall = cfg.getBoolValue("priorities","prerouteall",false);
+    // handlers whose priority did not change are kept so calls are routed during reload
+    unsigned priority = cfg.getIntValue("priorities","preroute",100);
+    if (!(m_preroute && m_preroute->priority() == priority)) {
+	TelEngine::destruct(m_preroute);
+	if (priority)
+	    Engine::install(m_preroute = new PrerouteHandler(priority));
+    }
+    priority = cfg.getIntValue("priorities","route",100);
+    if (!(m_route && m_route->priority() == priority)) {
+	TelEngine::destruct(m_route);
+	if (priority)
+	    Engine::install(m_route = new RouteHandler(priority));
+    }
+    priority = cfg.getIntValue("priorities","status",110);
+    if (!(m_status && m_status->priority() == priority)) {
+	TelEngine::destruct(m_status);
+	TelEngine::destruct(m_command);
+	if (priority) {
+	    Engine::install(m_status = new StatusHandler(priority));
+	    Engine::install(m_command = new CommandHandler(priority));
+	}
+    }
+    ObjList oldExtra;
+    while (GenObject* h = s_extra.remove(false))
+	oldExtra.append(h);
+    NamedList* l = cfg.getSection("extra");
     if (l) {
 	unsigned int len = l->length();
 	for (unsigned int i=0; i<len; i++) {
@@ -974,14 +1582,29 @@ void RegexRoutePlugin::initialize()
 		const char* context = TelEngine::c_str(static_cast<const String*>(o->at(2)));
 		if (TelEngine::null(context))
 		    context = n->name().c_str();
-		if (s_cfg.getSection(context))
-		    Engine::install(new GenericHandler(n->name(),prio,context,match));
+		if (prog->find(context)) {
+		    GenericHandler* h = 0;
+		    for (ObjList* e = oldExtra.skipNull(); e; e = e->skipNext()) {
+			GenericHandler* g = static_cast<GenericHandler*>(e->get());
+			if (g->same(n->name(),prio,context,match)) {
+			    h = g;
+			    e->remove(false);
+			    break;
+			}
+		    }
+		    if (h)
+			s_extra.append(h);
+		    else
+			Engine::install(new GenericHandler(n->name(),prio,context,match));
+		}
 		else
 		    Debug(DebugWarn,"Missing context [%s] for handling %s",context,n->name().c_str());
 		TelEngine::destruct(o);
 	    }
 	}
     }
+    // handlers no longer configured are uninstalled by their destructor
+    oldExtra.clear();
 }
 
 }; // anonymous namespace
@@ -82,6 +82,7 @@ static const char* s_level[] =
 static const char* s_debug[] =
 {
     "threshold",
+    "locks",
     0
 };
 
@@ -119,7 +120,7 @@ static const CommandInfo s_cmdInfo[] =
     { "color", "[on|off]", s_bools, "Show status or turn local colorization on or off" },
 
     // Admin commands
-    { "debug", "[module] [level|objects|on|off]", s_level, "Show or change debugging level globally or per module" },
+    { "debug", "[module] [level|objects|locks|on|off]", s_level, "Show or change debugging level globally or per module" },
 #ifdef HAVE_MALLINFO
     { "meminfo", 0, 0, "Displays memory allocation statistics" },
 #endif
@@ -1137,6 +1138,10 @@ bool Connection::autoComplete()
 	completeWord(m.retValue(),YSTRING("all"),partWord);
 	completeWords(m.retValue(),s_bools,partWord);
     }
+    else if (partLine == "debug locks") {
+	completeWord(m.retValue(),YSTRING("reset"),partWord);
+	completeWords(m.retValue(),s_bools,partWord);
+    }
     else if (partLine.matches(o1) || partLine.matches(o2)) {
 	completeWord(m.retValue(),YSTRING("reset"),partWord);
 	completeWords(m.retValue(),s_bools,partWord);
@@ -1472,6 +1477,18 @@ bool Connection::processLine(const char *line, bool saveLine)
 		setObjCounting(dbg);
 	    }
 	}
+	else if (str.startSkip("locks")) {
+	    if (str == YSTRING("reset"))
+		Lockable::resetStats();
+	    else {
+		bool dbg = Lockable::stats();
+		str >> dbg;
+		if (!Lockable::enableStats(dbg)) {
+		    writeStr(m_machine ? "%%=debug:fail=nolockstats\r\n" : "Lock statistics are not supported by this build\r\n");
+		    return false;
+		}
+	    }
+	}
 	else if (str.startSkip("threshold")) {
 	    int thr = m_threshold;
 	    str >> thr;
@@ -1512,6 +1529,7 @@ bool Connection::processLine(const char *line, bool saveLine)
 	if (m_machine) {
 	    str = "%%=debug:level=";
 	    str << debugLevel() << ":objects=" << getObjCounting();
+	    str << ":locks=" << Lockable::stats();
 	    str << ":local=" << m_debug;
 	    str << ":threshold=" << m_threshold;
 	    if (counter)
@@ -1520,6 +1538,7 @@ bool Connection::processLine(const char *line, bool saveLine)
 	else {
 	    str = "Debug level: ";
 	    str << debugLevel() << ", objects: " << (getObjCounting() ? "on" : "off");
+	    str << ", locks: " << (Lockable::stats() ? "on" : "off");
 	    str << ", local: " << (m_debug ? "on" : "off");
 	    str << ", threshold: " << m_threshold;
 	    if (counter)
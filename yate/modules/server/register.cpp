@@ -1027,6 +1027,8 @@ void RegistModule::initialize()
     m_init = true;
     setup();
     Output("Initializing module Register for database");
+    // one fallback entry per routed call, let the table grow with the load
+    s_fallbacklist.autoResize();
     s_expire = s_cfg.getIntValue("general","expires",s_expire);
     s_errOffline = s_cfg.getBoolValue("call.route","offlineauto",true);
     Engine::install(new MessageRelay("engine.start",this,Private,150));
@@ -1058,14 +1060,14 @@ bool FallBackHandler::received(Message &msg)
 	case Answered:
 	{
 	    GenObject* route = s_fallbacklist[msg.getValue("targetid")];
-	    s_fallbacklist.remove(route);
+	    s_fallbacklist.remove(route,true,true);
 	    return false;
 	}
 	break;
 	case Hangup:
 	{
 	    GenObject* route = s_fallbacklist[msg.getValue("id")];
-	    s_fallbacklist.remove(route);
+	    s_fallbacklist.remove(route,true,true);
 	    return false;
 	}
 	break;
@@ -1075,7 +1077,7 @@ bool FallBackHandler::received(Message &msg)
 	    if (m_stoperror && m_stoperror.matches(reason)) {
 		//stop fallback on this error
 		GenObject* route = s_fallbacklist[msg.getValue("id")];
-		s_fallbacklist.remove(route);
+		s_fallbacklist.remove(route,true,true);
 		return false;
 	    }
 
@@ -1087,7 +1089,7 @@ bool FallBackHandler::received(Message &msg)
 		    Engine::enqueue(r);
 		    return true;
 		}
-		s_fallbacklist.remove(route);
+		s_fallbacklist.remove(route,true,true);
 	    }
 	    return false;
 	}
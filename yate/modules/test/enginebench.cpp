@@ -0,0 +1,786 @@
+/**
+ * enginebench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Microbenchmarks for the engine core classes
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class BenchHandler : public MessageHandler
+{
+public:
+    inline BenchHandler(const char* name, unsigned priority)
+	: MessageHandler(name,priority)
+	{ }
+    virtual bool received(Message& msg)
+	{ return false; }
+};
+
+// Results collected from the output benchmark threads
+struct OutputStats
+{
+    Mutex mutex;
+    unsigned int done;
+    u_int64_t usec;
+    u_int64_t worst;
+};
+
+class OutputThread : public Thread
+{
+public:
+    inline OutputThread(OutputStats& stats, unsigned int index, unsigned int count)
+	: Thread("BenchOutput"), m_stats(stats), m_index(index), m_count(count)
+	{ }
+    virtual void run();
+private:
+    OutputStats& m_stats;
+    unsigned int m_index;
+    unsigned int m_count;
+};
+
+// Results collected from the lock benchmark threads
+struct LockStatsBench
+{
+    Mutex mutex;
+    Mutex shared;
+    unsigned int done;
+    u_int64_t usec;
+};
+
+class LockThread : public Thread
+{
+public:
+    inline LockThread(LockStatsBench& stats, unsigned int count, bool shared)
+	: Thread("BenchLock"), m_stats(stats), m_count(count), m_shared(shared)
+	{ }
+    virtual void run();
+private:
+    LockStatsBench& m_stats;
+    unsigned int m_count;
+    bool m_shared;
+};
+
+// Results collected from the asynchronous DNS queries, referenced by each
+//  listener as queries may still complete after the benchmark gave up
+class ResolverStats : public RefObject
+{
+public:
+    inline ResolverStats()
+	: mutex(false,"BenchResolver"), done(0), records(0)
+	{ }
+    Mutex mutex;
+    unsigned int done;
+    unsigned int records;
+};
+
+// Results collected from the routing benchmark threads
+struct RouteStats
+{
+    Mutex mutex;
+    unsigned int done;
+    unsigned int routed;
+    u_int64_t usec;
+    u_int64_t worst;
+};
+
+class RouteThread : public Thread
+{
+public:
+    inline RouteThread(RouteStats& stats, unsigned int count, unsigned int rules)
+	: Thread("BenchRoute"), m_stats(stats), m_count(count), m_rules(rules)
+	{ }
+    virtual void run();
+private:
+    RouteStats& m_stats;
+    unsigned int m_count;
+    unsigned int m_rules;
+};
+
+class FloodThread : public Thread
+{
+public:
+    inline FloodThread(RouteStats& stats, const NamedList& params, unsigned int count)
+	: Thread("BenchFlood"), m_stats(stats), m_params(params), m_count(count)
+	{ }
+    virtual void run();
+private:
+    RouteStats& m_stats;
+    const NamedList& m_params;
+    unsigned int m_count;
+};
+
+class BenchListener : public ResolverListener
+{
+public:
+    inline BenchListener(ResolverStats* stats)
+	: m_stats(stats)
+	{ }
+    virtual void resolved(Resolver::Type type, const String& dname, int code,
+	ObjList& result, const String& error);
+private:
+    RefPointer<ResolverStats> m_stats;
+};
+
+class EngineBench : public Module
+{
+public:
+    EngineBench();
+    virtual ~EngineBench();
+    virtual void initialize();
+    virtual bool received(Message& msg, int id);
+    virtual bool commandComplete(Message& msg, const String& partLine,
+	const String& partWord);
+private:
+    bool onCmdControl(Message& msg);
+    void benchDispatch(Message& msg);
+    void benchParams(Message& msg);
+    void benchHashList(Message& msg);
+    void benchOutput(Message& msg);
+    void benchLocks(Message& msg);
+    void benchResolver(Message& msg);
+    void benchRouteConf(Message& msg);
+    void benchRoute(Message& msg);
+    void benchFlood(Message& msg);
+};
+
+static const char* s_cmds[] = {
+    "dispatch",
+    "params",
+    "hashlist",
+    "output",
+    "locks",
+    "resolver",
+    "routeconf",
+    "route",
+    "flood",
+    "help",
+    0
+};
+
+// Names of the messages installed in the dispatch benchmark
+static const char* s_msgNames[] = {
+    "call.route", "call.execute", "call.preroute", "call.answered",
+    "call.progress", "call.ringing", "call.update", "call.cdr",
+    "chan.dtmf", "chan.hangup", "chan.startup", "chan.disconnected",
+    "chan.notify", "chan.masquerade", "chan.control", "chan.operation",
+    "user.register", "user.unregister", "user.auth", "user.notify",
+    "engine.timer", "engine.status", "engine.command", "engine.help",
+    "msg.execute", "msg.route", "resource.subscribe", "resource.notify",
+    "database", "monitor.query", "monitor.notify", "ybts.ue",
+    0
+};
+
+// Parameters of a call.execute captured on a BTS routing a MO call to SIP
+static const TokenDict s_callExecute[] = {
+    { "id", 0 }, { "module", 0 }, { "status", 0 }, { "address", 0 },
+    { "billid", 0 }, { "answered", 0 }, { "direction", 0 }, { "callid", 0 },
+    { "caller", 0 }, { "called", 0 }, { "callername", 0 }, { "handlers", 0 },
+    { "ip_host", 0 }, { "ip_port", 0 }, { "ip_transport", 0 }, { "connection_id", 0 },
+    { "connection_reliable", 0 }, { "sip_uri", 0 }, { "sip_from", 0 }, { "sip_to", 0 },
+    { "sip_callid", 0 }, { "device", 0 }, { "sip_contact", 0 }, { "sip_supported", 0 },
+    { "sip_allow", 0 }, { "sip_content-type", 0 }, { "sip_user-agent", 0 }, { "sip_p-asserted-identity", 0 },
+    { "rtp_addr", 0 }, { "media", 0 }, { "formats", 0 }, { "transport", 0 },
+    { "rtp_mapping", 0 }, { "rtp_rfc2833", 0 }, { "rtp_port", 0 }, { "sdp_raw", 0 },
+    { "imsi", 0 }, { "tmsi", 0 }, { "imei", 0 }, { "msisdn", 0 },
+    { "ybts_call", 0 }, { "ybts_ti", 0 }, { "ybts_lai", 0 }, { "ybts_cellid", 0 },
+    { "ybts_arfcn", 0 }, { "ybts_channel", 0 }, { "ybts_tch", 0 }, { "ybts_speech", 0 },
+    { "osip_X-Caller-IMSI", 0 }, { "osip_X-Called-IMSI", 0 }, { "osip_P-Access-Network-Info", 0 }, { "osip_X-Roaming", 0 },
+    { "copyparams", 0 }, { "maxcall", 0 }, { "timeout", 0 }, { "pbxassist", 0 },
+    { "dtmfpass", 0 }, { "cdrtrack", 0 }, { "cdrwrite", 0 }, { "trace_msg_count", 0 },
+    { "line", 0 }, { "domain", 0 }, { "username", 0 }, { "authenticated", 0 },
+    { "realm", 0 }, { "nonce", 0 }, { "response", 0 }, { "oconnection_id", 0 },
+    { "format", 0 }, { "osip_Max-Forwards", 0 }, { "rtp_forward", 0 }, { "antiloop", 0 },
+    { "overlapped", 0 }, { "callto", 0 }, { "reason", 0 }, { "error", 0 },
+    { "earlymedia", 0 }, { "ringback", 0 }, { "autoring", 0 }, { "tonedetect_in", 0 },
+    { "handlers", 0 }, { "callto.1", 0 }, { "callto.1.maxcall", 0 }, { "callto.2", 0 },
+    { 0, 0 }
+};
+
+// Parameters queried by the handlers of a call.execute, some are missing
+static const char* s_callExecuteQuery[] = {
+    "id", "callto", "caller", "called", "billid", "maxcall", "timeout",
+    "rtp_forward", "media", "formats", "sip_uri", "osip_X-Caller-IMSI",
+    "imsi", "msisdn", "ybts_tch", "copyparams", "pbxassist", "cdrtrack",
+    "antiloop", "oconnection_id", "line", "domain", "autoanswer", "autorepeat",
+    "callto.3", "calledname", "diverter", "reason", "error", "cdrwrite",
+    0
+};
+
+INIT_PLUGIN(EngineBench);
+
+
+void OutputThread::run()
+{
+    u_int64_t worst = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < m_count; i++) {
+	u_int64_t t1 = Time::now();
+	Output("enginebench output thread %u line %u of %u",m_index,i + 1,m_count);
+	t1 = Time::now() - t1;
+	if (worst < t1)
+	    worst = t1;
+    }
+    t = Time::now() - t;
+    Lock lock(m_stats.mutex);
+    m_stats.usec += t;
+    if (m_stats.worst < worst)
+	m_stats.worst = worst;
+    m_stats.done++;
+}
+
+
+void LockThread::run()
+{
+    // each thread has its own mutex unless asked to share one
+    Mutex own(false,"BenchLockOwn");
+    Mutex& mtx = m_shared ? m_stats.shared : own;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < m_count; i++) {
+	mtx.lock();
+	mtx.unlock();
+    }
+    t = Time::now() - t;
+    Lock lock(m_stats.mutex);
+    m_stats.usec += t;
+    m_stats.done++;
+}
+
+void RouteThread::run()
+{
+    unsigned int routed = 0;
+    u_int64_t worst = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < m_count; i++) {
+	unsigned int n = Random::random() % m_rules;
+	Message m("call.route");
+	m.addParam("module","enginebench");
+	m.addParam("caller",String(1000 + (n % 9000)));
+	m.addParam("called",String(4000000 + 7 * n));
+	u_int64_t t1 = Time::now();
+	if (Engine::dispatch(m) && m.retValue())
+	    routed++;
+	t1 = Time::now() - t1;
+	if (worst < t1)
+	    worst = t1;
+    }
+    t = Time::now() - t;
+    Lock lock(m_stats.mutex);
+    m_stats.usec += t;
+    m_stats.routed += routed;
+    if (m_stats.worst < worst)
+	m_stats.worst = worst;
+    m_stats.done++;
+}
+
+void FloodThread::run()
+{
+    unsigned int handled = 0;
+    u_int64_t worst = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < m_count; i++) {
+	Message m(m_params,m_params);
+	m.setParam("index",String(i));
+	u_int64_t t1 = Time::now();
+	if (Engine::dispatch(m))
+	    handled++;
+	t1 = Time::now() - t1;
+	if (worst < t1)
+	    worst = t1;
+    }
+    t = Time::now() - t;
+    Lock lock(m_stats.mutex);
+    m_stats.usec += t;
+    m_stats.routed += handled;
+    if (m_stats.worst < worst)
+	m_stats.worst = worst;
+    m_stats.done++;
+}
+
+void BenchListener::resolved(Resolver::Type type, const String& dname, int code,
+    ObjList& result, const String& error)
+{
+    Lock lock(m_stats->mutex);
+    m_stats->done++;
+    m_stats->records += result.count();
+}
+
+
+EngineBench::EngineBench()
+    : Module("enginebench","misc")
+{
+    Output("Loaded module EngineBench");
+}
+
+EngineBench::~EngineBench()
+{
+    Output("Unloading module EngineBench");
+}
+
+void EngineBench::initialize()
+{
+    Output("Initializing module EngineBench");
+    if (!relayInstalled(Control)) {
+	setup();
+	installRelay(Control);
+    }
+}
+
+bool EngineBench::received(Message& msg, int id)
+{
+    if (id == Control) {
+	if (msg[YSTRING("component")] == name())
+	    return onCmdControl(msg);
+	return false;
+    }
+    return Module::received(msg,id);
+}
+
+bool EngineBench::commandComplete(Message& msg, const String& partLine,
+    const String& partWord)
+{
+    if (partLine == YSTRING("control")) {
+	itemComplete(msg.retValue(),name(),partWord);
+	return false;
+    }
+    String tmp = partLine;
+    if (tmp.startSkip("control") && tmp == name()) {
+	for (const char** c = s_cmds; *c; c++)
+	    itemComplete(msg.retValue(),*c,partWord);
+	return false;
+    }
+    return Module::commandComplete(msg,partLine,partWord);
+}
+
+bool EngineBench::onCmdControl(Message& msg)
+{
+    static const char* s_help =
+	"\r\ncontrol enginebench dispatch [handlers=300] [count=100000] [broadcast=4]"
+	"\r\n  Measure MessageDispatcher::dispatch() cost against installed handler count"
+	"\r\ncontrol enginebench params [count=100000] [hash=16]"
+	"\r\n  Replay call.execute parameter lookups with and without hash index"
+	"\r\ncontrol enginebench hashlist [count=100000] [size=17] [load=4]"
+	"\r\n  Fill and search a fixed size and an auto resizing HashList"
+	"\r\ncontrol enginebench output [threads=4] [count=10000]"
+	"\r\n  Write lines to the log from several threads and report caller latency"
+	"\r\ncontrol enginebench locks [threads=4] [count=1000000] [shared=no]"
+	"\r\n  Lock and unlock mutexes from several threads, report cost per pair"
+	"\r\ncontrol enginebench resolver [name=4.3.2.1.e164.arpa] [type=NAPTR] [count=100] [listeners=16]"
+	"\r\n  Compare direct and cached DNS queries, join asynchronous queries"
+	"\r\ncontrol enginebench routeconf file=<path> [rules=5000]"
+	"\r\n  Write a regexroute configuration with many number routes"
+	"\r\ncontrol enginebench route [threads=4] [count=10000] [rules=5000] [reload=0]"
+	"\r\n  Route calls from several threads while reloading the routing modules"
+	"\r\ncontrol enginebench flood message=<name> [threads=4] [count=10000] [param=value...]"
+	"\r\n  Dispatch a message with the other parameters from several threads";
+
+    const String& cmd = msg[YSTRING("operation")];
+    if (cmd == YSTRING("dispatch"))
+	benchDispatch(msg);
+    else if (cmd == YSTRING("params"))
+	benchParams(msg);
+    else if (cmd == YSTRING("hashlist"))
+	benchHashList(msg);
+    else if (cmd == YSTRING("output"))
+	benchOutput(msg);
+    else if (cmd == YSTRING("locks"))
+	benchLocks(msg);
+    else if (cmd == YSTRING("resolver"))
+	benchResolver(msg);
+    else if (cmd == YSTRING("routeconf"))
+	benchRouteConf(msg);
+    else if (cmd == YSTRING("route"))
+	benchRoute(msg);
+    else if (cmd == YSTRING("flood"))
+	benchFlood(msg);
+    else
+	msg.retValue() << s_help;
+    return true;
+}
+
+// Install handlers spread over a set of message names in a private dispatcher
+//  then dispatch messages with one of the names
+void EngineBench::benchDispatch(Message& msg)
+{
+    int handlers = msg.getIntValue(YSTRING("handlers"),300,1,100000);
+    int count = msg.getIntValue(YSTRING("count"),100000,1);
+    int broadcast = msg.getIntValue(YSTRING("broadcast"),4,0,handlers);
+    unsigned int names = 0;
+    while (s_msgNames[names])
+	names++;
+    MessageDispatcher disp;
+    for (int i = 0; i < handlers; i++) {
+	const char* name = (i < broadcast) ? 0 : s_msgNames[i % names];
+	disp.install(new BenchHandler(name,(unsigned int)(10 + (i * 7) % 200)));
+    }
+    Message m("chan.dtmf");
+    m.addParam("id","sip/1");
+    m.addParam("text","5");
+    u_int64_t t = Time::now();
+    for (int i = 0; i < count; i++)
+	disp.dispatch(m);
+    t = Time::now() - t;
+    msg.retValue() << "dispatch: handlers=" << handlers << " broadcast=" << broadcast <<
+	" count=" << count << " usec=" << t;
+    if (count)
+	msg.retValue() << " nsec/msg=" << (unsigned int)((t * 1000) / count);
+    msg.retValue() << "\r\n";
+}
+
+// Build a call.execute message and query it as routing handlers would
+void EngineBench::benchParams(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),100000,1);
+    int hash = msg.getIntValue(YSTRING("hash"),16,1);
+    // handlers use YSTRING() so names have their hash already computed
+    String names[sizeof(s_callExecuteQuery) / sizeof(const char*)];
+    unsigned int n = 0;
+    for (; s_callExecuteQuery[n]; n++) {
+	names[n] = s_callExecuteQuery[n];
+	names[n].hash();
+    }
+    unsigned int found = 0;
+    for (int pass = 0; pass < 2; pass++) {
+	Message m("call.execute");
+	m.hashParams(pass ? hash : 0);
+	for (const TokenDict* d = s_callExecute; d->token; d++)
+	    m.addParam(d->token,"value");
+	u_int64_t t = Time::now();
+	for (int i = 0; i < count; i++) {
+	    for (unsigned int j = 0; j < n; j++) {
+		if (m.getParam(names[j]))
+		    found++;
+	    }
+	    // handlers also update some parameters while routing
+	    m.setParam("handlers","javascript:15,regexroute:100");
+	    m.clearParam(YSTRING("reason"));
+	    m.addParam("reason","none");
+	}
+	t = Time::now() - t;
+	msg.retValue() << "params: hash=" << (pass ? hash : 0) << " count=" << count <<
+	    " usec=" << t;
+	if (count)
+	    msg.retValue() << " nsec/msg=" << (unsigned int)((t * 1000) / count);
+	msg.retValue() << "\r\n";
+    }
+    if (!found)
+	msg.retValue() << "params: no parameters found\r\n";
+}
+
+// Insert channel like identifiers then look them all up, report the worst insert
+void EngineBench::benchHashList(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),100000,1);
+    int size = msg.getIntValue(YSTRING("size"),17,1,1024);
+    int load = msg.getIntValue(YSTRING("load"),4,1);
+    String* ids = new String[count];
+    for (int i = 0; i < count; i++)
+	ids[i] << "sip/" << (i + 1);
+    for (int pass = 0; pass < 2; pass++) {
+	HashList list(size);
+	if (pass)
+	    list.autoResize(load);
+	u_int64_t worst = 0;
+	u_int64_t t = Time::now();
+	for (int i = 0; i < count; i++) {
+	    u_int64_t t1 = Time::now();
+	    list.append(&ids[i])->setDelete(false);
+	    t1 = Time::now() - t1;
+	    if (worst < t1)
+		worst = t1;
+	}
+	u_int64_t t2 = Time::now();
+	int found = 0;
+	for (int i = 0; i < count; i++) {
+	    if (list.find(ids[i]))
+		found++;
+	}
+	t2 = Time::now() - t2;
+	t = Time::now() - t - t2;
+	msg.retValue() << "hashlist: resize=" << (pass ? "yes" : "no") << " count=" << count <<
+	    " buckets=" << list.length() << " insert_usec=" << t << " worst_insert_usec=" <<
+	    worst << " find_usec=" << t2 << " found=" << found << "\r\n";
+	// objects are owned by the array
+	list.clear();
+    }
+    delete[] ids;
+}
+
+// Flood the output from several threads, compare runs with different logqueue settings
+void EngineBench::benchOutput(Message& msg)
+{
+    int threads = msg.getIntValue(YSTRING("threads"),4,1,64);
+    int count = msg.getIntValue(YSTRING("count"),10000,1);
+    unsigned int dropped = Debugger::asyncDropped();
+    OutputStats stats;
+    stats.done = 0;
+    stats.usec = 0;
+    stats.worst = 0;
+    unsigned int started = 0;
+    for (int i = 0; i < threads; i++) {
+	OutputThread* thr = new OutputThread(stats,i + 1,count);
+	if (thr->startup())
+	    started++;
+	else
+	    delete thr;
+    }
+    // threads delete themselves, wait until all reported
+    for (;;) {
+	Lock lock(stats.mutex);
+	if (stats.done >= started)
+	    break;
+	lock.drop();
+	Thread::idle();
+    }
+    msg.retValue() << "output: queue=" << Debugger::asyncOutput() << " threads=" << started <<
+	" count=" << count << " usec=" << stats.usec << " worst_usec=" << stats.worst <<
+	" dropped=" << (Debugger::asyncDropped() - dropped);
+    if (started && count)
+	msg.retValue() << " nsec/line=" << (unsigned int)((stats.usec * 1000) / (started * count));
+    msg.retValue() << "\r\n";
+}
+
+// Lock and unlock private or shared mutexes, compare runs with and without -Dd
+void EngineBench::benchLocks(Message& msg)
+{
+    int threads = msg.getIntValue(YSTRING("threads"),4,1,64);
+    int count = msg.getIntValue(YSTRING("count"),1000000,1);
+    bool shared = msg.getBoolValue(YSTRING("shared"));
+    LockStatsBench stats;
+    stats.done = 0;
+    stats.usec = 0;
+    unsigned int started = 0;
+    u_int64_t t = Time::now();
+    for (int i = 0; i < threads; i++) {
+	LockThread* thr = new LockThread(stats,count,shared);
+	if (thr->startup())
+	    started++;
+	else
+	    delete thr;
+    }
+    // threads delete themselves, wait until all reported
+    for (;;) {
+	Lock lock(stats.mutex);
+	if (stats.done >= started)
+	    break;
+	lock.drop();
+	Thread::idle();
+    }
+    t = Time::now() - t;
+    msg.retValue() << "locks: safety=" << String::boolText(Lockable::safety()) <<
+	" shared=" << String::boolText(shared) << " threads=" << started <<
+	" count=" << count << " usec=" << t;
+    if (started && count)
+	msg.retValue() << " nsec/pair=" << (unsigned int)((stats.usec * 1000) / ((u_int64_t)started * count));
+    msg.retValue() << "\r\n";
+}
+
+// Repeat a DNS query directly and through the cache, then start many
+//  identical asynchronous queries that should result in a single lookup
+void EngineBench::benchResolver(Message& msg)
+{
+    const String& name = msg[YSTRING("name")];
+    const char* dname = name ? name.c_str() : "4.3.2.1.e164.arpa";
+    int type = lookup(msg.getValue(YSTRING("type"),"NAPTR"),Resolver::s_types,Resolver::Naptr);
+    int count = msg.getIntValue(YSTRING("count"),100,1);
+    int listeners = msg.getIntValue(YSTRING("listeners"),16,1,10000);
+    Resolver::init();
+    int code = 0;
+    unsigned int records = 0;
+    u_int64_t direct = Time::now();
+    for (int i = 0; i < count; i++) {
+	ObjList res;
+	code = Resolver::query((Resolver::Type)type,dname,res);
+	records = res.count();
+    }
+    direct = Time::now() - direct;
+    Resolver::clearCache();
+    u_int64_t cached = Time::now();
+    for (int i = 0; i < count; i++) {
+	ObjList res;
+	Resolver::cachedQuery((Resolver::Type)type,dname,res);
+    }
+    cached = Time::now() - cached;
+    Resolver::clearCache();
+    ResolverStats* stats = new ResolverStats;
+    u_int64_t async = Time::now();
+    for (int i = 0; i < listeners; i++) {
+	BenchListener* l = new BenchListener(stats);
+	Resolver::asyncQuery((Resolver::Type)type,dname,l);
+	TelEngine::destruct(l);
+    }
+    // give up after 10 seconds if the server does not answer
+    unsigned int notified = 0;
+    for (;;) {
+	Lock lock(stats->mutex);
+	notified = stats->done;
+	if ((notified >= (unsigned int)listeners) || (Time::now() - async > 10000000))
+	    break;
+	lock.drop();
+	Thread::idle();
+    }
+    async = Time::now() - async;
+    TelEngine::destruct(stats);
+    String status;
+    Resolver::cacheStatus(status);
+    msg.retValue() << "resolver: type=" << lookup(type,Resolver::s_types) << " name=" << dname <<
+	" code=" << code << " records=" << records << " count=" << count <<
+	" direct_usec=" << (unsigned int)(direct / count) <<
+	" cached_usec=" << (unsigned int)(cached / count) <<
+	" listeners=" << listeners << " notified=" << notified <<
+	" async_usec=" << async << " " << status << "\r\n";
+}
+
+// Generate a large regexroute.conf: one number route per rule, every 10th
+//  one conditional on the caller, plus a few blocks and parameter matches
+void EngineBench::benchRouteConf(Message& msg)
+{
+    const String& file = msg[YSTRING("file")];
+    if (!file) {
+	msg.retValue() << "routeconf: missing file parameter\r\n";
+	return;
+    }
+    int rules = msg.getIntValue(YSTRING("rules"),5000,1,1000000);
+    Configuration cfg(file);
+    NamedList* sect = cfg.createSection("general");
+    sect->setParam("priority","100");
+    sect = cfg.createSection("default");
+    sect->addParam("${module}^sip$","{");
+    sect->addParam("${sip_x-bench}^yes$","echo Bench call from ${caller}");
+    sect->addParam("^999","goto bench-special");
+    sect->addParam("}","");
+    for (int i = 0; i < rules; i++) {
+	String called;
+	called << "^" << (4000000 + 7 * i) << "$";
+	String dest;
+	dest << "sip/sip:\\0@gw" << (i % 7) << ";maxcall=20000";
+	if (i % 10)
+	    sect->addParam(called,dest);
+	else
+	    sect->addParam(called,"if ${caller}^1=" + dest);
+    }
+    sect->addParam(".*","-;error=noroute");
+    sect = cfg.createSection("bench-special");
+    sect->addParam("^999\\(.*\\)$","sip/sip:\\1@special");
+    bool ok = cfg.save();
+    msg.retValue() << "routeconf: file=" << file << " rules=" << rules <<
+	" saved=" << String::boolText(ok) << "\r\n";
+}
+
+// Route calls to random numbers of the generated configuration from several
+//  threads, optionally reinitializing the routing modules meanwhile
+void EngineBench::benchRoute(Message& msg)
+{
+    int threads = msg.getIntValue(YSTRING("threads"),4,1,64);
+    int count = msg.getIntValue(YSTRING("count"),10000,1);
+    int rules = msg.getIntValue(YSTRING("rules"),5000,1,1000000);
+    int reload = msg.getIntValue(YSTRING("reload"),0,0);
+    RouteStats stats;
+    stats.done = 0;
+    stats.routed = 0;
+    stats.usec = 0;
+    stats.worst = 0;
+    unsigned int started = 0;
+    u_int64_t t = Time::now();
+    for (int i = 0; i < threads; i++) {
+	RouteThread* thr = new RouteThread(stats,count,rules);
+	if (thr->startup())
+	    started++;
+	else
+	    delete thr;
+    }
+    u_int64_t reloadUsec = 0;
+    int reloads = 0;
+    // threads delete themselves, wait until all reported
+    for (;;) {
+	Lock lock(stats.mutex);
+	if (stats.done >= started)
+	    break;
+	lock.drop();
+	if (reloads < reload) {
+	    u_int64_t t1 = Time::now();
+	    Engine::init("regexroute");
+	    reloadUsec += Time::now() - t1;
+	    reloads++;
+	}
+	Thread::idle();
+    }
+    t = Time::now() - t;
+    msg.retValue() << "route: threads=" << started << " count=" << count <<
+	" rules=" << rules << " routed=" << stats.routed << " usec=" << t <<
+	" worst_usec=" << stats.worst << " reloads=" << reloads;
+    if (reloads)
+	msg.retValue() << " usec/reload=" << (unsigned int)(reloadUsec / reloads);
+    if (started && count)
+	msg.retValue() << " usec/route=" << (unsigned int)(stats.usec / ((u_int64_t)started * count));
+    msg.retValue() << "\r\n";
+}
+
+// Dispatch copies of a message from several threads, compare handler modes
+void EngineBench::benchFlood(Message& msg)
+{
+    const String& name = msg[YSTRING("message")];
+    if (!name) {
+	msg.retValue() << "flood: missing message parameter\r\n";
+	return;
+    }
+    int threads = msg.getIntValue(YSTRING("threads"),4,1,64);
+    int count = msg.getIntValue(YSTRING("count"),10000,1);
+    NamedList params(name);
+    params.copyParams(msg);
+    params.clearParam(YSTRING("component"));
+    params.clearParam(YSTRING("operation"));
+    params.clearParam(YSTRING("message"));
+    params.clearParam(YSTRING("threads"));
+    params.clearParam(YSTRING("count"));
+    RouteStats stats;
+    stats.done = 0;
+    stats.routed = 0;
+    stats.usec = 0;
+    stats.worst = 0;
+    unsigned int started = 0;
+    u_int64_t t = Time::now();
+    for (int i = 0; i < threads; i++) {
+	FloodThread* thr = new FloodThread(stats,params,count);
+	if (thr->startup())
+	    started++;
+	else
+	    delete thr;
+    }
+    // threads delete themselves, wait until all reported
+    for (;;) {
+	Lock lock(stats.mutex);
+	if (stats.done >= started)
+	    break;
+	lock.drop();
+	Thread::idle();
+    }
+    t = Time::now() - t;
+    msg.retValue() << "flood: message=" << name << " threads=" << started <<
+	" count=" << count << " handled=" << stats.routed << " usec=" << t <<
+	" worst_usec=" << stats.worst;
+    if (t)
+	msg.retValue() << " msg/s=" << (unsigned int)(((u_int64_t)started * count * 1000000) / t);
+    msg.retValue() << "\r\n";
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,404 @@
+/**
+ * jsbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Benchmarks for the Javascript engine on routing style script code
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+#include <yatescript.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// One parsed copy of the benchmark script running in its own context
+class BenchScript
+{
+public:
+    BenchScript(const String& text, bool compiled);
+    ~BenchScript();
+    inline bool valid() const
+	{ return m_runner != 0; }
+    bool call(const String& func, int count, String& result, u_int64_t& usec);
+    void functions(ObjList& list, const String& only) const;
+private:
+    JsParser m_parser;
+    ScriptRun* m_runner;
+};
+
+class JsBench : public Module
+{
+public:
+    JsBench();
+    virtual ~JsBench();
+    virtual void initialize();
+    virtual bool received(Message& msg, int id);
+    virtual bool commandComplete(Message& msg, const String& partLine,
+	const String& partWord);
+private:
+    bool onCmdControl(Message& msg);
+    void benchRun(Message& msg);
+};
+
+static const char* s_cmds[] = {
+    "run",
+    "help",
+    0
+};
+
+// Hot paths of the nib.js and roaming.js routing scripts, made deterministic
+// Each bench_* function is called with the call number as argument
+static const char* s_script =
+    "// Routing state as nib.js and roaming.js keep it\n"
+    "var registered_subscribers = {};\n"
+    "var nnsf_bits = 8;\n"
+    "var nnsf_mask = 255;\n"
+    "var nnsf_node_shift = 50331648;\n"
+    "var nnsf_local_mask = 65535;\n"
+    "var last_tmsi = 0;\n"
+    "var last_used_node = 0;\n"
+    "var node_count = 6;\n"
+    "var stats = {routed:0, offline:0, outside:0, sos:0};\n"
+    "\n"
+    "for (var i = 0; i < 200; i++) {\n"
+    "    var sub = {};\n"
+    "    sub.msisdn = \"+40720\" + (100000 + i);\n"
+    "    sub.tmsi = \"\" + (1000 + i * 7);\n"
+    "    if (i % 5)\n"
+    "\tsub.location = \"ybts/TMSI\" + sub.tmsi;\n"
+    "    else\n"
+    "\tsub.location = \"\";\n"
+    "    registered_subscribers[\"00101000000\" + (1000 + i)] = sub;\n"
+    "}\n"
+    "\n"
+    "// TMSI allocation arithmetic of newTmsi()\n"
+    "function bench_tmsi(n)\n"
+    "{\n"
+    "    var t = last_tmsi;\n"
+    "    for (var i = 0; i < 200; i++) {\n"
+    "\tif (nnsf_bits > 0)\n"
+    "\t    t = ((t & 4278190080) >> nnsf_bits) | (t & nnsf_local_mask);\n"
+    "\tt++;\n"
+    "\tif (nnsf_bits > 0)\n"
+    "\t    t = ((t << nnsf_bits) & 4278190080) | nnsf_node_shift | (t & nnsf_local_mask);\n"
+    "\tif ((t & 3221225472) == 3221225472)\n"
+    "\t    t = nnsf_node_shift + 1;\n"
+    "    }\n"
+    "    last_tmsi = t;\n"
+    "    return t;\n"
+    "}\n"
+    "\n"
+    "// Node selection of getSIPRegistrar()\n"
+    "function bench_node(n)\n"
+    "{\n"
+    "    var sum = 0;\n"
+    "    for (var i = 0; i < 200; i++) {\n"
+    "\tvar hex_tmsi = nnsf_node_shift + i * 65537;\n"
+    "\tvar tmsi_node = (hex_tmsi >> (24 - nnsf_bits)) & nnsf_mask;\n"
+    "\tlast_used_node = last_used_node + 1;\n"
+    "\tif (last_used_node == node_count)\n"
+    "\t    last_used_node = 0;\n"
+    "\tsum += tmsi_node * 10 + last_used_node;\n"
+    "    }\n"
+    "    return sum;\n"
+    "}\n"
+    "\n"
+    "// Call counters kept while routing\n"
+    "function bench_counters(n)\n"
+    "{\n"
+    "    for (var i = 0; i < 200; i++) {\n"
+    "\tswitch ((n + i) % 5) {\n"
+    "\t    case 0:\n"
+    "\t\tstats.routed++;\n"
+    "\t\tbreak;\n"
+    "\t    case 1:\n"
+    "\t\tstats.offline++;\n"
+    "\t\tbreak;\n"
+    "\t    case 2:\n"
+    "\t\tstats.outside += 2;\n"
+    "\t\tbreak;\n"
+    "\t    default:\n"
+    "\t\tstats.sos = stats.sos + 1;\n"
+    "\t}\n"
+    "    }\n"
+    "    return stats.routed + stats.offline * 3 + stats.outside * 5 + stats.sos * 7;\n"
+    "}\n"
+    "\n"
+    "// Number building of goodNumber() with digits taken from the call number\n"
+    "function bench_number(n)\n"
+    "{\n"
+    "    var num = \"\";\n"
+    "    for (var i = 0; i < 20; i++) {\n"
+    "\tvar v = n * 31 + i * 17;\n"
+    "\tvar A = \"\" + (2 + v % 8);\n"
+    "\tvar B = \"\" + ((v >> 3) % 10);\n"
+    "\tvar C = \"\" + ((v >> 5) % 10);\n"
+    "\tvar D = \"\" + ((v >> 7) % 10);\n"
+    "\tswitch (v % 6) {\n"
+    "\t    case 0: num = A + B + C + D + D + D + D; break;\n"
+    "\t    case 1: num = A + B + C + C + B + A + D; break;\n"
+    "\t    case 2: num = A + B + C + A + B + C + D; break;\n"
+    "\t    case 3: num = A + A + B + B + C + C + D; break;\n"
+    "\t    case 4: num = \"2345\" + B + C + D; break;\n"
+    "\t    default: num = A + B + C + \"6789\";\n"
+    "\t}\n"
+    "    }\n"
+    "    return num;\n"
+    "}\n"
+    "\n"
+    "// Called number matching of routeToRegUser()\n"
+    "function bench_route(n)\n"
+    "{\n"
+    "    var called = \"0720\" + (100000 + (n * 13) % 200);\n"
+    "    var msisdn, loc;\n"
+    "    for (var imsi_key in registered_subscribers) {\n"
+    "\tmsisdn = registered_subscribers[imsi_key][\"msisdn\"];\n"
+    "\tloc = registered_subscribers[imsi_key][\"location\"];\n"
+    "\tif (msisdn.substr(0,1) == \"+\")\n"
+    "\t    msisdn = msisdn.substr(1);\n"
+    "\tif (called.substr(-msisdn.length) == msisdn || msisdn.substr(-called.length) == called) {\n"
+    "\t    if (loc != \"\")\n"
+    "\t\treturn loc;\n"
+    "\t    return \"offline\";\n"
+    "\t}\n"
+    "    }\n"
+    "    return \"outside\";\n"
+    "}\n"
+    "\n"
+    "// TMSI lookup of updateCaller()\n"
+    "function bench_caller(n)\n"
+    "{\n"
+    "    var tmsi = \"\" + (1000 + ((n * 7) % 200) * 7);\n"
+    "    for (var imsi_key in registered_subscribers) {\n"
+    "\tif (registered_subscribers[imsi_key].tmsi == tmsi)\n"
+    "\t    return registered_subscribers[imsi_key].msisdn;\n"
+    "    }\n"
+    "    return \"\";\n"
+    "}\n"
+    "\n"
+    "// Keyed subscriber lookup of getRegUserMsisdn(), some IMSIs are unknown\n"
+    "function bench_lookup(n)\n"
+    "{\n"
+    "    var found = 0;\n"
+    "    for (var i = 0; i < 200; i++) {\n"
+    "\tvar imsi = \"00101000000\" + (1000 + (n * 7 + i * 13) % 250);\n"
+    "\tif (registered_subscribers[imsi] != \"\") {\n"
+    "\t    if (registered_subscribers[imsi][\"location\"] != \"\")\n"
+    "\t\tfound++;\n"
+    "\t}\n"
+    "    }\n"
+    "    return found;\n"
+    "}\n"
+    "\n"
+    "// Subscriber replacement of registerSubscriber()\n"
+    "function bench_register(n)\n"
+    "{\n"
+    "    for (var i = 0; i < 50; i++) {\n"
+    "\tvar imsi = \"00101000000\" + (1000 + (n * 3 + i) % 200);\n"
+    "\tvar sub = registered_subscribers[imsi];\n"
+    "\tvar nsub = {};\n"
+    "\tnsub.msisdn = sub.msisdn;\n"
+    "\tnsub.tmsi = sub.tmsi;\n"
+    "\tnsub.location = \"ybts/TMSI\" + n;\n"
+    "\tregistered_subscribers[imsi] = nsub;\n"
+    "    }\n"
+    "    return registered_subscribers[\"00101000000\" + (1000 + n % 200)].location;\n"
+    "}\n";
+
+INIT_PLUGIN(JsBench);
+
+
+BenchScript::BenchScript(const String& text, bool compiled)
+    : m_runner(0)
+{
+    m_parser.compile(compiled);
+    if (!m_parser.parse(text))
+	return;
+    m_runner = m_parser.createRunner(0,"jsbench");
+    if (m_runner && (m_runner->run() != ScriptRun::Succeeded))
+	TelEngine::destruct(m_runner);
+}
+
+BenchScript::~BenchScript()
+{
+    TelEngine::destruct(m_runner);
+}
+
+// Call a function a number of times, keep the last returned value
+bool BenchScript::call(const String& func, int count, String& result, u_int64_t& usec)
+{
+    if (!m_runner)
+	return false;
+    u_int64_t t = Time::now();
+    for (int i = 0; i < count; i++) {
+	ObjList args;
+	args.append(new ExpOperation((int64_t)i));
+	if (m_runner->call(func,args) != ScriptRun::Succeeded)
+	    return false;
+	ExpOperation* op = ExpEvaluator::popOne(m_runner->stack());
+	if (i == count - 1) {
+	    if (op)
+		result = *op;
+	    else
+		result.clear();
+	}
+	TelEngine::destruct(op);
+    }
+    usec = Time::now() - t;
+    return true;
+}
+
+// List the global benchmark functions in the order they were defined
+void BenchScript::functions(ObjList& list, const String& only) const
+{
+    if (!(m_runner && m_runner->context()))
+	return;
+    const NamedList& params = m_runner->context()->params();
+    for (const ObjList* l = params.paramList()->skipNull(); l; l = l->skipNext()) {
+	const NamedString* ns = static_cast<const NamedString*>(l->get());
+	if (!ns->name().startsWith("bench_"))
+	    continue;
+	if (only && (ns->name() != only))
+	    continue;
+	if (YOBJECT(JsFunction,ns))
+	    list.append(new String(ns->name()));
+    }
+}
+
+
+JsBench::JsBench()
+    : Module("jsbench","misc")
+{
+    Output("Loaded module JsBench");
+}
+
+JsBench::~JsBench()
+{
+    Output("Unloading module JsBench");
+}
+
+void JsBench::initialize()
+{
+    Output("Initializing module JsBench");
+    if (!relayInstalled(Control)) {
+	setup();
+	installRelay(Control);
+    }
+}
+
+bool JsBench::received(Message& msg, int id)
+{
+    if (id == Control) {
+	if (msg[YSTRING("component")] == name())
+	    return onCmdControl(msg);
+	return false;
+    }
+    return Module::received(msg,id);
+}
+
+bool JsBench::commandComplete(Message& msg, const String& partLine,
+    const String& partWord)
+{
+    if (partLine == YSTRING("control")) {
+	itemComplete(msg.retValue(),name(),partWord);
+	return false;
+    }
+    String tmp = partLine;
+    if (tmp.startSkip("control") && tmp == name()) {
+	for (const char** c = s_cmds; *c; c++)
+	    itemComplete(msg.retValue(),*c,partWord);
+	return false;
+    }
+    return Module::commandComplete(msg,partLine,partWord);
+}
+
+bool JsBench::onCmdControl(Message& msg)
+{
+    static const char* s_help =
+	"\r\ncontrol jsbench run [count=300] [only=bench_name] [file=script.js]"
+	"\r\n  Call the bench_* functions of the built-in routing script or of a file"
+	"\r\n  on compiled and on interpreted only code, check they return the same";
+
+    const String& cmd = msg[YSTRING("operation")];
+    if (cmd == YSTRING("run"))
+	benchRun(msg);
+    else
+	msg.retValue() << s_help;
+    return true;
+}
+
+// Run each benchmark function on compiled and on interpreted only code
+void JsBench::benchRun(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),300,1,1000000);
+    const String& file = msg[YSTRING("file")];
+    String text;
+    if (file) {
+	File f;
+	int64_t len = 0;
+	if (f.openPath(file) && ((len = f.length()) > 0) && (len < 1000000)) {
+	    DataBlock buf(0,(unsigned int)len);
+	    if (f.readData(buf.data(),buf.length()) == (int)len)
+		text.assign((const char*)buf.data(),buf.length());
+	}
+	if (!text) {
+	    msg.retValue() << "jsbench: cannot read " << file << "\r\n";
+	    return;
+	}
+    }
+    else
+	text = s_script;
+    BenchScript comp(text,true);
+    BenchScript intr(text,false);
+    if (!(comp.valid() && intr.valid())) {
+	msg.retValue() << "jsbench: script failed to parse or run\r\n";
+	return;
+    }
+    ObjList funcs;
+    comp.functions(funcs,msg[YSTRING("only")]);
+    u_int64_t tComp = 0;
+    u_int64_t tIntr = 0;
+    for (ObjList* l = funcs.skipNull(); l; l = l->skipNext()) {
+	const String& func = *static_cast<const String*>(l->get());
+	String rComp;
+	String rIntr;
+	u_int64_t uComp = 0;
+	u_int64_t uIntr = 0;
+	msg.retValue() << func << ":";
+	if (!(comp.call(func,count,rComp,uComp) && intr.call(func,count,rIntr,uIntr))) {
+	    msg.retValue() << " failed\r\n";
+	    continue;
+	}
+	tComp += uComp;
+	tIntr += uIntr;
+	msg.retValue() << " compiled_usec/call=" << (unsigned int)(uComp / count) <<
+	    " interpreted_usec/call=" << (unsigned int)(uIntr / count);
+	if (uComp)
+	    msg.retValue() << " speedup%=" << (unsigned int)((uIntr * 100) / uComp);
+	if (rComp == rIntr)
+	    msg.retValue() << " result=" << rComp;
+	else
+	    msg.retValue() << " MISMATCH compiled=" << rComp << " interpreted=" << rIntr;
+	msg.retValue() << "\r\n";
+    }
+    msg.retValue() << "total: functions=" << funcs.count() << " count=" << count <<
+	" compiled_usec=" << tComp << " interpreted_usec=" << tIntr << "\r\n";
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
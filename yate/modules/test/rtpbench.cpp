@@ -0,0 +1,469 @@
+/**
+ * rtpbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Benchmarks for the RTP library transport and groups
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+#include <yatertp.h>
+
+#include <string.h>
+
+// Size of a G.711 packet carrying 20ms of audio
+#define G711_PACKET (12 + 160)
+// Latency histogram bucket size and count
+#define LAT_BUCKET 50
+#define LAT_BUCKETS 2000
+// Maximum datagrams per batch in the batch benchmark
+#define BATCH_MAX 64
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// State shared by the stream driver threads and the benchmark
+struct StreamStats
+{
+    Mutex mutex;
+    Socket sock;
+    unsigned int streams;
+    unsigned int interval;
+    unsigned int* ports;
+    unsigned int done;
+    volatile bool running;
+    volatile bool measure;
+    u_int64_t sent;
+    u_int64_t received;
+    u_int64_t latTotal;
+    u_int64_t latMax;
+    unsigned int latHist[LAT_BUCKETS + 1];
+    void reset();
+};
+
+// Thread sending one G.711 packet per interval to each stream
+class StreamSender : public Thread
+{
+public:
+    inline StreamSender(StreamStats& stats)
+	: Thread("BenchRtpSend",High), m_stats(stats)
+	{ }
+    virtual void run();
+private:
+    StreamStats& m_stats;
+};
+
+// Thread collecting the packets forwarded back by the streams
+class StreamReceiver : public Thread
+{
+public:
+    inline StreamReceiver(StreamStats& stats)
+	: Thread("BenchRtpRecv",High), m_stats(stats)
+	{ }
+    virtual void run();
+private:
+    StreamStats& m_stats;
+};
+
+// Transport that sends back what it receives, like one leg of a reflector
+class EchoTransport : public RTPTransport
+{
+public:
+    inline EchoTransport()
+	{ setProcessor(this); }
+    inline void joinGroup(RTPGroup* grp)
+	{ group(grp); }
+};
+
+class RtpBench : public Module
+{
+public:
+    RtpBench();
+    virtual ~RtpBench();
+    virtual void initialize();
+    virtual bool received(Message& msg, int id);
+    virtual bool commandComplete(Message& msg, const String& partLine,
+	const String& partWord);
+private:
+    bool onCmdControl(Message& msg);
+    void benchStreams(Message& msg);
+    void benchBatch(Message& msg);
+};
+
+static const char* s_cmds[] = {
+    "streams",
+    "batch",
+    "help",
+    0
+};
+
+INIT_PLUGIN(RtpBench);
+
+
+static inline u_int64_t cpuUsec()
+{
+    return SysUsage::usecRunTime(SysUsage::UserTime) +
+	SysUsage::usecRunTime(SysUsage::KernelTime);
+}
+
+
+void StreamStats::reset()
+{
+    Lock lck(mutex);
+    sent = 0;
+    received = 0;
+    latTotal = 0;
+    latMax = 0;
+    for (unsigned int i = 0; i <= LAT_BUCKETS; i++)
+	latHist[i] = 0;
+}
+
+
+void StreamSender::run()
+{
+    unsigned char buf[G711_PACKET];
+    ::memset(buf,0xff,sizeof(buf));
+    SocketAddr addr(AF_INET);
+    addr.host("127.0.0.1");
+    u_int16_t seq = 0;
+    u_int32_t ts = 0;
+    u_int64_t next = Time::now();
+    while (m_stats.running) {
+	buf[0] = 0x80;
+	buf[1] = 0;
+	buf[2] = seq >> 8;
+	buf[3] = seq & 0xff;
+	buf[4] = ts >> 24;
+	buf[5] = (ts >> 16) & 0xff;
+	buf[6] = (ts >> 8) & 0xff;
+	buf[7] = ts & 0xff;
+	unsigned int sent = 0;
+	for (unsigned int i = 0; i < m_stats.streams; i++) {
+	    // SSRC carries the stream index, payload starts with the send time
+	    buf[8] = i >> 24;
+	    buf[9] = (i >> 16) & 0xff;
+	    buf[10] = (i >> 8) & 0xff;
+	    buf[11] = i & 0xff;
+	    u_int64_t now = Time::now();
+	    ::memcpy(buf + 12,&now,sizeof(now));
+	    addr.port(m_stats.ports[i]);
+	    if (m_stats.sock.sendTo(buf,sizeof(buf),addr) == (int)sizeof(buf))
+		sent++;
+	}
+	if (m_stats.measure) {
+	    Lock lck(m_stats.mutex);
+	    m_stats.sent += sent;
+	}
+	seq++;
+	ts += 160;
+	next += 1000 * (u_int64_t)m_stats.interval;
+	u_int64_t now = Time::now();
+	if (next > now)
+	    Thread::usleep(next - now);
+	else
+	    next = now;
+    }
+    Lock lck(m_stats.mutex);
+    m_stats.done++;
+}
+
+void StreamReceiver::run()
+{
+    unsigned char buf[1500];
+    SocketAddr addr;
+    while (m_stats.running) {
+	bool readOk = false;
+	if (!m_stats.sock.select(&readOk,0,0,(int64_t)10000) || !readOk)
+	    continue;
+	u_int64_t received = 0;
+	u_int64_t total = 0;
+	u_int64_t worst = 0;
+	int len;
+	Lock lck(m_stats.mutex);
+	while ((len = m_stats.sock.recvFrom(buf,sizeof(buf),addr)) >= G711_PACKET) {
+	    if (!m_stats.measure)
+		continue;
+	    u_int64_t sent;
+	    ::memcpy(&sent,buf + 12,sizeof(sent));
+	    u_int64_t lat = Time::now() - sent;
+	    received++;
+	    total += lat;
+	    if (worst < lat)
+		worst = lat;
+	    unsigned int b = (unsigned int)(lat / LAT_BUCKET);
+	    m_stats.latHist[(b < LAT_BUCKETS) ? b : LAT_BUCKETS]++;
+	}
+	m_stats.received += received;
+	m_stats.latTotal += total;
+	if (m_stats.latMax < worst)
+	    m_stats.latMax = worst;
+    }
+    Lock lck(m_stats.mutex);
+    m_stats.done++;
+}
+
+
+RtpBench::RtpBench()
+    : Module("rtpbench","misc")
+{
+    Output("Loaded module RtpBench");
+}
+
+RtpBench::~RtpBench()
+{
+    Output("Unloading module RtpBench");
+}
+
+void RtpBench::initialize()
+{
+    Output("Initializing module RtpBench");
+    if (!relayInstalled(Control)) {
+	setup();
+	installRelay(Control);
+    }
+}
+
+bool RtpBench::received(Message& msg, int id)
+{
+    if (id == Control) {
+	if (msg[YSTRING("component")] == name())
+	    return onCmdControl(msg);
+	return false;
+    }
+    return Module::received(msg,id);
+}
+
+bool RtpBench::commandComplete(Message& msg, const String& partLine,
+    const String& partWord)
+{
+    if (partLine == YSTRING("control")) {
+	itemComplete(msg.retValue(),name(),partWord);
+	return false;
+    }
+    String tmp = partLine;
+    if (tmp.startSkip("control") && tmp == name()) {
+	for (const char** c = s_cmds; *c; c++)
+	    itemComplete(msg.retValue(),*c,partWord);
+	return false;
+    }
+    return Module::commandComplete(msg,partLine,partWord);
+}
+
+bool RtpBench::onCmdControl(Message& msg)
+{
+    static const char* s_help =
+	"\r\ncontrol rtpbench streams [count=2000] [groups=0] [event=yes] [duration=10] [sleep=5]"
+	"\r\n  Echo G.711 streams on loopback, report CPU use and receive to forward latency"
+	"\r\n  groups=0 runs one polling group per stream, else streams are spread on groups"
+	"\r\ncontrol rtpbench batch [count=200000] [batch=8] [size=172]"
+	"\r\n  Pass datagrams over loopback one by one and batched, report packets per CPU second";
+
+    const String& cmd = msg[YSTRING("operation")];
+    if (cmd == YSTRING("streams"))
+	benchStreams(msg);
+    else if (cmd == YSTRING("batch"))
+	benchBatch(msg);
+    else
+	msg.retValue() << s_help;
+    return true;
+}
+
+// Send 20ms G.711 packets to many transports that echo them back
+// The CPU time includes the packet generator and collector threads
+void RtpBench::benchStreams(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),2000,1,20000);
+    int groups = msg.getIntValue(YSTRING("groups"),0,0,64);
+    bool event = msg.getBoolValue(YSTRING("event"),true);
+    int duration = msg.getIntValue(YSTRING("duration"),10,1,600);
+    int msec = msg.getIntValue(YSTRING("sleep"),5,1,50);
+    if (groups > count)
+	groups = count;
+    StreamStats stats;
+    stats.streams = 0;
+    stats.interval = 20;
+    stats.done = 0;
+    stats.running = true;
+    stats.measure = false;
+    stats.reset();
+    SocketAddr local(AF_INET);
+    local.host("127.0.0.1");
+    if (!(stats.sock.create(AF_INET,SOCK_DGRAM) && stats.sock.bind(local) &&
+	stats.sock.getSockName(local))) {
+	msg.retValue() << "streams: cannot create the driver socket\r\n";
+	return;
+    }
+    stats.sock.setBlocking(false);
+    int bufSize = 8 * 1024 * 1024;
+    stats.sock.setOption(SOL_SOCKET,SO_RCVBUF,&bufSize,sizeof(bufSize));
+    stats.sock.setOption(SOL_SOCKET,SO_SNDBUF,&bufSize,sizeof(bufSize));
+
+    RTPGroup** grps = groups ? new RTPGroup*[groups] : 0;
+    for (int i = 0; i < groups; i++)
+	grps[i] = new RTPGroup(msec,Thread::Normal,event);
+    EchoTransport** trans = new EchoTransport*[count];
+    stats.ports = new unsigned int[count];
+    for (int i = 0; i < count; i++) {
+	trans[i] = new EchoTransport;
+	SocketAddr addr(AF_INET);
+	addr.host("127.0.0.1");
+	if (!trans[i]->localAddr(addr,false)) {
+	    TelEngine::destruct(trans[i]);
+	    break;
+	}
+	stats.ports[i] = addr.port();
+	trans[i]->remoteAddr(local);
+	trans[i]->joinGroup(groups ? grps[i % groups] : new RTPGroup(msec));
+	stats.streams++;
+    }
+    unsigned int threads = 0;
+    StreamReceiver* recv = new StreamReceiver(stats);
+    if (recv->startup())
+	threads++;
+    else
+	delete recv;
+    StreamSender* send = new StreamSender(stats);
+    if (send->startup())
+	threads++;
+    else
+	delete send;
+
+    // let the streams settle before measuring
+    Thread::msleep(1000);
+    stats.reset();
+    stats.measure = true;
+    u_int64_t cpu = cpuUsec();
+    u_int64_t t = Time::now();
+    Thread::msleep(1000 * duration);
+    stats.measure = false;
+    t = Time::now() - t;
+    cpu = cpuUsec() - cpu;
+    stats.running = false;
+    for (;;) {
+	Lock lock(stats.mutex);
+	if (stats.done >= threads)
+	    break;
+	lock.drop();
+	Thread::idle();
+    }
+
+    for (unsigned int i = 0; i < stats.streams; i++) {
+	trans[i]->joinGroup(0);
+	TelEngine::destruct(trans[i]);
+    }
+    delete[] trans;
+    delete[] stats.ports;
+    // groups terminate on their own when running out of processors
+    delete[] grps;
+
+    u_int64_t p99 = 0;
+    if (stats.received) {
+	u_int64_t n = 0;
+	for (unsigned int i = 0; i <= LAT_BUCKETS; i++) {
+	    n += stats.latHist[i];
+	    if (n * 100 >= stats.received * 99) {
+		p99 = (i + 1) * (u_int64_t)LAT_BUCKET;
+		break;
+	    }
+	}
+    }
+    msg.retValue() << "streams: count=" << stats.streams << " groups=" << groups <<
+	" event=" << String::boolText(event) << " sleep=" << msec <<
+	" usec=" << t << " sent=" << stats.sent << " received=" << stats.received;
+    if (t)
+	msg.retValue() << " cpu%=" << (unsigned int)((cpu * 100) / t);
+    if (stats.received)
+	msg.retValue() << " lat_avg_usec=" << (stats.latTotal / stats.received) <<
+	    " lat_p99_usec=" << p99 << " lat_max_usec=" << stats.latMax;
+    msg.retValue() << "\r\n";
+}
+
+// Send and receive datagrams over loopback in a single thread, first with one
+//  system call per datagram then with one per batch
+void RtpBench::benchBatch(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),200000,1);
+    int batch = msg.getIntValue(YSTRING("batch"),8,1,BATCH_MAX);
+    int size = msg.getIntValue(YSTRING("size"),G711_PACKET,12,1400);
+    Socket tx;
+    Socket rx;
+    SocketAddr addr(AF_INET);
+    addr.host("127.0.0.1");
+    if (!(tx.create(AF_INET,SOCK_DGRAM) && rx.create(AF_INET,SOCK_DGRAM) &&
+	rx.bind(addr) && rx.getSockName(addr))) {
+	msg.retValue() << "batch: cannot create the sockets\r\n";
+	return;
+    }
+    tx.setBlocking(false);
+    rx.setBlocking(false);
+    char buf[BATCH_MAX][1500];
+    SocketAddr from[BATCH_MAX];
+    SocketDatagram out[BATCH_MAX];
+    SocketDatagram in[BATCH_MAX];
+    for (int i = 0; i < batch; i++) {
+	::memset(buf[i],0x80,size);
+	out[i].buffer = buf[i];
+	out[i].size = size;
+	out[i].length = 0;
+	out[i].addr = &addr;
+	in[i].buffer = buf[i];
+	in[i].size = sizeof(buf[i]);
+	in[i].length = 0;
+	in[i].addr = &from[i];
+    }
+    msg.retValue() << "batch: count=" << count << " batch=" << batch << " size=" << size;
+    for (int mode = 0; mode < 2; mode++) {
+	u_int64_t received = 0;
+	u_int64_t cpu = cpuUsec();
+	u_int64_t t = Time::now();
+	for (int done = 0; done < count; done += batch) {
+	    int sent = 0;
+	    if (mode) {
+		int n = tx.sendBatch(out,batch);
+		if (n > 0)
+		    sent = n;
+		while (sent > 0) {
+		    n = rx.recvBatch(in,batch);
+		    if (n <= 0)
+			break;
+		    received += n;
+		    sent -= n;
+		}
+	    }
+	    else {
+		for (int i = 0; i < batch; i++)
+		    if (tx.sendTo(buf[i],size,addr) == size)
+			sent++;
+		for (; sent > 0; sent--) {
+		    if (rx.recvFrom(buf[0],sizeof(buf[0]),from[0]) <= 0)
+			break;
+		    received++;
+		}
+	    }
+	}
+	t = Time::now() - t;
+	cpu = cpuUsec() - cpu;
+	msg.retValue() << (mode ? " batched:" : " single:") << " received=" << received <<
+	    " usec=" << t << " cpu_usec=" << cpu;
+	if (cpu)
+	    msg.retValue() << " pps/core=" << (unsigned int)((received * 1000000) / cpu);
+    }
+    msg.retValue() << "\r\n";
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
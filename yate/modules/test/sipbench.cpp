@@ -0,0 +1,467 @@
+/**
+ * sipbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Load benchmarks for the SIP library engine, fed without sockets
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+#include <yatesip.h>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Party that accepts and drops everything the engine sends
+class BenchParty : public SIPParty
+{
+public:
+    inline BenchParty()
+	: SIPParty(false), m_sent(0)
+	{
+	    setAddr("10.0.0.1",5060,true);
+	    setAddr("10.0.0.2",5060,false);
+	}
+    virtual bool transmit(SIPEvent* event)
+	{ m_sent++; return true; }
+    virtual const char* getProtoName() const
+	{ return "UDP"; }
+    virtual bool setParty(const URI& uri)
+	{ return true; }
+    virtual void* getTransport()
+	{ return 0; }
+    unsigned int m_sent;
+};
+
+class BenchEngine : public SIPEngine
+{
+public:
+    inline BenchEngine()
+	: SIPEngine("YATE/SipBench"), m_party(new BenchParty), m_hold(false)
+	{ }
+    virtual ~BenchEngine()
+	{
+	    m_transList.clear();
+	    TelEngine::destruct(m_party);
+	}
+    virtual bool buildParty(SIPMessage* message)
+	{
+	    if (!message->getParty())
+		message->setParty(m_party);
+	    return true;
+	}
+    // leave new requests unanswered if holding
+    virtual void processEvent(SIPEvent* event)
+	{
+	    if (m_hold && event && event->isIncoming() && event->getMessage() &&
+		!event->getMessage()->isAnswer() && (event->getState() == SIPTransaction::Trying))
+		delete event;
+	    else
+		SIPEngine::processEvent(event);
+	}
+    // feed a received buffer the way a transport would
+    inline SIPTransaction* received(const char* buf, int len)
+	{
+	    m_party->ref();
+	    return addMessage(m_party,buf,len);
+	}
+    // answer all transactions that still wait for it
+    inline unsigned int answerAll(int code)
+	{
+	    unsigned int n = 0;
+	    Lock mylock(this);
+	    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext())
+		if (static_cast<SIPTransaction*>(l->get())->setResponse(code))
+		    n++;
+	    return n;
+	}
+    inline void setT1(u_int64_t usec)
+	{ m_t1 = usec; }
+    inline void hold(bool on)
+	{ m_hold = on; }
+    inline unsigned int sent() const
+	{ return m_party->m_sent; }
+private:
+    BenchParty* m_party;
+    bool m_hold;
+};
+
+class SipBench : public Module
+{
+public:
+    SipBench();
+    virtual ~SipBench();
+    virtual void initialize();
+    virtual bool received(Message& msg, int id);
+    virtual bool commandComplete(Message& msg, const String& partLine,
+	const String& partWord);
+private:
+    bool onCmdControl(Message& msg);
+    void benchTransactions(Message& msg);
+    void benchEvents(Message& msg);
+    void benchParse(Message& msg);
+};
+
+static const char* s_cmds[] = {
+    "transactions",
+    "events",
+    "parse",
+    "help",
+    0
+};
+
+// Requests captured on a registrar, %u is replaced by the user agent number
+// The last one comes from an old RFC 2543 user agent without magic cookie
+static const char* s_register =
+    "REGISTER sip:example.org SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK%u.%u;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "From: <sip:%u@example.org>;tag=%ub1c3\r\n"
+    "To: <sip:%u@example.org>\r\n"
+    "Call-ID: reg%u-7c1e@10.0.0.2\r\n"
+    "CSeq: %u REGISTER\r\n"
+    "Contact: <sip:%u@10.0.0.2:5060;transport=udp>;expires=600\r\n"
+    "User-Agent: Grandstream GXP2160 1.0.11.3\r\n"
+    "Allow: INVITE, ACK, OPTIONS, CANCEL, BYE, SUBSCRIBE, NOTIFY, INFO, REFER, UPDATE, MESSAGE\r\n"
+    "Supported: replaces, path, timer, eventlist\r\n"
+    "Expires: 600\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static const char* s_options =
+    "OPTIONS sip:example.org SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK%u.%u\r\n"
+    "Max-Forwards: 70\r\n"
+    "From: <sip:%u@example.org>;tag=%ua9f0\r\n"
+    "To: <sip:example.org>\r\n"
+    "Call-ID: opt%u-%u@10.0.0.2\r\n"
+    "CSeq: %u OPTIONS\r\n"
+    "User-Agent: Linphone/3.6.1 (eXosip2/4.1.0)\r\n"
+    "Accept: application/sdp\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static const char* s_register2543 =
+    "REGISTER sip:example.org SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.2:5060;branch=%u.%u\r\n"
+    "From: sip:%u@example.org;tag=%u\r\n"
+    "To: sip:%u@example.org\r\n"
+    "Call-ID: %u@10.0.0.2\r\n"
+    "CSeq: %u REGISTER\r\n"
+    "Contact: sip:%u@10.0.0.2:5060\r\n"
+    "Expires: 3600\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+// Messages seen on a proxy, parsed as they are
+static const char* s_parse[] = {
+    "INVITE sip:200@example.org SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK74bf9;rport\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.7:5060;branch=z9hG4bK0a1f7c;received=10.0.0.7\r\n"
+    "Max-Forwards: 69\r\n"
+    "Record-Route: <sip:10.0.0.2;lr>\r\n"
+    "f: \"Bob\" <sip:100@example.org>;tag=9fxced76sl\r\n"
+    "t: <sip:200@example.org>\r\n"
+    "i: 3848276298220188511@10.0.0.7\r\n"
+    "CSeq: 2 INVITE\r\n"
+    "Contact: <sip:100@10.0.0.7:5060;transport=udp>\r\n"
+    "Proxy-Authorization: Digest username=\"100\", realm=\"example.org\",\r\n"
+    "  nonce=\"3c2e1f8d0b1a\", uri=\"sip:200@example.org\",\r\n"
+    "  response=\"6629fae49393a05397450978507c4ef1\", algorithm=MD5\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+    "Supported: replaces, timer\r\n"
+    "User-Agent: Zoiper rv2.8.20\r\n"
+    "Session-Expires: 1800\r\n"
+    "c: application/sdp\r\n"
+    "l: 231\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=Z 0 0 IN IP4 10.0.0.7\r\n"
+    "s=Z\r\n"
+    "c=IN IP4 10.0.0.7\r\n"
+    "t=0 0\r\n"
+    "m=audio 8000 RTP/AVP 3 110 8 0 98 101\r\n"
+    "a=rtpmap:110 speex/8000\r\n"
+    "a=rtpmap:98 iLBC/8000\r\n"
+    "a=fmtp:98 mode=20\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-15\r\n"
+    "a=sendrecv\r\n",
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK1928374;received=10.0.0.1;rport=5060\r\n"
+    "From: <sip:100@example.org>;tag=1234\r\n"
+    "To: <sip:100@example.org>;tag=as1e4b\r\n"
+    "Call-ID: 55aa@10.0.0.1\r\n"
+    "CSeq: 102 REGISTER\r\n"
+    "Server: Asterisk PBX 11.7.0\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH\r\n"
+    "Supported: replaces, timer\r\n"
+    "Expires: 600\r\n"
+    "Contact: <sip:100@10.0.0.1:5060>;expires=600\r\n"
+    "Date: Tue, 14 Oct 2014 09:32:11 GMT\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+    0
+};
+
+INIT_PLUGIN(SipBench);
+
+
+// Build the text of a captured request for a user agent
+static int buildRequest(char* buf, int size, unsigned int ua, unsigned int seq, bool options)
+{
+    if (options)
+	return ::snprintf(buf,size,s_options,ua,seq,ua,ua,ua,seq,seq);
+    if ((ua % 10) == 9)
+	return ::snprintf(buf,size,s_register2543,ua,seq,ua,ua,ua,ua,seq,ua);
+    return ::snprintf(buf,size,s_register,ua,seq,ua,ua,ua,ua,seq,ua);
+}
+
+
+SipBench::SipBench()
+    : Module("sipbench","misc")
+{
+    Output("Loaded module SipBench");
+}
+
+SipBench::~SipBench()
+{
+    Output("Unloading module SipBench");
+}
+
+void SipBench::initialize()
+{
+    Output("Initializing module SipBench");
+    if (!relayInstalled(Control)) {
+	setup();
+	installRelay(Control);
+    }
+}
+
+bool SipBench::received(Message& msg, int id)
+{
+    if (id == Control) {
+	if (msg[YSTRING("component")] == name())
+	    return onCmdControl(msg);
+	return false;
+    }
+    return Module::received(msg,id);
+}
+
+bool SipBench::commandComplete(Message& msg, const String& partLine,
+    const String& partWord)
+{
+    if (partLine == YSTRING("control")) {
+	itemComplete(msg.retValue(),name(),partWord);
+	return false;
+    }
+    String tmp = partLine;
+    if (tmp.startSkip("control") && tmp == name()) {
+	for (const char** c = s_cmds; *c; c++)
+	    itemComplete(msg.retValue(),*c,partWord);
+	return false;
+    }
+    return Module::commandComplete(msg,partLine,partWord);
+}
+
+bool SipBench::onCmdControl(Message& msg)
+{
+    static const char* s_help =
+	"\r\ncontrol sipbench transactions [count=20000] [replay=100000] [options=20] [lazy=no]"
+	"\r\n  Load REGISTER transactions then replay retransmissions mixed with new OPTIONS"
+	"\r\n  (percent), report parse+match cost per message kind"
+	"\r\ncontrol sipbench events [count=20000] [calls=100000] [clients=1000] [t1=20]"
+	"\r\n  Measure event polling while requests wait for an answer, then answer them,"
+	"\r\n  send unanswered client requests and run until all timers expired"
+	"\r\ncontrol sipbench parse [count=100000]"
+	"\r\n  Parse captured messages eagerly, lazily and lazily with all headers"
+	"\r\n  built later, check the results are the same";
+
+    const String& cmd = msg[YSTRING("operation")];
+    if (cmd == YSTRING("transactions"))
+	benchTransactions(msg);
+    else if (cmd == YSTRING("events"))
+	benchEvents(msg);
+    else if (cmd == YSTRING("parse"))
+	benchParse(msg);
+    else
+	msg.retValue() << s_help;
+    return true;
+}
+
+// Fill the engine with in-flight server transactions then feed retransmissions
+//  that must match them, mixed with new requests that match nothing
+void SipBench::benchTransactions(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),20000,1,1000000);
+    int replay = msg.getIntValue(YSTRING("replay"),100000,1);
+    int options = msg.getIntValue(YSTRING("options"),20,0,100);
+    BenchEngine* engine = new BenchEngine;
+    engine->lazyParse(msg.getBoolValue(YSTRING("lazy")));
+    char buf[2048];
+    u_int64_t t = Time::now();
+    for (int i = 0; i < count; i++)
+	engine->received(buf,buildRequest(buf,sizeof(buf),i,1,false));
+    u_int64_t fill = Time::now() - t;
+    unsigned int trans = engine->transactionCount();
+    unsigned int matched = 0;
+    unsigned int created = 0;
+    unsigned int retrans = 0;
+    unsigned int seq = 1;
+    u_int64_t tMatch = 0;
+    u_int64_t tNew = 0;
+    for (int i = 0; i < replay; i++) {
+	unsigned int ua = Random::random() % count;
+	bool opt = (int)(Random::random() % 100) < options;
+	if (opt)
+	    seq++;
+	else
+	    retrans++;
+	int len = buildRequest(buf,sizeof(buf),ua,opt ? seq : 1,opt);
+	t = Time::now();
+	SIPTransaction* tr = engine->received(buf,len);
+	t = Time::now() - t;
+	if (opt)
+	    tNew += t;
+	else
+	    tMatch += t;
+	if (!tr)
+	    continue;
+	if (opt)
+	    created++;
+	else
+	    matched++;
+    }
+    msg.retValue() << "transactions: count=" << trans << " fill_usec=" << fill <<
+	" replay=" << replay << " matched=" << matched << "/" << retrans <<
+	" created=" << created << " final=" << engine->transactionCount();
+    msg.retValue() << " fill_nsec/msg=" << (unsigned int)((fill * 1000) / count);
+    if (retrans)
+	msg.retValue() << " match_nsec/msg=" << (unsigned int)((tMatch * 1000) / retrans);
+    if (replay > (int)retrans)
+	msg.retValue() << " new_nsec/msg=" << (unsigned int)((tNew * 1000) / (replay - retrans));
+    msg.retValue() << "\r\n";
+    delete engine;
+}
+
+// Keep many server transactions waiting for an answer and poll for events,
+//  then run them and a number of unanswered client transactions to the end
+void SipBench::benchEvents(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),20000,1,1000000);
+    int calls = msg.getIntValue(YSTRING("calls"),100000,1);
+    int clients = msg.getIntValue(YSTRING("clients"),1000,0,100000);
+    int t1 = msg.getIntValue(YSTRING("t1"),20,1,500);
+    BenchEngine* engine = new BenchEngine;
+    engine->addAllowed("REGISTER");
+    engine->setT1(t1 * 1000);
+    engine->hold(true);
+    char buf[2048];
+    for (int i = 0; i < count; i++)
+	engine->received(buf,buildRequest(buf,sizeof(buf),i,1,false));
+    unsigned int events = 0;
+    u_int64_t t = Time::now();
+    while (engine->process())
+	events++;
+    u_int64_t drain = Time::now() - t;
+    // nothing to report, waiting transactions must not slow down polling
+    t = Time::now();
+    for (int i = 0; i < calls; i++)
+	engine->process();
+    u_int64_t idle = Time::now() - t;
+    engine->hold(false);
+    unsigned int answered = engine->answerAll(200);
+    for (int i = 0; i < clients; i++) {
+	String uri;
+	uri << "sip:" << i << "@10.0.0.2";
+	SIPMessage* m = new SIPMessage("OPTIONS",uri);
+	engine->addMessage(m);
+	m->deref();
+    }
+    t = Time::now();
+    u_int64_t stop = t + 60000000;
+    while (engine->transactionCount() && (Time::now() < stop)) {
+	if (engine->process())
+	    events++;
+	else
+	    Thread::idle();
+    }
+    t = Time::now() - t;
+    msg.retValue() << "events: count=" << count << " events=" << events <<
+	" drain_usec=" << drain << " idle_nsec/call=" << (unsigned int)((idle * 1000) / calls) <<
+	" answered=" << answered << " clients=" << clients <<
+	" sent=" << engine->sent() << " expected=" << (2 * count + 5 * clients) <<
+	" left=" << engine->transactionCount() << " run_msec=" << (unsigned int)(t / 1000) <<
+	" timer_msec=" << (64 * t1) << "\r\n";
+    delete engine;
+}
+
+// Parse the captured messages and the generated ones, the way an engine
+//  matching transactions uses them
+void SipBench::benchParse(Message& msg)
+{
+    int count = msg.getIntValue(YSTRING("count"),100000,1);
+    char reg[2048];
+    char reg2543[2048];
+    const char* corpus[4] = { s_parse[0], s_parse[1], reg, reg2543 };
+    int lens[4] = { (int)::strlen(s_parse[0]), (int)::strlen(s_parse[1]),
+	buildRequest(reg,sizeof(reg),1,1,false), buildRequest(reg2543,sizeof(reg2543),9,1,false) };
+    static const char* s_modes[3] = { "eager", "lazy", "lazy_decode" };
+    u_int64_t times[3];
+    for (int m = 0; m < 3; m++) {
+	bool lazy = (m > 0);
+	u_int64_t t = Time::now();
+	for (int i = 0; i < count; i++) {
+	    int n = i % 4;
+	    SIPMessage* sip = SIPMessage::fromParsing(0,corpus[n],lens[n],0,lazy);
+	    if (!sip)
+		continue;
+	    sip->getHeader("Via");
+	    sip->getHeader("Call-ID");
+	    sip->getParam("From","tag");
+	    if (m > 1)
+		sip->decodeHeaders();
+	    sip->deref();
+	}
+	times[m] = Time::now() - t;
+    }
+    // a lazily parsed message must end up identical to an eager one
+    unsigned int equal = 0;
+    for (int n = 0; n < 4; n++) {
+	SIPMessage* eager = SIPMessage::fromParsing(0,corpus[n],lens[n]);
+	SIPMessage* lazy = SIPMessage::fromParsing(0,corpus[n],lens[n],0,true);
+	if (eager && lazy && (eager->getCSeq() == lazy->getCSeq()) &&
+	    (eager->method == lazy->method) && (eager->getHeaders() == lazy->getHeaders())) {
+	    const DataBlock& b1 = eager->getBuffer();
+	    const DataBlock& b2 = lazy->getBuffer();
+	    if ((b1.length() == b2.length()) && !::memcmp(b1.data(),b2.data(),b1.length()))
+		equal++;
+	}
+	TelEngine::destruct(eager);
+	TelEngine::destruct(lazy);
+    }
+    msg.retValue() << "parse: count=" << count << " equal=" << equal << "/4";
+    for (int m = 0; m < 3; m++)
+	msg.retValue() << " " << s_modes[m] << "_nsec/msg=" << (unsigned int)((times[m] * 1000) / count);
+    msg.retValue() << "\r\n";
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -318,6 +318,9 @@ public:
 	{ m_idA = id; }
     inline void setB(const String& id)
 	{ m_idB = id; }
+    // let an event driven group wait on the sockets once they are bound
+    inline void watch()
+	{ m_group->update(m_rtpA); m_group->update(m_rtpB); }
 private:
     RTPGroup* m_group;
     RTPTransport* m_rtpA;
@@ -1283,7 +1286,9 @@ YRTPReflector::YRTPReflector(const String& id, bool passiveA, bool passiveB)
     : m_idA(id)
 {
     DDebug(&splugin,DebugInfo,"YRTPReflector::YRTPReflector('%s') [%p]",id.c_str(),this);
-    m_group = new RTPGroup(s_sleep,s_priority);
+    m_group = RTPGroup::shared();
+    if (!m_group)
+	m_group = new RTPGroup(s_sleep,s_priority);
     m_rtpA = new RTPTransport;
     m_rtpB = new RTPTransport;
     m_rtpA->setProcessor(m_rtpB);
@@ -1709,6 +1714,7 @@ void YRTPPlugin::reflectExecute(Message& msg)
 	TelEngine::destruct(r);
 	return;
     }
+    r->watch();
     String templ;
     templ << "\\1" << r->rtpB().localAddr().host();
     templ << "\\3" << r->rtpB().localAddr().host();
@@ -1868,6 +1874,7 @@ void YRTPPlugin::initialize()
     s_sleep = cfg.getIntValue("general","defsleep",5);
     RTPGroup::setMinSleep(cfg.getIntValue("general","minsleep"));
     s_priority = Thread::priority(cfg.getValue("general","thread"));
+    RTPGroup::setShared(cfg.getIntValue("general","groups",0,0,64),s_sleep,s_priority);
     s_rtpWarnSeq = cfg.getBoolValue("general","rtp_warn_seq",true);
     s_timeout = cfg.getIntValue("timeouts","timeout",3000);
     s_udptlTimeout = cfg.getIntValue("timeouts","udptl_timeout",25000);
@@ -24,6 +24,14 @@
 #include <yatesdp.h>
 
 #include <string.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#define SIP_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 
 using namespace TelEngine;
@@ -35,6 +43,7 @@ class YateSIPTransport;                  // SIP transport: keeps a socket, read/
 class YateSIPUDPTransport;               // UDP transport
 class YateSIPTCPTransport;               // TCP/TLS transport
 class YateSIPTransportWorker;            // A transport worker
+class YateSIPReactor;                    // A thread shared by many transports
 class YateSIPTCPListener;                // A TCP listener
 class YateUDPParty;                      // A SIP UDP party
 class YateTCPParty;                      // A SIP TCP/TLS party
@@ -58,6 +67,15 @@ class SIPDriver;
 // 1 minute
 #define BIND_RETRY_MAX 60000
 
+// Maximum number of transport reactor threads
+#define REACTOR_MAX 64
+// Maximum interval a reactor waits for socket events of a transport (usec)
+#define REACTOR_WAIT 60000000
+// Interval idle UDP transports check their bind status when run by a reactor (usec)
+#define REACTOR_UDP_WAIT 1000000
+// Maximum number of socket events handled in one reactor loop
+#define REACTOR_EVENTS 256
+
 static const TokenDict dict_errors[] = {
     { "incomplete", 484 },
     { "noroute", 404 },
@@ -324,6 +342,7 @@ class YateSIPTransport : public Mutex, public RefObject, public ProtocolHolder
     friend class SIPDriver;
     friend class YateSIPEndPoint;
     friend class YateSIPTransportWorker;
+    friend class YateSIPReactor;
 public:
     enum Status {
 	Idle = 0,
@@ -391,8 +410,12 @@ protected:
     // Status changed notification for descendents
     virtual void statusChanged()
 	{}
-    // Start the worker thread
+    // Start the worker thread or attach to a reactor
     bool startWorker(Thread::Priority prio);
+    // Retrieve the current socket handle
+    SOCKET sockHandle();
+    // Interval to wait for socket events when run by a reactor
+    static int reactorWait(u_int64_t now, u_int64_t until);
     // Change transport status. Notify it
     void changeStatus(int stat);
     // Handle received messages, set party, add to engine
@@ -417,6 +440,8 @@ protected:
     String m_rtpLocalAddr;               // RTP local address
     String m_rtpNatAddr;                 // NAT IP to override RTP local address
     YateSIPTransportWorker* m_worker;    // Transport worker
+    YateSIPReactor* m_reactor;           // Reactor running the transport instead of a worker
+    unsigned int m_reactorSlot;          // Slot index in the reactor
     bool m_initialized;                  // Flag reset when initializing by the module and set in init()
     String m_protoAddr;                  // Proto + addr: used for debug (send/recv msg)
 private:
@@ -543,6 +568,75 @@ private:
     YateSIPTransport* m_transport;
 };
 
+// Thread waiting for socket events of many transports and running them
+// UDP listeners and incoming TCP/TLS transports can use a reactor instead
+//  of a worker thread each
+class YateSIPReactor : public Thread, public Mutex
+{
+public:
+    YateSIPReactor(unsigned int index, Thread::Priority prio);
+    ~YateSIPReactor();
+    virtual void run();
+    inline bool valid() const
+	{ return m_poll >= 0; }
+    inline unsigned int count() const
+	{ return m_count; }
+    // Attach a transport to the least loaded reactor
+    // Return false if reactors are disabled or not available
+    static bool attach(YateSIPTransport* trans, Thread::Priority prio);
+    // Detach a transport, wait for it to leave the processing
+    // Return true if the transport reference held for it must be released
+    bool detach(YateSIPTransport* trans);
+    // Request to run a transport as soon as possible
+    void wake(YateSIPTransport* trans);
+    // Build the status of all reactors
+    static void status(String& buf);
+private:
+    struct Slot {
+	YateSIPTransport* trans;         // Transport, 0 if slot is free
+	unsigned int gen;                // Generation, changed when slot is reused
+	unsigned int nextFree;           // Next free slot index
+	SOCKET fd;                       // Socket watched for events
+	u_int64_t when;                  // Time to run without socket events, 0 if none
+	u_int64_t queued;                // Time of the valid timer queue entry, 0 if none
+	bool watched;                    // The socket was added to the event poller
+	bool owned;                      // The transport reference is held for us
+	bool ready;                      // The slot is in the ready list
+    };
+    struct Timer {
+	u_int64_t when;
+	unsigned int slot;
+	unsigned int gen;
+    };
+    bool add(YateSIPTransport* trans);
+    void clear();
+    void watch(unsigned int idx, SOCKET fd);
+    void unwatch(unsigned int idx);
+    void setReady(unsigned int idx);
+    void schedule(unsigned int idx, u_int64_t when);
+    void runTimers(u_int64_t now);
+    int waitTimeout(u_int64_t now);
+    void runSlot(unsigned int idx);
+    bool removeSlot(unsigned int idx);
+    void pushTimer(u_int64_t when, unsigned int idx);
+    void popTimer();
+    unsigned int m_index;                // Index in reactors list
+    int m_poll;                          // Event poller
+    int m_wakeFd;                        // Event descriptor used to wake up the reactor
+    Slot* m_slots;                       // Transport slots
+    unsigned int m_slotsLen;             // Allocated slots
+    unsigned int m_freeSlot;             // First free slot
+    unsigned int m_count;                // Attached transports
+    unsigned int* m_ready;               // Slots to run as soon as possible
+    unsigned int m_readyCount;
+    unsigned int m_readyLen;
+    Timer* m_timers;                     // Timer queue (heap) of slots to run later
+    unsigned int m_timerCount;
+    unsigned int m_timerLen;
+    YateSIPTransport* m_current;         // Transport being run
+    bool m_signaled;                     // Wake up was already signaled
+};
+
 class YateSIPTCPListener : public Thread, public GenObject, public ProtocolHolder, public YateSIPListener
 {
     friend class SIPDriver;
@@ -1227,6 +1321,9 @@ static unsigned int s_tcpConnectRetry = 3; // Number of TCP connect attempts
 static u_int64_t s_tcpConnectInterval = 1000000; // The interval to attempt tcp connect
 static unsigned int s_tcpIdle = TCP_IDLE_DEF; // TCP transport idle interval
 static unsigned int s_tcpMaxpkt = 1500;  // Maximum packet to accept on TCP connections
+static unsigned int s_reactorThreads = 0; // Transport reactor threads, 0 to use a worker per transport
+static Mutex s_reactorMutex(false,"SIPReactors"); // Protect the reactors list
+static YateSIPReactor* s_reactors[REACTOR_MAX]; // Transport reactors
 static String s_tcpOutRtpip;             // RTP ip for outgoing tcp/tls transports (protected by plugin mutex)
 static bool s_lineKeepTcpOffline = true; // Lines: keep TCP transports when offline
 static String s_sslCertFile;             // File containing the SSL client certificate to present if requested by the server
@@ -1703,6 +1800,7 @@ static bool matchAny(const String& name, const char** strs)
 // Copy headers from SIP message to Yate message
 static void copySipHeaders(NamedList& msg, const SIPMessage& sip, bool filter = true, bool auth = false)
 {
+    sip.decodeHeaders();
     const ObjList* l = sip.header.skipNull();
     for (; l; l = l->skipNext()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -2760,7 +2858,7 @@ YateSIPTransport::YateSIPTransport(int proto, const String& id, Socket* sock, in
     ProtocolHolder(proto),
     m_id(id), m_status(stat), m_statusChgTime(Time::secNow()),
     m_sock(sock), m_maxpkt(1500),
-    m_worker(0), m_initialized(false)
+    m_worker(0), m_reactor(0), m_reactorSlot(0), m_initialized(false)
 {
 }
 
@@ -2852,6 +2950,8 @@ void YateSIPTransport::terminate(const char* reason)
 {
     XDebug(&plugin,DebugInfo,"YateSIPTransport::terminate(%s) [%p]",reason,this);
     changeStatus(Terminating);
+    YateSIPReactor* reactor = m_reactor;
+    bool owned = reactor && reactor->detach(this);
     if (m_worker) {
 	bool wait = false;
 	lock();
@@ -2878,6 +2978,9 @@ void YateSIPTransport::terminate(const char* reason)
 	    m_reason = reason;
     }
     changeStatus(Terminated);
+    // Release the reference kept for the reactor, as the worker does when exiting
+    if (owned)
+	deref();
 }
 
 const String& YateSIPTransport::toString() const
@@ -2903,11 +3006,15 @@ void YateSIPTransport::destroyed()
     RefObject::destroyed();
 }
 
-// Start the worker thread
+// Start the worker thread or attach to a reactor
 bool YateSIPTransport::startWorker(Thread::Priority prio)
 {
     Lock lck(this);
-    if (m_worker)
+    if (m_worker || m_reactor)
+	return true;
+    // Outgoing TCP/TLS keep their worker: they resolve and connect synchronously
+    YateSIPTCPTransport* tcp = tcpTransport();
+    if (!(tcp && tcp->outgoing()) && YateSIPReactor::attach(this,prio))
 	return true;
     m_worker = new YateSIPTransportWorker(this,prio);
     if (m_worker->startup())
@@ -2918,6 +3025,22 @@ bool YateSIPTransport::startWorker(Thread::Priority prio)
     return false;
 }
 
+// Retrieve the current socket handle
+SOCKET YateSIPTransport::sockHandle()
+{
+    Lock lck(this);
+    return m_sock ? m_sock->handle() : Socket::invalidHandle();
+}
+
+// Interval to wait for socket events when run by a reactor
+int YateSIPTransport::reactorWait(u_int64_t now, u_int64_t until)
+{
+    if (until <= now)
+	return Thread::idleUsec();
+    until -= now;
+    return (until < REACTOR_WAIT) ? (int)until : REACTOR_WAIT;
+}
+
 // Change transport status. Notify it
 void YateSIPTransport::changeStatus(int stat)
 {
@@ -3065,6 +3188,9 @@ bool YateSIPUDPTransport::init(const NamedList& params, const NamedList& defs, b
     }
     if (ok && first)
 	ok = startWorker(prio);
+    else if (ok && m_reactor)
+	// Let the reactor check the bind status now
+	m_reactor->wake(this);
     return ok;
 }
 
@@ -3150,9 +3276,12 @@ int YateSIPUDPTransport::process()
     if (!(YateSIPEndPoint::canRead() || ((evc & 3) == 0)))
 	return Thread::idleUsec();
     int retVal = 0;
+    // Run by a reactor: the socket is non blocking, read until it would block
+    if (m_reactor)
+	retVal = REACTOR_UDP_WAIT;
     // Check if we can read (select is available)
     // Wait up to the platform idle time if we had no events in last run
-    if (m_sock->canSelect()) {
+    else if (m_sock->canSelect()) {
 	bool ok = false;
 	if (m_sock->select(&ok,0,0,Thread::idleUsec())) {
 	    if (!ok)
@@ -3176,6 +3305,8 @@ int YateSIPUDPTransport::process()
     int res = m_sock->recvFrom((void*)m_buffer.data(),m_buffer.length() - 1,m_remote);
     if (res <= 0) {
 	printReadError();
+	if (m_reactor && !m_sock->canRetry())
+	    return Thread::idleUsec();
 	return retVal;
     }
     if (res < 72) {
@@ -3202,7 +3333,8 @@ int YateSIPUDPTransport::process()
 	Alarm(&plugin,"performance",DebugNote,"Flood drop cleared, resumed normal message processing");
     }
 
-    SIPMessage* msg = SIPMessage::fromParsing(0,b,res);
+    SIPMessage* msg = SIPMessage::fromParsing(0,b,res,0,
+	plugin.ep() && plugin.ep()->engine()->lazyParse());
     receiveMsg(msg);
     return 0;
 }
@@ -3284,6 +3416,10 @@ void YateSIPTCPTransport::setFlowTimer(bool on, unsigned int interval)
     Debug(&plugin,DebugInfo,"Transport(%s) flow timer is '%s' idle interval is %u seconds [%p]",
 	m_id.c_str(),String::boolText(m_flowTimer),m_idleInterval,this);
     setIdleTimeout();
+    YateSIPReactor* reactor = m_reactor;
+    lock.drop();
+    if (reactor)
+	reactor->wake(this);
 }
 
 // Send data
@@ -3308,6 +3444,10 @@ bool YateSIPTCPTransport::send(SIPEvent* event)
     Debug(&plugin,DebugAll,"Transport(%s) enqueued (%p,%s) [%p]",
 	m_id.c_str(),msg,tmp.c_str(),this);
 #endif
+    YateSIPReactor* reactor = m_reactor;
+    lock.drop();
+    if (reactor)
+	reactor->wake(this);
     return true;
 }
 
@@ -3399,7 +3539,16 @@ int YateSIPTCPTransport::process()
 	}
 	setIdleTimeout(time);
     }
-    return read ? 0 : Thread::idleUsec();
+    if (read)
+	return 0;
+    // Run by a reactor: wait for socket events until the idle timeout
+    //  unless there is data left to send
+    if (m_reactor) {
+	Lock lck(this);
+	if (!(m_queue.skipNull() || m_keepAlivePending))
+	    return reactorWait(time,m_idleTimeout);
+    }
+    return Thread::idleUsec();
 }
 
 void YateSIPTCPTransport::destroyed()
@@ -3722,7 +3871,8 @@ bool YateSIPTCPTransport::readData(const Time& time, bool& read)
 		break;
 	    }
 	    // Parse the message headers
-	    m_msg = SIPMessage::fromParsing(0,data,m_sipBufOffs,&m_contentLen);
+	    m_msg = SIPMessage::fromParsing(0,data,m_sipBufOffs,&m_contentLen,
+		plugin.ep() && plugin.ep()->engine()->lazyParse());
 	    if (!m_msg) {
 		m_reason = "Received invalid message";
 		String tmp(data,m_sipBufOffs);
@@ -3899,6 +4049,480 @@ void YateSIPTransportWorker::cleanupTransport(bool final, bool terminate)
 }
 
 
+YateSIPReactor::YateSIPReactor(unsigned int index, Thread::Priority prio)
+    : Thread("YSIP Reactor",prio), Mutex(false,"YSIPReactor"),
+    m_index(index), m_poll(-1), m_wakeFd(-1),
+    m_slots(0), m_slotsLen(0), m_freeSlot(0), m_count(0),
+    m_ready(0), m_readyCount(0), m_readyLen(0),
+    m_timers(0), m_timerCount(0), m_timerLen(0),
+    m_current(0), m_signaled(false)
+{
+#ifdef SIP_EPOLL
+    m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_poll >= 0)
+	m_wakeFd = ::eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd >= 0) {
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = (u_int64_t)-1;
+	if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,m_wakeFd,&ev)) {
+	    ::close(m_wakeFd);
+	    m_wakeFd = -1;
+	}
+    }
+    if (m_wakeFd < 0) {
+	Debug(&plugin,DebugWarn,"Reactor(%u) failed to create event poller: %d %s [%p]",
+	    index,errno,::strerror(errno),this);
+	if (m_poll >= 0)
+	    ::close(m_poll);
+	m_poll = -1;
+    }
+#endif
+    DDebug(&plugin,DebugAll,"Reactor(%u) created [%p]",index,this);
+}
+
+YateSIPReactor::~YateSIPReactor()
+{
+    s_reactorMutex.lock();
+    if (s_reactors[m_index] == this)
+	s_reactors[m_index] = 0;
+    s_reactorMutex.unlock();
+    clear();
+#ifdef SIP_EPOLL
+    if (m_wakeFd >= 0)
+	::close(m_wakeFd);
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
+    delete[] m_slots;
+    delete[] m_ready;
+    delete[] m_timers;
+    DDebug(&plugin,DebugAll,"Reactor(%u) destroyed [%p]",m_index,this);
+}
+
+void YateSIPReactor::run()
+{
+    DDebug(&plugin,DebugAll,"Reactor(%u) started [%p]",m_index,this);
+#ifdef SIP_EPOLL
+    struct epoll_event ev[REACTOR_EVENTS];
+    while (!Thread::check(false)) {
+	lock();
+	int tout = waitTimeout(Time::now());
+	unlock();
+	int n = ::epoll_wait(m_poll,ev,REACTOR_EVENTS,tout);
+	if (n < 0) {
+	    if (errno != EINTR) {
+		Debug(&plugin,DebugWarn,"Reactor(%u) event wait failed: %d %s [%p]",
+		    m_index,errno,::strerror(errno),this);
+		Thread::idle();
+	    }
+	    n = 0;
+	}
+	lock();
+	for (int i = 0; i < n; i++) {
+	    u_int64_t data = ev[i].data.u64;
+	    if (data == (u_int64_t)-1) {
+		u_int64_t val = 0;
+		if (::read(m_wakeFd,&val,sizeof(val)) < 0 && errno != EAGAIN)
+		    Debug(&plugin,DebugMild,"Reactor(%u) wake up read failed: %d %s [%p]",
+			m_index,errno,::strerror(errno),this);
+		m_signaled = false;
+		continue;
+	    }
+	    // transports may have left since the wait started, check the slot generation
+	    unsigned int idx = (unsigned int)(data & 0xffffffff);
+	    if (idx < m_slotsLen && m_slots[idx].trans && (m_slots[idx].gen == (unsigned int)(data >> 32)))
+		setReady(idx);
+	}
+	runTimers(Time::now());
+	// slots made ready while running these are left for the next loop
+	unsigned int count = m_readyCount;
+	for (unsigned int i = 0; i < count; i++)
+	    runSlot(m_ready[i]);
+	m_readyCount -= count;
+	for (unsigned int i = 0; i < m_readyCount; i++)
+	    m_ready[i] = m_ready[count + i];
+	unlock();
+    }
+#endif
+    DDebug(&plugin,DebugAll,"Reactor(%u) terminated [%p]",m_index,this);
+    clear();
+}
+
+// Attach a transport to the least loaded reactor
+bool YateSIPReactor::attach(YateSIPTransport* trans, Thread::Priority prio)
+{
+    if (!trans)
+	return false;
+    Lock lck(s_reactorMutex);
+    YateSIPReactor* best = 0;
+    for (unsigned int i = 0; i < s_reactorThreads; i++) {
+	YateSIPReactor* r = s_reactors[i];
+	if (!r) {
+	    r = new YateSIPReactor(i,prio);
+	    if (!(r->valid() && r->startup())) {
+		delete r;
+		break;
+	    }
+	    s_reactors[i] = r;
+	}
+	if (!best || (r->count() < best->count()))
+	    best = r;
+    }
+    return best && best->add(trans);
+}
+
+// Add a transport, run it as soon as possible
+bool YateSIPReactor::add(YateSIPTransport* trans)
+{
+    SOCKET fd = trans->sockHandle();
+    Lock lck(this);
+    if (m_freeSlot >= m_slotsLen) {
+	unsigned int len = m_slotsLen ? (2 * m_slotsLen) : 64;
+	Slot* slots = new Slot[len];
+	for (unsigned int i = 0; i < m_slotsLen; i++)
+	    slots[i] = m_slots[i];
+	for (unsigned int i = m_slotsLen; i < len; i++) {
+	    slots[i].trans = 0;
+	    slots[i].gen = 0;
+	    slots[i].nextFree = i + 1;
+	}
+	delete[] m_slots;
+	m_slots = slots;
+	m_freeSlot = m_slotsLen;
+	m_slotsLen = len;
+    }
+    unsigned int idx = m_freeSlot;
+    Slot& s = m_slots[idx];
+    m_freeSlot = s.nextFree;
+    YateSIPTCPTransport* tcp = trans->tcpTransport();
+    s.trans = trans;
+    s.fd = Socket::invalidHandle();
+    s.when = 0;
+    s.queued = 0;
+    s.watched = false;
+    s.owned = tcp && !tcp->outgoing();
+    s.ready = false;
+    trans->m_reactor = this;
+    trans->m_reactorSlot = idx;
+    m_count++;
+    watch(idx,fd);
+    setReady(idx);
+    if (!(m_signaled || Thread::current() == this)) {
+	m_signaled = true;
+#ifdef SIP_EPOLL
+	u_int64_t val = 1;
+	if (::write(m_wakeFd,&val,sizeof(val)) < 0)
+	    m_signaled = false;
+#endif
+    }
+    XDebug(&plugin,DebugAll,"Reactor(%u) attached transport (%p,%s) slot=%u count=%u [%p]",
+	m_index,trans,trans->toString().c_str(),idx,m_count,this);
+    return true;
+}
+
+// Release all transports
+void YateSIPReactor::clear()
+{
+    for (unsigned int i = 0; ; i++) {
+	lock();
+	if (i >= m_slotsLen) {
+	    unlock();
+	    break;
+	}
+	YateSIPTransport* trans = m_slots[i].trans;
+	bool owned = trans && removeSlot(i);
+	unlock();
+	if (owned)
+	    trans->deref();
+    }
+}
+
+// Detach a transport, wait for it to leave the processing
+bool YateSIPReactor::detach(YateSIPTransport* trans)
+{
+    if (!trans)
+	return false;
+    lock();
+    if (Thread::current() != this) {
+	unsigned int n = 500;
+	while (m_current == trans && n--) {
+	    unlock();
+	    Thread::idle();
+	    lock();
+	}
+	if (m_current == trans)
+	    Debug(&plugin,DebugFail,"Reactor(%u) detaching running transport (%p,%s) [%p]",
+		m_index,trans,trans->toString().c_str(),this);
+    }
+    unsigned int idx = trans->m_reactorSlot;
+    bool owned = false;
+    if (trans->m_reactor == this && idx < m_slotsLen && m_slots[idx].trans == trans)
+	owned = removeSlot(idx);
+    unlock();
+    return owned;
+}
+
+// Request to run a transport as soon as possible
+void YateSIPReactor::wake(YateSIPTransport* trans)
+{
+    if (!trans)
+	return;
+    Lock lck(this);
+    unsigned int idx = trans->m_reactorSlot;
+    if (!(trans->m_reactor == this && idx < m_slotsLen && m_slots[idx].trans == trans))
+	return;
+    setReady(idx);
+    if (m_signaled || Thread::current() == this)
+	return;
+    m_signaled = true;
+#ifdef SIP_EPOLL
+    u_int64_t val = 1;
+    if (::write(m_wakeFd,&val,sizeof(val)) < 0)
+	m_signaled = false;
+#endif
+}
+
+// Build the status of all reactors
+void YateSIPReactor::status(String& buf)
+{
+    Lock lck(s_reactorMutex);
+    unsigned int threads = 0;
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < REACTOR_MAX; i++) {
+	if (!s_reactors[i])
+	    continue;
+	threads++;
+	count += s_reactors[i]->count();
+    }
+    if (threads)
+	buf.append("reactors=",",") << threads << ",reactor_transports=" << count;
+}
+
+// Add the socket of a slot to the event poller
+// Socket events are edge triggered, transports read or write until they would block
+void YateSIPReactor::watch(unsigned int idx, SOCKET fd)
+{
+    Slot& s = m_slots[idx];
+    s.fd = fd;
+    s.watched = false;
+    if (fd == Socket::invalidHandle())
+	return;
+#ifdef SIP_EPOLL
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.u64 = ((u_int64_t)s.gen << 32) | idx;
+    if (!::epoll_ctl(m_poll,EPOLL_CTL_ADD,fd,&ev))
+	s.watched = true;
+    else
+	Debug(&plugin,DebugWarn,"Reactor(%u) failed to watch socket %d of (%p,%s): %d %s [%p]",
+	    m_index,fd,s.trans,s.trans->toString().c_str(),errno,::strerror(errno),this);
+#endif
+}
+
+// Remove the socket of a slot from the event poller
+// Closed sockets are removed by the system, call this only while the socket is open
+void YateSIPReactor::unwatch(unsigned int idx)
+{
+    Slot& s = m_slots[idx];
+#ifdef SIP_EPOLL
+    if (s.watched) {
+	struct epoll_event ev;
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,s.fd,&ev);
+    }
+#endif
+    s.watched = false;
+    s.fd = Socket::invalidHandle();
+}
+
+void YateSIPReactor::setReady(unsigned int idx)
+{
+    Slot& s = m_slots[idx];
+    if (s.ready)
+	return;
+    s.ready = true;
+    if (m_readyCount >= m_readyLen) {
+	unsigned int len = m_readyLen ? (2 * m_readyLen) : 64;
+	unsigned int* ready = new unsigned int[len];
+	for (unsigned int i = 0; i < m_readyCount; i++)
+	    ready[i] = m_ready[i];
+	delete[] m_ready;
+	m_ready = ready;
+	m_readyLen = len;
+    }
+    m_ready[m_readyCount++] = idx;
+}
+
+// Set the time to run a slot without socket events
+// The timer queue keeps only the earliest time, a later one is queued when it expires
+void YateSIPReactor::schedule(unsigned int idx, u_int64_t when)
+{
+    Slot& s = m_slots[idx];
+    s.when = when;
+    if (s.queued && (s.queued <= when))
+	return;
+    pushTimer(when,idx);
+    m_slots[idx].queued = when;
+}
+
+// Make ready the slots whose time expired
+void YateSIPReactor::runTimers(u_int64_t now)
+{
+    while (m_timerCount && (m_timers[0].when <= now)) {
+	Timer t = m_timers[0];
+	popTimer();
+	Slot& s = m_slots[t.slot];
+	// skip entries of freed slots or replaced by an earlier time
+	if (!(s.trans && (s.gen == t.gen) && (s.queued == t.when)))
+	    continue;
+	s.queued = 0;
+	if (!s.when)
+	    continue;
+	if (s.when > now) {
+	    u_int64_t when = s.when;
+	    pushTimer(when,t.slot);
+	    m_slots[t.slot].queued = when;
+	    continue;
+	}
+	s.when = 0;
+	setReady(t.slot);
+    }
+}
+
+// Interval to wait for socket events in milliseconds
+int YateSIPReactor::waitTimeout(u_int64_t now)
+{
+    if (m_readyCount)
+	return 0;
+    // wake up periodically to check if cancelled
+    int tout = 100;
+    if (m_timerCount) {
+	u_int64_t when = m_timers[0].when;
+	if (when <= now)
+	    return 0;
+	when = (when - now + 999) / 1000;
+	if (when < (u_int64_t)tout)
+	    tout = (int)when;
+    }
+    return tout;
+}
+
+// Run the transport of a ready slot
+// Must be called locked, the lock is released while the transport runs
+void YateSIPReactor::runSlot(unsigned int idx)
+{
+    if (!(m_slots[idx].trans && m_slots[idx].ready))
+	return;
+    m_slots[idx].ready = false;
+    YateSIPTransport* t = m_slots[idx].trans;
+    unsigned int gen = m_slots[idx].gen;
+    // Keep the transport alive while calling its method
+    RefPointer<YateSIPTransport> trans = t;
+    if (!trans)
+	return;
+    m_current = t;
+    unlock();
+    int n = trans->process();
+    SOCKET fd = trans->sockHandle();
+    lock();
+    m_current = 0;
+    bool owned = false;
+    bool stop = false;
+    // skip the transport if it was detached while running
+    if (m_slots[idx].trans == t && m_slots[idx].gen == gen) {
+	// the transport replaced its socket, the old one was closed
+	if (fd != m_slots[idx].fd)
+	    watch(idx,fd);
+	if (n < 0) {
+	    owned = removeSlot(idx);
+	    stop = true;
+	}
+	else if (!n) {
+	    m_slots[idx].when = 0;
+	    setReady(idx);
+	}
+	else
+	    schedule(idx,Time::now() + n);
+    }
+    unlock();
+    if (stop) {
+	trans->terminate();
+	if (owned)
+	    trans->deref();
+    }
+    trans = 0;
+    lock();
+}
+
+// Free a slot, return true if the transport reference is held for it
+bool YateSIPReactor::removeSlot(unsigned int idx)
+{
+    unwatch(idx);
+    Slot& s = m_slots[idx];
+    bool owned = s.owned;
+    XDebug(&plugin,DebugAll,"Reactor(%u) detached transport (%p,%s) slot=%u count=%u [%p]",
+	m_index,s.trans,s.trans->toString().c_str(),idx,m_count - 1,this);
+    s.trans->m_reactor = 0;
+    s.trans = 0;
+    s.gen++;
+    s.when = 0;
+    s.queued = 0;
+    s.owned = false;
+    s.ready = false;
+    s.nextFree = m_freeSlot;
+    m_freeSlot = idx;
+    m_count--;
+    return owned;
+}
+
+void YateSIPReactor::pushTimer(u_int64_t when, unsigned int idx)
+{
+    if (m_timerCount >= m_timerLen) {
+	unsigned int len = m_timerLen ? (2 * m_timerLen) : 64;
+	Timer* timers = new Timer[len];
+	for (unsigned int i = 0; i < m_timerCount; i++)
+	    timers[i] = m_timers[i];
+	delete[] m_timers;
+	m_timers = timers;
+	m_timerLen = len;
+    }
+    // sift up
+    unsigned int i = m_timerCount++;
+    while (i) {
+	unsigned int parent = (i - 1) / 2;
+	if (m_timers[parent].when <= when)
+	    break;
+	m_timers[i] = m_timers[parent];
+	i = parent;
+    }
+    m_timers[i].when = when;
+    m_timers[i].slot = idx;
+    m_timers[i].gen = m_slots[idx].gen;
+}
+
+void YateSIPReactor::popTimer()
+{
+    if (!m_timerCount)
+	return;
+    Timer last = m_timers[--m_timerCount];
+    // sift down
+    unsigned int i = 0;
+    while (true) {
+	unsigned int child = 2 * i + 1;
+	if (child >= m_timerCount)
+	    break;
+	if ((child + 1 < m_timerCount) && (m_timers[child + 1].when < m_timers[child].when))
+	    child++;
+	if (last.when <= m_timers[child].when)
+	    break;
+	m_timers[i] = m_timers[child];
+	i = child;
+    }
+    if (m_timerCount)
+	m_timers[i] = last;
+}
+
+
 YateSIPTCPListener::YateSIPTCPListener(int proto, const String& name, const NamedList& params)
     : Thread("YSIP Listener",Thread::priority(params.getValue("thread"))),
     ProtocolHolder(proto),
@@ -4403,6 +5027,7 @@ void YateSIPEngine::initialize(NamedList* params)
     if (!params)
 	params = &dummy;
     lazyTrying(params->getBoolValue("lazy100",false));
+    lazyParse(params->getBoolValue("lazyparse",false));
     m_fork = params->getBoolValue("fork",true);
     m_flags = params->getIntValue("flags",m_flags);
     m_foreignAuth = params->getBoolValue("auth_foreign",false);
@@ -4440,6 +5065,9 @@ void YateSIPEngine::transportChangedStatus(YateSIPTransport* trans, int stat, co
     Lock lock(this);
     for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
 	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	// finished transactions wait in list to be removed
+	if (t->getState() == SIPTransaction::Invalid)
+	    continue;
 	if (t->initialMessage() && t->initialMessage()->getParty() &&
 	    trans == t->initialMessage()->getParty()->getTransport()) {
 	    bool active = t->isActive();
@@ -4559,6 +5187,7 @@ bool YateSIPEngine::checkUser(String& username, const String& realm, const Strin
 	hl = message->getHeader("User-Agent");
 	if (hl)
 	    m.addParam("device",*hl);
+	message->decodeHeaders();
 	for (const ObjList* l = message->header.skipNull(); l; l = l->skipNext()) {
 	    hl = static_cast<const MimeHeaderLine*>(l->get());
 	    String name(hl->name());
@@ -8967,6 +9596,14 @@ void SIPDriver::initialize()
     maxChans(s_cfg.getIntValue("general","maxchans",maxChans()));
     // Adjust here the TCP idle interval: it uses the SIP engine
     s_tcpIdle = tcpIdleInterval(s_cfg.getIntValue("general","tcp_idle",TCP_IDLE_DEF));
+    // Set the reactors before setting up listeners
+    s_reactorMutex.lock();
+#ifdef SIP_EPOLL
+    s_reactorThreads = s_cfg.getIntValue("general","transport_threads",0,0,REACTOR_MAX);
+#else
+    s_reactorThreads = 0;
+#endif
+    s_reactorMutex.unlock();
     // Mark listeners
     m_endpoint->initializing(true);
     // Setup general listener
@@ -9100,6 +9737,7 @@ void SIPDriver::statusParams(String& str)
     Driver::statusParams(str);
     if (m_endpoint->engine())
 	str.append("transactions=",",") << m_endpoint->engine()->transactionCount();
+    YateSIPReactor::status(str);
 }
 
 // Build and dispatch a socket.ssl message
@@ -614,6 +614,28 @@ public:
      */
     static void setIntOut(void (*outFunc)(const char*,int) = 0);
 
+    /**
+     * Set up asynchronous output. Lines are queued and written, in a batch when
+     *  possible, by a separate thread. Output callbacks are called by that thread
+     * @param size Number of lines the queue can hold, zero for synchronous output
+     * @param block True to wait for room in a full queue, false to drop the line
+     *  from the log, the internal output and captured events still get it
+     * @return True if the output mode was changed, false if the writer thread failed
+     */
+    static bool setAsyncOutput(unsigned int size, bool block = false);
+
+    /**
+     * Retrieve the size of the asynchronous output queue
+     * @return Number of lines the queue can hold, zero if output is synchronous
+     */
+    static unsigned int asyncOutput();
+
+    /**
+     * Retrieve the number of lines dropped because the output queue was full
+     * @return Number of lines dropped since startup
+     */
+    static unsigned int asyncDropped();
+
     /**
      * Set the alarm hook callback
      * @param alarmFunc Pointer to the alarm callback function, NULL to disable
@@ -3290,11 +3312,13 @@ public:
     virtual void* getObject(const String& name) const;
 
     /**
-     * Get the number of hash entries
+     * Get the number of hash entries.
+     * While an automatic resize is in progress this includes the entries
+     *  of the old table that were not yet moved
      * @return Count of hash entries
      */
     inline unsigned int length() const
-	{ return m_size; }
+	{ return m_old ? (m_size + m_oldSize) : m_size; }
 
     /**
      * Get the number of non-null objects in the list
@@ -3309,10 +3333,17 @@ public:
      * @return Pointer to the list or NULL
      */
     inline ObjList* getList(unsigned int index) const
-	{ return (index < m_size) ? m_lists[index] : 0; }
+    {
+	if (index < m_size)
+	    return m_lists[index];
+	index -= m_size;
+	return (m_old && (index < m_oldSize)) ? m_old[index] : 0;
+    }
 
     /**
      * Retrieve one of the internal object lists knowing the hash value.
+     * While an automatic resize is in progress objects may still be found
+     *  in the old table so use find() to locate them instead
      * @param hash Hash of the internal list to retrieve
      * @return Pointer to the list or NULL if never filled
      */
@@ -3405,9 +3436,29 @@ public:
      */
     bool resync();
 
+    /**
+     * Enable or disable automatic growth of the number of hash entries.
+     * When the average number of objects per entry exceeds the load factor
+     *  a table with about twice the entries is allocated and objects are moved
+     *  to it a few entries at a time on each append() so that no single
+     *  operation pays for a full rehash
+     * @param maxLoad Average objects per entry that triggers growth, zero to disable
+     * @param maxSize Maximum number of hash entries the list can grow to
+     */
+    void autoResize(unsigned int maxLoad = 4, unsigned int maxSize = 65536);
+
 private:
+    void grow();
+    void moveEntry(unsigned int index);
+    void rehash(unsigned int entries);
     unsigned int m_size;
     ObjList** m_lists;
+    ObjList** m_old;
+    unsigned int m_oldSize;
+    unsigned int m_moved;
+    unsigned int m_maxLoad;
+    unsigned int m_maxSize;
+    unsigned int m_appends;
 };
 
 /**
@@ -4527,6 +4578,7 @@ public:
 };
 
 class NamedIterator;
+class NamedListIndex;
 
 /**
  * This class holds a named list of named strings
@@ -4556,6 +4608,11 @@ public:
      */
     NamedList(const char* name, const NamedList& original, const String& prefix);
 
+    /**
+     * Destructor, releases the parameters and the hash index
+     */
+    virtual ~NamedList();
+
     /**
      * Assignment operator
      * @param value New name and parameters to assign
@@ -4588,7 +4645,38 @@ public:
      * Clear all parameters
      */
     inline void clearParams()
-	{ m_params.clear(); }
+	{ dropIndex(); m_params.clear(); }
+
+    /**
+     * Enable or disable the hash index used to find parameters by name.
+     * The index is built on demand when a lookup walks past the threshold
+     *  and is kept in sync by the methods of this class.
+     * Insertion order and duplicate names are not affected, a lookup still
+     *  returns the first parameter with the given name.
+     * Parameters must not be renamed while the index is enabled unless
+     *  the list is accessed through the non const paramList() first
+     * @param threshold Number of parameters a lookup must walk before the
+     *  index is built, zero to disable the index
+     */
+    void hashParams(unsigned int threshold = 16);
+
+    /**
+     * Retrieve the hash index threshold
+     * @return Number of parameters a lookup must walk before the index is built,
+     *  zero if the index is disabled
+     */
+    inline unsigned int hashParams() const
+	{ return m_hashMin; }
+
+    /**
+     * Retrieve a counter of the changes made to the parameters list.
+     * Adding, removing or replacing a parameter through the methods of this
+     *  class changes it, assigning a new value to a parameter does not.
+     * Getting the non const paramList() also counts as a change
+     * @return Value that differs from one retrieved before any such change
+     */
+    inline unsigned int changes() const
+	{ return m_changes; }
 
     /**
      * Add a named string to the parameter list.
@@ -4608,15 +4696,12 @@ public:
 
     /**
      * Set a named string in the parameter list.
+     * The first parameter with the same name is replaced, if there is none
+     *  the new one is appended to the list
      * @param param Parameter to set or add
      * @return Reference to this NamedList
      */
-    inline NamedList& setParam(NamedString* param)
-    {
-	if (param)
-	    m_params.setUnique(param);
-	return *this;
-    }
+    NamedList& setParam(NamedString* param);
 
     /**
      * Set a named string in the parameter list.
@@ -4814,11 +4899,12 @@ public:
     static const NamedList& empty();
 
     /**
-     * Get the parameters list
+     * Get the parameters list.
+     * The hash index is dropped as the list may be modified by the caller
      * @return Pointer to the parameters list
      */
     inline ObjList* paramList()
-	{ return &m_params; }
+	{ dropIndex(); return &m_params; }
 
     /**
      * Get the parameters list
@@ -4829,7 +4915,17 @@ public:
 
 private:
     NamedList(); // no default constructor please
+    inline void dropIndex()
+	{ m_changes++; if (m_index) resetIndex(); }
+    void resetIndex();
+    void indexParam(NamedString* param, ObjList* node);
+    ObjList* appendParam(NamedString* param);
+    void removeNode(ObjList* node, bool delobj = true);
+    NamedListIndex* buildIndex() const;
     ObjList m_params;
+    unsigned int m_hashMin;
+    unsigned int m_changes;
+    NamedListIndex* volatile m_index;
 };
 
 /**
@@ -5104,6 +5200,35 @@ public:
      * @return Locking safety measures flag value
      */
     static bool safety();
+
+    /**
+     * Start or stop collecting contention statistics for mutexes and semaphores.
+     * Statistics are kept per lock name so give hot locks a distinctive name.
+     * The library must be built with lock statistics support for this to work
+     * @param enable True to start collecting statistics, false to stop
+     * @return True if lock statistics are supported
+     */
+    static bool enableStats(bool enable = true);
+
+    /**
+     * Check if lock contention statistics are currently collected
+     * @return True if statistics are being collected
+     */
+    static bool stats();
+
+    /**
+     * Clear all collected lock contention statistics
+     */
+    static void resetStats();
+
+    /**
+     * Append lock contention statistics to a string. Each lock name is
+     *  appended as name=acquired|contended|waitusec|maxwaitusec|holdusec|maxholdusec
+     *  with entries separated by commas
+     * @param dest String to append the statistics to
+     * @return Number of lock names appended
+     */
+    static unsigned int statistics(String& dest);
 };
 
 /**
@@ -6783,6 +6908,32 @@ protected:
     HANDLE m_handle;
 };
 
+/**
+ * A structure describing one datagram in batched socket operations
+ */
+struct SocketDatagram {
+    /**
+     * Buffer holding the datagram data
+     */
+    void* buffer;
+
+    /**
+     * Size of the buffer when receiving, length of the data when sending
+     */
+    int size;
+
+    /**
+     * Length of the data received, @ref Socket::socketError() if dropped by a filter
+     */
+    int length;
+
+    /**
+     * Address of the peer, filled on receive, destination when sending.
+     * May be NULL when receiving or sending on a connected socket
+     */
+    SocketAddr* addr;
+};
+
 /**
  * This class encapsulates a system dependent socket in a system independent abstraction
  * @short A generic socket class
@@ -7210,6 +7361,16 @@ public:
      */
     virtual int send(const void* buffer, int length, int flags = 0);
 
+    /**
+     * Send several datagrams over a connected or unconnected socket.
+     * Uses a single system call where supported, one @ref sendTo() per datagram otherwise
+     * @param msgs Array of datagrams to send, size of each holds the data length
+     * @param count Number of datagrams in the array
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams sent, @ref socketError() if an error occurred on the first one
+     */
+    virtual int sendBatch(const SocketDatagram* msgs, unsigned int count, int flags = 0);
+
     /**
      * Write data to a connected stream socket
      * @param buffer Buffer for data transfer
@@ -7239,6 +7400,17 @@ public:
      */
     int recvFrom(void* buffer, int length, SocketAddr& addr, int flags = 0);
 
+    /**
+     * Receive several datagrams from a connected or unconnected socket without waiting.
+     * Uses a single system call where supported, one @ref recvFrom() per datagram otherwise.
+     * Datagrams dropped by the socket filters are returned with a length of @ref socketError()
+     * @param msgs Array of datagram buffers, length and addr are filled on return
+     * @param count Number of datagram buffers in the array
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams returned, @ref socketError() if an error occurred on the first one
+     */
+    virtual int recvBatch(SocketDatagram* msgs, unsigned int count, int flags = 0);
+
     /**
      * Receive a message from a connected socket
      * @param buffer Buffer for data transfer
@@ -7698,6 +7870,13 @@ public:
     inline const String& nextName() const
 	{ return m_next; }
 
+    /**
+     * Copy a NaptrRecord list into another one
+     * @param dest Destination list
+     * @param src Source list
+     */
+    static void copy(ObjList& dest, const ObjList& src);
+
 protected:
     String m_flags;
     String m_service;
@@ -7709,6 +7888,8 @@ private:
     NaptrRecord() {}                     // No default contructor
 };
 
+class ResolverListener;
+
 /**
  * This class offers DNS query services
  * @short DNS services
@@ -7799,12 +7980,83 @@ public:
      */
     static int txtQuery(const char* dname, ObjList& result, String* error = 0);
 
+    /**
+     * Make a query using the shared cache. Answers are kept for the smallest
+     *  record TTL, failed and empty answers for the negative TTL.
+     * A thread asking for a query already in progress waits for its result
+     *  instead of sending another one
+     * @param type Query type as enumeration
+     * @param dname Domain to query
+     * @param result List of resulting record items
+     * @param error Optional string to be filled with error string
+     * @return 0 on success, error code otherwise (h_errno value on Linux)
+     */
+    static int cachedQuery(Type type, const char* dname, ObjList& result, String* error = 0);
+
+    /**
+     * Start an asynchronous query using the shared cache. The query is run by
+     *  one of the resolver threads, identical queries in progress are joined
+     * @param type Query type as enumeration
+     * @param dname Domain to query
+     * @param listener Listener to notify when the query completes, it is
+     *  referenced until then. It is notified before returning if the answer
+     *  was already in cache
+     * @return True if the query was started or answered from cache
+     */
+    static bool asyncQuery(Type type, const char* dname, ResolverListener* listener);
+
+    /**
+     * Set up the query cache
+     * @param maxTtl Maximum time in seconds to keep an answer, zero to disable caching
+     * @param negTtl Time in seconds to keep a failed or empty answer, zero to not keep them
+     * @param maxEntries Maximum number of cached answers
+     */
+    static void setupCache(unsigned int maxTtl, unsigned int negTtl, unsigned int maxEntries);
+
+    /**
+     * Set the maximum number of threads running asynchronous queries
+     * @param threads Maximum number of resolver threads, zero to stop all of
+     *  them and run new asynchronous queries in the calling thread
+     */
+    static void setupAsync(unsigned int threads);
+
+    /**
+     * Remove all answers from the query cache
+     */
+    static void clearCache();
+
+    /**
+     * Append the query cache statistics to a status string
+     * @param buf String to append to, parameters are comma separated
+     */
+    static void cacheStatus(String& buf);
+
     /**
      * Resolver type names
      */
     static const TokenDict s_types[];
 };
 
+/**
+ * Interface of objects that get notified when an asynchronous query completes
+ * @short Asynchronous DNS query listener
+ */
+class YATE_API ResolverListener : public RefObject
+{
+    YCLASS(ResolverListener,RefObject)
+public:
+    /**
+     * Called when an asynchronous query completes, usually from a resolver thread
+     * @param type Query type as enumeration
+     * @param dname Domain that was queried
+     * @param code 0 on success, error code otherwise (h_errno value on Linux)
+     * @param result List of resulting record items, the listener may take them
+     * @param error Error string, empty on success
+     */
+    virtual void resolved(Resolver::Type type, const String& dname, int code,
+	ObjList& result, const String& error) = 0;
+};
+
 /**
  * The Cipher class provides an abstraction for data encryption classes
  * @short An abstract cipher
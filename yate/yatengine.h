@@ -302,6 +302,7 @@ private:
 
 class MessageDispatcher;
 class MessageRelay;
+class MessageWorkQueue;
 class Engine;
 
 /**
@@ -474,6 +475,7 @@ private:
     RefObject* m_data;
     bool m_notify;
     bool m_broadcast;
+    volatile unsigned int m_queued;
     void commonEncode(String& str) const;
     int commonDecode(const char* str, int offs);
 };
@@ -733,6 +735,8 @@ public:
      * Synchronously dispatch a message to the installed handlers.
      * Handlers matching the message name and filter parameter are called in
      *  their installed order (based on priority) until one returns true.
+     * Only handlers installed for the message name and broadcast handlers
+     *  (installed with an empty name) are visited, other handlers cost nothing.
      * If the message has the broadcast flag set all matching handlers are
      *  called and the return value is true if any handler returned true.
      * Note that in some cases when a handler is removed from the list
@@ -743,23 +747,45 @@ public:
     bool dispatch(Message& msg);
 
     /**
-     * Put a message in the waiting queue for asynchronous dispatching
+     * Put a message in the waiting queue for asynchronous dispatching.
+     * If worker queues are active the message is pushed in one of them,
+     *  the shared queue is used only when they are full or not yet active
      * @param msg The message to enqueue, will be destroyed after dispatching
-     * @return True if successfully queued, false otherwise
+     * @return True if successfully queued, false if already queued
      */
     bool enqueue(Message* msg);
 
     /**
-     * Dispatch all messages from the waiting queue
+     * Dispatch all messages from the waiting queues
      */
     void dequeue();
 
     /**
-     * Dispatch one message from the waiting queue
-     * @return True if success, false if the queue is empty
+     * Dispatch one message from the waiting queues
+     * @return True if success, false if all queues are empty
      */
     bool dequeueOne();
 
+    /**
+     * Create the per worker message queues, can be called only once
+     * @param count Maximum number of workers that will serve the queues
+     * @param size Number of messages each worker queue can hold
+     * @return True if the queues were created
+     */
+    bool setupWorkers(unsigned int count, unsigned int size = 1024);
+
+    /**
+     * Dispatch one message from the queue of a worker, steal it from the
+     *  queues of other workers or the shared queue if the own queue is empty.
+     * If no message is available wait until one is enqueued or timeout expires
+     * @param index Index of the worker, must be lower than the count passed
+     *  to setupWorkers(), the worker queue is activated on first call
+     * @param maxwait Maximum time to wait for a message in microseconds
+     * @param idle Optional flag set to true if all queues were found empty
+     * @return True if a message was dispatched, false if timeout expired
+     */
+    bool dequeueWorker(unsigned int index, long maxwait, bool* idle = 0);
+
     /**
      * Set a limit to generate warning when a message took too long to dispatch
      * @param usec Warning time limit in microseconds, zero to disable
@@ -771,7 +797,7 @@ public:
      * Clear all the message handlers and post-dispatch hooks
      */
     inline void clear()
-	{ m_handlers.clear(); m_hookAppend = &m_hooks; m_hooks.clear(); }
+	{ m_named.clear(); m_broadcast.clear(); m_handlers.clear(); m_hookAppend = &m_hooks; m_hooks.clear(); }
 
     /**
      * Get the number of messages waiting in the queue
@@ -807,10 +833,21 @@ protected:
 	{ m_trackParam = paramName; }
 
 private:
+    Message* takeMessage(unsigned int index);
+    void wakeWorker();
     ObjList m_handlers;
+    HashList m_named;
+    ObjList m_broadcast;
     ObjList m_messages;
     ObjList m_hooks;
     Mutex m_hookMutex;
+    Semaphore m_wakeup;
+    MessageWorkQueue** m_workQueues;
+    unsigned int m_workCount;
+    volatile unsigned int m_workActive;
+    volatile unsigned int m_workNext;
+    volatile int m_workIdle;
+    volatile bool m_msgShared;
     ObjList* m_msgAppend;
     ObjList* m_hookAppend;
     String m_trackParam;
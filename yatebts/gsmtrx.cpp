@@ -126,8 +126,8 @@ private:
 
 INIT_PLUGIN(GsmTrxModule);
 static unsigned int s_engineStop = 0;
-static const String s_modCmds[] = {"help",""};
-static const String s_trxCmds[] = {"print-status",""};
+static const String s_modCmds[] = {"sigproc-kernels","sigproc-test","sigproc-bench","help",""};
+static const String s_trxCmds[] = {"print-status","qmf-stats",""};
 
 static const TokenDict s_stateName[] = {
     {"Idle",    GsmTrxModule::Idle},
@@ -430,6 +430,14 @@ bool GsmTrxModule::onCmdControl(Message& msg)
 	"\r\n  Set transceiver print status."
 	    "\r\n    count: negative to print until stopped, number of print operations otherwise."
 	    "\r\n    nobursts=yes inhibits bursts counters printing."
+	"\r\ncontrol gsmtrx qmf-stats [reset=no]"
+	"\r\n  Print transceiver QMF tree processing time statistics."
+	"\r\ncontrol gsmtrx sigproc-kernels [level=scalar|sse2|avx2|avx512]"
+	"\r\n  Show or change the signal processing vector kernels in use."
+	"\r\ncontrol gsmtrx sigproc-test [oversample=8]"
+	"\r\n  Check all supported vector kernels against the scalar ones."
+	"\r\ncontrol gsmtrx sigproc-bench [count=10000] [oversample=8] [arfcns=4]"
+	"\r\n  Measure the time spent by each supported vector kernel."
 	"\r\ncontrol gsmtrx help"
 	"\r\n  Display control commands help";
 
@@ -439,6 +447,30 @@ bool GsmTrxModule::onCmdControl(Message& msg)
 	msg.retValue() << s_help;
 	return true;
     }
+    if (oper == YSTRING("sigproc-kernels")) {
+	const String& lvl = msg[YSTRING("level")];
+	if (lvl) {
+	    int level = lvl.toInteger(SigProcKernels::s_levels,-1);
+	    if (!SigProcKernels::select(level)) {
+		msg.retValue() << "Unsupported kernels level '" << lvl << "'\r\n";
+		return true;
+	    }
+	}
+	msg.retValue() << "current=" << lookup(SigProcKernels::level(),SigProcKernels::s_levels);
+	msg.retValue() << " best=" << lookup(SigProcKernels::best(),SigProcKernels::s_levels);
+	msg.retValue() << "\r\n";
+	return true;
+    }
+    if (oper == YSTRING("sigproc-test")) {
+	SigProcKernels::test(msg.retValue(),msg.getIntValue(YSTRING("oversample"),8,1,8));
+	return true;
+    }
+    if (oper == YSTRING("sigproc-bench")) {
+	SigProcKernels::bench(msg.retValue(),msg.getIntValue(YSTRING("count"),10000,1),
+	    msg.getIntValue(YSTRING("oversample"),8,1,8),
+	    msg.getIntValue(YSTRING("arfcns"),4,1,4));
+	return true;
+    }
     // Transceiver commands
     RefPointer<GsmTrxQMF> trx;
     if (getTransceiver(trx))
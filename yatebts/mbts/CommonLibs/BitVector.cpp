@@ -30,6 +30,10 @@
 #include <iostream>
 #include <stdio.h>
 #include <sstream>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -51,6 +55,21 @@ unsigned applyPoly(uint64_t val, uint64_t poly, unsigned order)
 
 
 
+void Generator::computeTable()
+{
+	if (!byteShifts()) return;
+	// 8 shifts without input from each possible value of the 8 high bits.
+	// The low bits and the input byte contribute linearly without feedback.
+	for (unsigned i=0; i<256; i++) {
+		mState = (uint64_t)i << (mLen-8);
+		for (unsigned j=0; j<8; j++) syndromeShift(0);
+		mTable[i] = mState & mMask;
+	}
+	mState = 0;
+}
+
+
+
 
 
 
@@ -287,6 +306,301 @@ ostream& operator<<(ostream& os, const BitVector& hv)
 
 
 
+/** Spread the 32 bits of val to the odd bit positions of the result. */
+static inline uint64_t spread32(uint64_t val)
+{
+	val &= 0xffffffffULL;
+	val = (val | (val<<16)) & 0x0000ffff0000ffffULL;
+	val = (val | (val<<8)) & 0x00ff00ff00ff00ffULL;
+	val = (val | (val<<4)) & 0x0f0f0f0f0f0f0f0fULL;
+	val = (val | (val<<2)) & 0x3333333333333333ULL;
+	val = (val | (val<<1)) & 0x5555555555555555ULL;
+	return val;
+}
+
+
+/** Reverse the bit order within each byte of a word. */
+static inline uint64_t reverseBytes(uint64_t val)
+{
+	val = ((val>>1) & 0x5555555555555555ULL) | ((val & 0x5555555555555555ULL)<<1);
+	val = ((val>>2) & 0x3333333333333333ULL) | ((val & 0x3333333333333333ULL)<<2);
+	val = ((val>>4) & 0x0f0f0f0f0f0f0f0fULL) | ((val & 0x0f0f0f0f0f0f0f0fULL)<<4);
+	return val;
+}
+
+
+void PackedBitVector::resize(size_t len)
+{
+	if (len!=mSize || !mWords.size()) {
+		mSize = len;
+		mWords.resize((len+63)/64 ? (len+63)/64 : 1);
+	}
+	zero();
+}
+
+
+void PackedBitVector::pack(const BitVector& source)
+{
+	resize(source.size());
+	const char *sp = source.begin();
+	for (size_t w=0; w<mWords.size(); w++) {
+		const size_t n = (mSize-64*w < 64) ? (mSize-64*w) : 64;
+		uint64_t accum = 0;
+		for (size_t i=0; i<n; i++) accum = (accum<<1) | (*sp++ & 0x01);
+		mWords[w] = n ? (accum << (64-n)) : 0;
+	}
+}
+
+
+void PackedBitVector::copyToSegment(BitVector& other, size_t start) const
+{
+	assert(start+mSize<=other.size());
+	char *dp = other.begin() + start;
+	for (size_t w=0; w<mWords.size(); w++) {
+		const size_t n = (mSize-64*w < 64) ? (mSize-64*w) : 64;
+		const uint64_t val = mWords[w];
+		for (size_t i=0; i<n; i++) *dp++ = (val >> (63-i)) & 0x01;
+	}
+}
+
+
+void PackedBitVector::copyToSegment(PackedBitVector& other, size_t start) const
+{
+	assert(start+mSize<=other.size());
+	if (!(start & 63)) {
+		// Aligned, copy words and merge the last one.
+		const size_t base = start>>6;
+		const size_t whole = mSize>>6;
+		for (size_t w=0; w<whole; w++) other.mWords[base+w] = mWords[w];
+		if (mSize & 63) other.fillField(start+64*whole,mWords[whole]>>(64-(mSize&63)),mSize&63);
+		return;
+	}
+	for (size_t i=0; i<mSize; i+=64) {
+		const unsigned n = (mSize-i < 64) ? (mSize-i) : 64;
+		other.fillField(start+i,mWords[i>>6]>>(64-n),n);
+	}
+}
+
+
+PackedBitVector PackedBitVector::segment(size_t start, size_t span) const
+{
+	assert(start+span<=mSize);
+	PackedBitVector seg(span);
+	for (size_t i=0; i<span; i+=64) {
+		const unsigned n = (span-i < 64) ? (span-i) : 64;
+		seg.mWords[i>>6] = peekField(start+i,n) << (64-n);
+	}
+	return seg;
+}
+
+
+void PackedBitVector::invert()
+{
+	for (size_t w=0; w<mWords.size(); w++) mWords[w] = ~mWords[w];
+	trim();
+}
+
+
+void PackedBitVector::LSB8MSB()
+{
+	// Whole bytes are byte aligned in the words.
+	const size_t size8 = 8*(mSize/8);
+	const size_t whole = size8>>6;
+	for (size_t w=0; w<whole; w++) mWords[w] = reverseBytes(mWords[w]);
+	if (size8 & 63) {
+		const uint64_t m = ~0ULL << (64-(size8&63));
+		mWords[whole] = (reverseBytes(mWords[whole]) & m) | (mWords[whole] & ~m);
+	}
+}
+
+
+uint64_t PackedBitVector::syndrome(Generator& gen) const
+{
+	gen.clear();
+	size_t i = 0;
+	if (gen.byteShifts()) {
+		for (; i+8<=mSize; i+=8)
+			gen.syndromeShift8(mWords[i>>6] >> (56-(i&63)));
+	}
+	for (; i<mSize; i++) gen.syndromeShift(bit(i));
+	return gen.state();
+}
+
+
+uint64_t PackedBitVector::parity(Generator& gen) const
+{
+	gen.clear();
+	size_t i = 0;
+	if (gen.byteShifts()) {
+		for (; i+8<=mSize; i+=8)
+			gen.encoderShift8(mWords[i>>6] >> (56-(i&63)));
+	}
+	for (; i<mSize; i++) gen.encoderShift(bit(i));
+	return gen.state();
+}
+
+
+void PackedBitVector::encode(const ViterbiR2O4& coder, PackedBitVector& target) const
+{
+	assert(coder.iRate()==2);
+	assert(mSize*2 == target.size());
+	// Generator taps, bit k of a state table index is the input k bits ago.
+	uint32_t taps[2] = {0,0};
+	for (unsigned g=0; g<2; g++) {
+		for (unsigned k=0; k<5; k++) {
+			if (coder.stateTable(g,1<<k)) taps[g] |= 1<<k;
+		}
+	}
+	// Each output stream is a XOR of delayed copies of the input,
+	// computed for 64 bits at a time then interleaved into the target.
+	uint64_t prev = 0;
+	for (size_t w=0; w<mWords.size(); w++) {
+		const uint64_t cur = mWords[w];
+		uint64_t out[2] = {0,0};
+		for (unsigned k=0; k<5; k++) {
+			const uint64_t delayed = k ? ((cur>>k) | (prev<<(64-k))) : cur;
+			if (taps[0] & (1<<k)) out[0] ^= delayed;
+			if (taps[1] & (1<<k)) out[1] ^= delayed;
+		}
+		prev = cur;
+		target.mWords[2*w] = (spread32(out[0]>>32)<<1) | spread32(out[1]>>32);
+		if (2*w+1 < target.mWords.size())
+			target.mWords[2*w+1] = (spread32(out[0])<<1) | spread32(out[1]);
+	}
+	target.trim();
+}
+
+
+uint64_t PackedBitVector::peekField(size_t readIndex, unsigned length) const
+{
+	assert(length<=64);
+	assert(readIndex+length<=mSize);
+	if (!length) return 0;
+	const size_t w = readIndex>>6;
+	const unsigned off = readIndex & 63;
+	uint64_t val = mWords[w] << off;
+	if (off+length > 64) val |= mWords[w+1] >> (64-off);
+	return val >> (64-length);
+}
+
+
+uint64_t PackedBitVector::peekFieldReversed(size_t readIndex, unsigned length) const
+{
+	uint64_t val = peekField(readIndex,length);
+	uint64_t accum = 0;
+	for (unsigned i=0; i<length; i++) {
+		accum = (accum<<1) | (val & 0x01);
+		val >>= 1;
+	}
+	return accum;
+}
+
+
+uint64_t PackedBitVector::readField(size_t& readIndex, unsigned length) const
+{
+	const uint64_t retVal = peekField(readIndex,length);
+	readIndex += length;
+	return retVal;
+}
+
+
+uint64_t PackedBitVector::readFieldReversed(size_t& readIndex, unsigned length) const
+{
+	const uint64_t retVal = peekFieldReversed(readIndex,length);
+	readIndex += length;
+	return retVal;
+}
+
+
+void PackedBitVector::fillField(size_t writeIndex, uint64_t value, unsigned length)
+{
+	assert(length<=64);
+	assert(writeIndex+length<=mSize);
+	if (!length) return;
+	const size_t w = writeIndex>>6;
+	const unsigned off = writeIndex & 63;
+	if (length<64) value &= (1ULL<<length)-1;
+	if (off+length <= 64) {
+		const unsigned shift = 64-off-length;
+		const uint64_t m = ((length<64) ? ((1ULL<<length)-1) : ~0ULL) << shift;
+		mWords[w] = (mWords[w] & ~m) | (value << shift);
+		return;
+	}
+	// Split across two words: n1 low bits of word w, n2 high bits of word w+1.
+	const unsigned n1 = 64-off;
+	const unsigned n2 = length-n1;
+	mWords[w] = (mWords[w] & (~0ULL << n1)) | (value >> n2);
+	mWords[w+1] = (mWords[w+1] & (~0ULL >> n2)) | (value << (64-n2));
+}
+
+
+void PackedBitVector::fillFieldReversed(size_t writeIndex, uint64_t value, unsigned length)
+{
+	uint64_t accum = 0;
+	for (unsigned i=0; i<length; i++) {
+		accum = (accum<<1) | (value & 0x01);
+		value >>= 1;
+	}
+	fillField(writeIndex,accum,length);
+}
+
+
+void PackedBitVector::writeField(size_t& writeIndex, uint64_t value, unsigned length)
+{
+	fillField(writeIndex,value,length);
+	writeIndex += length;
+}
+
+
+void PackedBitVector::writeFieldReversed(size_t& writeIndex, uint64_t value, unsigned length)
+{
+	fillFieldReversed(writeIndex,value,length);
+	writeIndex += length;
+}
+
+
+unsigned PackedBitVector::sum() const
+{
+	unsigned sum = 0;
+	for (size_t w=0; w<mWords.size(); w++) sum += __builtin_popcountll(mWords[w]);
+	return sum;
+}
+
+
+void PackedBitVector::map(const unsigned *map, size_t mapSize, PackedBitVector& dest) const
+{
+	assert(mapSize<=dest.size());
+	for (size_t i=0; i<mapSize; i+=64) {
+		const unsigned n = (mapSize-i < 64) ? (mapSize-i) : 64;
+		uint64_t accum = 0;
+		for (unsigned j=0; j<n; j++) {
+			const unsigned k = map[i+j];
+			accum = (accum<<1) | ((mWords[k>>6] >> (63-(k&63))) & 0x01);
+		}
+		if (n==64) dest.mWords[i>>6] = accum;
+		else dest.fillField(i,accum,n);
+	}
+}
+
+
+void PackedBitVector::unmap(const unsigned *map, size_t mapSize, PackedBitVector& dest) const
+{
+	for (size_t i=0; i<mapSize; i++) dest.settfb(map[i],bit(i));
+}
+
+
+ostream& operator<<(ostream& os, const PackedBitVector& hv)
+{
+	for (size_t i=0; i<hv.size(); i++) {
+		if (hv.bit(i)) os << '1';
+		else os << '0';
+	}
+	return os;
+}
+
+
+
+
 ViterbiR2O4::ViterbiR2O4()
 {
 	assert(mDeferral < 32);
@@ -402,6 +716,167 @@ const ViterbiR2O4::vCand& ViterbiR2O4::step(uint32_t inSample, const float *prob
 }
 
 
+ViterbiR2O4Packed::ViterbiR2O4Packed()
+{
+	for (unsigned k=0; k<5; k++) {
+		// Survivor j has the input history of state (j & mask) in step k
+		const unsigned mask = (0x01<<k)-1;
+		for (unsigned j=0; j<16; j++) {
+			const unsigned b = j & 0x01;
+			const unsigned lo = (((j>>1) & mask)<<1) | b;
+			const unsigned hi = ((((j>>1) | 0x08) & mask)<<1) | b;
+			mOutMask[k][0][0][j] = -(int16_t)stateTable(0,lo);
+			mOutMask[k][0][1][j] = -(int16_t)stateTable(1,lo);
+			mOutMask[k][1][0][j] = -(int16_t)stateTable(0,hi);
+			mOutMask[k][1][1][j] = -(int16_t)stateTable(1,hi);
+		}
+	}
+}
+
+
+// Mismatch cost of a received soft bit, relative to the match cost
+static inline int16_t packedCost(float pVal)
+{
+	if (pVal>0.5F) pVal = 1.0F-pVal;
+	float ipVal = 1.0F-pVal;
+	if (pVal<0.01F) pVal = 0.01;
+	if (ipVal<0.01F) ipVal = 0.01;
+	return (int16_t)lrintf((0.25F/pVal - 0.25F/ipVal) * ViterbiR2O4Packed::mScale);
+}
+
+
+void ViterbiR2O4Packed::decode(const SoftVector& in, BitVector& target) const
+{
+	const size_t sz = in.size();
+	const unsigned defer = deferral();
+	const size_t steps = target.size() + defer;
+	assert(sz <= iRate()*target.size());
+
+	// Hard decisions and mismatch costs, padding has the same cost for both values
+	char hard[2*steps];
+	int16_t cost[2*steps];
+	for (size_t i=0; i<sz; i++) {
+		hard[i] = in[i]>0.5F;
+		cost[i] = packedCost(in[i]);
+	}
+	for (size_t i=sz; i<2*steps; i++) {
+		hard[i] = 0;
+		cost[i] = 0;
+	}
+
+	char *op = target.begin();
+#ifdef __SSE2__
+	// Metrics: states 0..7, 8..15
+	// Histories: states 0..3, 4..7, 8..11, 12..15
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i inBit = _mm_set_epi32(1,0,1,0);
+	__m128i m0 = zero, m1 = zero;
+	__m128i h0 = zero, h1 = zero, h2 = zero, h3 = zero;
+	for (size_t t=0; t<steps; t++) {
+		const int16_t (*mask)[2][16] = mOutMask[(t < 4) ? t : 4];
+		// Branch costs of transitions from low and high prefix survivors
+		const __m128i inv0 = _mm_set1_epi16(hard[2*t] ? -1 : 0);
+		const __m128i inv1 = _mm_set1_epi16(hard[2*t+1] ? -1 : 0);
+		const __m128i c0 = _mm_set1_epi16(cost[2*t]);
+		const __m128i c1 = _mm_set1_epi16(cost[2*t+1]);
+		__m128i bc[2][2];
+		for (unsigned p=0; p<2; p++) {
+			for (unsigned n=0; n<2; n++) {
+				const __m128i e0 = _mm_loadu_si128((const __m128i*)(mask[p][0] + 8*n));
+				const __m128i e1 = _mm_loadu_si128((const __m128i*)(mask[p][1] + 8*n));
+				bc[p][n] = _mm_add_epi16(_mm_and_si128(_mm_xor_si128(e0,inv0),c0),
+					_mm_and_si128(_mm_xor_si128(e1,inv1),c1));
+			}
+		}
+		// Add-compare-select: new state j comes from j>>1 (low) or (j>>1)|8 (high)
+		const __m128i lo0 = _mm_adds_epi16(_mm_unpacklo_epi16(m0,m0),bc[0][0]);
+		const __m128i lo1 = _mm_adds_epi16(_mm_unpackhi_epi16(m0,m0),bc[0][1]);
+		const __m128i hi0 = _mm_adds_epi16(_mm_unpacklo_epi16(m1,m1),bc[1][0]);
+		const __m128i hi1 = _mm_adds_epi16(_mm_unpackhi_epi16(m1,m1),bc[1][1]);
+		const __m128i d0 = _mm_cmplt_epi16(lo0,hi0);
+		const __m128i d1 = _mm_cmplt_epi16(lo1,hi1);
+		m0 = _mm_min_epi16(lo0,hi0);
+		m1 = _mm_min_epi16(lo1,hi1);
+		// Move the input histories along with the decisions
+		__m128i d = _mm_unpacklo_epi16(d0,d0);
+		const __m128i n0 = _mm_or_si128(_mm_slli_epi32(_mm_or_si128(
+			_mm_and_si128(d,_mm_unpacklo_epi32(h0,h0)),
+			_mm_andnot_si128(d,_mm_unpacklo_epi32(h2,h2))),1),inBit);
+		d = _mm_unpackhi_epi16(d0,d0);
+		const __m128i n1 = _mm_or_si128(_mm_slli_epi32(_mm_or_si128(
+			_mm_and_si128(d,_mm_unpackhi_epi32(h0,h0)),
+			_mm_andnot_si128(d,_mm_unpackhi_epi32(h2,h2))),1),inBit);
+		d = _mm_unpacklo_epi16(d1,d1);
+		const __m128i n2 = _mm_or_si128(_mm_slli_epi32(_mm_or_si128(
+			_mm_and_si128(d,_mm_unpacklo_epi32(h1,h1)),
+			_mm_andnot_si128(d,_mm_unpacklo_epi32(h3,h3))),1),inBit);
+		d = _mm_unpackhi_epi16(d1,d1);
+		h3 = _mm_or_si128(_mm_slli_epi32(_mm_or_si128(
+			_mm_and_si128(d,_mm_unpackhi_epi32(h1,h1)),
+			_mm_andnot_si128(d,_mm_unpackhi_epi32(h3,h3))),1),inBit);
+		h0 = n0;
+		h1 = n1;
+		h2 = n2;
+		// Normalize metrics to the minimum one
+		__m128i mn = _mm_min_epi16(m0,m1);
+		mn = _mm_min_epi16(mn,_mm_shuffle_epi32(mn,_MM_SHUFFLE(1,0,3,2)));
+		mn = _mm_min_epi16(mn,_mm_shuffle_epi32(mn,_MM_SHUFFLE(2,3,0,1)));
+		mn = _mm_min_epi16(mn,_mm_shufflelo_epi16(mn,_MM_SHUFFLE(2,3,0,1)));
+		mn = _mm_shuffle_epi32(_mm_shufflelo_epi16(mn,_MM_SHUFFLE(0,0,0,0)),_MM_SHUFFLE(0,0,0,0));
+		m0 = _mm_sub_epi16(m0,mn);
+		m1 = _mm_sub_epi16(m1,mn);
+		if (t < defer) continue;
+		// Output the deferred bit of the first minimum cost state
+		unsigned best;
+		const int z0 = _mm_movemask_epi8(_mm_cmpeq_epi16(m0,zero));
+		if (z0) best = __builtin_ctz(z0)>>1;
+		else best = 8 + (__builtin_ctz(_mm_movemask_epi8(_mm_cmpeq_epi16(m1,zero)))>>1);
+		uint32_t hist[16] __attribute__((aligned(16)));
+		_mm_store_si128((__m128i*)hist,h0);
+		_mm_store_si128((__m128i*)(hist+4),h1);
+		_mm_store_si128((__m128i*)(hist+8),h2);
+		_mm_store_si128((__m128i*)(hist+12),h3);
+		*op++ = (hist[best] >> defer) & 0x01;
+	}
+#else
+	int16_t metric[16] = {0};
+	uint32_t hist[16] = {0};
+	for (size_t t=0; t<steps; t++) {
+		const int16_t (*mask)[2][16] = mOutMask[(t < 4) ? t : 4];
+		const int16_t inv0 = hard[2*t] ? -1 : 0;
+		const int16_t inv1 = hard[2*t+1] ? -1 : 0;
+		int16_t newMetric[16];
+		uint32_t newHist[16];
+		int16_t mn = 0x7fff;
+		for (unsigned j=0; j<16; j++) {
+			int lo = metric[j>>1] + ((mask[0][0][j] ^ inv0) & cost[2*t]) +
+				((mask[0][1][j] ^ inv1) & cost[2*t+1]);
+			int hi = metric[(j>>1) | 8] + ((mask[1][0][j] ^ inv0) & cost[2*t]) +
+				((mask[1][1][j] ^ inv1) & cost[2*t+1]);
+			if (lo > 0x7fff) lo = 0x7fff;
+			if (hi > 0x7fff) hi = 0x7fff;
+			if (lo < hi) {
+				newMetric[j] = lo;
+				newHist[j] = (hist[j>>1]<<1) | (j & 0x01);
+			}
+			else {
+				newMetric[j] = hi;
+				newHist[j] = (hist[(j>>1) | 8]<<1) | (j & 0x01);
+			}
+			if (newMetric[j] < mn) mn = newMetric[j];
+		}
+		unsigned best = 16;
+		for (unsigned j=0; j<16; j++) {
+			metric[j] = newMetric[j] - mn;
+			hist[j] = newHist[j];
+			if (best == 16 && !metric[j]) best = j;
+		}
+		if (t >= defer) *op++ = (hist[best] >> defer) & 0x01;
+	}
+#endif
+}
+
+
 uint64_t Parity::syndrome(const BitVector& receivedCodeword)
 {
 	return receivedCodeword.syndrome(*this);
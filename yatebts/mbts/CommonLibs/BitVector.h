@@ -45,6 +45,7 @@ class Generator {
 	uint64_t mMask;		///< mask for reading state
 	unsigned mLen;		///< number of bits used in shift register
 	unsigned mLen_1;	///< mLen - 1
+	uint64_t mTable[256];	///< state change for 8 shifts, indexed by the 8 high state bits
 
 	public:
 
@@ -52,7 +53,7 @@ class Generator {
 		:mCoeff(wCoeff),mState(0),
 		mMask((1ULL<<wLen)-1),
 		mLen(wLen),mLen_1(wLen-1)
-	{ assert(wLen<64); }
+	{ assert(wLen<64); computeTable(); }
 
 	void clear() { mState=0; }
 
@@ -84,6 +85,34 @@ class Generator {
 		if (fb) mState ^= mCoeff;
 	}
 
+	/** True if the 8-bit shift methods below can be used. */
+	bool byteShifts() const { return mLen>8; }
+
+	/**
+		Same as 8 syndromeShift() calls, MSB of inByte first.
+		Only valid if byteShifts() is true.
+	*/
+	void syndromeShift8(unsigned inByte)
+	{
+		mState = ((mState<<8) & mMask) ^ (inByte & 0xff) ^
+			mTable[(mState>>(mLen-8)) & 0xff];
+	}
+
+	/**
+		Same as 8 encoderShift() calls, MSB of inByte first.
+		Only valid if byteShifts() is true.
+	*/
+	void encoderShift8(unsigned inByte)
+	{
+		mState = ((mState<<8) & mMask) ^
+			mTable[((mState>>(mLen-8)) ^ inByte) & 0xff];
+	}
+
+	private:
+
+	/** Precompute mTable. */
+	void computeTable();
+
 
 };
 
@@ -224,6 +253,45 @@ class ViterbiR2O4 {
 
 
 
+/**
+	Alternative decoder for the ViterbiR2O4 code.
+	All 16 states are processed at once (add-compare-select butterflies in SIMD
+	registers when available) using saturated 16-bit integer path metrics.
+	Each state carries its packed 32-bit input history along with its metric,
+	so the deferred output bit is taken from the best state without a traceback.
+	Decisions match ViterbiR2O4 except for metric rounding.
+*/
+class ViterbiR2O4Packed : public ViterbiR2O4 {
+
+	public:
+
+		/** Fixed point scale of the cost metrics. */
+		static const int mScale = 256;
+
+		ViterbiR2O4Packed();
+
+		/**
+			Decode soft symbols.
+			@param in Soft symbols, 2 for each output bit.
+			@param target Decoded bits.
+		*/
+		void decode(const SoftVector& in, BitVector& target) const;
+
+	private:
+
+		/**
+			Expected coder outputs, for each new state, of the transitions from the
+			low (0-prefix) and high (1-prefix) survivor, as 0/-1 masks of the first
+			and second output bit: mOutMask[step][low/high][bit][state].
+			Survivors are duplicated in the first 4 steps: the table is indexed
+			by the number of steps already done, all steps after the 4th use the last one.
+		*/
+		int16_t mOutMask[5][2][2][16];
+
+};
+
+
+
 
 class BitVector : public Vector<char> {
 
@@ -368,6 +436,131 @@ std::ostream& operator<<(std::ostream&, const BitVector&);
 
 
 
+/**
+	Bit vector packed 64 bits per word, MSB first: bit i is bit 63-(i%64) of word i/64.
+	Same field, segment and copy operations as BitVector, but they work on whole
+	words instead of one byte per bit.
+	Bits past size() in the last word are always kept zero.
+	Unlike BitVector there are no aliases: segment() returns a copy.
+*/
+class PackedBitVector {
+
+	private:
+
+	Vector<uint64_t> mWords;	///< bit storage
+	size_t mSize;				///< number of bits
+
+	public:
+
+	/**@name Constructors. */
+	//@{
+	PackedBitVector(size_t len=0):mSize(0) { resize(len); }
+	PackedBitVector(const BitVector& source):mSize(0) { pack(source); }
+	//@}
+
+	/** Change the size of the vector, clearing all bits. */
+	void resize(size_t len);
+
+	size_t size() const { return mSize; }
+
+	/** Number of storage words. */
+	size_t words() const { return mWords.size(); }
+
+	/** Read a storage word. */
+	uint64_t word(size_t index) const { return mWords[index]; }
+
+	/** Set all bits to zero. */
+	void zero() { mWords.fill(0); }
+
+	/** Get a bit. */
+	bool bit(size_t index) const
+	{
+		assert(index<mSize);
+		return (mWords[index>>6] >> (63-(index&63))) & 0x01;
+	}
+
+	/** Set a bit */
+	void settfb(size_t index, int value)
+	{
+		assert(index<mSize);
+		const uint64_t m = 1ULL << (63-(index&63));
+		if (value & 0x01) mWords[index>>6] |= m;
+		else mWords[index>>6] &= ~m;
+	}
+
+	/**@name Conversion from/to byte per bit storage. */
+	//@{
+	/** Resize to match source and pack all its bits. */
+	void pack(const BitVector& source);
+	/** Unpack all bits into the start of target. */
+	void unpack(BitVector& target) const { copyToSegment(target,0); }
+	//@}
+
+	/**@name Copies. */
+	//@{
+	/** Return a copy of a subvector. */
+	PackedBitVector segment(size_t start, size_t span) const;
+	PackedBitVector head(size_t span) const { return segment(0,span); }
+	PackedBitVector tail(size_t start) const { return segment(start,size()-start); }
+	/** Copy all bits into other, starting at bit start. */
+	void copyToSegment(PackedBitVector& other, size_t start=0) const;
+	void copyToSegment(BitVector& other, size_t start=0) const;
+	//@}
+
+	/** Invert all bits. */
+	void invert();
+
+	/** Reverse bit order in each whole byte (groups of 8 from the start). */
+	void LSB8MSB();
+
+	/**@name Polynomial operations, one table step per byte. */
+	//@{
+	/** Calculate the syndrome of the vector with the given Generator. */
+	uint64_t syndrome(Generator& gen) const;
+	/** Calculate the parity word for the vector with the given Generator. */
+	uint64_t parity(Generator& gen) const;
+	/** Encode the signal with the GSM rate 1/2 convolutional encoder. */
+	void encode(const ViterbiR2O4& encoder, PackedBitVector& target) const;
+	//@}
+
+	/**@name Field operations, length up to 64 bits. */
+	//@{
+	uint64_t peekField(size_t readIndex, unsigned length) const;
+	uint64_t peekFieldReversed(size_t readIndex, unsigned length) const;
+	uint64_t readField(size_t& readIndex, unsigned length) const;
+	uint64_t readFieldReversed(size_t& readIndex, unsigned length) const;
+	void fillField(size_t writeIndex, uint64_t value, unsigned length);
+	void fillFieldReversed(size_t writeIndex, uint64_t value, unsigned length);
+	void writeField(size_t& writeIndex, uint64_t value, unsigned length);
+	void writeFieldReversed(size_t& writeIndex, uint64_t value, unsigned length);
+	//@}
+
+	/** Sum of bits. */
+	unsigned sum() const;
+
+	/** Reorder bits, dest[i] = this[map[i]]. */
+	void map(const unsigned *map, size_t mapSize, PackedBitVector& dest) const;
+
+	/** Reorder bits, dest[map[i]] = this[i]. */
+	void unmap(const unsigned *map, size_t mapSize, PackedBitVector& dest) const;
+
+	private:
+
+	/** Clear the bits past mSize in the last word. */
+	void trim()
+	{
+		if (mSize & 63) mWords[mWords.size()-1] &= ~0ULL << (64-(mSize&63));
+	}
+
+};
+
+
+
+std::ostream& operator<<(std::ostream&, const PackedBitVector&);
+
+
+
+
 
 
 /**
@@ -433,6 +626,10 @@ class SoftVector: public Vector<float> {
 	/** Decode soft symbols with the GSM rate-1/2 Viterbi decoder. */
 	void decode(ViterbiR2O4 &decoder, BitVector& target) const;
 
+	/** Decode soft symbols with the packed GSM rate-1/2 Viterbi decoder. */
+	void decode(const ViterbiR2O4Packed &decoder, BitVector& target) const
+		{ decoder.decode(*this,target); }
+
 	// (pat) How good is the SoftVector in the sense of the bits being solid?
 	// Result of 1 is perfect and 0 means all the bits were 0.5
 	// If plow is non-NULL, also return the lowest energy bit.
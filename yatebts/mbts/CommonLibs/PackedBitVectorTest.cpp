@@ -0,0 +1,242 @@
+/*
+* Copyright 2008 Free Software Foundation, Inc.
+*
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+/*
+	Check PackedBitVector against BitVector and compare their speed on the
+	block coding of each GSM 05.03 channel type:
+	encode is parity + convolutional coding (+ interleaving for XCCH),
+	decode is the parity check of the received u[] (the Viterbi step is common).
+	Usage: PackedBitVectorTest [frames]
+*/
+
+#include "BitVector.h"
+#include <iostream>
+#include <cstdlib>
+#include <sys/time.h>
+
+using namespace std;
+
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,0);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static bool same(const BitVector& v1, const PackedBitVector& v2)
+{
+	if (v1.size()!=v2.size()) return false;
+	for (size_t i=0; i<v1.size(); i++) if (v1.bit(i)!=v2.bit(i)) return false;
+	return true;
+}
+
+static unsigned sFailures = 0;
+
+static void check(bool ok, const char* what)
+{
+	if (ok) return;
+	cout << "FAILED: " << what << endl;
+	sFailures++;
+}
+
+
+// Basic operations on odd sizes and offsets.
+static void testOps()
+{
+	const size_t sizes[] = {1, 7, 8, 63, 64, 65, 184, 228, 456};
+	for (unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+		const size_t sz = sizes[s];
+		BitVector v(sz);
+		for (size_t i=0; i<sz; i++) v[i] = random() & 0x01;
+		PackedBitVector p(v);
+		check(same(v,p),"pack");
+		BitVector u(sz);
+		p.unpack(u);
+		check(u.size()==sz && same(u,p),"unpack");
+		check(v.sum()==p.sum(),"sum");
+		for (unsigned n=0; n<200; n++) {
+			const size_t start = random() % sz;
+			unsigned len = random() % 65;
+			if (start+len > sz) len = sz-start;
+			check(v.peekField(start,len)==p.peekField(start,len),"peekField");
+			check(v.peekFieldReversed(start,len)==p.peekFieldReversed(start,len),"peekFieldReversed");
+			const uint64_t val = ((uint64_t)random()<<32) ^ random();
+			v.fillField(start,val,len);
+			p.fillField(start,val,len);
+			check(same(v,p),"fillField");
+			v.fillFieldReversed(start,val,len);
+			p.fillFieldReversed(start,val,len);
+			check(same(v,p),"fillFieldReversed");
+			check(same(v.segment(start,len),p.segment(start,len)),"segment");
+		}
+		BitVector big(sz+77);
+		PackedBitVector pbig(sz+77);
+		big.zero();
+		for (size_t start=0; start<=77; start+=7) {
+			v.copyToSegment(big,start);
+			p.copyToSegment(pbig,start);
+			check(same(big,pbig),"copyToSegment");
+		}
+		v.invert();
+		p.invert();
+		check(same(v,p),"invert");
+		v.LSB8MSB();
+		p.LSB8MSB();
+		check(same(v,p),"LSB8MSB");
+	}
+}
+
+
+/** A block code: data, parity and tail bit counts, convolutional coding or not. */
+struct Channel {
+	const char* name;
+	uint64_t poly;
+	unsigned parityBits;
+	unsigned dataBits;
+	unsigned tailBits;
+	bool convolutional;
+	bool interleave;
+};
+
+static const Channel sChannels[] = {
+	{ "XCCH/CS-1", 0x10004820009ULL, 40, 184, 4, true, true },
+	{ "SCH", 0x0575, 10, 25, 4, true, false },
+	{ "RACH", 0x06f, 6, 8, 4, true, false },
+	{ "TCH/FS 1a", 0x0b, 3, 50, 0, false, false },
+	{ "CS-4", (1<<16) + (1<<12) + (1<<5) + 1, 16, 431, 0, false, false },
+};
+
+
+static void runChannel(const Channel& ch, unsigned frames)
+{
+	const unsigned uLen = ch.dataBits + ch.parityBits + ch.tailBits;
+	const unsigned cLen = ch.convolutional ? 2*uLen : uLen;
+	ViterbiR2O4 vCoder;
+	Parity parity(ch.poly,ch.parityBits,ch.dataBits+ch.parityBits);
+
+	// GSM 05.03 4.1.4 interleaving as a map for each burst.
+	unsigned imap[4][114];
+	for (int k=0; k<456; k++) imap[k%4][2*((49*k) % 57) + ((k%8)/4)] = k;
+
+	BitVector* data = new BitVector[frames];
+	for (unsigned f=0; f<frames; f++) {
+		data[f] = BitVector(ch.dataBits);
+		for (unsigned i=0; i<ch.dataBits; i++) data[f][i] = random() & 0x01;
+	}
+
+	// Byte per bit
+	BitVector u(uLen), c(cLen), i[4];
+	for (unsigned B=0; B<4; B++) i[B] = BitVector(114);
+	u.zero();
+	BitVector d(u.head(ch.dataBits)), p(u.segment(ch.dataBits,ch.parityBits));
+	unsigned long check1 = 0;
+	double t = now();
+	for (unsigned f=0; f<frames; f++) {
+		data[f].copyToSegment(u,0);
+		d.LSB8MSB();
+		parity.writeParityWord(d,p);
+		if (ch.convolutional) u.encode(vCoder,c);
+		else u.copyToSegment(c,0);
+		if (ch.interleave) {
+			for (int k=0; k<456; k++) i[k%4][2*((49*k) % 57) + ((k%8)/4)] = c[k];
+			check1 += i[f%4].sum();
+		}
+		else check1 += c.sum();
+	}
+	const double te1 = now()-t;
+	BitVector lastC(c);
+
+	// Packed
+	PackedBitVector pu(uLen), pc(cLen), pd(ch.dataBits), pi[4];
+	for (unsigned B=0; B<4; B++) pi[B].resize(114);
+	unsigned long check2 = 0;
+	t = now();
+	for (unsigned f=0; f<frames; f++) {
+		pd.pack(data[f]);
+		pd.LSB8MSB();
+		pd.copyToSegment(pu,0);
+		pu.fillField(ch.dataBits,~pd.parity(parity),ch.parityBits);
+		if (ch.convolutional) pu.encode(vCoder,pc);
+		else pu.copyToSegment(pc,0);
+		if (ch.interleave) {
+			for (unsigned B=0; B<4; B++) pc.map(imap[B],114,pi[B]);
+			check2 += pi[f%4].sum();
+		}
+		else check2 += pc.sum();
+	}
+	const double te2 = now()-t;
+	check(same(lastC,pc),"encoded frame");
+	check(check1==check2,"encoded frames");
+	if (ch.interleave) {
+		for (unsigned B=0; B<4; B++) check(same(i[B],pi[B]),"interleaved frame");
+	}
+
+	// Parity check of the received d[]:p[], with one corrupted frame in 8.
+	BitVector* rx = new BitVector[frames];
+	for (unsigned f=0; f<frames; f++) {
+		rx[f] = BitVector(ch.dataBits+ch.parityBits);
+		data[f].copyToSegment(rx[f],0);
+		rx[f].fillField(ch.dataBits,data[f].parity(parity),ch.parityBits);
+		if (!(f%8)) rx[f][random() % rx[f].size()] ^= 1;
+	}
+	unsigned good1 = 0;
+	t = now();
+	for (unsigned f=0; f<frames; f++) good1 += !parity.syndrome(rx[f]);
+	const double td1 = now()-t;
+	PackedBitVector* prx = new PackedBitVector[frames];
+	for (unsigned f=0; f<frames; f++) prx[f].pack(rx[f]);
+	unsigned good2 = 0;
+	t = now();
+	for (unsigned f=0; f<frames; f++) good2 += !prx[f].syndrome(parity);
+	const double td2 = now()-t;
+	check(good1==good2,"syndromes");
+	check(good1==frames-(frames+7)/8,"good frames");
+
+	cout << ch.name << ": encode byte " << (unsigned)(frames/te1) << " packed " << (unsigned)(frames/te2)
+		<< " frames/s | parity check byte " << (unsigned)(frames/td1) << " packed " << (unsigned)(frames/td2)
+		<< " frames/s" << endl;
+	delete[] data;
+	delete[] rx;
+	delete[] prx;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const unsigned frames = (argc>1) ? atoi(argv[1]) : 100000;
+	srandom(1);
+	testOps();
+	for (unsigned c=0; c<sizeof(sChannels)/sizeof(sChannels[0]); c++)
+		runChannel(sChannels[c],frames);
+	if (sFailures) {
+		cout << sFailures << " failures" << endl;
+		return 1;
+	}
+	cout << "OK" << endl;
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+* Copyright 2008 Free Software Foundation, Inc.
+*
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+/*
+	Compare ViterbiR2O4Packed against ViterbiR2O4 on noisy XCCH sized frames:
+	decoding speed, bit errors against the sent data and differences between them.
+	Usage: ViterbiTest [frames]
+*/
+
+#include "BitVector.h"
+#include <iostream>
+#include <cstdlib>
+#include <math.h>
+#include <sys/time.h>
+
+using namespace std;
+
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,0);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+// Gaussian noise, Box-Muller
+static float noise(float sigma)
+{
+	float u1 = (random()+1.0F)/(RAND_MAX+2.0F);
+	float u2 = (random()+1.0F)/(RAND_MAX+2.0F);
+	return sigma*sqrtf(-2.0F*logf(u1))*cosf(2.0F*M_PI*u2);
+}
+
+static unsigned errors(const BitVector& v1, const BitVector& v2)
+{
+	unsigned n = 0;
+	for (size_t i=0; i<v1.size(); i++) n += v1.bit(i) != v2.bit(i);
+	return n;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const unsigned frames = (argc>1) ? atoi(argv[1]) : 10000;
+	// XCCH: 184 data + 40 parity + 4 tail bits
+	const unsigned uLen = 228;
+	const float sigmas[] = {0.0F, 0.2F, 0.3F, 0.4F, 0.5F, 0.6F};
+	ViterbiR2O4 vCoder;
+	ViterbiR2O4Packed pCoder;
+	srandom(1);
+
+	cout << "frames=" << frames << " bits=" << uLen << endl;
+	for (unsigned s=0; s<sizeof(sigmas)/sizeof(sigmas[0]); s++) {
+		// Build the noisy frames first, time only the decoders
+		SoftVector* rx = new SoftVector[frames];
+		BitVector* tx = new BitVector[frames];
+		for (unsigned f=0; f<frames; f++) {
+			tx[f] = BitVector(uLen);
+			for (unsigned i=0; i<uLen-4; i++) tx[f][i] = random() & 0x01;
+			for (unsigned i=uLen-4; i<uLen; i++) tx[f][i] = 0;
+			BitVector c(2*uLen);
+			tx[f].encode(vCoder,c);
+			rx[f] = SoftVector(c.size());
+			for (unsigned i=0; i<c.size(); i++) {
+				float v = c.bit(i) + noise(sigmas[s]);
+				rx[f][i] = (v<0.0F) ? 0.0F : ((v>1.0F) ? 1.0F : v);
+			}
+		}
+		BitVector* u1 = new BitVector[frames];
+		BitVector* u2 = new BitVector[frames];
+		for (unsigned f=0; f<frames; f++) {
+			u1[f] = BitVector(uLen);
+			u2[f] = BitVector(uLen);
+		}
+		double t = now();
+		for (unsigned f=0; f<frames; f++) rx[f].decode(vCoder,u1[f]);
+		const double t1 = now()-t;
+		t = now();
+		for (unsigned f=0; f<frames; f++) rx[f].decode(pCoder,u2[f]);
+		const double t2 = now()-t;
+		unsigned err1 = 0, err2 = 0, diff = 0, diffFrames = 0;
+		unsigned bad1 = 0, bad2 = 0;
+		for (unsigned f=0; f<frames; f++) {
+			const unsigned e1 = errors(tx[f],u1[f]);
+			const unsigned e2 = errors(tx[f],u2[f]);
+			const unsigned d = errors(u1[f],u2[f]);
+			err1 += e1;
+			err2 += e2;
+			bad1 += e1 != 0;
+			bad2 += e2 != 0;
+			diff += d;
+			diffFrames += d != 0;
+		}
+		cout << "sigma=" << sigmas[s]
+			<< " float: " << (unsigned)(frames/t1) << " frames/s BER=" << (double)err1/(frames*uLen)
+			<< " FER=" << (double)bad1/frames
+			<< " | packed: " << (unsigned)(frames/t2) << " frames/s BER=" << (double)err2/(frames*uLen)
+			<< " FER=" << (double)bad2/frames
+			<< " | differing bits=" << diff << " frames=" << diffFrames << endl;
+		delete[] rx;
+		delete[] tx;
+		delete[] u1;
+		delete[] u2;
+	}
+}
@@ -627,7 +627,11 @@ SharedL1Decoder::SharedL1Decoder()
 	: mBlockCoder(0x10004820009ULL, 40, 224),
 	mC(456),
 	mU(228), 
-	mP(mU.segment(184,40)),mDP(mU.head(224)),mD(mU.head(184)),
+	mP(mU.segment(184,40)),mDP(mU.head(224)),
+#if GSM_PACKED_FEC
+	mPackedDP(224),
+#endif
+	mD(mU.head(184)),
 	mHParity(0x06f,6,8),mHU(18),mHD(mHU.head(8))
 {
 	for (int i=0; i<4; i++) {
@@ -815,10 +819,18 @@ bool SharedL1Decoder::decode()
 	// False detections are EXTREMELY rare.
 	// Parity check of u[].
 	// GSM 05.03 4.1.2.
+#if GSM_PACKED_FEC
+	mPackedDP.pack(mDP);
+	mPackedDP.fillField(184,~mPackedDP.peekField(184,40),40);	// parity is inverted
+	// The syndrome should be zero.
+	OBJLOG(DEBUG) <<"XCCHL1Decoder d[]:p[]=" << mPackedDP;
+	unsigned syndrome = mPackedDP.syndrome(mBlockCoder);
+#else
 	mP.invert();							// parity is inverted
 	// The syndrome should be zero.
 	OBJLOG(DEBUG) <<"XCCHL1Decoder d[]:p[]=" << mDP;
 	unsigned syndrome = mBlockCoder.syndrome(mDP);
+#endif
 	OBJLOG(DEBUG) <<"XCCHL1Decoder syndrome=" << hex << syndrome << dec;
 	// Simulate high FER for testing?
 	if (random()%100 < gConfig.getNum("Test.GSM.SimulatedFER.Uplink")) {
@@ -911,16 +923,34 @@ void SACCHL1Decoder::handleGoodFrame()
 }
 
 
+// GSM 05.03 4.1.4 for each burst: i[B][j] = c[sInterleave41[B][j]]
+static unsigned sInterleave41[4][114];
+static bool sInterleave41Ready = false;
+
+
 // Process the 184 bit frame, starting at offset, add parity, encode.
 // Result is left in mI, representing 4 radio bursts.
 void SharedL1Encoder::encodeFrame41(const BitVector &src, int offset, bool copy)
 {
 	if (copy) src.copyToSegment(mU,offset);
 	OBJLOG(DEBUG) << "XCCHL1Encoder before d[]=" << mD;
+#if GSM_PACKED_FEC
+	// Everything stays packed until the bursts are written to mI.
+	// Unlike below u[] and c[] are left in mPackedU and mPackedC.
+	mPackedD.pack(mD);
+	mPackedD.LSB8MSB();
+	OBJLOG(DEBUG) << "XCCHL1Encoder after d[]=" << mPackedD;
+	encodePacked41();
+	for (int B=0; B<4; B++) {
+		mPackedC.map(sInterleave41[B],114,mPackedI);
+		mPackedI.unpack(mI[B]);
+	}
+#else
 	mD.LSB8MSB();
 	OBJLOG(DEBUG) << "XCCHL1Encoder after d[]=" << mD;
 	encode41();
 	interleave41();
+#endif
 }
 
 
@@ -956,6 +986,11 @@ XCCHL1Encoder::XCCHL1Encoder(
 // which are the bits set in Parity initialization below.
 void SharedL1Encoder::initInterleave(int mIsize)
 {
+	if (!sInterleave41Ready) {
+		for (int k=0; k<456; k++)
+			sInterleave41[k%4][2*((49*k) % 57) + ((k%8)/4)] = k;
+		sInterleave41Ready = true;
+	}
 	// Set up the interleaving buffers.
 	for(int k = 0; k<mIsize; k++) {
 		mI[k] = BitVector(114);
@@ -971,6 +1006,9 @@ SharedL1Encoder::SharedL1Encoder():
 	mC(456), mU(228),
 	mP(mU.segment(184,40)),
 	mD(mU.head(184))
+#if GSM_PACKED_FEC
+	,mPackedD(184), mPackedU(228), mPackedC(456), mPackedI(114)
+#endif
 {
 	initInterleave(4);
 	mU.zero();	// zeros out the tail bits.
@@ -1053,6 +1091,12 @@ void SharedL1Encoder::encode41()
 {
 	// Perform the FEC encoding of GSM 05.03 4.1.2 and 4.1.3
 
+#if GSM_PACKED_FEC
+	mPackedD.pack(mD);
+	encodePacked41();
+	mP.fillField(0,mPackedU.peekField(184,40),40);
+	mPackedC.unpack(mC);
+#else
 	// GSM 05.03 4.1.2
 	// Generate the parity bits.
 	mBlockCoder.writeParityWord(mD,mP);
@@ -1060,19 +1104,43 @@ void SharedL1Encoder::encode41()
 	// GSM 05.03 4.1.3
 	// Apply the convolutional encoder.
 	mU.encode(mVCoder,mC);
+#endif
 	OBJLOG(DEBUG) << "XCCHL1Encoder c[]=" << mC;
 }
 
 
+#if GSM_PACKED_FEC
+void SharedL1Encoder::encodePacked41()
+{
+	// GSM 05.03 4.1.2
+	// Generate the parity bits, the tail bits are always zero.
+	mPackedD.copyToSegment(mPackedU);
+	mPackedU.fillField(184,~mPackedD.parity(mBlockCoder),40);
+	OBJLOG(DEBUG) << "XCCHL1Encoder u[]=" << mPackedU;
+	// GSM 05.03 4.1.3
+	// Apply the convolutional encoder.
+	mPackedU.encode(mVCoder,mPackedC);
+}
+#endif
+
+
 
 void SharedL1Encoder::interleave41()
 {
+#if GSM_PACKED_FEC
+	mPackedC.pack(mC);
+	for (int B=0; B<4; B++) {
+		mPackedC.map(sInterleave41[B],114,mPackedI);
+		mPackedI.unpack(mI[B]);
+	}
+#else
 	// GSM 05.03, 4.1.4.  Verbatim.
 	for (int k=0; k<456; k++) {
 		int B = k%4;
 		int j = 2*((49*k) % 57) + ((k%8)/4);
 		mI[B][j] = mC[k];
 	}
+#endif
 }
 
 
@@ -619,7 +619,7 @@ class RACHL1Decoder : public L1Decoder
 
 	/**@name FEC state. */
 	//@{
-	ViterbiR2O4 mVCoder;	///< nearly all GSM channels use the same convolutional code
+	ViterbiR2O4Packed mVCoder;	///< nearly all GSM channels use the same convolutional code
 	Parity mParity;					///< block coder
 	BitVector mU;					///< u[], as per GSM 05.03 2.2
 	BitVector mD;					///< d[], as per GSM 05.03 2.2
@@ -684,6 +684,18 @@ class SharedL1Encoder
     BitVector mD;               ///< d[], as per GSM 05.03 2.2		Incoming Data.
     BitVector mI[4];           ///< i[][], as per GSM 05.03 2.2	Outgoing Data.
     BitVector mE[4];
+#if GSM_PACKED_FEC
+	/**@name Packed copies used by the block coding, see GSM_PACKED_FEC. */
+	//@{
+	PackedBitVector mPackedD;	///< d[]
+	PackedBitVector mPackedU;	///< u[]
+	PackedBitVector mPackedC;	///< c[]
+	PackedBitVector mPackedI;	///< one burst of i[][]
+	//@}
+
+	/** Code the packed d[] into the packed c[], GSM 05.03 4.1.2 and 4.1.3. */
+	void encodePacked41();
+#endif
 
 	/**
 	  Encode u[] to c[].
@@ -714,13 +726,16 @@ class SharedL1Decoder
 
     /**@name FEC state. */
     //@{
-	ViterbiR2O4 mVCoder;	///< nearly all GSM channels use the same convolutional code
+	ViterbiR2O4Packed mVCoder;	///< nearly all GSM channels use the same convolutional code
     Parity mBlockCoder;
 	public:
     SoftVector mC;              ///< c[], as per GSM 05.03 2.2
     BitVector mU;               ///< u[], as per GSM 05.03 2.2
     BitVector mP;               ///< p[], as per GSM 05.03 2.2
     BitVector mDP;              ///< d[]:p[] (data & parity)
+#if GSM_PACKED_FEC
+    PackedBitVector mPackedDP;  ///< packed d[]:p[] for the parity check
+#endif
 	public:
     BitVector mD;               ///< d[], as per GSM 05.03 2.2
     SoftVector mE[4];
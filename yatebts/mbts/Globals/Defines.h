@@ -7,6 +7,9 @@
 
 // GPRS_1 turns on the SharedEncoder.  It is the thing that keeps the modem from registering.
 #define GPRS_ENCODER 1	// Use SharedL1Encoder and SharedL1Decoder
+#ifndef GSM_PACKED_FEC
+#define GSM_PACKED_FEC 1	// Word packed bits (PackedBitVector) for the GSM 05.03 4.1 block coding
+#endif
 #define GPRS_TESTSI4 1
 #define GPRS_TEST 1		// Compile in other GPRS stuff.
 #define GPRS_PAT 1		// Compile in GPRS code.  Turn this off to get previous non-GRPS code,
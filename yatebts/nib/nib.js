@@ -42,33 +42,24 @@ function readUEs()
 
 /*
  * Read registered subscribers from tmsidata.conf configuration file and last allocated tmsi
+ * Changes are kept in the tmsidata.conf.journal file until the store compacts them in tmsidata.conf
  */
 function readUEsFromConf()
 {
-    conf = new ConfigFile(Engine.configFile("tmsidata"),true);
-
-    tmsisection = conf.getSection("tmsi",true);
-    last_tmsi = tmsisection.getValue("last");
-
-    ues = conf.getSection("ues",true);
-    var subscriber_info, imsi;
+    // Ex   registered user:226030182676743=000000bd,354695033561290,40121212121,1401097352,ybts/TMSI000000bd
+    // Ex unregistered user:226030182676743=000000bd,354695033561290,40121212121,1401097352,
+    // imsi=tmsi,imei,msisdn,expires,location
+    store = new SubscriberStore(Engine.configFile("tmsidata"));
+    if (store.load()==false)
+	Engine.alarm(4, "Could not open journal of tmsidata.conf");
+
+    last_tmsi = store.lastTmsi();
     registered_subscribers = {};
 
-    keys = ues.keys();
+    var imsi;
     var count_ues = 0;
-    for (imsi of keys) {
-	// Ex   registered user:226030182676743=000000bd,354695033561290,40121212121,1401097352,ybts/TMSI000000bd
-	// Ex unregistered user:226030182676743=000000bd,354695033561290,40121212121,1401097352,
-	// imsi=tmsi,imei,msisdn,expires,location
-	subscriber_info = ues.getValue(imsi);
-	subscriber_info = subscriber_info.split(",");
-	var tmsi = subscriber_info[0];
-	var imei = subscriber_info[1];
-	var msisdn = subscriber_info[2];
-	var expires = subscriber_info[3];
-	expires = parseInt(expires);
-	var loc = subscriber_info[4];
-	registered_subscribers[imsi] = {"tmsi":tmsi,"imei":imei,"msisdn":msisdn,"expires":expires,"location":loc};
+    for (imsi of store.keys()) {
+	registered_subscribers[imsi] = store.get(imsi);
 	count_ues = count_ues+1;
     }
 
@@ -114,13 +105,13 @@ function subscriberEqual(obj1, obj2)
  */
 function saveUEinConf(imsi,subscriber)
 {
-    if (subscriber!=undefined) {
-	var fields = subscriber["tmsi"]+","+subscriber["imei"]+","+subscriber["msisdn"]+","+subscriber["expires"]+","+subscriber["location"];
-	conf.setValue(ues,imsi,fields);
-    } else
-	conf.clearKey(ues,imsi);
+    var saved;
+    if (subscriber!=undefined)
+	saved = store.set(imsi,subscriber);
+    else
+	saved = store.remove(imsi);
 
-    if (conf.save()==false)
+    if (saved==false)
 	Engine.alarm(4, "Could not save tmsi in tmsidata.conf");
 }
 
@@ -132,8 +123,7 @@ function saveTMSI(tmsi)
 
 function saveTMSIinConf(tmsi)
 {
-    conf.setValue(tmsisection,"last",tmsi);
-    if (conf.save()==false)
+    if (store.lastTmsi(tmsi)==false)
 	Engine.alarm(4, "Could not save last tmsi in tmsidata.conf");
 }
 
@@ -346,8 +336,9 @@ function updateSubscriber(fields, imsi)
 	} else if (subscribers[imsi]["msisdn"]!=fields["msisdn"]) {
 	    // subscriber msisdn was changed. Try to keep registration
 	    if (registered_subscribers[imsi]!="") {
-		var subscriber = registered_subscribers[imsi];
-		subscriber["msisdn"] = fields["msisdn"];
+		// build a new object, saveUE() compares it with the registered one
+		var reg = registered_subscribers[imsi];
+		var subscriber = {"tmsi":reg["tmsi"], "msisdn":fields["msisdn"], "imei":reg["imei"], "expires":reg["expires"], "location":reg["location"]};
 		saveUE(imsi,subscriber);
 	    }
 	}
@@ -417,18 +408,11 @@ function readConfiguration(return_subscribers)
 // Allocate an unused TMSI
 function allocTmsi()
 {
-    var imsi_key, tmsi, in_use;
+    var tmsi;
 
     for (;;) {
 	tmsi = newTmsi();
-	in_use = false;
-	for (imsi_key in registered_subscribers) {
-	    if (registered_subscribers[imsi_key]==tmsi) {
-		in_use = true;
-		break;
-	    }
-	}
-	if (in_use)
+	if (store.findTmsi(tmsi))
 	    continue;
 	saveTMSI(tmsi);
 	break;
@@ -438,21 +422,11 @@ function allocTmsi()
  
 function numberAvailable(val,imsi)
 {
-    var number;
-    for (var imsi_key in registered_subscribers) {
-	number = registered_subscribers[imsi_key]["msisdn"];
-	if (number.substr(0,1)=="+")
-	    number = number.substr(1);
-
-	if (number==val) {
-	    if (imsi!=undefined && imsi==imsi_key)
-		// keep numbers already associated
-		return true;
-	    else
-	    	return false;
-	}
-    }
-    return true;
+    var imsi_key = store.findMsisdn(val);
+    if (!imsi_key)
+	return true;
+    // keep numbers already associated
+    return (imsi!=undefined && imsi==imsi_key);
 }
  
 function newNumber(imsi)
@@ -549,7 +523,7 @@ function getSubscriberMsisdn(imsi)
 
 function getSubscriberIMSI(msisdn,tmsi)
 {
-    var imsi_key, nr, short_number, user_tmsi;
+    var imsi_key, nr, short_number;
 
     if (msisdn) {
 	if (subscribers) {
@@ -572,27 +546,16 @@ function getSubscriberIMSI(msisdn,tmsi)
 	    }
 	}
 
-	for (imsi_key in registered_subscribers) {
-	    nr = registered_subscribers[imsi_key]["msisdn"];
-	    if (nr.length>0) {
-		// strip + from start of number
-		if (nr.substr(0,1)=="+")
-		    nr = nr.substr(1);
-
-		//if (nr==msisdn || nr.substr(0,msisdn.length)==msisdn || (msisdn.substr(0,1)=="+" && msisdn.substr(1,nr.length)==nr))
-		if (msisdn.substr(-nr.length)==nr)
-		    return imsi_key;
-	    }
-	}
+	// registered subscriber whose number is a suffix of msisdn
+	imsi_key = store.matchMsisdn(msisdn);
+	if (imsi_key)
+	    return imsi_key;
 
     }
     else if (tmsi) {
-	for (imsi_key in registered_subscribers) {
-	    user_tmsi = registered_subscribers[imsi_key].tmsi;
-	    if (user_tmsi==tmsi) {
-		return imsi_key;
-	    }
-	}
+	imsi_key = store.findTmsi(tmsi);
+	if (imsi_key)
+	    return imsi_key;
     }
 
     return false;
@@ -612,13 +575,9 @@ function updateCaller(msg,imsi)
 	    return false;
 	}
     } else if (caller.match(/TMSI/)) {
-	var tmsi = caller.substr(4);
-	for (var imsi_key in registered_subscribers) {
-	    if (registered_subscribers[imsi_key].tmsi == tmsi) {
-		msg.caller = registered_subscribers[imsi_key].msisdn;
-		break;
-	    }
-	}
+	var imsi_key = store.findTmsi(caller.substr(4));
+	if (imsi_key)
+	    msg.caller = registered_subscribers[imsi_key].msisdn;
     }
 
     return true;
@@ -677,24 +636,18 @@ function routeSOS(msg)
 
 function routeToRegUser(msg,called)
 {
-    var msisdn, loc;
-    for (var imsi_key in registered_subscribers) {
-	msisdn = registered_subscribers[imsi_key]["msisdn"];
-	loc = registered_subscribers[imsi_key]["location"];
-	if (msisdn.substr(0,1)=="+")
-	    msisdn = msisdn.substr(1);
-	if (called.substr(-msisdn.length)==msisdn || msisdn.substr(-called.length)==called) {
-	    if (loc!="") {
-		msg.otmsi = registered_subscribers[imsi_key]["tmsi"];
-		msg.oimsi = imsi_key;
-		msg.retValue(loc);
-		return true;
-	    } else {
-		msg.error = "offline";
-		return true;
-	    }
-	}
-    }
+    // registered subscriber whose number ends the called number or ends with it
+    var imsi_key = store.matchMsisdn(called,true);
+    if (!imsi_key)
+	return;
+    var loc = registered_subscribers[imsi_key]["location"];
+    if (loc!="") {
+	msg.otmsi = registered_subscribers[imsi_key]["tmsi"];
+	msg.oimsi = imsi_key;
+	msg.retValue(loc);
+    } else
+	msg.error = "offline";
+    return true;
 }
 
 // Run expiration and retries
@@ -0,0 +1,197 @@
+/**
+ * storebench.js
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Copyright (C) 2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Registration storm benchmark for the NIB subscriber storage
+ * Load it from the rmanager console:
+ *
+ * javascript load storebench=/path/to/storebench.js
+ *
+ * It writes storebench_tmsidata.conf in the configuration directory
+ */
+
+var bench_count = 200000;
+var bench_lookups = 20000;
+// The old storage rewrites the whole file on every change, use fewer subscribers
+var conf_count = 2000;
+// Scanning script objects is slow too, keep the scanned object small
+var scan_count = 2000;
+var scan_lookups = 20;
+
+function benchImsi(i)
+{
+    return "00101" + (1000000000 + i);
+}
+
+function benchTmsi(i,gen)
+{
+    return "" + (gen * 10000000 + 3000000 + i);
+}
+
+function benchMsisdn(i)
+{
+    return "+40720" + (1000000 + i);
+}
+
+function benchSubscriber(i,gen)
+{
+    var tmsi = benchTmsi(i,gen);
+    var sub = {};
+    sub.tmsi = tmsi;
+    sub.imei = "35469503" + (1000000 + i);
+    sub.msisdn = benchMsisdn(i);
+    sub.expires = 1401097352 + gen;
+    sub.location = "ybts/TMSI" + tmsi;
+    return sub;
+}
+
+function benchRate(what,count,start)
+{
+    var ms = Date.now() - start;
+    if (ms <= 0)
+	ms = 1;
+    Engine.output("storebench: " + what + ": " + count + " in " + ms + " ms, "
+	+ (count * 1000 / ms) + "/s");
+}
+
+// Registrations as saveUEinConf() did them before the subscriber store
+function benchConfFile(file)
+{
+    File.remove(file);
+    var conf = new ConfigFile(file);
+    var ues = conf.getSection("ues",true);
+    var start = Date.now();
+    for (var i = 0; i < conf_count; i++) {
+	var sub = benchSubscriber(i,1);
+	var fields = sub.tmsi + "," + sub.imei + "," + sub.msisdn + "," + sub.expires + "," + sub.location;
+	conf.setValue(ues,benchImsi(i),fields);
+	conf.save();
+    }
+    benchRate("ConfigFile registrations",conf_count,start);
+    File.remove(file);
+}
+
+// MSISDN lookups as getSubscriberIMSI() did them by scanning the subscribers
+function benchScan()
+{
+    var subs = {};
+    for (var i = 0; i < scan_count; i++)
+	subs[benchImsi(i)] = benchSubscriber(i,1);
+    var start = Date.now();
+    var found = 0;
+    for (var n = 0; n < scan_lookups; n++) {
+	var called = "40720" + (1000000 + (n * 7919) % scan_count);
+	for (var imsi_key in subs) {
+	    var nr = subs[imsi_key]["msisdn"];
+	    if (nr.substr(0,1) == "+")
+		nr = nr.substr(1);
+	    if (called.substr(-nr.length) == nr) {
+		found++;
+		break;
+	    }
+	}
+    }
+    benchRate("object scan MSISDN lookups (found " + found + ")",scan_lookups,start);
+}
+
+function benchStore(file)
+{
+    File.remove(file);
+    File.remove(file + ".journal");
+    var store = new SubscriberStore(file);
+    store.load();
+
+    var start = Date.now();
+    for (var i = 0; i < bench_count; i++) {
+	var sub = benchSubscriber(i,1);
+	store.set(benchImsi(i),sub);
+	store.lastTmsi(sub.tmsi);
+    }
+    benchRate("store registrations",bench_count,start);
+
+    // everybody attaches again with a new TMSI, the journal gets compacted
+    start = Date.now();
+    for (var i = 0; i < bench_count; i++) {
+	var sub = benchSubscriber(i,2);
+	store.set(benchImsi(i),sub);
+	store.lastTmsi(sub.tmsi);
+    }
+    benchRate("store re-registrations",bench_count,start);
+
+    start = Date.now();
+    var found = 0;
+    for (var n = 0; n < bench_lookups; n++) {
+	var i = (n * 7919) % bench_count;
+	if (store.findTmsi(benchTmsi(i,2)) == benchImsi(i))
+	    found++;
+    }
+    benchRate("store TMSI lookups (found " + found + ")",bench_lookups,start);
+
+    start = Date.now();
+    found = 0;
+    for (var n = 0; n < bench_lookups; n++) {
+	var i = (n * 7919) % bench_count;
+	if (store.matchMsisdn("40720" + (1000000 + i)) == benchImsi(i))
+	    found++;
+    }
+    benchRate("store MSISDN lookups (found " + found + ")",bench_lookups,start);
+
+    start = Date.now();
+    found = 0;
+    for (var n = 0; n < bench_lookups; n++) {
+	var i = (n * 7919) % bench_count;
+	if (store.matchMsisdn("720" + (1000000 + i),true) == benchImsi(i))
+	    found++;
+    }
+    benchRate("store short MSISDN lookups (found " + found + ")",bench_lookups,start);
+
+
+    start = Date.now();
+    store = new SubscriberStore(file);
+    store.load();
+    benchRate("store reload",store.count(),start);
+    if (store.lastTmsi() != benchTmsi(bench_count - 1,2))
+	Engine.output("storebench: last TMSI mismatch: " + store.lastTmsi());
+    if (store.get(benchImsi(12345)).tmsi != benchTmsi(12345,2))
+	Engine.output("storebench: subscriber mismatch after reload");
+
+    // MSISDN changed from the subscribers list as updateSubscriber() does it
+    var imsi = benchImsi(777);
+    var reg = store.get(imsi);
+    var sub = {"tmsi":reg.tmsi, "imei":reg.imei, "expires":reg.expires, "location":reg.location};
+    sub.msisdn = "+40799" + (1000000 + 777);
+    if (reg.msisdn == sub.msisdn)
+	Engine.output("storebench: MSISDN change compared equal");
+    store.set(imsi,sub);
+    store = new SubscriberStore(file);
+    store.load();
+    if (store.matchMsisdn("40799" + (1000000 + 777)) != imsi)
+	Engine.output("storebench: changed MSISDN not found after reload");
+    if (store.matchMsisdn("40720" + (1000000 + 777)) == imsi)
+	Engine.output("storebench: old MSISDN still found after reload");
+    if (store.get(imsi).location != reg.location)
+	Engine.output("storebench: registration lost on MSISDN change");
+
+    File.remove(file);
+    File.remove(file + ".journal");
+}
+
+var bench_file = Engine.configFile("storebench_tmsidata");
+benchConfFile(bench_file);
+benchScan();
+benchStore(bench_file);
@@ -23,6 +23,19 @@
 #include <stdio.h>
 #include <string.h>
 
+// Build SSE2/AVX2/AVX-512 kernels selected at runtime
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ((defined(__GNUC__) && (__GNUC__ >= 5)) || defined(__clang__))
+#define SIGPROC_X86
+#include <immintrin.h>
+// Keep multiply and add separate (no FMA) so results match the scalar code
+#ifdef __clang__
+#define SIGPROC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIGPROC_TARGET(isa) __attribute__((target(isa),optimize("fp-contract=off")))
+#endif
+#endif
+
 //#define COMPLEX_DUMP_G
 
 using namespace TelEngine;
@@ -68,10 +81,7 @@ float Complex::sumMulConj(const Complex* data, unsigned int len)
 {
     if (!data)
 	return 0;
-    float val = 0;
-    for (; len; len--, data++)
-	val += data->mulConj();
-    return val;
+    return SigProcKernels::current().sumMulConj(data,len);
 }
 
 // Set complex elements from 16 bit integers array (pairs of real/imaginary parts)
@@ -103,6 +113,522 @@ void Complex::dump(String& dest, const Complex* c, unsigned int len, const char*
 }
 
 
+//
+// SigProcKernels
+//
+// Array kernels work on interleaved (real,imag) float pairs
+// Vector kernels handle whole vectors and leave the tail to the scalar ones
+
+static void scalarMultiply(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n)
+{
+    for (; n; --n, ++dest, ++c1, ++c2)
+	Complex::multiply(*dest,*c1,*c2);
+}
+
+static void scalarSum(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n)
+{
+    for (; n; --n, ++dest, ++c1, ++c2)
+	Complex::sum(*dest,*c1,*c2);
+}
+
+static void scalarDiff(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n)
+{
+    for (; n; --n, ++dest, ++c1, ++c2)
+	Complex::diff(*dest,*c1,*c2);
+}
+
+static void scalarSumMul(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n)
+{
+    for (; n; --n, ++dest, ++c1, ++c2)
+	Complex::sumMul(*dest,*c1,*c2);
+}
+
+static void scalarSumMulTotal(Complex& dest, const Complex* c1, const Complex* c2, unsigned int n)
+{
+    for (; n; --n, ++c1, ++c2)
+	Complex::sumMul(dest,*c1,*c2);
+}
+
+static float scalarSumMulConj(const Complex* data, unsigned int n)
+{
+    float val = 0;
+    for (; n; --n, ++data)
+	val += data->mulConj();
+    return val;
+}
+
+static void scalarConvolution(Complex* out, unsigned int n, const Complex* f,
+    const float* g, unsigned int glen)
+{
+    unsigned int half = glen / 2;
+    for (; n; --n, ++out, ++f) {
+	out->set();
+	const Complex* fs = f;
+	const Complex* fe = f + glen - 1;
+	const float* gs = g;
+	for (unsigned int k = half; k; --k, ++fs, --fe, ++gs)
+	    Complex::sumMulFSum(*out,*fs,*fe,*gs);
+	Complex::sumMulF(*out,*fs,*gs);
+    }
+}
+
+static void scalarCorrelate(Complex* out, unsigned int n, const Complex* a,
+    const float* g, unsigned int glen)
+{
+    for (; n; --n, ++out, ++a) {
+	out->set();
+	for (unsigned int j = 0; j < glen; j++)
+	    Complex::sumMulF(*out,a[j],g[j]);
+    }
+}
+
+static const SigProcKernels s_scalarKernels = {
+    scalarMultiply, scalarSum, scalarDiff, scalarSumMul, scalarSumMulTotal,
+    scalarSumMulConj, scalarConvolution, scalarCorrelate
+};
+
+#ifdef SIGPROC_X86
+
+// Each block below defines the vector type V holding W complex numbers for an
+//  instruction set and the operations used by the shared kernel bodies
+// Complex multiply: (ar*br - ai*bi, ai*br + ar*bi), the sign of the real part
+//  product is flipped with XOR so results are bit exact with the scalar code
+
+#define SIGPROC_KERNELS(isa,pfx,V,W,LOAD,STORE,ADD,MUL,ZERO,SET1,CMUL,HSUM) \
+SIGPROC_TARGET(isa) static void pfx##Multiply(Complex* dest, const Complex* c1, \
+    const Complex* c2, unsigned int n) \
+{ \
+    for (; n >= W; n -= W, dest += W, c1 += W, c2 += W) \
+	STORE(dest,CMUL(LOAD(c1),LOAD(c2))); \
+    scalarMultiply(dest,c1,c2,n); \
+} \
+SIGPROC_TARGET(isa) static void pfx##Sum(Complex* dest, const Complex* c1, \
+    const Complex* c2, unsigned int n) \
+{ \
+    for (; n >= W; n -= W, dest += W, c1 += W, c2 += W) \
+	STORE(dest,ADD(LOAD(c1),LOAD(c2))); \
+    scalarSum(dest,c1,c2,n); \
+} \
+SIGPROC_TARGET(isa) static void pfx##Diff(Complex* dest, const Complex* c1, \
+    const Complex* c2, unsigned int n) \
+{ \
+    for (; n >= W; n -= W, dest += W, c1 += W, c2 += W) \
+	STORE(dest,pfx##Sub(LOAD(c1),LOAD(c2))); \
+    scalarDiff(dest,c1,c2,n); \
+} \
+SIGPROC_TARGET(isa) static void pfx##SumMul(Complex* dest, const Complex* c1, \
+    const Complex* c2, unsigned int n) \
+{ \
+    for (; n >= W; n -= W, dest += W, c1 += W, c2 += W) \
+	STORE(dest,ADD(LOAD(dest),CMUL(LOAD(c1),LOAD(c2)))); \
+    scalarSumMul(dest,c1,c2,n); \
+} \
+SIGPROC_TARGET(isa) static void pfx##SumMulTotal(Complex& dest, const Complex* c1, \
+    const Complex* c2, unsigned int n) \
+{ \
+    V acc = ZERO(); \
+    for (; n >= W; n -= W, c1 += W, c2 += W) \
+	acc = ADD(acc,CMUL(LOAD(c1),LOAD(c2))); \
+    float tmp[2 * W]; \
+    STORE((Complex*)tmp,acc); \
+    float r = 0; \
+    float i = 0; \
+    for (unsigned int k = 0; k < 2 * W; k += 2) { \
+	r += tmp[k]; \
+	i += tmp[k + 1]; \
+    } \
+    dest.set(dest.real() + r,dest.imag() + i); \
+    scalarSumMulTotal(dest,c1,c2,n); \
+} \
+SIGPROC_TARGET(isa) static float pfx##SumMulConj(const Complex* data, unsigned int n) \
+{ \
+    V acc = ZERO(); \
+    for (; n >= W; n -= W, data += W) { \
+	V v = LOAD(data); \
+	acc = ADD(acc,MUL(v,v)); \
+    } \
+    return HSUM(acc) + scalarSumMulConj(data,n); \
+} \
+SIGPROC_TARGET(isa) static void pfx##Convolution(Complex* out, unsigned int n, \
+    const Complex* f, const float* g, unsigned int glen) \
+{ \
+    unsigned int half = glen / 2; \
+    for (; n >= W; n -= W, out += W, f += W) { \
+	V acc = ZERO(); \
+	const Complex* fe = f + glen - 1; \
+	for (unsigned int k = 0; k < half; k++) \
+	    acc = ADD(acc,MUL(ADD(LOAD(f + k),LOAD(fe - k)),SET1(g[k]))); \
+	STORE(out,ADD(acc,MUL(LOAD(f + half),SET1(g[half])))); \
+    } \
+    scalarConvolution(out,n,f,g,glen); \
+} \
+SIGPROC_TARGET(isa) static void pfx##Correlate(Complex* out, unsigned int n, \
+    const Complex* a, const float* g, unsigned int glen) \
+{ \
+    for (; n >= W; n -= W, out += W, a += W) { \
+	V acc = ZERO(); \
+	for (unsigned int j = 0; j < glen; j++) \
+	    acc = ADD(acc,MUL(LOAD(a + j),SET1(g[j]))); \
+	STORE(out,acc); \
+    } \
+    scalarCorrelate(out,n,a,g,glen); \
+} \
+static const SigProcKernels s_##pfx##Kernels = { \
+    pfx##Multiply, pfx##Sum, pfx##Diff, pfx##SumMul, pfx##SumMulTotal, \
+    pfx##SumMulConj, pfx##Convolution, pfx##Correlate \
+};
+
+// SSE2: 2 complex numbers per vector
+#define SSE2_LOAD(p) _mm_loadu_ps((const float*)(p))
+#define SSE2_STORE(p,v) _mm_storeu_ps((float*)(p),v)
+
+SIGPROC_TARGET("sse2") static inline __m128 sse2Sub(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(a,b);
+}
+
+SIGPROC_TARGET("sse2") static inline __m128 sse2CMul(__m128 a, __m128 b)
+{
+    __m128 br = _mm_shuffle_ps(b,b,_MM_SHUFFLE(2,2,0,0));
+    __m128 bi = _mm_shuffle_ps(b,b,_MM_SHUFFLE(3,3,1,1));
+    __m128 as = _mm_shuffle_ps(a,a,_MM_SHUFFLE(2,3,0,1));
+    __m128 sign = _mm_set_ps(0.0f,-0.0f,0.0f,-0.0f);
+    return _mm_add_ps(_mm_mul_ps(a,br),_mm_xor_ps(_mm_mul_ps(as,bi),sign));
+}
+
+SIGPROC_TARGET("sse2") static inline float sse2HSum(__m128 v)
+{
+    float tmp[4];
+    _mm_storeu_ps(tmp,v);
+    return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+}
+
+SIGPROC_KERNELS("sse2",sse2,__m128,2,SSE2_LOAD,SSE2_STORE,_mm_add_ps,_mm_mul_ps,
+    _mm_setzero_ps,_mm_set1_ps,sse2CMul,sse2HSum)
+
+// AVX2: 4 complex numbers per vector
+#define AVX2_LOAD(p) _mm256_loadu_ps((const float*)(p))
+#define AVX2_STORE(p,v) _mm256_storeu_ps((float*)(p),v)
+
+SIGPROC_TARGET("avx2") static inline __m256 avx2Sub(__m256 a, __m256 b)
+{
+    return _mm256_sub_ps(a,b);
+}
+
+SIGPROC_TARGET("avx2") static inline __m256 avx2CMul(__m256 a, __m256 b)
+{
+    __m256 br = _mm256_moveldup_ps(b);
+    __m256 bi = _mm256_movehdup_ps(b);
+    __m256 as = _mm256_permute_ps(a,_MM_SHUFFLE(2,3,0,1));
+    __m256 sign = _mm256_set_ps(0.0f,-0.0f,0.0f,-0.0f,0.0f,-0.0f,0.0f,-0.0f);
+    return _mm256_add_ps(_mm256_mul_ps(a,br),_mm256_xor_ps(_mm256_mul_ps(as,bi),sign));
+}
+
+SIGPROC_TARGET("avx2") static inline float avx2HSum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1));
+    return sse2HSum(s);
+}
+
+SIGPROC_KERNELS("avx2",avx2,__m256,4,AVX2_LOAD,AVX2_STORE,_mm256_add_ps,_mm256_mul_ps,
+    _mm256_setzero_ps,_mm256_set1_ps,avx2CMul,avx2HSum)
+
+// AVX-512: 8 complex numbers per vector
+// Some compilers warn about the undefined source of unmasked permutes
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#define AVX512_LOAD(p) _mm512_loadu_ps((const float*)(p))
+#define AVX512_STORE(p,v) _mm512_storeu_ps((float*)(p),v)
+
+SIGPROC_TARGET("avx512f") static inline __m512 avx512Sub(__m512 a, __m512 b)
+{
+    return _mm512_sub_ps(a,b);
+}
+
+SIGPROC_TARGET("avx512f") static inline __m512 avx512CMul(__m512 a, __m512 b)
+{
+    __m512 br = _mm512_moveldup_ps(b);
+    __m512 bi = _mm512_movehdup_ps(b);
+    __m512 as = _mm512_permute_ps(a,_MM_SHUFFLE(2,3,0,1));
+    // flip the sign of even (real part) elements
+    __m512i sign = _mm512_set1_epi64(0x80000000);
+    __m512 p = _mm512_castsi512_ps(_mm512_xor_si512(
+	_mm512_castps_si512(_mm512_mul_ps(as,bi)),sign));
+    return _mm512_add_ps(_mm512_mul_ps(a,br),p);
+}
+
+SIGPROC_TARGET("avx512f") static inline float avx512HSum(__m512 v)
+{
+    float tmp[16];
+    _mm512_storeu_ps(tmp,v);
+    float s = 0;
+    for (unsigned int i = 0; i < 16; i++)
+	s += tmp[i];
+    return s;
+}
+
+SIGPROC_KERNELS("avx512f",avx512,__m512,8,AVX512_LOAD,AVX512_STORE,_mm512_add_ps,
+    _mm512_mul_ps,_mm512_setzero_ps,_mm512_set1_ps,avx512CMul,avx512HSum)
+#pragma GCC diagnostic pop
+
+#endif // SIGPROC_X86
+
+const TokenDict SigProcKernels::s_levels[] = {
+    {"scalar", Scalar},
+    {"sse2", SSE2},
+    {"avx2", AVX2},
+    {"avx512", AVX512},
+    {0, 0}
+};
+
+const SigProcKernels* SigProcKernels::s_current = &s_scalarKernels;
+
+// Retrieve a set of kernels if supported by the CPU
+const SigProcKernels* SigProcKernels::get(int level)
+{
+#ifdef SIGPROC_X86
+    // we may be called from static constructors
+    __builtin_cpu_init();
+#endif
+    switch (level) {
+	case Scalar:
+	    return &s_scalarKernels;
+#ifdef SIGPROC_X86
+	case SSE2:
+	    return __builtin_cpu_supports("sse2") ? &s_sse2Kernels : 0;
+	case AVX2:
+	    return __builtin_cpu_supports("avx2") ? &s_avx2Kernels : 0;
+	case AVX512:
+	    return __builtin_cpu_supports("avx512f") ? &s_avx512Kernels : 0;
+#endif
+	default:
+	    return 0;
+    }
+}
+
+// Retrieve the best instruction set supported by the CPU
+int SigProcKernels::best()
+{
+    int level = LevelCount - 1;
+    while (level > Scalar && !get(level))
+	level--;
+    return level;
+}
+
+// Retrieve the instruction set in use
+int SigProcKernels::level()
+{
+    for (int level = LevelCount - 1; level > Scalar; level--)
+	if (s_current == get(level))
+	    return level;
+    return Scalar;
+}
+
+// Change the kernels in use
+bool SigProcKernels::select(int level)
+{
+    const SigProcKernels* k = get(level);
+    if (!k)
+	return false;
+    s_current = k;
+    return true;
+}
+
+typedef void (*SigProcArrayKernel)(Complex*, const Complex*, const Complex*, unsigned int);
+
+// Random float in [-1,1] range
+static inline float randomFloat(Random& rnd)
+{
+    return (float)(rnd.next() % 20001) / 10000 - 1;
+}
+
+static void randomFill(Complex* data, unsigned int n, Random& rnd)
+{
+    for (; n; --n, ++data)
+	data->set(randomFloat(rnd),randomFloat(rnd));
+}
+
+// Maximum absolute difference between real or imaginary parts
+static float maxDiff(const Complex* c1, const Complex* c2, unsigned int n)
+{
+    float d = 0;
+    for (; n; --n, ++c1, ++c2) {
+	float t = ::fabsf(c1->real() - c2->real());
+	if (!(t <= d))
+	    d = t;
+	t = ::fabsf(c1->imag() - c2->imag());
+	if (!(t <= d))
+	    d = t;
+    }
+    return d;
+}
+
+// Element wise kernels must return the same results as the scalar ones
+static bool testArray(String& dest, const char* name, SigProcArrayKernel ref,
+    SigProcArrayKernel kernel, const ComplexVector& c1, const ComplexVector& c2, unsigned int len)
+{
+    ComplexVector r(c2);
+    ComplexVector k(c2);
+    ref(r.data(),c1.data(),c2.data(),len);
+    kernel(k.data(),c1.data(),c2.data(),len);
+    float d = maxDiff(r.data(),k.data(),len);
+    dest << " " << name << "=";
+    if (d == 0)
+	dest << "exact";
+    else
+	dest << "FAILED(" << d << ")";
+    return d == 0;
+}
+
+// Sums of products are computed in a different order, check relative error
+static bool testSum(String& dest, const char* name, float ref, float val)
+{
+    float d = ::fabsf(ref - val);
+    float e = ::fabsf(ref) > 1 ? d / ::fabsf(ref) : d;
+    bool ok = (e <= 1e-4);
+    dest << " " << name << "=" << (ok ? "" : "FAILED(") << e << (ok ? "" : ")");
+    return ok;
+}
+
+// Check all available kernels against the scalar ones
+bool SigProcKernels::test(String& dest, unsigned int oversample)
+{
+    unsigned int len = SignalProcessing::gsmSlotLen(oversample ? oversample : 1);
+    FloatVector g;
+    SignalProcessing::generateLaurentPulseAproximation(g);
+    // access burst synchronization sequence correlation
+    unsigned int corrLen = 64;
+    unsigned int corrTaps = 41;
+    FloatVector taps(corrTaps);
+    // fixed seed so failures can be reproduced
+    Random rnd(1);
+    for (unsigned int i = 0; i < taps.length(); i++)
+	taps[i] = randomFloat(rnd);
+    ComplexVector c1(len + g.length());
+    ComplexVector c2(len + g.length());
+    randomFill(c1.data(),c1.length(),rnd);
+    randomFill(c2.data(),c2.length(),rnd);
+    const SigProcKernels& s = s_scalarKernels;
+    ComplexVector r(len);
+    ComplexVector k(len);
+    dest << "len=" << len << " taps=" << g.length() << " correlate=" <<
+	corrLen << "x" << corrTaps << "\r\n";
+    bool ok = true;
+    for (int level = Scalar + 1; level < LevelCount; level++) {
+	const SigProcKernels* t = get(level);
+	if (!t)
+	    continue;
+	dest << lookup(level,s_levels) << ":";
+	ok = testArray(dest,"multiply",s.multiply,t->multiply,c1,c2,len) && ok;
+	ok = testArray(dest,"sum",s.sum,t->sum,c1,c2,len) && ok;
+	ok = testArray(dest,"diff",s.diff,t->diff,c1,c2,len) && ok;
+	ok = testArray(dest,"sumMul",s.sumMul,t->sumMul,c1,c2,len) && ok;
+	s.convolution(r.data(),len,c1.data(),g.data(),g.length());
+	t->convolution(k.data(),len,c1.data(),g.data(),g.length());
+	float d = maxDiff(r.data(),k.data(),len);
+	dest << " convolution=" << (d == 0 ? "exact" : "FAILED");
+	ok = (d == 0) && ok;
+	s.correlate(r.data(),corrLen,c1.data(),taps.data(),corrTaps);
+	t->correlate(k.data(),corrLen,c1.data(),taps.data(),corrTaps);
+	d = maxDiff(r.data(),k.data(),corrLen);
+	dest << " correlate=" << (d == 0 ? "exact" : "FAILED");
+	ok = (d == 0) && ok;
+	Complex cr;
+	Complex ck;
+	s.sumMulTotal(cr,c1.data(),c2.data(),len);
+	t->sumMulTotal(ck,c1.data(),c2.data(),len);
+	ok = testSum(dest,"sumMulTotal.real",cr.real(),ck.real()) && ok;
+	ok = testSum(dest,"sumMulTotal.imag",cr.imag(),ck.imag()) && ok;
+	ok = testSum(dest,"sumMulConj",s.sumMulConj(c1.data(),len),
+	    t->sumMulConj(c1.data(),len)) && ok;
+	dest << "\r\n";
+    }
+    return ok;
+}
+
+// Measure the speed of all available kernels
+void SigProcKernels::bench(String& dest, unsigned int count, unsigned int oversample,
+    unsigned int arfcns)
+{
+    if (!count)
+	count = 1;
+    unsigned int len = SignalProcessing::gsmSlotLen(oversample ? oversample : 1);
+    FloatVector g;
+    SignalProcessing::generateLaurentPulseAproximation(g);
+    ComplexVectorVector fs;
+    SignalProcessing::generateARFCNsFreqShift(fs,arfcns ? arfcns : 1,oversample);
+    Random rnd(1);
+    ComplexVector c1(len + g.length());
+    randomFill(c1.data(),c1.length(),rnd);
+    ComplexVector out(len);
+    FloatVector taps(41);
+    for (unsigned int i = 0; i < taps.length(); i++)
+	taps[i] = randomFloat(rnd);
+    volatile float sink = 0;
+    dest << "len=" << len << " taps=" << g.length() << " arfcns=" << fs.length() <<
+	" count=" << count << " (nsec per call)\r\n";
+    for (int level = Scalar; level < LevelCount; level++) {
+	const SigProcKernels* k = get(level);
+	if (!k)
+	    continue;
+	uint64_t t[9];
+	t[0] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->multiply(out.data(),c1.data(),fs[0].data(),len);
+	t[1] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->sum(out.data(),c1.data(),fs[0].data(),len);
+	t[2] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->diff(out.data(),c1.data(),fs[0].data(),len);
+	t[3] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->sumMul(out.data(),c1.data(),fs[0].data(),len);
+	t[4] = Time::now();
+	for (unsigned int i = 0; i < count; i++) {
+	    Complex c;
+	    k->sumMulTotal(c,c1.data(),fs[0].data(),len);
+	    sink = c.real();
+	}
+	t[5] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    sink = k->sumMulConj(c1.data(),len);
+	t[6] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->convolution(out.data(),len,c1.data(),g.data(),g.length());
+	t[7] = Time::now();
+	for (unsigned int i = 0; i < count; i++)
+	    k->correlate(out.data(),64,c1.data(),taps.data(),taps.length());
+	t[8] = Time::now();
+	// mix the bursts of all ARFCNs in a transmitted timeslot
+	uint64_t mix = Time::now();
+	for (unsigned int i = 0; i < count; i++) {
+	    k->multiply(out.data(),c1.data(),fs[0].data(),len);
+	    for (unsigned int j = 1; j < fs.length(); j++)
+		k->sumMul(out.data(),c1.data(),fs[j].data(),len);
+	}
+	mix = Time::now() - mix;
+	static const char* s_names[] = {"multiply", "sum", "diff", "sumMul",
+	    "sumMulTotal", "sumMulConj", "convolution", "correlate"};
+	dest << lookup(level,s_levels) << ":";
+	for (unsigned int i = 0; i < 8; i++)
+	    dest << " " << s_names[i] << "=" << (unsigned int)((t[i + 1] - t[i]) * 1000 / count);
+	dest << " txmix=" << (unsigned int)(mix * 1000 / count) << "\r\n";
+    }
+    (void)sink;
+}
+
+// Select the best kernels when the library is loaded
+class SigProcKernelsInit
+{
+public:
+    inline SigProcKernelsInit()
+	{ SigProcKernels::select(SigProcKernels::best()); }
+};
+
+static SigProcKernelsInit s_kernelsInit;
+
+
 //
 // SignalProcessing
 //
@@ -218,22 +744,8 @@ void SignalProcessing::convolution(ComplexVector& out, const ComplexVector& fVec
 	return;
     }
     out.resize(fVect.length() - gVect.length());
-    Complex* x = out.data();
-    unsigned int Lp_1 = gVect.length() / 2;
-    const Complex* parseF = fVect.data();
-    for (unsigned int n = 0;n < out.length(); n++, ++x, ++parseF) {
-	x->set();
-	const Complex* f = parseF;
-	const Complex* fe = parseF + gVect.length() - 1;
-	const float* g = gVect.data();
-	for (unsigned int conv = 0; conv < Lp_1; conv++) {
-	    Complex::sumMulFSum(*x,*f,*fe,*g);
-	    f++;
-	    fe--;
-	    g++;
-	}
-	Complex::sumMulF(*x,*f,*g);
-    }
+    SigProcKernels::current().convolution(out.data(),out.length(),fVect.data(),
+	gVect.data(),gVect.length());
 }
 
 // Sum the ARFCN frequency shift vectors
@@ -439,11 +951,10 @@ void SignalProcessing::correlate(ComplexVector& out, const ComplexVector& a1, un
     
     unsigned int end = a1Len - end1;
     end += a1.length() % 2;
-    for (unsigned int i = end1;i < end; i ++, x ++) {
-	(*x).set(0,0);
-	int tindex = i - substract + a1Start;
-	for (unsigned int j = 0;j < length;j ++)
-	    Complex::sumMulF(*x,a1[tindex + j],a2[j]);
+    if (end > (unsigned int)end1) {
+	SigProcKernels::current().correlate(x,end - end1,a1.data() + end1 - substract + a1Start,
+	    a2.data(),length);
+	x += end - end1;
     }
 
     for (unsigned int i = end;i < a1Len; i ++, x ++) {
@@ -34,6 +34,7 @@ namespace TelEngine {
 //#define SIGPROC_OBJ_STORE_DISABLE
 
 class SigProcUtils;                      // Utility functions
+class SigProcKernels;                    // Complex array operations
 class Complex;                           // A Complex (float) number
 class SignalProcessing;                  // Signal processing
 
@@ -158,6 +159,133 @@ public:
 };
 
 
+/**
+ * This class holds a set of implementations of the Complex array operations.
+ * The fastest set supported by the CPU is selected at startup, all of them
+ *  process elements in the same order as the scalar code except for the
+ *  operations returning a sum of products
+ * @short Complex array operation kernels
+ */
+class SigProcKernels
+{
+public:
+    /**
+     * Kernel instruction sets
+     */
+    enum Level {
+	Scalar = 0,
+	SSE2,
+	AVX2,
+	AVX512,
+	LevelCount
+    };
+
+    /**
+     * Multiply arrays: dest[i] = c1[i] * c2[i]
+     */
+    void (*multiply)(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n);
+
+    /**
+     * Sum arrays: dest[i] = c1[i] + c2[i]
+     */
+    void (*sum)(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n);
+
+    /**
+     * Subtract arrays: dest[i] = c1[i] - c2[i]
+     */
+    void (*diff)(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n);
+
+    /**
+     * Add products to an array: dest[i] += c1[i] * c2[i]
+     */
+    void (*sumMul)(Complex* dest, const Complex* c1, const Complex* c2, unsigned int n);
+
+    /**
+     * Add the sum of products to a number: dest += SUM(c1[i] * c2[i])
+     */
+    void (*sumMulTotal)(Complex& dest, const Complex* c1, const Complex* c2, unsigned int n);
+
+    /**
+     * Sum of products of numbers with their conjugate: SUM(data[i] * conj(data[i]))
+     */
+    float (*sumMulConj)(const Complex* data, unsigned int n);
+
+    /**
+     * Convolution with a symmetric real filter, out[i] =
+     *  SUM(k=0..glen/2-1)((f[i + k] + f[i + glen - 1 - k]) * g[k]) + f[i + glen/2] * g[glen/2]
+     */
+    void (*convolution)(Complex* out, unsigned int n, const Complex* f,
+	const float* g, unsigned int glen);
+
+    /**
+     * Correlation with a real sequence: out[i] = SUM(j=0..glen-1)(a[i + j] * g[j])
+     */
+    void (*correlate)(Complex* out, unsigned int n, const Complex* a,
+	const float* g, unsigned int glen);
+
+    /**
+     * Retrieve the kernels in use
+     * @return Current kernels
+     */
+    static inline const SigProcKernels& current()
+	{ return *s_current; }
+
+    /**
+     * Retrieve a set of kernels
+     * @param level Instruction set
+     * @return Kernels pointer, 0 if not built or not supported by the CPU
+     */
+    static const SigProcKernels* get(int level);
+
+    /**
+     * Retrieve the best instruction set supported by the CPU
+     * @return Instruction set (Level)
+     */
+    static int best();
+
+    /**
+     * Retrieve the instruction set of the kernels in use
+     * @return Instruction set (Level)
+     */
+    static int level();
+
+    /**
+     * Change the kernels in use
+     * @param level Instruction set to use
+     * @return True on success, false if not available
+     */
+    static bool select(int level);
+
+    /**
+     * Check all available kernels against the scalar ones using random data
+     *  of the size processed for each timeslot
+     * @param dest String to append the report to
+     * @param oversample Oversampling value used to size the data
+     * @return True if all results are within tolerance
+     */
+    static bool test(String& dest, unsigned int oversample = 8);
+
+    /**
+     * Measure the speed of all available kernels using data of the size
+     *  processed for each timeslot
+     * @param dest String to append the report to
+     * @param count Number of times to run each kernel
+     * @param oversample Oversampling value used to size the data
+     * @param arfcns Number of ARFCNs mixed in each transmitted timeslot
+     */
+    static void bench(String& dest, unsigned int count = 10000,
+	unsigned int oversample = 8, unsigned int arfcns = 4);
+
+    /**
+     * Instruction set names
+     */
+    static const TokenDict s_levels[];
+
+private:
+    static const SigProcKernels* s_current;
+};
+
+
 /**
  * This class implements a complex number
  * @short A Complex (float) number
@@ -336,11 +464,8 @@ public:
      * @param len2 Second array length
      */
     static inline void multiply(Complex* dest, unsigned int len,
-	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2) {
-	    unsigned int n = SigProcUtils::min(len,len1,len2);
-	    for (; n; --n, ++dest, ++c1, ++c2)
-		multiply(*dest,*c1,*c2);
-	}
+	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2)
+	{ SigProcKernels::current().multiply(dest,c1,c2,SigProcUtils::min(len,len1,len2)); }
 
     /**
      * Multiply two complex arrays.
@@ -380,11 +505,8 @@ public:
      * @param len2 Second array length
      */
     static inline void sum(Complex* dest, unsigned int len,
-	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2) {
-	    unsigned int n = SigProcUtils::min(len,len1,len2);
-	    for (; n; --n, ++dest, ++c1, ++c2)
-		sum(*dest,*c1,*c2);
-	}
+	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2)
+	{ SigProcKernels::current().sum(dest,c1,c2,SigProcUtils::min(len,len1,len2)); }
 
     /**
      * Compute the sum of two complex arrays.
@@ -433,9 +555,8 @@ public:
      * @return Destination number address
      */
     static inline Complex& sumMul(Complex& dest, const Complex* c1, unsigned int len1,
-	const Complex* c2, unsigned int len2){
-	    for (unsigned int n = SigProcUtils::min(len1,len2); n; --n, ++c1, ++c2)
-		sumMul(dest,*c1,*c2);
+	const Complex* c2, unsigned int len2) {
+	    SigProcKernels::current().sumMulTotal(dest,c1,c2,SigProcUtils::min(len1,len2));
 	    return dest;
 	}
 
@@ -450,11 +571,8 @@ public:
      * @param len2 Second array length
      */
     static inline void sumMul(Complex* dest, unsigned int len,
-	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2) {
-	    unsigned int n = SigProcUtils::min(len,len1,len2);
-	    for (; n; --n, ++dest, ++c1, ++c2)
-		sumMul(*dest,*c1,*c2);
-	}
+	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2)
+	{ SigProcKernels::current().sumMul(dest,c1,c2,SigProcUtils::min(len,len1,len2)); }
 
     /**
      * Multiply c1 by f. Add the result to c
@@ -498,11 +616,8 @@ public:
      * @param len2 Second array length
      */
     static inline void diff(Complex* dest, unsigned int len,
-	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2) {
-	    unsigned int n = SigProcUtils::min(len,len1,len2);
-	    for (; n; --n, ++dest, ++c1, ++c2)
-		diff(*dest,*c1,*c2);
-	}
+	const Complex* c1, unsigned int len1, const Complex* c2, unsigned int len2)
+	{ SigProcKernels::current().diff(dest,c1,c2,SigProcUtils::min(len,len1,len2)); }
 
     /**
      * Compute the difference of two complex arrays.
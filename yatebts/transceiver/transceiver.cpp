@@ -21,6 +21,11 @@
 
 #include "transceiver.h"
 #include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 // Socket read/write
 #ifdef XDEBUG
@@ -83,7 +88,8 @@ public:
 	ARFCNTx = 0x0008,
 	ARFCNRx = 0x0010,
 	TrxRadioOut = 0x0020,
-	RadioMask = TrxRadioRead | TrxRadioIn | TrxRadioOut | ARFCNTx | ARFCNRx,
+	TrxQmf = 0x0040,
+	RadioMask = TrxRadioRead | TrxRadioIn | TrxRadioOut | ARFCNTx | ARFCNRx | TrxQmf,
     };
     TrxWorker(unsigned int type, TransceiverObj* obj, Thread::Priority prio = Thread::Normal)
 	: Thread(buildName(type,obj),prio), m_type(type), m_obj(obj)
@@ -270,6 +276,7 @@ const TokenDict TrxWorker::s_name[] = {
     {"TrxRadioRead",  TrxRadioRead},
     {"TrxRadioIn",    TrxRadioIn},
     {"TrxRadioOut",   TrxRadioOut},
+    {"TrxQmf",        TrxQmf},
     {0,0},
 };
 
@@ -280,6 +287,7 @@ const TokenDict TrxWorker::s_info[] = {
     {"Radio read process",     TrxRadioIn},
     {"Radio input process",    TrxRadioIn},
     {"Radio device send",      TrxRadioOut},
+    {"QMF subtree process",    TrxQmf},
     {0,0},
 };
 
@@ -357,12 +365,14 @@ void TrxWorker::cancelThreads(TransceiverObj* o, unsigned int waitMs1, Thread**
     Thread*& t1 = th1 ? *th1 : dummy;
     Thread*& t2 = th2 ? *th2 : dummy;
     Thread*& t3 = th3 ? *th3 : dummy;
-    if (!(t1 || t2))
+    if (!(t1 || t2 || t3))
 	return;
     if (t1)
 	t1->cancel(false);
     if (t2)
 	t2->cancel(false);
+    if (t3)
+	t3->cancel(false);
     if (waitMs1)
 	waitMs1 = threadIdleIntervals(waitMs1);
     if (waitMs2)
@@ -370,14 +380,14 @@ void TrxWorker::cancelThreads(TransceiverObj* o, unsigned int waitMs1, Thread**
     if (waitMs3)
 	waitMs3 = threadIdleIntervals(waitMs3);
     bool stop = false;
-    while ((t1 || t2) && !stop) {
+    while ((t1 || t2 || t3) && !stop) {
 	lck.drop();
 	Thread::idle();
 	stop = Thread::check(false);
 	if (!stop && (waitMs1 || waitMs2 || waitMs3)) {
 	    checkHardCancel(t1,waitMs1,o,&s_mutex);
 	    checkHardCancel(t2,waitMs2,o,&s_mutex);
-	    checkHardCancel(t3,waitMs2,o,&s_mutex);
+	    checkHardCancel(t3,waitMs3,o,&s_mutex);
 	}
 	lck.acquire(s_mutex);
     }
@@ -411,6 +421,9 @@ void TrxWorker::run()
 	case TrxRadioRead:
 	    (static_cast<Transceiver*>(m_obj))->runReadRadio();
 	    break;
+	case TrxQmf:
+	    (static_cast<TransceiverQMF*>(m_obj))->runQmfWorker(this);
+	    break;
 	default:
 	    Debug(m_obj,DebugStub,"TrxWorker::run() type=%d not handled",m_type);
     }
@@ -1835,6 +1848,7 @@ void Transceiver::radioPowerOff()
     m_stateMutex.lock();
     TrxWorker::cancelThreads(this,0,&m_radioInThread,0,&m_radioOutThread,
 	0,&m_radioReadThread);
+    radioThreadsStopped();
     // Signal Tx ready: this will stop us waiting for Tx ready
     m_txSync.unlock();
     for (unsigned int i = 0; i < m_arfcnCount; i++)
@@ -2485,6 +2499,8 @@ int Transceiver::handleCmdManageTx(unsigned int arfcn, String& cmd, String* rspP
 //
 TransceiverQMF::TransceiverQMF(const char* name)
     : Transceiver(name),
+    m_qmfWorkers(0),
+    m_qmfSpin(0),
     m_halfBandFltCoeffLen(11),
     m_tscSamples(26),
 #ifdef TRANSCEIVER_DUMP_DEMOD_PERF
@@ -2534,6 +2550,106 @@ void TransceiverQMF::reInit(const NamedList& params)
 {
     Transceiver::reInit(params);
     m_tscSamples = getUInt(params,YSTRING("chan_estimator_tsc_samples"),26,2,26);
+    // Subtree workers are useless with 1 ARFCN (there is a single path in QMF tree)
+    //  or if we don't have spare CPUs
+    int workers = 0;
+    if (m_arfcnConf > 1) {
+#ifdef _SC_NPROCESSORS_ONLN
+	workers = ::sysconf(_SC_NPROCESSORS_ONLN) - 1;
+#endif
+	if (workers > QMF_WORKERS)
+	    workers = QMF_WORKERS;
+    }
+    m_qmfWorkers = params.getIntValue(YSTRING("qmf_workers"),workers,0,QMF_WORKERS);
+    m_qmfCpus = params[YSTRING("qmf_cpus")];
+    m_qmfSpin = params.getIntValue(YSTRING("qmf_spin"),20,0,1000);
+}
+
+// Handle control commands
+bool TransceiverQMF::control(const String& oper, const NamedList& params)
+{
+    if (oper == YSTRING("qmf-stats"))
+	qmfDumpStats(params.getBoolValue(YSTRING("reset")));
+    else
+	return Transceiver::control(oper,params);
+    return true;
+}
+
+// Worker terminated notification
+void TransceiverQMF::workerTerminated(Thread* th)
+{
+    if (!th)
+	return;
+    Lock lck(TrxWorker::s_mutex);
+    for (unsigned int i = 0; i < QMF_WORKERS; i++) {
+	if (m_qmfWorker[i].thread != th)
+	    continue;
+	m_qmfWorker[i].thread = 0;
+	return;
+    }
+    lck.drop();
+    Transceiver::workerTerminated(th);
+}
+
+// Busy wait at most m_qmfSpin microseconds for a counter to change
+// Return true if changed
+bool TransceiverQMF::qmfSpin(volatile unsigned int& counter, unsigned int old)
+{
+    if (!m_qmfSpin)
+	return false;
+    uint64_t stop = Time::now() + m_qmfSpin;
+    while (counter == old) {
+	if (Time::now() > stop)
+	    return false;
+    }
+    return true;
+}
+
+// Run a QMF subtree worker loop
+// Wait for parent node to signal data available, process the low band subtree
+void TransceiverQMF::runQmfWorker(Thread* th)
+{
+    int index = -1;
+    Lock lck(TrxWorker::s_mutex);
+    for (unsigned int i = 0; i < QMF_WORKERS; i++) {
+	if (m_qmfWorker[i].thread == th) {
+	    index = i;
+	    break;
+	}
+    }
+    lck.drop();
+    if (index < 0)
+	return;
+    QmfWorker& w = m_qmfWorker[index];
+    if (w.cpu >= 0) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(w.cpu,&set);
+	int err = ::pthread_setaffinity_np(::pthread_self(),sizeof(set),&set);
+	if (err) {
+	    String s;
+	    Thread::errorString(s,err);
+	    Debug(this,DebugNote,"%sFailed to run QMF worker %d on CPU %d: %d %s [%p]",
+		prefix(),index,w.cpu,err,s.c_str(),this);
+	}
+#else
+	Debug(this,DebugNote,"%sQMF worker CPU affinity not supported [%p]",prefix(),this);
+#endif
+    }
+    unsigned int seen = w.jobsDone;
+    while (!thShouldExit(this)) {
+	if (seen == w.jobs && !qmfSpin(w.jobs,seen)) {
+	    w.start.lock(Thread::idleUsec());
+	    continue;
+	}
+	seen = w.jobs;
+	__sync_synchronize();
+	qmfChild(m_qmfTime,index,true);
+	__sync_synchronize();
+	w.jobsDone = seen;
+	w.done.unlock();
+    }
 }
 
 // Process a received radio burst
@@ -2794,6 +2910,7 @@ void TransceiverQMF::radioPowerOnStarting()
     }
     if (tmp)
 	Debug(this,DebugAll,"%sQMF nodes: [%p]%s",prefix(),this,encloseDashes(tmp));
+    qmfWorkersStart();
     // Generate the half band filter coefficients
     if (m_halfBandFltCoeffLen && m_halfBandFltCoeff.length() != m_halfBandFltCoeffLen) {
 	m_halfBandFltCoeff.assign(m_halfBandFltCoeffLen);
@@ -2817,6 +2934,13 @@ void TransceiverQMF::radioPowerOnStarting()
     }
 }
 
+// Radio threads stopped notification
+void TransceiverQMF::radioThreadsStopped()
+{
+    Transceiver::radioThreadsStopped();
+    qmfWorkersStop();
+}
+
 // Set channel (slot) type
 void TransceiverQMF::setChanType(unsigned int arfcn, unsigned int slot, int chanType)
 {
@@ -2863,16 +2987,21 @@ void TransceiverQMF::processRadioData(RadioRxData* d)
     GSMTime time = d->m_time;
     XDebug(this,DebugAll,"Processing radio input TN=%u FN=%u len=%u [%p]",
 	time.tn(),time.fn(),d->m_data.length(),this);
+    uint64_t start = Time::now();
     m_qmf[0].data.exchange(d->m_data);
     m_radioRxStore.store(d);
 #ifdef TRANSCEIVER_DUMP_RX_INPUT_OUTPUT
     RxInData::add(m_qmf[0].data,time);
 #endif
-    qmf(time);
+    // Workers read the time from here, it must not change until the tree is done
+    m_qmfTime = time;
+    qmf(m_qmfTime,0,start);
+    m_qmfSlotStat.update(start);
 }
 
 // Run the QMF algorithm
-void TransceiverQMF::qmf(const GSMTime& time, unsigned int index)
+// start: Node processing start time, 0 to use current time
+void TransceiverQMF::qmf(const GSMTime& time, unsigned int index, uint64_t start)
 {
     if (index > 14) {
 	Debug(this,DebugFail,"qmf: invalid index %u [%p]",index,this);
@@ -2882,6 +3011,8 @@ void TransceiverQMF::qmf(const GSMTime& time, unsigned int index)
     QmfBlock& crt = m_qmf[index];
     if (!(crt.chans && crt.data.data() && crt.data.length()))
 	return;
+    if (!start)
+	start = Time::now();
 
     if (index == 0) {
 	if (s_dumper) {
@@ -2931,8 +3062,10 @@ void TransceiverQMF::qmf(const GSMTime& time, unsigned int index)
 #endif
     dumpRxData("qmf[",index,"].x",crt.data.data(),crt.data.length());
     // Even if the power is too low compute noise from every 9th timeslot
-    if ((crt.power < m_burstMinPower) && (time.timeslot() % 9))
+    if ((crt.power < m_burstMinPower) && (time.timeslot() % 9)) {
+	crt.procStat.update(start);
 	return;
+    }
     // Forward data to ARFCNs
     if (a) {
 	RadioRxData* r = a->m_radioRxStore.get();
@@ -2941,6 +3074,7 @@ void TransceiverQMF::qmf(const GSMTime& time, unsigned int index)
 	XDebug(this,DebugAll,"Forwarding radio data ARFCN=%u len=%u TN=%u FN=%u [%p]",
 	    a->arfcn(),r->m_data.length(),time.tn(),time.fn(),this);
 	a->recvRadioData(r);
+	crt.procStat.update(start);
 	return;
     }
     // Frequency shift
@@ -2959,14 +3093,127 @@ void TransceiverQMF::qmf(const GSMTime& time, unsigned int index)
     dumpRecvBurst(tmp3,time,crt.halfBandFilter.data(),crt.halfBandFilter.length());
 #endif
     dumpRxData("qmf[",index,"].w",crt.halfBandFilter.data(),crt.halfBandFilter.length());
+    crt.procStat.update(start);
+
+    // Both subtrees busy and a worker available: process the low band subtree
+    //  in parallel, wait for it before returning.
+    // The subtrees don't share any data, ARFCN data is always forwarded in
+    //  timeslot order
+    if (indexLo >= 0 && indexHi >= 0 && index < QMF_WORKERS &&
+	m_qmfWorker[index].thread) {
+	QmfWorker& w = m_qmfWorker[index];
+	unsigned int job = w.jobs + 1;
+	__sync_synchronize();
+	w.jobs = job;
+	w.start.unlock();
+	if (!thShouldExit(this))
+	    qmfChild(time,index,false);
+	uint64_t wait = Time::now();
+	if (w.jobsDone != job && !qmfSpin(w.jobsDone,job - 1)) {
+	    while (w.jobsDone != job) {
+		if (thShouldExit(this))
+		    return;
+		w.done.lock(Thread::idleUsec());
+	    }
+	}
+	__sync_synchronize();
+	crt.waitStat.update(wait);
+	return;
+    }
+    if (indexLo >= 0 && !thShouldExit(this))
+	qmfChild(time,index,true);
+    if (indexHi >= 0 && !thShouldExit(this))
+	qmfChild(time,index,false);
+}
+
+// Build the low or high band output of a node and run the QMF algorithm on it
+void TransceiverQMF::qmfChild(const GSMTime& time, unsigned int index, bool low)
+{
+    uint64_t start = Time::now();
+    QmfBlock& crt = m_qmf[index];
+    unsigned int child = 2 * index + (low ? 1 : 2);
+    if (low)
+	qmfBuildOutputLowBand(crt,m_qmf[child].data,&m_qmf[child].power);
+    else
+	qmfBuildOutputHighBand(crt,m_qmf[child].data,&m_qmf[child].power);
+    qmf(time,child,start);
+}
+
+// Start QMF subtree workers
+void TransceiverQMF::qmfWorkersStart()
+{
+    qmfWorkersStop();
+    ObjList* cpus = m_qmfCpus.split(',',false);
+    ObjList* o = cpus->skipNull();
+    for (unsigned int i = 0; i < m_qmfWorkers; i++) {
+	QmfWorker& w = m_qmfWorker[i];
+	// Drop jobs left by a previous run
+	w.jobsDone = w.jobs;
+	w.cpu = -1;
+	if (o) {
+	    w.cpu = o->get()->toString().toInteger(-1);
+	    o = o->skipNext();
+	}
+	if (!TrxWorker::create(w.thread,TrxWorker::TrxQmf,this))
+	    break;
+    }
+    TelEngine::destruct(cpus);
+}
+
+// Stop QMF subtree workers
+void TransceiverQMF::qmfWorkersStop()
+{
+    TrxWorker::softCancel(TrxWorker::TrxQmf);
+    TrxWorker::cancelThreads(this,20,&m_qmfWorker[0].thread,20,&m_qmfWorker[1].thread,
+	20,&m_qmfWorker[2].thread);
+}
+
+static inline void appendQmfStat(String& s, const QmfStat& st)
+{
+    s << "count=" << st.count;
+    s << " avg=" << (unsigned int)(st.count ? (st.total / st.count) : 0) << "us";
+    s << " max=" << (unsigned int)st.max << "us";
+}
 
-    if (indexLo >= 0 && !thShouldExit(this)) {
-	qmfBuildOutputLowBand(crt,m_qmf[indexLo].data,&m_qmf[indexLo].power);
-	qmf(time,indexLo);
+// Print QMF processing statistics
+// Note: values are taken without protection
+void TransceiverQMF::qmfDumpStats(bool reset)
+{
+    static const char* s_level[] = {"Root", "Level1", "Level2", "ARFCN"};
+    unsigned int workers = 0;
+    for (unsigned int i = 0; i < QMF_WORKERS; i++)
+	if (m_qmfWorker[i].thread)
+	    workers++;
+    String s;
+    s << "\r\nWorkers:\t" << workers;
+    s << "\r\nTimeslot:\t";
+    appendQmfStat(s,m_qmfSlotStat);
+    QmfStat level[4];
+    String nodes;
+    for (unsigned int i = 0; i < 15; i++) {
+	QmfBlock& b = m_qmf[i];
+	level[(i < 1) ? 0 : ((i < 3) ? 1 : ((i < 7) ? 2 : 3))].add(b.procStat);
+	if (!b.procStat.count)
+	    continue;
+	nodes << "\r\n  " << s_qmfBlock4[i].name << "[" << i << "]:\t";
+	appendQmfStat(nodes,b.procStat);
+	if (b.waitStat.count) {
+	    nodes << "\r\n  " << s_qmfBlock4[i].name << "[" << i << "] wait:\t";
+	    appendQmfStat(nodes,b.waitStat);
+	}
+    }
+    for (unsigned int i = 0; i < 4; i++) {
+	s << "\r\n" << s_level[i] << ":\t";
+	appendQmfStat(s,level[i]);
     }
-    if (indexHi >= 0 && !thShouldExit(this)) {
-	qmfBuildOutputHighBand(crt,m_qmf[indexHi].data,&m_qmf[indexHi].power);
-	qmf(time,indexHi);
+    s << "\r\nNodes:" << nodes;
+    Output("Transceiver(%s) QMF statistics: [%p]%s",debugName(),this,encloseDashes(s));
+    if (!reset)
+	return;
+    m_qmfSlotStat.reset();
+    for (unsigned int i = 0; i < 15; i++) {
+	m_qmf[i].procStat.reset();
+	m_qmf[i].waitStat.reset();
     }
 }
 
@@ -575,7 +575,7 @@ public:
      * @param params Operation parameters
      * @return True on success, false on failure
      */
-    bool control(const String& oper, const NamedList& params);
+    virtual bool control(const String& oper, const NamedList& params);
 
     /**
      * Check if the transceiver is exiting (stopping)
@@ -659,6 +659,14 @@ protected:
      */
     virtual void radioPowerOnStarting();
 
+    /**
+     * Radio threads stopped notification.
+     * Called on radio power off after the radio read, process and send threads
+     *  were stopped
+     */
+    virtual void radioThreadsStopped()
+	{ }
+
     /**
      * Set channel (slot) type
      * @param arfcn ARFCN number
@@ -885,6 +893,36 @@ private:
 };
 
 
+/**
+ * This structure holds QMF processing time statistics
+ * @short QMF processing time statistics
+ */
+struct QmfStat
+{
+    inline QmfStat()
+	: count(0), total(0), max(0)
+	{}
+    inline void update(uint64_t start, uint64_t now = Time::now()) {
+	    uint64_t d = (now > start) ? (now - start) : 0;
+	    count++;
+	    total += d;
+	    if (max < d)
+		max = d;
+	}
+    inline void add(const QmfStat& other) {
+	    count += other.count;
+	    total += other.total;
+	    if (max < other.max)
+		max = other.max;
+	}
+    inline void reset()
+	{ count = total = max = 0; }
+    uint64_t count;                      // Number of processed timeslots
+    uint64_t total;                      // Total time in microseconds
+    uint64_t max;                        // Maximum time in microseconds
+};
+
+
 /**
  * This structure holds data for a QMF block
  * @short A QMF block
@@ -901,6 +939,32 @@ struct QmfBlock
     ComplexVector freqShift;             // Frequency shifting vector
     ComplexVector halfBandFilter;        // Used when applying the half band filter
     float power;                         // Used to calculate the power level
+    QmfStat procStat;                    // Node processing time (children excluded)
+    QmfStat waitStat;                    // Time spent waiting for the low band worker
+};
+
+
+// Maximum number of QMF workers: one for each node splitting in 2 subtrees
+//  in the first 2 tree levels
+#define QMF_WORKERS 3
+
+/**
+ * This structure holds data for a worker processing the low band subtree of a QMF node.
+ * Jobs are counted, the semaphores are only used to wake up a sleeping waiter
+ * @short A QMF subtree worker
+ */
+struct QmfWorker
+{
+    inline QmfWorker()
+	: thread(0), jobs(0), jobsDone(0),
+	start(1,"QmfWorkerStart",0), done(1,"QmfWorkerDone",0), cpu(-1)
+	{}
+    Thread* thread;                      // The worker thread
+    volatile unsigned int jobs;          // Number of requested jobs
+    volatile unsigned int jobsDone;      // Number of processed jobs
+    Semaphore start;                     // Signalled when a new job is requested
+    Semaphore done;                      // Signalled when a job was processed
+    int cpu;                             // CPU to run on, negative for any
 };
 
 
@@ -942,6 +1006,26 @@ public:
      */
     virtual bool processRadioBurst(unsigned int arfcn, ArfcnSlot& slot, GSMRxBurst& b);
 
+    /**
+     * Handle control commands
+     * @param oper Operation to execute
+     * @param params Operation parameters
+     * @return True on success, false on failure
+     */
+    virtual bool control(const String& oper, const NamedList& params);
+
+    /**
+     * Worker terminated notification
+     * @param th Worker thread
+     */
+    virtual void workerTerminated(Thread* th);
+
+    /**
+     * Run a QMF subtree worker loop
+     * @param th Worker thread
+     */
+    void runQmfWorker(Thread* th);
+
 protected:
     /**
      * Process received radio data
@@ -954,6 +1038,11 @@ protected:
      */
     virtual void radioPowerOnStarting();
 
+    /**
+     * Radio threads stopped notification
+     */
+    virtual void radioThreadsStopped();
+
     /**
      * Set channel (slot) type
      * @param arfcn ARFCN number
@@ -975,7 +1064,16 @@ protected:
 
 private:
     // Run the QMF algorithm on node at given index
-    void qmf(const GSMTime& time, unsigned int index = 0);
+    void qmf(const GSMTime& time, unsigned int index = 0, uint64_t start = 0);
+    // Build the low or high band output of a node and run the QMF algorithm on it
+    void qmfChild(const GSMTime& time, unsigned int index, bool low);
+    // Busy wait for a worker job counter to change
+    bool qmfSpin(volatile unsigned int& counter, unsigned int old);
+    // Start/stop QMF subtree workers
+    void qmfWorkersStart();
+    void qmfWorkersStop();
+    // Print QMF processing statistics
+    void qmfDumpStats(bool reset);
     inline void qmfApplyFreqShift(QmfBlock& b) {
 	    if (b.freqShift.length() < b.data.length())
 		SignalProcessing::setFreqShifting(&b.freqShift,b.freqShiftValue,
@@ -993,6 +1091,12 @@ private:
     void checkDemodPerf(const ARFCN* a, const GSMRxBurst& b, int bType);
 
     QmfBlock m_qmf[15];                  // QMF tree
+    GSMTime m_qmfTime;                   // Time of the timeslot being processed
+    QmfStat m_qmfSlotStat;               // Timeslot processing time
+    QmfWorker m_qmfWorker[QMF_WORKERS];  // Low band subtree workers of the first tree nodes
+    unsigned int m_qmfWorkers;           // Configured number of subtree workers
+    unsigned int m_qmfSpin;              // Interval (in microseconds) to busy wait before sleeping
+    String m_qmfCpus;                    // Configured CPUs to run the subtree workers on
     unsigned int m_halfBandFltCoeffLen;  // Half band filter coefficients length
     FloatVector m_halfBandFltCoeff;      // Half band filter coefficients vector
     unsigned int m_tscSamples;           // The number of TSC samples used to build the channel estimate
@@ -86,6 +86,9 @@ namespace { // anonymous
 
 #define NO_CONN_ID 0xffff
 
+// Number of independently locked buckets of an UE lookup index
+#define YBTS_UE_INDEX_BUCKETS 64
+
 // Constant strings
 static const String s_message = "Message";
 static const String s_type = "type";
@@ -166,6 +169,7 @@ class YBTSCommand;                       // Command interface
 class YBTSSignalling;                    // Signalling interface
 class YBTSMedia;                         // Media interface
 class YBTSUE;                            // A registered equipment
+class YBTSUEIndex;                       // UE lookup table by identity
 class YBTSLocationUpd;                   // Running location update from UE
 class YBTSSubmit;                        // MO SMS/SS submit thread
 class YBTSSmsInfo;                       // Holds data describing a pending SMS
@@ -1157,7 +1161,16 @@ class YBTSUE : public RefObject, public Mutex, public YBTSConnIdHolder
     friend class YBTSMM;
     friend class YBTSDriver;
     friend class YBTSConn;
+    friend class YBTSUEIndex;
 public:
+    // Identities indexed by the MM for UE lookup
+    enum Ident {
+	IdentTmsi = 0,
+	IdentImsi,
+	IdentImei,
+	IdentPaging,
+	IdentCount
+    };
     inline const String& imsi() const
 	{ return m_imsi; }
     inline const String& tmsi() const
@@ -1205,23 +1218,54 @@ protected:
     inline YBTSUE(YBTSMM* mm, const char* imsi, const char* tmsi)
 	: Mutex(false,"YBTSUE"),
 	m_mm(mm), m_registered(true), m_imsiDetached(false), m_removed(false),
-	m_askIMEI(false), m_pageCnt(0), m_imsi(imsi), m_tmsi(tmsi)
+	m_askIMEI(false), m_indexed(false), m_pageCnt(0), m_seq(0),
+	m_imsi(imsi), m_tmsi(tmsi)
 	{}
     YBTSUE(YBTSMM* mm, String& state);
     virtual void destroyed();
+    // Change identities, keep the MM lookup indexes in sync. UE must be locked
+    inline void setTmsi(const String& val)
+	{ setIdent(m_tmsi,val,IdentTmsi); }
+    inline void setImsi(const String& val)
+	{ setIdent(m_imsi,val,IdentImsi); }
+    inline void setImei(const String& val)
+	{ setIdent(m_imei,val,IdentImei); }
+    inline void setPaging(const String& val)
+	{ setIdent(m_paging,val,IdentPaging); }
+    void setIdent(String& ident, const String& val, int type);
+    const String& ident(int type) const;
 
     YBTSMM* m_mm;
     bool m_registered;
     bool m_imsiDetached;                 // Unregistered due to IMSI detached
     bool m_removed;                      // Removed from MM list
     bool m_askIMEI;                      // Ask IMEI
+    bool m_indexed;                      // Identities are in MM indexes
     uint32_t m_pageCnt;
+    unsigned int m_seq;                  // Order of addition to MM list
     String m_imsi;
     String m_tmsi;
     String m_imei;
     String m_paging;
 };
 
+// UE lookup table by one identity, each bucket has its own lock
+// Several UEs may be indexed by the same value
+class YBTSUEIndex
+{
+public:
+    YBTSUEIndex();
+    void add(const String& key, YBTSUE* ue);
+    void remove(const String& key, YBTSUE* ue);
+    // Add UEs indexed by key to a list, sorted in the order they were added to MM
+    // List items hold a reference to the UE
+    void find(const String& key, ObjList& found);
+
+private:
+    Mutex m_mutex[YBTS_UE_INDEX_BUCKETS];
+    HashList m_lists[YBTS_UE_INDEX_BUCKETS];
+};
+
 class YBTSLocationUpd : public YBTSGlobalThread, public YBTSConnIdHolder,
     public YBTSConnAuth
 {
@@ -1392,6 +1436,8 @@ public:
     bool createEmptyUE(RefPointer<YBTSUE>& ue);
     // Remove an UE from list
     void removeUE(YBTSUE* ue, const char* reason);
+    // Move an UE identity in lookup index
+    void reindexUE(YBTSUE* ue, int type, const String& oldVal, const String& newVal);
     virtual void destruct();
     static inline XmlElement* buildMM()
 	{ return new XmlElement("MM"); }
@@ -1417,6 +1463,12 @@ protected:
     void sendIdentityRequest(YBTSConn* conn, int type);
     // Find UE by paging identity
     bool findUEPagingSafe(RefPointer<YBTSUE>& ue, const String& paging);
+    // Find UE by TMSI/IMSI/IMEI in lookup indexes
+    // Found list holds references to the checked UEs
+    bool findUESafe(RefPointer<YBTSUE>& ue, const String& tmsi,
+	const String& imsi, const String& imei, ObjList& found);
+    // Index and append a new UE to list. UE list must be locked
+    void addUE(YBTSUE* ue);
     // Get IMSI/TMSI from request
     uint8_t getMobileIdentTIMSI(YBTSMessage& m, const XmlElement& request,
 	const XmlElement& identXml, const String*& ident, bool& isTMSI);
@@ -1429,6 +1481,8 @@ protected:
     String m_name;
     Mutex m_ueMutex;
     ObjList m_ues;                       // List of UEs
+    unsigned int m_ueSeq;                // Sequence of UEs added to list
+    YBTSUEIndex m_ueIndex[YBTSUE::IdentCount]; // UE lookup by identity
 };
 
 class YBTSCallDesc : public String, public YBTSConnIdHolder
@@ -5243,11 +5297,11 @@ void YBTSUE::update(const NamedList& params, const String& prefix)
 {
     Lock lck(this);
     if (!m_tmsi)
-	m_tmsi = params[prefix + "tmsi"];
+	setTmsi(params[prefix + "tmsi"]);
     if (!m_imsi)
-	m_imsi = params[prefix + "imsi"];
+	setImsi(params[prefix + "imsi"]);
     if (!m_imei)
-	m_imei = params[prefix + "imei"];
+	setImei(params[prefix + "imei"]);
 }
 
 // Start paging, return true if already paging
@@ -5282,7 +5336,7 @@ bool YBTSUE::startPaging(BtsPagingChanType type)
 	Debug(&__plugin,DebugAll,"Started paging %s",tmp.c_str());
 	lck.acquire(this);
 	if (!m_paging)
-	    m_paging = tmp;
+	    setPaging(tmp);
 	return true;
     }
     return false;
@@ -5316,7 +5370,7 @@ void YBTSUE::stopPagingNow()
 	Debug(&__plugin,DebugAll,"Stopped paging %s",tmp.c_str());
 	lock();
 	if (m_paging == tmp)
-	    m_paging.clear();
+	    setPaging(String::empty());
 	unlock();
     }
 }
@@ -5336,7 +5390,7 @@ void YBTSUE::destroyed()
 YBTSUE::YBTSUE(YBTSMM* mm, String& state)
     : Mutex(false,"YBTSUE"),
       m_mm(mm), m_registered(true), m_imsiDetached(false), m_removed(false),
-      m_askIMEI(false), m_pageCnt(0)
+      m_askIMEI(false), m_indexed(false), m_pageCnt(0), m_seq(0)
 {
     int sep = state.find(':');
     if (sep < 0)
@@ -5359,6 +5413,31 @@ YBTSUE::YBTSUE(YBTSMM* mm, String& state)
     }
 }
 
+// Change an identity, move it in MM index if the UE is in MM list
+void YBTSUE::setIdent(String& ident, const String& val, int type)
+{
+    if (ident == val)
+	return;
+    if (m_indexed && m_mm)
+	m_mm->reindexUE(this,type,ident,val);
+    ident = val;
+}
+
+const String& YBTSUE::ident(int type) const
+{
+    switch (type) {
+	case IdentTmsi:
+	    return m_tmsi;
+	case IdentImsi:
+	    return m_imsi;
+	case IdentImei:
+	    return m_imei;
+	case IdentPaging:
+	    return m_paging;
+    }
+    return String::empty();
+}
+
 bool YBTSUE::serialize(String& str)
 {
     str << imsi() << ":" << imei() << ":" << tmsi();
@@ -5764,12 +5843,86 @@ void YBTSMtSmsList::destroyed()
 }
 
 
+//
+// YBTSUEIndex
+//
+// Index entry, holds all UEs with the same identity
+class YBTSUEIndexEntry : public String
+{
+public:
+    inline YBTSUEIndexEntry(const String& key)
+	: String(key)
+	{}
+    ObjList m_ues;
+};
+
+YBTSUEIndex::YBTSUEIndex()
+{
+    for (unsigned int i = 0; i < YBTS_UE_INDEX_BUCKETS; i++)
+	m_lists[i].autoResize();
+}
+
+void YBTSUEIndex::add(const String& key, YBTSUE* ue)
+{
+    unsigned int b = key.hash() % YBTS_UE_INDEX_BUCKETS;
+    Lock lck(m_mutex[b]);
+    YBTSUEIndexEntry* e = static_cast<YBTSUEIndexEntry*>(m_lists[b][key]);
+    if (!e) {
+	e = new YBTSUEIndexEntry(key);
+	m_lists[b].append(e);
+    }
+    else if (e->m_ues.find(ue))
+	return;
+    e->m_ues.append(ue)->setDelete(false);
+}
+
+void YBTSUEIndex::remove(const String& key, YBTSUE* ue)
+{
+    unsigned int b = key.hash() % YBTS_UE_INDEX_BUCKETS;
+    Lock lck(m_mutex[b]);
+    YBTSUEIndexEntry* e = static_cast<YBTSUEIndexEntry*>(m_lists[b][key]);
+    if (!e)
+	return;
+    e->m_ues.remove(ue,false);
+    if (!e->m_ues.skipNull())
+	m_lists[b].remove(e,true,true);
+}
+
+void YBTSUEIndex::find(const String& key, ObjList& found)
+{
+    unsigned int b = key.hash() % YBTS_UE_INDEX_BUCKETS;
+    Lock lck(m_mutex[b]);
+    YBTSUEIndexEntry* e = static_cast<YBTSUEIndexEntry*>(m_lists[b][key]);
+    if (!e)
+	return;
+    for (ObjList* o = e->m_ues.skipNull(); o; o = o->skipNext()) {
+	YBTSUE* ue = static_cast<YBTSUE*>(o->get());
+	ObjList* pos = found.skipNull();
+	for (; pos; pos = pos->skipNext()) {
+	    YBTSUE* crt = static_cast<YBTSUE*>(pos->get());
+	    if (crt == ue || crt->m_seq > ue->m_seq)
+		break;
+	}
+	if (pos && pos->get() == ue)
+	    continue;
+	// UE removed from indexes when destroyed, we can't reference a dying one
+	if (!ue->ref())
+	    continue;
+	if (pos)
+	    pos->insert(ue);
+	else
+	    found.append(ue);
+    }
+}
+
+
 //
 // YBTSMM
 //
 YBTSMM::YBTSMM()
     : Mutex(false,"YBTSMM"),
-    m_ueMutex(false,"YBTSMMUEList")
+    m_ueMutex(false,"YBTSMMUEList"),
+    m_ueSeq(0)
 {
     m_name = "ybts-mm";
     debugName(m_name);
@@ -5822,8 +5975,8 @@ void YBTSMM::locUpdTerminated(uint64_t startTime, YBTSUE* ue, uint16_t connId,
 		    "UE (%p) registered TMSI '%s' -> '%s', IMSI '%s' -> '%s' conn=%u [%p]",
 		    ue,ue->tmsi().safe(),tmsi.c_str(),
 		    ue->imsi().safe(),imsi.safe(),connId,this);
-		ue->m_tmsi = tmsi;
-		ue->m_imsi = imsi;
+		ue->setTmsi(tmsi);
+		ue->setImsi(imsi);
 	    }
 	}
 	else {
@@ -5839,10 +5992,10 @@ void YBTSMM::locUpdTerminated(uint64_t startTime, YBTSUE* ue, uint16_t connId,
 	bool askIMSI = params.getBoolValue(YSTRING("askimsi"));
 	ue->m_askIMEI = params.getBoolValue(YSTRING("askimei"));
 	if (ue->m_askIMEI)
-	    ue->m_imei.clear();
+	    ue->setImei(String::empty());
 	if (askIMSI) {
-	    ue->m_imsi.clear();
-	    ue->m_tmsi.clear();
+	    ue->setImsi(String::empty());
+	    ue->setTmsi(String::empty());
 	    lckUE.drop();
 	    sendIdentityRequest(conn,YBTSConn::FAskIMSI);
 	    return;
@@ -5915,12 +6068,48 @@ bool YBTSMM::getUESafe(RefPointer<YBTSUE>& ue, const String& tmsi, const String&
 {
     if (!(tmsi || imsi || imei))
 	return false;
+    // Checked UEs are released after unlocking the list: removeUE() locks it
+    ObjList found;
+    if (findUESafe(ue,tmsi,imsi,imei,found))
+	return true;
+    if (!create)
+	return false;
+    found.clear();
     Lock lck(m_ueMutex);
-    for (ObjList* o = m_ues.skipNull(); o; o = o->skipNext()) {
+    // The UE may have been added while the list was not locked
+    if (findUESafe(ue,tmsi,imsi,imei,found))
+	return true;
+    YBTSUE* u = new YBTSUE(this,imsi,tmsi);
+    ue = u;
+    if (ue) {
+	if (imei)
+	    u->m_imei = imei;
+	else
+	    u->m_askIMEI = s_askIMEI;
+	addUE(u);
+	Debug(this,DebugAll,"Added UE (%p) TMSI=%s IMSI=%s [%p]",
+	    u,tmsi.safe(),imsi.safe(),this);
+    }
+    TelEngine::destruct(u);
+    return ue != 0;
+}
+
+// Find UE by TMSI/IMSI/IMEI, fill its empty identities
+// Candidates are checked in the order they were added to list
+bool YBTSMM::findUESafe(RefPointer<YBTSUE>& ue, const String& tmsi,
+    const String& imsi, const String& imei, ObjList& found)
+{
+    if (tmsi)
+	m_ueIndex[YBTSUE::IdentTmsi].find(tmsi,found);
+    if (imsi)
+	m_ueIndex[YBTSUE::IdentImsi].find(imsi,found);
+    if (imei)
+	m_ueIndex[YBTSUE::IdentImei].find(imei,found);
+    for (ObjList* o = found.skipNull(); o; o = o->skipNext()) {
 	YBTSUE* u = static_cast<YBTSUE*>(o->get());
-	if (!u->alive())
-	    continue;
 	Lock lckUE(u);
+	if (!u->m_indexed)
+	    continue;
 	bool matched = false;
 	if (tmsi && u->tmsi()) {
 	    if (tmsi != u->tmsi())
@@ -5944,28 +6133,14 @@ bool YBTSMM::getUESafe(RefPointer<YBTSUE>& ue, const String& tmsi, const String&
 	if (!ue)
 	    continue;
 	if (!ue->tmsi())
-	    ue->m_tmsi = tmsi;
+	    ue->setTmsi(tmsi);
 	if (!ue->imsi())
-	    ue->m_imsi = imsi;
+	    ue->setImsi(imsi);
 	if (!ue->imei())
-	    ue->m_imei = imei;
+	    ue->setImei(imei);
 	return true;
     }
-    if (!create)
-	return false;
-    YBTSUE* u = new YBTSUE(this,imsi,tmsi);
-    ue = u;
-    if (ue) {
-	if (imei)
-	    u->m_imei = imei;
-	else
-	    u->m_askIMEI = s_askIMEI;
-	m_ues.append(u)->setDelete(false);
-	Debug(this,DebugAll,"Added UE (%p) TMSI=%s IMSI=%s [%p]",
-	    u,tmsi.safe(),imsi.safe(),this);
-    }
-    TelEngine::destruct(u);
-    return ue != 0;
+    return false;
 }
 
 bool YBTSMM::createEmptyUE(RefPointer<YBTSUE>& ue)
@@ -5975,13 +6150,39 @@ bool YBTSMM::createEmptyUE(RefPointer<YBTSUE>& ue)
     if (ue) {
 	Lock lck(m_ueMutex);
 	u->m_askIMEI = s_askIMEI;
-	m_ues.append(u)->setDelete(false);
+	addUE(u);
 	Debug(this,DebugAll,"Added empty UE (%p) [%p]",u,this);
     }
     TelEngine::destruct(u);
     return ue != 0;
 }
 
+// Index and append a new UE to list. UE list must be locked
+void YBTSMM::addUE(YBTSUE* ue)
+{
+    Lock lckUE(ue);
+    ue->m_seq = ++m_ueSeq;
+    ue->m_indexed = true;
+    for (int i = 0; i < YBTSUE::IdentCount; i++) {
+	const String& ident = ue->ident(i);
+	if (ident)
+	    m_ueIndex[i].add(ident,ue);
+    }
+    lckUE.drop();
+    m_ues.append(ue)->setDelete(false);
+}
+
+// Move an UE identity in lookup index. UE must be locked
+void YBTSMM::reindexUE(YBTSUE* ue, int type, const String& oldVal, const String& newVal)
+{
+    if (type < 0 || type >= YBTSUE::IdentCount)
+	return;
+    if (oldVal)
+	m_ueIndex[type].remove(oldVal,ue);
+    if (newVal)
+	m_ueIndex[type].add(newVal,ue);
+}
+
 void YBTSMM::destruct()
 {
     m_ueMutex.lock();
@@ -5994,6 +6195,7 @@ void YBTSMM::destruct()
 		continue;
 	    Lock lckUE(u);
 	    u->m_mm = 0;
+	    u->m_indexed = false;
 	}
     }
     m_ueMutex.unlock();
@@ -6004,6 +6206,17 @@ void YBTSMM::removeUE(YBTSUE* ue, const char* reason)
 {
     if (!ue)
 	return;
+    // UE may be destroyed but is still in indexes, nobody can reference it
+    ue->lock();
+    if (ue->m_indexed) {
+	ue->m_indexed = false;
+	for (int i = 0; i < YBTSUE::IdentCount; i++) {
+	    const String& ident = ue->ident(i);
+	    if (ident)
+		m_ueIndex[i].remove(ident,ue);
+	}
+    }
+    ue->unlock();
     Lock lck(m_ueMutex);
     if (!(m_ues.remove(ue,false)))
 	return;
@@ -6161,7 +6374,7 @@ void YBTSMM::handleIdentityResponse(YBTSMessage& m, const XmlElement& xml, YBTSC
 	    return;
 	}
 	if (!ue->imsi()) {
-	    ue->m_imsi = ident;
+	    ue->setImsi(ident);
 	    Debug(this,DebugAll,"UE (%p) IMSI set to %s on conn=%u [%p]",
 		conn->ue(),ue->imsi().safe(),m.connId(),this);
 	}
@@ -6181,7 +6394,7 @@ void YBTSMM::handleIdentityResponse(YBTSMessage& m, const XmlElement& xml, YBTSC
 	    return;
 	}
 	type= YBTSConn::FAskIMEI;
-	ue->m_imei = ident;
+	ue->setImei(ident);
 	ue->m_askIMEI = false;
     }
     else {
@@ -6266,7 +6479,7 @@ void YBTSMM::handleLocationUpdate(YBTSMessage& m, const XmlElement* xml, YBTSCon
     }
     Lock lckUE(ue);
     if (ue->m_askIMEI) {
-	ue->m_imei.clear();
+	ue->setImei(String::empty());
 	lckUE.drop();
 	sendIdentityRequest(conn,YBTSConn::FAskIMEI);
 	return;
@@ -6476,13 +6689,12 @@ bool YBTSMM::findUEPagingSafe(RefPointer<YBTSUE>& ue, const String& paging)
 {
     if (!paging)
 	return false;
-    Lock lck(m_ueMutex);
-    for (ObjList* o = m_ues.skipNull(); o; o = o->skipNext()) {
+    ObjList found;
+    m_ueIndex[YBTSUE::IdentPaging].find(paging,found);
+    for (ObjList* o = found.skipNull(); o; o = o->skipNext()) {
 	YBTSUE* u = static_cast<YBTSUE*>(o->get());
-	if (!u->alive())
-	    continue;
 	Lock lckUE(u);
-	if (paging == u->paging()) {
+	if (u->m_indexed && paging == u->paging()) {
 	    ue = u;
 	    return (ue != 0);
 	}